@@ -8,7 +8,15 @@ Interactive CLI tool for assembling code and generating ROMs
 Compilation:
    g++ -std=c++17 -Wall -o gct gate_computer_toolset.cpp
 Usage:
-  ./gct
+  ./gct                          (interactive menu)
+  ./gct asm [options] <sources>  (headless batch assembly, see ./gct asm --help)
+  ./gct link [options] <objects> (link .gobj files from ./gct asm -c into ROMs)
+  ./gct superopt <sequence>      (search cheaper equivalents for a rewrite database)
+  ./gct run [options] <program>  (run a source or ROM on the emulator)
+  ./gct test [options] <manifest> (run regression tests of emulated programs on every core)
+  ./gct lsp                      (language server for editors, stdin/stdout)
+  ./gct rom <tool name>          (run a ROM generator tool without the menu)
+  ./gct daemon                   (resident assembler; use ./gct asm --daemon)
 
 */
 
@@ -21,8 +29,63 @@ Usage:
 #include <algorithm>
 #include <functional>
 #include <cctype>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <filesystem>
+#include <memory>
+#include <map>
 #include "utils/RomWriter.hpp"
 #include "utils/IsaSpec.hpp"
+#include "utils/MappedFile.hpp"
+#include "utils/AsmLexer.hpp"
+#include "utils/ThreadPool.hpp"
+#include "utils/AssemblyCache.hpp"
+#include "utils/ObjectModule.hpp"
+#include "utils/Linker.hpp"
+#include "utils/Assembler.hpp"
+#include "utils/ControlFlow.hpp"
+#include "utils/ConstantPropagation.hpp"
+#include "utils/JumpThreading.hpp"
+#include "utils/LoopUnrolling.hpp"
+#include "utils/RegisterAllocator.hpp"
+#include "utils/StrengthReduction.hpp"
+#include "utils/Outliner.hpp"
+#include "utils/BlockLayout.hpp"
+#include "utils/Peephole.hpp"
+#include "utils/Superoptimizer.hpp"
+#include "utils/Emulator.hpp"
+#include "utils/BatchEmulator.hpp"
+#include "utils/TestManifest.hpp"
+#include "utils/WorkStealing.hpp"
+#include "utils/AsmDocument.hpp"
+#include "utils/Json.hpp"
+#include "utils/LocalSocket.hpp"
+
+// Heap allocation counter for the Assembler Benchmark, in benchmark builds only
+// (g++ -DGCT_COUNT_ALLOCATIONS ...): it replaces operator new for the whole binary.
+#ifdef GCT_COUNT_ALLOCATIONS
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
 
 // Tool Registry - holds all registered tools
 class ToolRegistry {
@@ -58,6 +121,9 @@ public:
 
     // Get user inputs (override if tool needs specific inputs)
     virtual void getInputs() {}
+
+    // True if getInputs() prompts the user; such tools cannot run headless (gct rom)
+    virtual bool hasInputs() const { return false; }
 };
 
 // Simple base class for tools
@@ -76,11 +142,14 @@ class DigitalLogicSimHelper {
 private:
     std::string chipName;
     std::string basePath;
+    std::ostream& out;
+    std::ostream& err;
 
 public:
-    DigitalLogicSimHelper(const std::string& chip = "16-CPU")
+    DigitalLogicSimHelper(const std::string& chip = "16-CPU", std::ostream& log = std::cout, std::ostream& errorLog = std::cerr)
         : chipName(chip),
-          basePath("C:\\Users\\Limey\\AppData\\LocalLow\\SebastianLague\\Digital-Logic-Sim\\Projects\\16-Bit Computer 1.3\\Chips\\") {}
+          basePath("C:\\Users\\Limey\\AppData\\LocalLow\\SebastianLague\\Digital-Logic-Sim\\Projects\\16-Bit Computer 1.3\\Chips\\"),
+          out(log), err(errorLog) {}
 
     // Update a single subchip's InternalData array
     bool updateSubchipData(const std::string& subchipLabel, const std::vector<uint16_t>& data) {
@@ -89,7 +158,7 @@ public:
         // Read entire file
         std::ifstream jsonFile(jsonPath);
         if (!jsonFile.is_open()) {
-            std::cerr << "Warning: Could not open Digital Logic Sim file: " << jsonPath << "\n";
+            err << "Warning: Could not open Digital Logic Sim file: " << jsonPath << "\n";
             return false;
         }
 
@@ -100,14 +169,14 @@ public:
         std::string searchStr = "\"Label\":\"" + subchipLabel + "\"";
         size_t labelPos = fileContent.find(searchStr);
         if (labelPos == std::string::npos) {
-            std::cerr << "Warning: Could not find subchip with label '" << subchipLabel << "'\n";
+            err << "Warning: Could not find subchip with label '" << subchipLabel << "'\n";
             return false;
         }
 
         // Find InternalData array start after this label
         size_t dataStart = fileContent.find("\"InternalData\":[", labelPos);
         if (dataStart == std::string::npos) {
-            std::cerr << "Warning: Could not find InternalData for '" << subchipLabel << "'\n";
+            err << "Warning: Could not find InternalData for '" << subchipLabel << "'\n";
             return false;
         }
 
@@ -127,7 +196,7 @@ public:
         // Write back to file
         std::ofstream outFile(jsonPath);
         if (!outFile.is_open()) {
-            std::cerr << "Error: Could not write to Digital Logic Sim file\n";
+            err << "Error: Could not write to Digital Logic Sim file\n";
             return false;
         }
         outFile << fileContent;
@@ -143,7 +212,7 @@ public:
         // Read entire file
         std::ifstream jsonFile(jsonPath);
         if (!jsonFile.is_open()) {
-            std::cerr << "Warning: Could not open Digital Logic Sim file: " << jsonPath << "\n";
+            err << "Warning: Could not open Digital Logic Sim file: " << jsonPath << "\n";
             return false;
         }
 
@@ -159,14 +228,14 @@ public:
             std::string searchStr = "\"Label\":\"" + subchipLabel + "\"";
             size_t labelPos = fileContent.find(searchStr);
             if (labelPos == std::string::npos) {
-                std::cerr << "Warning: Could not find subchip with label '" << subchipLabel << "'\n";
+                err << "Warning: Could not find subchip with label '" << subchipLabel << "'\n";
                 continue;
             }
 
             // Find InternalData array start after this label
             size_t dataStart = fileContent.find("\"InternalData\":[", labelPos);
             if (dataStart == std::string::npos) {
-                std::cerr << "Warning: Could not find InternalData for '" << subchipLabel << "'\n";
+                err << "Warning: Could not find InternalData for '" << subchipLabel << "'\n";
                 continue;
             }
 
@@ -187,13 +256,13 @@ public:
         // Write back to file
         std::ofstream outFile(jsonPath);
         if (!outFile.is_open()) {
-            std::cerr << "Error: Could not write to Digital Logic Sim file\n";
+            err << "Error: Could not write to Digital Logic Sim file\n";
             return false;
         }
         outFile << fileContent;
         outFile.close();
 
-        std::cout << "Updated Digital Logic Sim chip '" << chipName << "' in: " << jsonPath << "\n";
+        out << "Updated Digital Logic Sim chip '" << chipName << "' in: " << jsonPath << "\n";
         return true;
     }
 };
@@ -207,770 +276,647 @@ class AssemblerTool : public AutoRegisterTool<AssemblerTool> {
 private:
     std::string inputFile;
     std::string outputBase;
-    IsaSpec::ISA_SPEC isaSpec;
-
-    // Helper: Check if mnemonic is an ALU operation (based on type in spec)
-    bool isAluOperation(const std::string& mnemonic) {
-        // Search through technical instructions for matching mnemonic with TYPE_ALU
-        for (const auto& instr : isaSpec.instructions_tech) {
-            if (instr.mnemonic == mnemonic && instr.type == IsaSpec::InstructionType::TYPE_ALU) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    // Helper: Find opcode from mnemonic and operand types using ISA spec
-    // The compiler differentiates by checking if the last operand is a register or immediate
-    uint8_t findOpcode(const std::string& mnemonic, bool immediate) {
-        for (const auto& instr : isaSpec.instructions_tech) {
-            if (instr.mnemonic == mnemonic && instr.flags.IMMEDIATE == immediate) {
-                return instr.opcode;
+    const IsaSpec::ISA_SPEC& isaSpec = IsaSpec::sharedISASpec();
+
+    // Message streams and Digital Logic Sim update, redirected/disabled for headless runs
+    std::ostream* out = &std::cout;
+    std::ostream* err = &std::cerr;
+    bool updateSimulator = true;
+    int errorCount = 0;
+
+    // Optional on-disk assembly cache, shared between instances
+    AssemblyCache* cache = nullptr;
+    bool cacheHit = false;
+
+    // Object output: write a relocatable .gobj instead of ROMs, undefined labels become external references
+    bool objectOutput = false;
+
+    // 0 = emit what is written, 1 = constant propagation, jump threading, unreachable code removal, loop
+    // unrolling, strength reduction and peephole optimizer, then outlining if the program would not fit the ROM,
+    // 2 (-Os) = 1 without unrolling and always outline
+    int optimizeLevel = 0;
+
+    // Instructions loop unrolling may add at -O1
+    size_t unrollBudget = LoopUnroller::DEFAULT_BUDGET;
+
+    // Control-flow graph export next to the output: "dot", "json", or empty for none
+    std::string cfgFormat;
+
+    // Execution profile for basic-block layout at -O1 and up (ROM output), empty for none
+    std::string profilePath;
+
+    // Rewrite database (gct superopt) for the peephole optimizer at -O1 and up, empty for none
+    std::string rewritesPath;
+
+    // Output of the last assembly
+    std::vector<uint32_t> instructions;
+    std::vector<AsmSymbol> symbolTable;
+    std::vector<ObjectModule::Relocation> relocations;
+    std::vector<std::string> warnings;
+
+    // Helper: Parse inputFile's source with the assembler library and print its diagnostics
+    void assembleSource(std::string_view source) {
+        Assembler assembler(isaSpec);
+        assembler.setRelocatable(objectOutput);
+        AssemblyResult result = assembler.assemble(source);
+
+        // Virtual registers are allocated at every optimization level
+        if (result.ok() && !result.virtualRegisters.empty()) {
+            RegisterAllocator allocator(isaSpec);
+            if (allocator.allocate(result, objectOutput)) {
+                const RegisterAllocator::Stats& regs = allocator.getStats();
+                *out << "Allocated " << regs.virtuals << " virtual registers (" << regs.spilled << " spilled to "
+                     << regs.slots << " RAM words, " << regs.loads << " loads, " << regs.stores << " stores)\n";
             }
         }
-        return 0xFF; // Invalid opcode
-    }
 
-    // Helper: Find opcode from mnemonic, type, and immediate flag
-    uint8_t findOpcodeByType(const std::string& mnemonic, IsaSpec::InstructionType type, bool immediate) {
-        for (const auto& instr : isaSpec.instructions_tech) {
-            if (instr.mnemonic == mnemonic && instr.type == type && instr.flags.IMMEDIATE == immediate) {
-                return instr.opcode;
-            }
+        warnings.clear();
+        for (const auto& diagnostic : result.diagnostics) {
+            *err << (diagnostic.severity == AsmDiagnostic::SEVERITY_ERROR ? "Error: " : "Warning: ")
+                 << diagnostic.message << "\n";
+            if (diagnostic.severity != AsmDiagnostic::SEVERITY_ERROR) warnings.push_back(diagnostic.message);
         }
-        return 0xFF; // Invalid opcode
-    }
+        errorCount += result.errorCount;
 
-    // Helper: Find branch condition code from mnemonic
-    int findBranchCondition(const std::string& mnemonic) {
-        for (const auto& branch : isaSpec.branch_conditions) {
-            if (branch.mnemonic == mnemonic) {
-                return branch.code;
+        if (optimizeLevel >= 1 && result.ok()) {
+            size_t before = result.instructions.size();
+            ConstantPropagator propagator(isaSpec);
+            propagator.optimize(result, objectOutput);
+            ConstantPropagator::Stats constants = propagator.getStats();
+            size_t unreachable = 0;
+            if (constants.taken + constants.notTaken > 0) {
+                unreachable += ControlFlowGraph(isaSpec).removeUnreachable(result, objectOutput);
             }
-        }
-        return -1;
-    }
-
-    // Symbol table for labels
-    struct Label {
-        std::string name;
-        uint8_t address;
-    };
-    std::vector<Label> symbolTable;
-
-    // Alias table for register aliasing
-    struct RegisterAlias {
-        std::string alias;
-        std::string registerName;  // e.g., "X0", "X1"
-    };
-    std::vector<RegisterAlias> aliasTable;
-
-    // Helper: Validate alias name (alphanumeric + underscore only)
-    bool isValidAliasName(const std::string& name) {
-        if (name.empty()) return false;
-
-        // Check that name contains only alphanumeric characters and underscores
-        for (char c : name) {
-            if (!std::isalnum(c) && c != '_') {
-                return false;
+            JumpThreader threader(isaSpec);
+            threader.optimize(result);
+            const JumpThreader::Stats& jumps = threader.getStats();
+            unreachable += ControlFlowGraph(isaSpec).removeUnreachable(result, objectOutput);
+
+            // Counted loops, then the values their copies make known (-Os is for size, so not there)
+            if (optimizeLevel == 1) {
+                LoopUnroller unroller(isaSpec);
+                unroller.setBudget(unrollBudget);
+                if (unroller.optimize(result, objectOutput) > 0) {
+                    for (const LoopUnroller::Loop& loop : unroller.getStats().loops) {
+                        *out << "Unrolled loop " << loop.label;
+                        if (loop.factor == 0) *out << " fully, " << loop.passes + 1 << " passes (";
+                        else *out << " " << loop.factor << "x (";
+                        *out << loop.added << " instructions added, ~" << loop.cycles << " cycles saved"
+                             << (loop.factor == 0 ? "" : " per " + std::to_string(loop.factor) + " passes") << ")\n";
+                    }
+                    propagator.optimize(result, objectOutput);
+                    const ConstantPropagator::Stats& again = propagator.getStats();
+                    constants.folded += again.folded;
+                    constants.known += again.known;
+                    constants.redundant += again.redundant;
+                    constants.taken += again.taken;
+                    constants.notTaken += again.notTaken;
+                    if (again.taken + again.notTaken > 0) {
+                        unreachable += ControlFlowGraph(isaSpec).removeUnreachable(result, objectOutput);
+                    }
+                }
             }
-        }
-
-        // Check that alias doesn't conflict with instruction mnemonics
-        if (isAluOperation(name)) return false;
-
-        // Check against other instruction mnemonics
-        const char* reserved[] = {
-            "MOV", "CMP", "B", "BEQ", "BNE", "BLT", "BLE", "BGT", "BGE",
-            "BCS", "BCC", "BMI", "BPL", "BVS", "BVC", "BHI", "BLS",
-            "READ", "WRITE", "PRINT", "EXIT", "NOT"
-        };
-
-        for (const char* mnemonic : reserved) {
-            if (name == mnemonic) return false;
-        }
-
-        return true;
-    }
-
-    // Helper: Resolve alias to register name
-    std::string resolveAlias(const std::string& str) {
-        // Check if this is an alias
-        for (const auto& alias : aliasTable) {
-            if (alias.alias == str) {
-                return alias.registerName;
+            StrengthReducer reducer(isaSpec);
+            size_t reduced = reducer.optimize(result);
+            PeepholeOptimizer optimizer(isaSpec);
+            RewriteDatabase rewrites;
+            if (!rewritesPath.empty()) {
+                if (rewrites.readFromFile(rewritesPath, isaSpec, *err)) optimizer.setRewrites(&rewrites);
+                else errorCount++;
             }
-        }
-        // Not an alias, return original
-        return str;
-    }
-
-    // Helper: Parse register (e.g., "X0" -> 0), with alias support
-    int parseRegister(const std::string& str) {
-        // First check if it's an alias
-        std::string resolved = resolveAlias(str);
-
-        if (resolved.length() < 2) return -1;
-        if (resolved[0] != 'X' && resolved[0] != 'x') return -1;
-        int reg = std::atoi(resolved.c_str() + 1);
-        if (reg < 0 || reg > 7) return -1;
-        return reg;
-    }
-
-    // Helper: Parse constant (hex, binary, decimal, ASCII)
-    int parseConstant(const std::string& str) {
-        if (str.empty()) return -1;
-
-        // ASCII character literal: 'A' -> 65
-        if (str.length() == 3 && str[0] == '\'' && str[2] == '\'') {
-            return (int)(unsigned char)str[1];
-        }
-
-        int value;
-        if (str.length() > 2 && str[0] == '0') {
-            if (str[1] == 'x' || str[1] == 'X') {
-                // Hexadecimal
-                value = std::strtol(str.c_str(), nullptr, 16);
-            } else if (str[1] == 'b' || str[1] == 'B') {
-                // Binary
-                value = std::strtol(str.c_str() + 2, nullptr, 2);
-            } else {
-                // Decimal
-                value = std::atoi(str.c_str());
+            optimizer.optimize(result);
+            const PeepholeOptimizer::Stats& stats = optimizer.getStats();
+            *out << "Optimized " << before << " -> " << result.instructions.size() << " instructions ("
+                 << constants.folded << " constants folded, " << constants.known + constants.redundant << " known results, "
+                 << constants.taken + constants.notTaken << " branches decided, " << jumps.threaded << " branches threaded, " << jumps.inverted << " inverted, "
+                 << jumps.fallthroughs << " fall-through branches, "
+                 << unreachable << " unreachable, " << reduced << " strength-reduced, " << stats.selfMoves << " self moves, " << stats.identities << " identities, "
+                 << stats.deadWrites << " dead writes, " << stats.compares + stats.deadCompares << " compares removed, "
+                 << stats.copies << " copies shortened";
+            if (!rewritesPath.empty()) *out << ", " << stats.rewrites << " rewrites";
+            *out << ")\n";
+
+            if (optimizeLevel >= 2 || result.instructions.size() > 256) {
+                Outliner outliner(isaSpec);
+                if (outliner.optimize(result, objectOutput) > 0) {
+                    const Outliner::Stats& outlined = outliner.getStats();
+                    *out << "Outlined " << outlined.calls << " sequences into " << outlined.functions << " subroutines, "
+                         << result.instructions.size() << " instructions (" << outlined.saved << " saved)\n";
+                }
             }
-        } else {
-            // Decimal
-            value = std::atoi(str.c_str());
-        }
-
-        if (value < 0 || value > 65535) return -1;
-        return value;
-    }
-
-    // Helper: Strip comments from line
-    void stripComments(std::string& line, bool& inMultiline) {
-        std::string result;
-        size_t i = 0;
-        size_t len = line.length();
 
-        while (i < len) {
-            if (inMultiline) {
-                // Look for end of multiline comment */
-                if (i < len - 1 && line[i] == '*' && line[i+1] == '/') {
-                    inMultiline = false;
-                    i += 2;
+            if (!profilePath.empty() && !objectOutput) {
+                ExecutionProfile profile;
+                if (!profile.readFromFile(profilePath, *err)) {
+                    errorCount++;
                 } else {
-                    i++;
-                }
-            } else {
-                // Check for start of multiline comment /*
-                if (i < len - 1 && line[i] == '/' && line[i+1] == '*') {
-                    inMultiline = true;
-                    i += 2;
-                }
-                // Check for single-line comment //
-                else if (i < len - 1 && line[i] == '/' && line[i+1] == '/') {
-                    break; // Rest of line is comment
-                }
-                // Regular character
-                else {
-                    result += line[i++];
+                    BlockLayout layout(isaSpec);
+                    layout.optimize(result, profile);
+                    const BlockLayout::Stats& blocks = layout.getStats();
+                    if (blocks.mismatches > 0) {
+                        *err << "Warning: Profile '" << profilePath << "' has " << blocks.mismatches
+                             << " edges that are not in this program, blocks left in place\n";
+                    } else {
+                        *out << "Laid out blocks for profile: " << blocks.moved << " moved, " << blocks.inverted << " branches inverted, "
+                             << blocks.removed << " removed, " << blocks.added << " added; taken branches "
+                             << blocks.takenBefore << " -> " << blocks.takenAfter << "\n";
+                    }
                 }
             }
         }
-        line = result;
+        if (!objectOutput && result.ok() && result.instructions.size() > 256) {
+            *err << "Error: Program is " << result.instructions.size() << " instructions, ROM holds 256"
+                 << (optimizeLevel == 0 ? " (-O1 may outline repeated code to make it fit)" : "") << "\n";
+            errorCount++;
+        }
+        if (!cfgFormat.empty() && result.ok() && !writeControlFlow(result)) errorCount++;
+        instructions = std::move(result.instructions);
+        symbolTable = std::move(result.symbols);
+        relocations = std::move(result.relocations);
     }
 
-    // Helper: Check if line is a label
-    bool isLabel(const std::string& line) {
-        size_t colonPos = line.find(':');
-        if (colonPos == std::string::npos) return false;
+    // Helper: Update ROM data in Digital Logic Sim JSON file
+    bool updateDigitalLogicSimRom(const std::vector<uint16_t>& alphaData, const std::vector<uint16_t>& betaData) {
+        // The project file is shared by every assembler instance
+        static std::mutex simFileMutex;
+        std::lock_guard<std::mutex> lock(simFileMutex);
+        DigitalLogicSimHelper simHelper("16-CPU", *out, *err);
 
-        std::string labelName = line.substr(0, colonPos);
-        // Trim whitespace
-        size_t start = labelName.find_first_not_of(" \t");
-        if (start == std::string::npos) return false;
-        labelName = labelName.substr(start);
+        std::vector<std::pair<std::string, std::vector<uint16_t>>> updates = {
+            {"Machine Code ALPHA", alphaData},
+            {"Machine Code BETA", betaData}
+        };
 
-        if (labelName.empty()) return false;
-        if (!std::isalpha(labelName[0]) && labelName[0] != '_' && labelName[0] != '.') return false;
-        return true;
+        *out << "\nUpdating Digital Logic Sim project...\n";
+        return simHelper.updateMultipleSubchips(updates);
     }
 
-    // Helper: Parse label name
-    std::string parseLabel(const std::string& line) {
-        size_t colonPos = line.find(':');
-        std::string labelName = line.substr(0, colonPos);
-        // Trim whitespace
-        size_t start = labelName.find_first_not_of(" \t");
-        if (start != std::string::npos) {
-            labelName = labelName.substr(start);
+    // Write the program's control-flow graph as outputBase + ".cfg.dot" or ".cfg.json"
+    bool writeControlFlow(AssemblyResult& result) {
+        ControlFlowGraph cfg(isaSpec);
+        cfg.build(result, objectOutput);
+
+        std::string base = outputBase.empty() ? std::filesystem::path(inputFile).replace_extension().string() : outputBase;
+        std::string cfgPath = base + ".cfg." + cfgFormat;
+        std::error_code ec;
+        std::filesystem::path cfgDir = std::filesystem::path(cfgPath).parent_path();
+        if (!cfgDir.empty()) std::filesystem::create_directories(cfgDir, ec);
+        std::ofstream file(cfgPath);
+        if (!file.is_open()) {
+            *err << "Error: Could not write '" << cfgPath << "'\n";
+            return false;
         }
-        return labelName;
+        if (cfgFormat == "json") cfg.writeJson(file);
+        else cfg.writeDot(file, std::filesystem::path(inputFile).stem().string());
+        *out << "Generated control-flow graph: " << cfgPath << " (" << cfg.getBlocks().size() << " blocks)\n";
+        return true;
     }
 
-    // Helper: Lookup label in symbol table
-    int lookupLabel(const std::string& name) {
+    // Write instructions, symbols and relocations as a relocatable object (outputBase + ".gobj")
+    bool writeObject(std::string_view source) {
+        ObjectModule object;
+        object.source = std::filesystem::path(inputFile).filename().string();
+        object.buildKey = buildKey(source);
+        object.code = instructions;
         for (const auto& label : symbolTable) {
-            if (label.name == name) return label.address;
-        }
-        return -1;
+            object.symbols.push_back({label.name, label.address, label.name[0] != '.'});
+        }
+        object.relocations = relocations;
+
+        std::string base = outputBase.empty() ? std::filesystem::path(inputFile).replace_extension().string() : outputBase;
+        std::string objectPath = base + ".gobj";
+        std::error_code ec;
+        std::filesystem::path objectDir = std::filesystem::path(objectPath).parent_path();
+        if (!objectDir.empty()) std::filesystem::create_directories(objectDir, ec);
+        if (!object.writeToFile(objectPath, *err)) return false;
+        *out << "\nCompiled " << instructions.size() << " instructions, " << relocations.size() << " relocations\n";
+        *out << "Generated object: " << objectPath << "\n";
+        return true;
     }
 
-    // Helper: Parse branch condition
-    int parseBranchCondition(const std::string& mnemonic) {
-        return findBranchCondition(mnemonic);
+public:
+    AssemblerTool() : AutoRegisterTool("Assemble Code", "Convert assembly to machine code (ALPHA/BETA ROMs)") {
+        std::cout << "ISA Specification v" << isaSpec.version << " loaded\n";
+        std::cout << "  " << isaSpec.instructions_tech.size() << " technical instructions, "
+                  << isaSpec.instructions_doc.size() << " documentation entries, "
+                  << isaSpec.branch_conditions.size() << " branch conditions\n";
     }
 
-    // Encoding functions
-    uint32_t encodeAlu(uint8_t op, uint8_t dst, uint16_t src1, uint16_t src2, bool isImmediate) {
-        uint32_t instr = 0;
-        uint8_t actualOpcode = isImmediate ? (op | 0x10) : op;
-        instr |= actualOpcode;
-        instr |= ((dst & 0x7) << 8);
-
-        if (!isImmediate) {
-            instr |= ((src1 & 0x7) << 12);
-            instr |= ((src2 & 0x7) << 16);
-        } else {
-            instr |= ((src1 & 0x7) << 12);
-            instr |= ((src2 & 0xFFFF) << 16);
-        }
-        return instr;
-    }
+    bool hasInputs() const override { return true; }
 
-    uint32_t encodeMove(uint8_t dst, uint16_t srcOrImm, bool isImmediate) {
-        uint32_t instr = 0;
-        uint8_t moveOp = findOpcode("MOV", isImmediate);
-        instr |= moveOp;
-        instr |= ((dst & 0x7) << 8);
+    void getInputs() override {
+        std::cout << "Input assembly file: ";
+        std::getline(std::cin, inputFile);
 
-        if (!isImmediate) {
-            instr |= ((srcOrImm & 0x7) << 12);
-        } else {
-            instr |= ((uint32_t)(srcOrImm & 0xFFFF) << 16);
-        }
-        return instr;
+        std::cout << "Output base name (for .out files): ";
+        std::getline(std::cin, outputBase);
     }
 
-    uint32_t encodeCmp(uint8_t src1, uint16_t src2, bool isImmediate) {
-        uint32_t instr = 0;
-        uint8_t cmpOp = findOpcode("CMP", isImmediate);
-        instr |= cmpOp;
-
-        if (!isImmediate) {
-            instr |= ((src1 & 0x7) << 12);
-            instr |= ((src2 & 0x7) << 16);
-        } else {
-            instr |= ((src1 & 0x7) << 12);
-            instr |= ((uint32_t)(src2 & 0xFFFF) << 16);
-        }
-        return instr;
+    // Headless assembler: no banner, no Digital Logic Sim update, all messages go to log
+    AssemblerTool(const std::string& input, const std::string& output, std::ostream& log)
+        : AutoRegisterTool("Assemble Code", "Convert assembly to machine code (ALPHA/BETA ROMs)"),
+          inputFile(input), outputBase(output), out(&log), err(&log), updateSimulator(false) {}
+
+    void setUpdateSimulator(bool update) { updateSimulator = update; }
+    void setCache(AssemblyCache* assemblyCache) { cache = assemblyCache; }
+    void setObjectOutput(bool object) { objectOutput = object; }
+    void setOptimizeLevel(int level) { optimizeLevel = level; }
+    void setCfgFormat(const std::string& format) { cfgFormat = format; }
+    void setProfile(const std::string& path) { profilePath = path; }
+    void setRewrites(const std::string& path) { rewritesPath = path; }
+    void setUnrollBudget(size_t instructions) { unrollBudget = instructions; }
+    bool wasCacheHit() const { return cacheHit; }
+    size_t getInstructionCount() const { return instructions.size(); }
+    const std::vector<uint32_t>& getInstructions() const { return instructions; }
+
+    // Hash of source and of everything else that decides its object code, recorded in .gobj objects
+    uint64_t buildKey(std::string_view source) const {
+        uint64_t key = AssemblyCache::makeKey(source, isaSpec, (uint32_t)optimizeLevel | (uint32_t)unrollBudget << 8);
+        if (optimizeLevel >= 1 && !rewritesPath.empty()) {
+            MappedFile rewrites(rewritesPath);
+            key = AssemblyCache::hashBytes(rewrites.isOpen() ? rewrites.view() : rewritesPath, key);
+        }
+        return key;
     }
 
-    uint32_t encodeBranch(uint8_t condition, uint16_t target, bool isImmediate) {
-        uint32_t instr = 0;
-        uint8_t branchOp = findOpcode("B", isImmediate);
-        instr |= branchOp;
-
-        if (isImmediate) {
-            // JI format: OPCODE[8] CONDITION[4] [0000] IMMEDIATE[16]
-            // Bits 0-7:   Opcode
-            // Bits 8-11:  Condition
-            // Bits 12-15: Always 0000
-            // Bits 16-31: Immediate address (16 bits)
-            instr |= ((condition & 0xF) << 8);
-            instr |= ((uint32_t)(target & 0xFFFF) << 16);
-        } else {
-            // J format: OPCODE[8] CONDITION[4] [0000] REG[4] [unused]
-            // Bits 0-7:   Opcode
-            // Bits 8-11:  Condition
-            // Bits 12-15: Always 0000
-            // Bits 16-19: Register to jump to
-            // Bits 20-31: Unused
-            instr |= ((condition & 0xF) << 8);
-            instr |= ((target & 0xF) << 16);
-        }
-        return instr;
-    }
-
-    uint32_t encodeRead(uint8_t dst, uint8_t addrReg) {
-        uint32_t instr = 0;
-        uint8_t readOp = findOpcode("READ", false);
-        instr |= readOp;
-        instr |= ((dst & 0x7) << 8);
-        instr |= ((addrReg & 0x7) << 16);
-        return instr;
-    }
-
-    uint32_t encodeReadI(uint8_t dst, uint16_t addrImm) {
-        uint32_t instr = 0;
-        uint8_t readOp = findOpcode("READ", true);
-        instr |= readOp;
-        instr |= ((dst & 0x7) << 8);
-        instr |= ((uint32_t)(addrImm & 0xFFFF) << 16);
-        return instr;
-    }
-
-    uint32_t encodeWrite(uint8_t dataReg, uint8_t addrReg) {
-        uint32_t instr = 0;
-        uint8_t writeOp = findOpcode("WRITE", false);
-        instr |= writeOp;
-        instr |= ((dataReg & 0x7) << 12);
-        instr |= ((addrReg & 0x7) << 16);
-        return instr;
-    }
-
-    uint32_t encodeWriteI(uint8_t dataReg, uint16_t addrImm) {
-        uint32_t instr = 0;
-        uint8_t writeOp = findOpcode("WRITE", true);
-        instr |= writeOp;
-        instr |= ((dataReg & 0x7) << 12);
-        instr |= ((uint32_t)(addrImm & 0xFFFF) << 16);
-        return instr;
-    }
-
-    // PRINT encoding per ISA: PRINT <address>, <data>
-    // PRINT_REG:    SCN[R[B]] = R[A]  -> address in B (bits 16-18), data in A (bits 12-14)
-    // PRINT_REG_I:  SCN[X] = R[A]     -> address in X (bits 16-23), data in A (bits 12-14)
-    // PRINT_CONST:  SCN[R[B]] = Y     -> address in B (bits 16-18), data in Y (bits 24-31)
-    // PRINT_CONST_I: SCN[X] = Y       -> address in X (bits 16-23), data in Y (bits 24-31)
-
-    uint32_t encodePrintReg(uint8_t dataReg, uint8_t posReg) {
-        uint32_t instr = 0;
-        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_REG, false);
-        instr |= printOp;
-        instr |= ((dataReg & 0x7) << 12);   // A field: data register
-        instr |= ((posReg & 0x7) << 16);    // B field: position register
-        return instr;
-    }
-
-    uint32_t encodePrintRegI(uint8_t dataReg, uint8_t posImm) {
-        uint32_t instr = 0;
-        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_REG, true);
-        instr |= printOp;
-        instr |= ((dataReg & 0x7) << 12);          // A field: data register
-        instr |= ((uint32_t)(posImm & 0xFF) << 16); // X (lower byte of immediate): position
-        return instr;
-    }
-
-    uint32_t encodePrintConst(uint8_t dataConst, uint8_t posReg) {
-        uint32_t instr = 0;
-        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_CONST, false);
-        instr |= printOp;
-        instr |= ((posReg & 0x7) << 16);           // B field: position register
-        instr |= ((uint32_t)(dataConst & 0xFF) << 24); // Y (upper byte): data constant
-        return instr;
-    }
-
-    uint32_t encodePrintConstI(uint16_t dataConst, uint8_t posImm) {
-        uint32_t instr = 0;
-        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_CONST, true);
-        instr |= printOp;
-        instr |= ((uint32_t)(posImm & 0xFF) << 16);    // X (lower byte): position
-        instr |= ((uint32_t)(dataConst & 0xFF) << 24); // Y (upper byte): data constant
-        return instr;
-    }
-
-    // Helper: Split string into tokens
-    std::vector<std::string> tokenize(const std::string& str) {
-        std::vector<std::string> tokens;
-        std::string current;
-
-        for (char c : str) {
-            if (c == ',' || std::isspace(c)) {
-                if (!current.empty()) {
-                    tokens.push_back(current);
-                    current.clear();
-                }
-            } else {
-                current += c;
-            }
-        }
-        if (!current.empty()) tokens.push_back(current);
-        return tokens;
+    // True if outputBase + ".gobj" was built from inputFile as it is now, with the same options
+    bool isObjectUpToDate() const {
+        MappedFile input(inputFile);
+        std::ostringstream ignored;
+        ObjectModule object;
+        return input.isOpen() && object.readFromFile(outputBase + ".gobj", ignored) && object.buildKey == buildKey(input.view());
     }
 
-    // Helper: Update ROM data in Digital Logic Sim JSON file
-    bool updateDigitalLogicSimRom(const std::vector<uint16_t>& alphaData, const std::vector<uint16_t>& betaData) {
-        DigitalLogicSimHelper simHelper("16-CPU");
-
-        std::vector<std::pair<std::string, std::vector<uint16_t>>> updates = {
-            {"Machine Code ALPHA", alphaData},
-            {"Machine Code BETA", betaData}
-        };
-
-        std::cout << "Updating Digital Logic Sim project...\n";
-        return simHelper.updateMultipleSubchips(updates);
+    void execute(RomFormat outputFormat) override {
+        assemble(outputFormat);
     }
 
-    // Parse a single instruction line
-    uint32_t parseInstruction(const std::string& line, bool& error, int instructionNumber = -1) {
-        error = false;
-
-        // Trim leading whitespace
-        size_t start = line.find_first_not_of(" \t");
-        if (start == std::string::npos) return 0;
-        std::string trimmed = line.substr(start);
-
-        if (trimmed.empty() || trimmed[0] == ';' || trimmed[0] == '#') return 0;
-        if (isLabel(trimmed)) return 0;
-
-        // Extract mnemonic
-        size_t spacePos = trimmed.find_first_of(" \t");
-        std::string mnemonic = (spacePos == std::string::npos) ? trimmed : trimmed.substr(0, spacePos);
+    // Assemble inputFile and write the ROMs, returns false if anything failed
+    bool assemble(RomFormat outputFormat) {
+        errorCount = 0;
 
-        // Convert to uppercase
-        for (char& c : mnemonic) c = std::toupper(c);
-
-        // Extract operands
-        std::string operands = (spacePos == std::string::npos) ? "" : trimmed.substr(spacePos + 1);
-        std::vector<std::string> tokens = tokenize(operands);
+        // Map input file
+        MappedFile input(inputFile);
+        if (!input.isOpen()) {
+            *err << "Error: Could not open file '" << inputFile << "'\n";
+            return false;
+        }
 
-        // LR pseudo-instruction (Load Register with instruction number)
-        if (mnemonic == "LR") {
-            if (tokens.size() != 1) { error = true; return 0; }
-            int dst = parseRegister(tokens[0]);
-            if (dst == -1) { error = true; return 0; }
-            if (instructionNumber == -1) {
-                std::cerr << "Error: LR instruction requires instruction number (internal error)\n";
-                error = true;
-                return 0;
+        // Object files are assembled directly; the cache holds finished programs only
+        if (objectOutput) {
+            assembleSource(input.view());
+            if (errorCount == 0 && !writeObject(input.view())) errorCount++;
+            return errorCount == 0;
+        }
+
+        // Reuse a cached assembly of identical source, otherwise parse and store it
+        // (the cache keeps no control-flow information and is not keyed by profile or rewrite database, so those
+        // always reassemble; the unroll budget is part of the key)
+        uint64_t cacheKey = 0;
+        cacheHit = false;
+        if (cache && cfgFormat.empty() && profilePath.empty() && rewritesPath.empty()) {
+            cacheKey = cache->makeKey(input.view(), isaSpec, (uint32_t)optimizeLevel | (uint32_t)unrollBudget << 8);
+            AssemblyCache::Entry entry;
+            if (cache->load(cacheKey, entry)) {
+                cacheHit = true;
+                instructions = entry.instructions;
+                symbolTable.clear();
+                for (const auto& symbol : entry.symbols) symbolTable.push_back({symbol.name, symbol.address});
+                for (const auto& warning : entry.warnings) *err << "Warning: " << warning << "\n";
             }
-            // Replace with MOV dst, instructionNumber
-            return encodeMove(dst, instructionNumber, true);
         }
-
-        // EXIT instruction
-        if (mnemonic == "EXIT") return 0xFFFFFFFF;
-
-        // ALU operations
-        if (isAluOperation(mnemonic)) {
-            uint8_t op = findOpcode(mnemonic, false);
-
-            if (tokens.size() == 3) {
-                int dst = parseRegister(tokens[0]);
-                int src1 = parseRegister(tokens[1]);
-                if (dst == -1 || src1 == -1) { error = true; return 0; }
-
-                int src2Reg = parseRegister(tokens[2]);
-                if (src2Reg != -1) {
-                    return encodeAlu(op, dst, src1, src2Reg, false);
-                } else {
-                    int src2Const = parseConstant(tokens[2]);
-                    if (src2Const == -1) { error = true; return 0; }
-                    return encodeAlu(op, dst, src1, src2Const, true);
-                }
-            } else if (tokens.size() == 2) {
-                int dst = parseRegister(tokens[0]);
-                if (dst == -1) { error = true; return 0; }
-
-                int srcReg = parseRegister(tokens[1]);
-                if (srcReg != -1) {
-                    return encodeAlu(op, dst, srcReg, 0, false);
-                } else {
-                    int srcConst = parseConstant(tokens[1]);
-                    if (srcConst == -1) { error = true; return 0; }
-                    return encodeAlu(op, dst, srcConst, 0, true);
-                }
+        if (!cacheHit) {
+            assembleSource(input.view());
+            if (cache && errorCount == 0) {
+                AssemblyCache::Entry entry;
+                entry.instructions = instructions;
+                for (const auto& label : symbolTable) entry.symbols.push_back({label.name, label.address});
+                entry.warnings = warnings;
+                cache->store(cacheKey, entry);
             }
-            error = true;
-            return 0;
         }
 
-        // NOT operation
-        if (mnemonic == "NOT") {
-            if (tokens.size() != 1) { error = true; return 0; }
-            int dst = parseRegister(tokens[0]);
-            if (dst == -1) { error = true; return 0; }
-            uint8_t notOp = findOpcode("NOT", false);
-            return encodeAlu(notOp, dst, 0, 0, false);
+        // A failed assembly leaves the ROMs and the simulator as they were
+        if (errorCount > 0) {
+            *err << "No ROMs written (" << errorCount << (errorCount == 1 ? " error" : " errors") << ")\n";
+            return false;
         }
 
-        // MOV operation
-        if (mnemonic == "MOV") {
-            if (tokens.size() != 2) { error = true; return 0; }
-            int dst = parseRegister(tokens[0]);
-            if (dst == -1) { error = true; return 0; }
+        // Prepare ALPHA and BETA data arrays (256 entries, padded with zeros)
+        std::vector<uint16_t> alphaData(256, 0);
+        std::vector<uint16_t> betaData(256, 0);
 
-            int srcReg = parseRegister(tokens[1]);
-            if (srcReg != -1) {
-                return encodeMove(dst, srcReg, false);
-            } else {
-                int srcConst = parseConstant(tokens[1]);
-                if (srcConst == -1) { error = true; return 0; }
-                return encodeMove(dst, srcConst, true);
-            }
+        for (size_t i = 0; i < instructions.size() && i < 256; i++) {
+            alphaData[i] = (instructions[i] >> 16) & 0xFFFF;
+            betaData[i] = instructions[i] & 0xFFFF;
         }
 
-        // CMP operation
-        if (mnemonic == "CMP") {
-            if (tokens.size() != 2) { error = true; return 0; }
-            int src1 = parseRegister(tokens[0]);
-            if (src1 == -1) { error = true; return 0; }
+        // Write traditional .out ROM files (only if outputBase is not empty)
+        if (!outputBase.empty()) {
+            RomWriter alphaWriter(outputBase + "_ALPHA.out", outputFormat);
+            RomWriter betaWriter(outputBase + "_BETA.out", outputFormat);
 
-            int src2Reg = parseRegister(tokens[1]);
-            if (src2Reg != -1) {
-                return encodeCmp(src1, src2Reg, false);
-            } else {
-                int src2Const = parseConstant(tokens[1]);
-                if (src2Const == -1) { error = true; return 0; }
-                return encodeCmp(src1, src2Const, true);
+            for (size_t i = 0; i < 256; i++) {
+                alphaWriter.set(i, alphaData[i]);
+                betaWriter.set(i, betaData[i]);
             }
-        }
 
-        // Branch operations
-        int condition = parseBranchCondition(mnemonic);
-        if (condition >= 0) {
-            if (tokens.size() != 1) { error = true; return 0; }
+            bool success = true;
+            success &= alphaWriter.writeToFile(*out);
+            success &= betaWriter.writeToFile(*out);
+            if (!success) errorCount++;
 
-            int targetReg = parseRegister(tokens[0]);
-            if (targetReg != -1) {
-                return encodeBranch(condition, targetReg, false);
-            } else {
-                // Try as immediate or label
-                int target = parseConstant(tokens[0]);
-                if (target == 0 && tokens[0] != "0") {
-                    // Try as label
-                    target = lookupLabel(tokens[0]);
-                    if (target < 0) { error = true; return 0; }
-                }
-                if (target < 0 || target > 65535) { error = true; return 0; }
-                return encodeBranch(condition, target, true);
+            if (success) {
+                *out << "\nCompiled " << instructions.size() << " instructions\n";
+                *out << "Generated ALPHA ROM: " << outputBase << "_ALPHA.out\n";
+                *out << "Generated BETA ROM:  " << outputBase << "_BETA.out\n";
             }
+        } else {
+            *out << "\nCompiled " << instructions.size() << " instructions\n";
+            *out << "Skipping .out file generation (no output base name provided)\n";
         }
 
-        // READ operation
-        if (mnemonic == "READ") {
-            if (tokens.size() != 2) { error = true; return 0; }
-            int dst = parseRegister(tokens[0]);
-            if (dst == -1) { error = true; return 0; }
+        // Update Digital Logic Sim JSON file
+        if (updateSimulator) updateDigitalLogicSimRom(alphaData, betaData);
+        return errorCount == 0;
+    }
+};
 
-            int addrReg = parseRegister(tokens[1]);
-            if (addrReg != -1) {
-                return encodeRead(dst, addrReg);
-            } else {
-                int addrImm = parseConstant(tokens[1]);
-                if (addrImm < 0 || addrImm > 65535) { error = true; return 0; }
-                return encodeReadI(dst, addrImm);
-            }
-        }
+// Assembler Benchmark Tool
+class AssemblerBenchmarkTool : public AutoRegisterTool<AssemblerBenchmarkTool> {
+private:
+    int lineCount = 50000;
+
+    // Representative instruction mix, cycled to build the synthetic program
+    static const std::vector<std::string>& sampleLines() {
+        static const std::vector<std::string> lines = {
+            "MOV X1 0x0000", "MOV X2 X1", "ADD X5 X1 X2      // running sum", "ADD X3 X3 0x0001",
+            "SUB X3 X3 4", "LSR X4 X2 X3", "AND X4 X4 0x000F", "BCDH X2 X0",
+            "UMUL_L X6 X1 3", "CMP X3 X0", "CMP X5 /* zero */ 0", "BGT fib_done",
+            "beq fib_done", "B fib_loop", "B X7", "READ X1 0x00",
+            "WRITE X1 X7", "PRINT X1 X4", "PRINT 3 '('", "NOT X2"
+        };
+        return lines;
+    }
 
-        // WRITE operation
-        if (mnemonic == "WRITE") {
-            if (tokens.size() != 2) { error = true; return 0; }
-            int dataReg = parseRegister(tokens[0]);
-            if (dataReg == -1) { error = true; return 0; }
+    // Assemble every line once, returns lines/sec and folds the encodings into checksum
+    double timeParse(Assembler& assembler, const std::vector<std::string>& lines, uint64_t& checksum) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lines.size(); i++) {
+            bool error = false;
+            checksum = checksum * 31 + assembler.parseInstruction(lines[i], error, i & 0xFF);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return lines.size() / elapsed.count();
+    }
 
-            int addrReg = parseRegister(tokens[1]);
-            if (addrReg != -1) {
-                return encodeWrite(dataReg, addrReg);
-            } else {
-                int addrImm = parseConstant(tokens[1]);
-                if (addrImm < 0 || addrImm > 65535) { error = true; return 0; }
-                return encodeWriteI(dataReg, addrImm);
-            }
-        }
-
-        // PRINT operation
-        if (mnemonic == "PRINT") {
-            if (tokens.size() != 2) { error = true; return 0; }
-
-            bool isAddrReg = (parseRegister(tokens[0]) != -1);
-            bool isCodeReg = (parseRegister(tokens[1]) != -1);
-
-            if (isAddrReg && isCodeReg) {
-                int addrReg = parseRegister(tokens[0]);
-                int codeReg = parseRegister(tokens[1]);
-                return encodePrintReg(codeReg, addrReg);
-            } else if (!isAddrReg && isCodeReg) {
-                int addrImm = parseConstant(tokens[0]);
-                int codeReg = parseRegister(tokens[1]);
-                if (addrImm < 0 || addrImm > 255) { error = true; return 0; }
-                return encodePrintRegI(codeReg, addrImm);
-            } else if (isAddrReg && !isCodeReg) {
-                int addrReg = parseRegister(tokens[0]);
-                int codeConst = parseConstant(tokens[1]);
-                if (codeConst < 0 || codeConst > 255) { error = true; return 0; }
-                return encodePrintConst(codeConst, addrReg);
-            } else {
-                int addrImm = parseConstant(tokens[0]);
-                int codeConst = parseConstant(tokens[1]);
-                if (addrImm < 0 || addrImm > 255 || codeConst < 0 || codeConst > 255) { error = true; return 0; }
-                return encodePrintConstI(codeConst, addrImm);
-            }
+    // The lookups the assembler made before IsaSpec had an index, kept here as the baseline for it:
+    // opcode by mnemonic and operand kind, else branch condition code, -1 if neither
+    static int linearLookup(const IsaSpec::ISA_SPEC& spec, std::string_view mnemonic, bool immediate) {
+        for (const auto& instr : spec.instructions_tech) {
+            if (instr.mnemonic == mnemonic && instr.flags.IMMEDIATE == immediate) return instr.opcode;
+        }
+        for (const auto& branch : spec.branch_conditions) {
+            if (branch.mnemonic == mnemonic) return branch.code;
         }
+        return -1;
+    }
 
-        error = true;
-        return 0;
+    // The same through the index, as Assembler looks mnemonics up
+    static int indexedLookup(const IsaSpec::ISA_SPEC& spec, std::string_view mnemonic, bool immediate) {
+        const IsaSpec::MnemonicInfo* info = IsaSpec::findMnemonic(spec, mnemonic);
+        if (info && info->opcode[immediate] != 0xFF) return info->opcode[immediate];
+        return IsaSpec::findBranchCondition(spec, mnemonic);
     }
 
-public:
-    AssemblerTool() : AutoRegisterTool("Assemble Code", "Convert assembly to machine code (ALPHA/BETA ROMs)") {
-        // Generate ISA spec algorithmically
-        isaSpec = IsaSpec::generateISASpec();
-        std::cout << "ISA Specification v" << isaSpec.version << " loaded\n";
-        std::cout << "  " << isaSpec.instructions_tech.size() << " technical instructions, "
-                  << isaSpec.instructions_doc.size() << " documentation entries, "
-                  << isaSpec.branch_conditions.size() << " branch conditions\n";
+    // Look up every mnemonic once with lookup, returns lookups/sec and folds the results into checksum
+    template <typename Lookup>
+    double timeLookups(const std::vector<std::string>& mnemonics, Lookup lookup, uint64_t& checksum) {
+        const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < mnemonics.size(); i++) checksum = checksum * 31 + (uint64_t)lookup(spec, mnemonics[i], i & 1);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return mnemonics.size() / elapsed.count();
     }
 
-    void getInputs() override {
-        std::cout << "Input assembly file: ";
-        std::getline(std::cin, inputFile);
+    volatile uint64_t checksumSink = 0;  // Keeps the encodings, and so the timed loop, observable
+
+    // Lex and assemble a whole source buffer the way Assembler::assemble does,
+    // returns lines/sec and the number of heap allocations made while doing so
+    double timeLexAndParse(Assembler& assembler, std::string_view source, uint64_t& allocations) {
+        AsmLexer lexer(source);
+        std::string_view line;
+        uint64_t checksum = 0;
+        size_t lineCount = 0;
+
+#ifdef GCT_COUNT_ALLOCATIONS
+        uint64_t allocationsBefore = allocationCount.load();
+#endif
+        auto start = std::chrono::steady_clock::now();
+        while (lexer.nextLine(line)) {
+            lineCount++;
+            if (line.empty()) continue;
+            bool error = false;
+            checksum = checksum * 31 + assembler.parseInstruction(line, error, lineCount & 0xFF);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+#ifdef GCT_COUNT_ALLOCATIONS
+        allocations = allocationCount.load() - allocationsBefore;
+#else
+        allocations = 0;
+#endif
 
-        std::cout << "Output base name (for .out files): ";
-        std::getline(std::cin, outputBase);
+        checksumSink = checksum;
+        return lineCount / elapsed.count();
     }
 
-    void execute(RomFormat outputFormat) override {
-        // Open input file
-        std::ifstream input(inputFile);
-        if (!input.is_open()) {
-            std::cerr << "Error: Could not open file '" << inputFile << "'\n";
-            return;
+    // Full library calls on a small program, returns microseconds per assemble()
+    double timeLibraryCall(std::string_view program, size_t& instructionCount) {
+        const int calls = 2000;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            AssemblyResult result = assemble(program);
+            instructionCount = result.instructions.size();
         }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / calls;
+    }
 
-        // Pass 1: Build symbol table and alias table
-        symbolTable.clear();
-        aliasTable.clear();
-        std::string line;
-        bool inMultiline = false;
-        int pc = 0;
-
-        while (std::getline(input, line) && pc < 256) {
-            stripComments(line, inMultiline);
-
-            size_t start = line.find_first_not_of(" \t");
-            if (start == std::string::npos) continue;
-            std::string trimmed = line.substr(start);
-            if (trimmed.empty()) continue;
-
-            // Check for #ALIAS directive
-            if (trimmed.length() > 6 && trimmed.substr(0, 6) == "#ALIAS") {
-                std::istringstream iss(trimmed.substr(6));
-                std::string regName, aliasName;
-                iss >> regName >> aliasName;
-
-                // Validate register name (need to temporarily disable alias resolution)
-                int regNum = -1;
-                if (regName.length() >= 2 && (regName[0] == 'X' || regName[0] == 'x')) {
-                    regNum = std::atoi(regName.c_str() + 1);
-                }
+public:
+    AssemblerBenchmarkTool() : AutoRegisterTool("Assembler Benchmark", "Measure assembler throughput (lines/sec)") {}
 
-                if (regNum < 0 || regNum > 7) {
-                    std::cerr << "Error: Invalid register in #ALIAS: " << regName << "\n";
-                    continue;
-                }
+    bool hasInputs() const override { return true; }
 
-                // Validate alias name
-                if (!isValidAliasName(aliasName)) {
-                    std::cerr << "Error: Invalid alias name: " << aliasName << "\n";
-                    std::cerr << "       Alias names must be alphanumeric with underscores only,\n";
-                    std::cerr << "       and must not conflict with instruction mnemonics.\n";
-                    continue;
-                }
+    void getInputs() override {
+        std::cout << "Synthetic program length in lines [50000]: ";
+        std::string input;
+        std::getline(std::cin, input);
+        if (!input.empty()) lineCount = std::max(1, std::atoi(input.c_str()));
+    }
 
-                // Add or update alias (subsequent calls overwrite)
-                bool found = false;
-                for (auto& alias : aliasTable) {
-                    if (alias.alias == aliasName) {
-                        alias.registerName = regName;
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    aliasTable.push_back({aliasName, regName});
-                }
-                // Don't increment PC for #ALIAS directives
-            }
-            else if (isLabel(trimmed)) {
-                std::string labelName = parseLabel(trimmed);
-                symbolTable.push_back({labelName, (uint8_t)pc});
-            } else {
-                // Regular instruction, increment PC
-                pc++;
-            }
+    void execute(RomFormat) override {
+        const auto& samples = sampleLines();
+        std::vector<std::string> lines, mnemonics;
+        std::string source;
+        lines.reserve(lineCount);
+        mnemonics.reserve(lineCount);
+        for (int i = 0; i < lineCount; i++) {
+            lines.push_back(samples[i % samples.size()]);
+            source += lines.back();
+            source += '\n';
+            std::string mnemonic = lines.back().substr(0, lines.back().find(' '));
+            for (char& c : mnemonic) c = (char)std::toupper((unsigned char)c);
+            mnemonics.push_back(mnemonic);
+        }
+
+        Assembler assembler;
+        assembler.setSymbols({{"fib_loop", 10}, {"fib_done", 18}});
+
+        // Program-sized source for the library call: one pass over the samples with its labels defined
+        std::string program = "fib_loop:\n";
+        for (const auto& sample : samples) program += sample + "\n";
+        program += "fib_done:\nEXIT\n";
+
+        // Best of three runs per mode
+        double linearRate = 0, indexedRate = 0, parseRate = 0, lexerRate = 0, callMicros = 0;
+        size_t programInstructions = 0;
+        uint64_t linearSum = 0, indexedSum = 0, lexerAllocations = 0;
+        for (int run = 0; run < 3; run++) {
+            uint64_t sum = 0;
+            linearRate = std::max(linearRate, timeLookups(mnemonics, linearLookup, sum));
+            linearSum = sum;
+
+            sum = 0;
+            indexedRate = std::max(indexedRate, timeLookups(mnemonics, indexedLookup, sum));
+            indexedSum = sum;
+
+            sum = 0;
+            parseRate = std::max(parseRate, timeParse(assembler, lines, sum));
+            checksumSink = sum;
+
+            lexerRate = std::max(lexerRate, timeLexAndParse(assembler, source, lexerAllocations));
+
+            double micros = timeLibraryCall(program, programInstructions);
+            callMicros = (run == 0) ? micros : std::min(callMicros, micros);
+        }
+
+        std::cout << "\nAssembled " << lineCount << " lines (best of 3)\n";
+        std::cout << "  Linear scan lookups: " << (uint64_t)linearRate << " mnemonics/sec\n";
+        std::cout << "  Indexed lookups:     " << (uint64_t)indexedRate << " mnemonics/sec\n";
+        std::cout << "  Speedup:             " << std::fixed << std::setprecision(2) << indexedRate / linearRate << "x\n";
+        std::cout << "  Parse:               " << (uint64_t)parseRate << " lines/sec\n";
+        std::cout << "  Lexer + parse:       " << (uint64_t)lexerRate << " lines/sec";
+#ifdef GCT_COUNT_ALLOCATIONS
+        std::cout << ", " << lexerAllocations << " allocations (" << std::setprecision(4)
+                  << (double)lexerAllocations / lineCount << " per line)";
+#else
+        std::cout << " (build with -DGCT_COUNT_ALLOCATIONS to count allocations)";
+#endif
+        std::cout << "\n";
+        std::cout << "  assemble() call:     " << std::setprecision(2) << callMicros << " us for "
+                  << programInstructions << " instructions\n";
+        if (linearSum != indexedSum) {
+            std::cerr << "Error: Indexed and linear lookups gave different results\n";
         }
+    }
+};
 
-        // Pass 2: Generate instructions
-        input.clear();
-        input.seekg(0);
-        inMultiline = false;
-        std::vector<uint32_t> instructions;
-
-        while (std::getline(input, line) && instructions.size() < 256) {
-            stripComments(line, inMultiline);
-
-            bool error = false;
-            // Pass current instruction number for LR pseudo-instruction
-            uint32_t instr = parseInstruction(line, error, instructions.size());
-
-            if (error) {
-                std::cerr << "Warning: Failed to parse line: " << line << "\n";
-                continue;
-            }
+// Emulator Benchmark Tool
+class EmulatorBenchmarkTool : public AutoRegisterTool<EmulatorBenchmarkTool> {
+private:
+    std::vector<std::string> programs = {"scripts/FIBONACCI.s", "scripts/FOR_LOOP.s"};
+    uint64_t instructionCount = 20000000;
+
+    // Run the program from reset until instructionCount instructions have executed, returns MIPS;
+    // machine receives the state of the last run
+    double timeRuns(Emulator& emulator, Emulator::Machine& machine, uint64_t& perRun) {
+        uint64_t executed = 0;
+        auto start = std::chrono::steady_clock::now();
+        do {
+            machine = Emulator::Machine();
+            emulator.run(machine, Emulator::ROM_SIZE * 65536);
+            perRun = emulator.getStats().steps;
+            executed += perRun;
+        } while (perRun > 0 && executed < instructionCount);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return executed / elapsed.count() / 1e6;
+    }
 
-            size_t start = line.find_first_not_of(" \t");
-            if (start != std::string::npos) {
-                std::string trimmed = line.substr(start);
-                // Skip labels and preprocessor directives (like #ALIAS)
-                if (!trimmed.empty() && !isLabel(trimmed) && trimmed[0] != '#') {
-                    instructions.push_back(instr);
-                }
-            }
-        }
-        input.close();
+    static bool sameState(const Emulator::Machine& first, const Emulator::Machine& second) {
+        return first.pc == second.pc && first.cpu.n == second.cpu.n && first.cpu.z == second.cpu.z &&
+               first.cpu.c == second.cpu.c && first.cpu.v == second.cpu.v &&
+               std::equal(first.cpu.regs, first.cpu.regs + 8, second.cpu.regs) &&
+               std::equal(first.memory, first.memory + Emulator::MEMORY_SIZE, second.memory) &&
+               std::equal(first.screen, first.screen + Emulator::SCREEN_SIZE, second.screen);
+    }
 
-        // Prepare ALPHA and BETA data arrays (256 entries, padded with zeros)
-        std::vector<uint16_t> alphaData(256, 0);
-        std::vector<uint16_t> betaData(256, 0);
+public:
+    EmulatorBenchmarkTool() : AutoRegisterTool("Emulator Benchmark", "Measure emulator throughput (MIPS)") {}
 
-        for (size_t i = 0; i < instructions.size(); i++) {
-            alphaData[i] = (instructions[i] >> 16) & 0xFFFF;
-            betaData[i] = instructions[i] & 0xFFFF;
-        }
+    bool hasInputs() const override { return true; }
 
-        // Write traditional .out ROM files (only if outputBase is not empty)
-        if (!outputBase.empty()) {
-            RomWriter alphaWriter(outputBase + "_ALPHA.out", outputFormat);
-            RomWriter betaWriter(outputBase + "_BETA.out", outputFormat);
+    void getInputs() override {
+        std::cout << "Programs to run [scripts/FIBONACCI.s scripts/FOR_LOOP.s]: ";
+        std::string input;
+        std::getline(std::cin, input);
+        std::istringstream paths(input);
+        std::vector<std::string> given;
+        for (std::string path; paths >> path;) given.push_back(path);
+        if (!given.empty()) programs = given;
+
+        std::cout << "Instructions per measurement [20000000]: ";
+        std::getline(std::cin, input);
+        if (!input.empty()) instructionCount = std::max(1LL, std::atoll(input.c_str()));
+    }
 
-            for (size_t i = 0; i < 256; i++) {
-                alphaWriter.set(i, alphaData[i]);
-                betaWriter.set(i, betaData[i]);
+    void execute(RomFormat) override {
+        for (const auto& path : programs) {
+            std::ostringstream log;
+            AssemblerTool assembler(path, "", log);
+            if (!assembler.assemble(ROM_HEX)) {
+                std::cerr << log.str() << "Error: Cannot assemble '" << path << "'\n";
+                continue;
+            }
+            Emulator emulator;
+            emulator.load(assembler.getInstructions());
+
+            // Best of three runs per mode
+            double decodingRate = 0, predecodedRate = 0, jitRate = 0;
+            uint64_t perRun = 0;
+            Emulator::Machine decoded, predecoded, translated;
+            bool hasJit = false;
+            for (int run = 0; run < 3; run++) {
+                emulator.setPredecoded(false);
+                decodingRate = std::max(decodingRate, timeRuns(emulator, decoded, perRun));
+                emulator.setPredecoded(true);
+                predecodedRate = std::max(predecodedRate, timeRuns(emulator, predecoded, perRun));
+                hasJit = emulator.setJit(true);
+                if (hasJit) jitRate = std::max(jitRate, timeRuns(emulator, translated, perRun));
+                emulator.setJit(false);
             }
 
-            bool success = true;
-            success &= alphaWriter.writeToFile();
-            success &= betaWriter.writeToFile();
-
-            if (success) {
-                std::cout << "\nCompiled " << instructions.size() << " instructions\n";
-                std::cout << "Generated ALPHA ROM: " << outputBase << "_ALPHA.out\n";
-                std::cout << "Generated BETA ROM:  " << outputBase << "_BETA.out\n";
+            std::cout << "\nEmulated " << path << ": " << perRun << " instructions per run, "
+                      << std::max(instructionCount, perRun) << " per measurement (best of 3)\n";
+            std::cout << "  Decoding every step: " << std::fixed << std::setprecision(1) << decodingRate << " MIPS\n";
+            std::cout << "  Predecoded:          " << predecodedRate << " MIPS\n";
+            if (hasJit) std::cout << "  JIT:                 " << jitRate << " MIPS\n";
+            std::cout << "  Speedup:             " << std::setprecision(2) << predecodedRate / decodingRate << "x";
+            if (hasJit) std::cout << " predecoded, " << jitRate / decodingRate << "x JIT";
+            std::cout << "\n" << std::defaultfloat;
+            if (!sameState(decoded, predecoded) || (hasJit && !sameState(decoded, translated))) {
+                std::cerr << "Error: Runs of '" << path << "' ended in different states\n";
             }
-        } else {
-            std::cout << "\nCompiled " << instructions.size() << " instructions\n";
-            std::cout << "Skipping .out file generation (no output base name provided)\n";
         }
-
-        // Update Digital Logic Sim JSON file
-        std::cout << "\nUpdating Digital Logic Sim project...\n";
-        updateDigitalLogicSimRom(alphaData, betaData);
     }
 };
 
 // Opcode Flags ROM Tool
 class OpcodeFlagsRomTool : public AutoRegisterTool<OpcodeFlagsRomTool> {
 private:
-    IsaSpec::ISA_SPEC isaSpec;
+    const IsaSpec::ISA_SPEC& isaSpec = IsaSpec::sharedISASpec();
 
 public:
-    OpcodeFlagsRomTool() : AutoRegisterTool("Opcode Flags ROM", "Generate opcode flags for instruction decoding") {
-        isaSpec = IsaSpec::generateISASpec();
-    }
+    OpcodeFlagsRomTool() : AutoRegisterTool("Opcode Flags ROM", "Generate opcode flags for instruction decoding") {}
 
     #define FLAG_VALID          (1 << 0)  // Bit 0: Valid instruction
     #define FLAG_TYPE_ALU       (0 << 1)  // Bits 1-4: Instruction type
@@ -1129,12 +1075,10 @@ public:
 // Instruction Type Display ROM Tool
 class InstructionTypeDisplayRomTool : public AutoRegisterTool<InstructionTypeDisplayRomTool> {
 private:
-    IsaSpec::ISA_SPEC isaSpec;
+    const IsaSpec::ISA_SPEC& isaSpec = IsaSpec::sharedISASpec();
 
 public:
-    InstructionTypeDisplayRomTool() : AutoRegisterTool("Instruction Type Display ROM", "Generate instruction type name lookup table") {
-        isaSpec = IsaSpec::generateISASpec();
-    }
+    InstructionTypeDisplayRomTool() : AutoRegisterTool("Instruction Type Display ROM", "Generate instruction type name lookup table") {}
 
     void execute(RomFormat outputFormat) override {
         RomWriter writerCharlie("rom_out/INSTRUCTION_TYPE_DISPLAY_CHARLIE.out", outputFormat);
@@ -1311,12 +1255,14 @@ private:
 public:
     AsciiFontRomTool() : AutoRegisterTool("ASCII Font ROM", "Generate font ROMs from 8x8 BMP atlas") {}
 
+    bool hasInputs() const override { return true; }
+
     void getInputs() override {
         std::cout << "BMP font file: ";
         std::getline(std::cin, bmpFile);
     }
 
-    void execute(RomFormat outputFormat) override {
+    void execute(RomFormat) override {
         std::cout << "\n[TODO: Implement ASCII font ROM generator]\n";
         std::cout << "Would process: " << bmpFile << "\n";
         std::cout << "Would generate: ROM_ALPHA/BRAVO/CHARLIE/DELTA\n";
@@ -1377,18 +1323,16 @@ public:
 // ISA Documentation Generator Tool
 class IsaDocGeneratorTool : public AutoRegisterTool<IsaDocGeneratorTool> {
 private:
-    IsaSpec::ISA_SPEC isaSpec;
+    const IsaSpec::ISA_SPEC& isaSpec = IsaSpec::sharedISASpec();
 
 public:
-    IsaDocGeneratorTool() : AutoRegisterTool("ISA Documentation Generator", "Update isa.md from IsaSpec.hpp") {
-        isaSpec = IsaSpec::generateISASpec();
-    }
+    IsaDocGeneratorTool() : AutoRegisterTool("ISA Documentation Generator", "Update isa.md from IsaSpec.hpp") {}
 
     void getInputs() override {
         // No inputs needed
     }
 
-    void execute(RomFormat outputFormat) override {
+    void execute(RomFormat) override {
         std::cout << "\n--- ISA Documentation Generator ---\n";
         std::cout << "Generating isa.md from IsaSpec.hpp...\n\n";
 
@@ -1716,6 +1660,8 @@ void registerAllTools() {
     REGISTER_TOOL(AsciiFontRomTool);
     REGISTER_TOOL(Fp16DigitMasksRomTool);
     REGISTER_TOOL(IsaDocGeneratorTool);
+    REGISTER_TOOL(AssemblerBenchmarkTool);
+    REGISTER_TOOL(EmulatorBenchmarkTool);
     // Add new tools here with: REGISTER_TOOL(YourNewTool);
 }
 
@@ -1895,9 +1841,1579 @@ public:
     }
 };
 
-// ISA Documentation Generator Tool
+// ============================================
+// HEADLESS COMMANDS
+// ============================================
+
+// Parse a -f format name, false if unknown
+bool parseRomFormat(const std::string& name, RomFormat& format) {
+    if (name == "hex") format = ROM_HEX;
+    else if (name == "uint") format = ROM_UINT;
+    else if (name == "int") format = ROM_INT;
+    else if (name == "binary") format = ROM_BINARY;
+    else return false;
+    return true;
+}
+
+const char* romFormatName(RomFormat format) {
+    switch (format) {
+        case ROM_HEX: return "hex";
+        case ROM_UINT: return "uint";
+        case ROM_INT: return "int";
+        case ROM_BINARY: return "binary";
+        default: return "hex";
+    }
+}
+
+// Send one request to a running gct daemon and wait for its response, false if unreachable
+bool daemonRequest(const std::string& socketPath, const JsonValue& request, JsonValue& response) {
+    LocalSocket socket;
+    std::string line;
+    if (!socket.connect(socketPath) || !socket.sendLine(request.dump()) || !socket.readLine(line)) return false;
+    return JsonValue::parse(line, response);
+}
+
+// Batch Assembler - "gct asm": assemble many sources concurrently, one AssemblerTool per source
+class BatchAssembler {
+private:
+    RomFormat outputFormat = ROM_HEX;
+    std::string outputDir = "rom_out";
+    size_t jobs = 0;
+    bool updateSimulator = false;
+    bool verbose = false;
+    bool objectOutput = false;
+    int optimizeLevel = 0;
+    std::string cfgFormat;
+    std::string profilePath;
+    std::string rewritesPath;
+    size_t unrollBudget = LoopUnroller::DEFAULT_BUDGET;
+    std::string cacheDir = ".gct_cache";
+    bool useDaemon = false;
+    std::string socketPath = LocalSocket::defaultPath();
+    std::vector<std::string> sources;
+
+    struct Result {
+        bool success = false;
+        bool cached = false;
+        bool upToDate = false;
+        size_t instructionCount = 0;
+        std::string log;
+    };
+
+    // Match '*' and '?' wildcards against a file name
+    static bool wildcardMatch(const char* pattern, const char* text) {
+        if (*pattern == '\0') return *text == '\0';
+        if (*pattern == '*') {
+            for (const char* t = text; ; t++) {
+                if (wildcardMatch(pattern + 1, t)) return true;
+                if (*t == '\0') return false;
+            }
+        }
+        if (*text == '\0') return false;
+        return (*pattern == '?' || *pattern == *text) && wildcardMatch(pattern + 1, text + 1);
+    }
+
+    // Add a source path, a glob (wildcards in the file name only) or an @list file
+    bool addSources(const std::string& arg) {
+        if (!arg.empty() && arg[0] == '@') {
+            std::ifstream list(arg.substr(1));
+            if (!list.is_open()) {
+                std::cerr << "Error: Could not open source list '" << arg.substr(1) << "'\n";
+                return false;
+            }
+            std::string entry;
+            while (std::getline(list, entry)) {
+                size_t start = entry.find_first_not_of(" \t\r");
+                size_t end = entry.find_last_not_of(" \t\r");
+                if (start == std::string::npos || entry[start] == '#') continue;
+                if (!addSources(entry.substr(start, end - start + 1))) return false;
+            }
+            return true;
+        }
+
+        if (arg.find_first_of("*?") == std::string::npos) {
+            sources.push_back(arg);
+            return true;
+        }
+
+        size_t slash = arg.find_last_of("/\\");
+        std::string dir = (slash == std::string::npos) ? "." : arg.substr(0, slash);
+        std::string pattern = (slash == std::string::npos) ? arg : arg.substr(slash + 1);
+        if (dir.find_first_of("*?") != std::string::npos) {
+            std::cerr << "Error: Wildcards are only supported in the file name: " << arg << "\n";
+            return false;
+        }
+
+        std::error_code ec;
+        std::vector<std::string> matches;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (entry.is_regular_file() && wildcardMatch(pattern.c_str(), name.c_str())) {
+                matches.push_back(slash == std::string::npos ? name : dir + arg[slash] + name);
+            }
+        }
+        if (ec) {
+            std::cerr << "Error: Could not read directory '" << dir << "'\n";
+            return false;
+        }
+        if (matches.empty()) {
+            std::cerr << "Warning: No sources match '" << arg << "'\n";
+        }
+        std::sort(matches.begin(), matches.end());
+        sources.insert(sources.end(), matches.begin(), matches.end());
+        return true;
+    }
+
+    void printUsage() {
+        std::cout << "Usage: gct asm [options] <source.s | glob | @list> ...\n";
+        std::cout << "  -f <FORMAT>  Output format: hex, uint, int, binary (default: hex)\n";
+        std::cout << "  -o <DIR>     Output directory for <name>_ALPHA/BETA.out (default: rom_out)\n";
+        std::cout << "  -j <N>       Worker threads (default: one per hardware thread)\n";
+        std::cout << "  -v           Print every source's assembler messages\n";
+        std::cout << "  -c           Write relocatable <name>.gobj objects for gct link instead of ROMs;\n";
+        std::cout << "               objects newer than their source and built with the same options\n";
+        std::cout << "               are not reassembled\n";
+        std::cout << "  -O1          Propagate constants, thread jumps, remove unreachable code, unroll counted loops,\n";
+        std::cout << "               reduce constant multiplies, run the peephole optimizer, and outline repeated code into\n";
+        std::cout << "               subroutines if the program would not fit the ROM (-O0: none, the default)\n";
+        std::cout << "  -Os          -O1 without loop unrolling, always outlining repeated code\n";
+        std::cout << "  --unroll-budget <N> Instructions loop unrolling may add at -O1 (default: "
+                  << LoopUnroller::DEFAULT_BUDGET << ", 0: none); ROM output stays within 256\n";
+        std::cout << "  --profile <FILE> With -O1/-Os, reorder basic blocks so the hot edges of an execution profile\n";
+        std::cout << "               (GCT-PROFILE edge counts or a trace of program counters) fall through\n";
+        std::cout << "  --rewrites <FILE> With -O1/-Os, also replace sequences listed in a rewrite database from gct superopt\n";
+        std::cout << "  --cfg <FORMAT> Also write the control-flow graph as <name>.cfg.dot or .cfg.json (dot, json)\n";
+        std::cout << "  --cache <DIR> Assembly cache directory (default: .gct_cache)\n";
+        std::cout << "  --no-cache   Always reassemble\n";
+        std::cout << "  --sim        Also update the Digital Logic Sim project (a single source only)\n";
+        std::cout << "  --daemon     Send sources to a running gct daemon (falls back to local assembly)\n";
+        std::cout << "  --socket <PATH> Daemon socket (default: " << LocalSocket::defaultPath() << ")\n";
+    }
+
+    // Assemble one source in the daemon; paths are made absolute since the daemon has its own working directory
+    void assembleRemote(const std::string& source, const std::string& outputBase, Result& result) {
+        std::error_code ec;
+        JsonValue request = JsonValue::object()
+            .set("command", "asm")
+            .set("source", std::filesystem::absolute(source, ec).string())
+            .set("output", outputBase.empty() ? std::string() : std::filesystem::absolute(outputBase, ec).string())
+            .set("format", romFormatName(outputFormat))
+            .set("sim", updateSimulator)
+            .set("object", objectOutput)
+            .set("optimize", optimizeLevel)
+            .set("cfg", cfgFormat)
+            .set("profile", profilePath.empty() ? std::string() : std::filesystem::absolute(profilePath, ec).string())
+            .set("rewrites", rewritesPath.empty() ? std::string() : std::filesystem::absolute(rewritesPath, ec).string())
+            .set("unroll_budget", unrollBudget);
+        JsonValue response;
+        if (!daemonRequest(socketPath, request, response)) {
+            result.log = "Error: Lost connection to gct daemon at " + socketPath + "\n";
+            return;
+        }
+        result.success = response["ok"].asBool();
+        result.cached = response["cached"].asBool();
+        result.instructionCount = (size_t)response["instructions"].asInt();
+        result.log = response["log"].asString();
+    }
+
+public:
+    int run(const std::vector<std::string>& args) {
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "-f" && hasValue) {
+                if (!parseRomFormat(args[++i], outputFormat)) {
+                    std::cerr << "Error: Unknown output format '" << args[i] << "'\n";
+                    return 1;
+                }
+            } else if (arg == "-o" && hasValue) {
+                outputDir = args[++i];
+            } else if (arg == "-j" && hasValue) {
+                jobs = std::max(1, std::atoi(args[++i].c_str()));
+            } else if (arg == "-v") {
+                verbose = true;
+            } else if (arg == "-c") {
+                objectOutput = true;
+            } else if (arg == "-O0" || arg == "-O1") {
+                optimizeLevel = arg[2] - '0';
+            } else if (arg == "-Os") {
+                optimizeLevel = 2;
+            } else if (arg == "--cfg" && hasValue) {
+                cfgFormat = args[++i];
+                if (cfgFormat != "dot" && cfgFormat != "json") {
+                    std::cerr << "Error: Unknown control-flow graph format '" << cfgFormat << "'\n";
+                    return 1;
+                }
+            } else if (arg == "--profile" && hasValue) {
+                profilePath = args[++i];
+            } else if (arg == "--rewrites" && hasValue) {
+                rewritesPath = args[++i];
+            } else if (arg == "--unroll-budget" && hasValue) {
+                unrollBudget = (size_t)std::clamp(std::atoi(args[++i].c_str()), 0, 65535);
+            } else if (arg == "--cache" && hasValue) {
+                cacheDir = args[++i];
+            } else if (arg == "--no-cache") {
+                cacheDir.clear();
+            } else if (arg == "--sim") {
+                updateSimulator = true;
+            } else if (arg == "--daemon") {
+                useDaemon = true;
+            } else if (arg == "--socket" && hasValue) {
+                socketPath = args[++i];
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                std::cerr << "Error: Unknown option '" << arg << "'\n";
+                printUsage();
+                return 1;
+            } else if (!addSources(arg)) {
+                return 1;
+            }
+        }
+
+        if (sources.empty()) {
+            printUsage();
+            return 1;
+        }
+        // Every source writes <output dir>/<stem>_*, so two sources with one stem would overwrite each other
+        if (!outputDir.empty()) {
+            std::map<std::string, std::string> stems;
+            bool duplicates = false;
+            for (const std::string& source : sources) {
+                auto [it, added] = stems.emplace(std::filesystem::path(source).stem().string(), source);
+                if (!added) {
+                    std::cerr << "Error: '" << source << "' and '" << it->second << "' would both write '"
+                              << outputDir << "/" << it->first << "'\n";
+                    duplicates = true;
+                }
+            }
+            if (duplicates) return 1;
+        }
+        // There is one Digital Logic Sim project, so with several sources the last one assembled would win
+        if (updateSimulator && !objectOutput && sources.size() > 1) {
+            std::cerr << "Error: --sim updates the Digital Logic Sim project from a single source, " << sources.size()
+                      << " given\n";
+            return 1;
+        }
+        if (!profilePath.empty() && (optimizeLevel == 0 || objectOutput)) {
+            std::cerr << "Warning: --profile lays out ROM output at -O1 or -Os, ignored here\n";
+        }
+        if (!rewritesPath.empty() && optimizeLevel == 0) {
+            std::cerr << "Warning: --rewrites applies at -O1 or -Os, ignored here\n";
+        }
+
+        JsonValue pong;
+        bool remote = useDaemon && daemonRequest(socketPath, JsonValue::object().set("command", "ping"), pong);
+        if (useDaemon && !remote) {
+            std::cerr << "Warning: No gct daemon at " << socketPath << ", assembling locally\n";
+        }
+
+        std::unique_ptr<AssemblyCache> cache;
+        if (!cacheDir.empty() && !objectOutput && !remote) cache = std::make_unique<AssemblyCache>(cacheDir);
+        bool reuseObjects = objectOutput && !cacheDir.empty();
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Result> results(sources.size());
+        {
+            ThreadPool pool(std::min(jobs ? jobs : std::thread::hardware_concurrency(), sources.size()));
+            for (size_t i = 0; i < sources.size(); i++) {
+                pool.submit([this, i, &results, &cache, reuseObjects, remote] {
+                    std::string stem = std::filesystem::path(sources[i]).stem().string();
+                    std::string outputBase = outputDir.empty() ? "" : outputDir + "/" + stem;
+
+                    std::ostringstream log;
+                    AssemblerTool assembler(sources[i], outputBase, log);
+                    assembler.setUpdateSimulator(updateSimulator && !objectOutput);
+                    assembler.setObjectOutput(objectOutput);
+                    assembler.setOptimizeLevel(optimizeLevel);
+                    assembler.setCfgFormat(cfgFormat);
+                    assembler.setProfile(profilePath);
+                    assembler.setRewrites(rewritesPath);
+                    assembler.setUnrollBudget(unrollBudget);
+                    assembler.setCache(cache.get());
+
+                    // Skip modules whose object is newer than the source and was built with these options
+                    if (reuseObjects && !outputBase.empty()) {
+                        std::error_code ec;
+                        auto objectTime = std::filesystem::last_write_time(outputBase + ".gobj", ec);
+                        if (!ec && objectTime >= std::filesystem::last_write_time(sources[i], ec) && !ec &&
+                            assembler.isObjectUpToDate()) {
+                            results[i].success = true;
+                            results[i].upToDate = true;
+                            return;
+                        }
+                    }
+
+                    if (remote) {
+                        assembleRemote(sources[i], outputBase, results[i]);
+                        return;
+                    }
+
+                    results[i].success = assembler.assemble(outputFormat);
+                    results[i].cached = assembler.wasCacheHit();
+                    results[i].instructionCount = assembler.getInstructionCount();
+                    results[i].log = log.str();
+                });
+            }
+            pool.wait();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        size_t failures = 0;
+        for (size_t i = 0; i < sources.size(); i++) {
+            const Result& result = results[i];
+            if (!result.success) failures++;
+            std::cout << (result.success ? "OK    " : "FAIL  ") << sources[i];
+            if (result.upToDate) std::cout << " (up to date)\n";
+            else std::cout << " (" << result.instructionCount << " instructions" << (result.cached ? ", cached" : "") << ")\n";
+            if (verbose || !result.success) std::cout << result.log;
+        }
+        std::cout << "\nAssembled " << sources.size() << " sources, " << failures << " failed, in "
+                  << std::fixed << std::setprecision(3) << elapsed.count() << "s\n";
+        if (cache) {
+            std::cout << "Cache: " << cache->getHits() << " hits, " << cache->getMisses() << " misses\n";
+        }
+        if (remote) std::cout << "Assembled by gct daemon at " << socketPath << "\n";
+        return failures ? 1 : 0;
+    }
+};
+
+// Link Command - "gct link": combine .gobj objects into ALPHA/BETA ROMs, dropping unreferenced functions
+class LinkCommand {
+private:
+    RomFormat outputFormat = ROM_HEX;
+    std::string outputBase;
+    bool stripUnused = true;
+    bool printMap = false;
+    bool updateSimulator = false;
+    std::vector<std::string> objects;
+
+    void printUsage() {
+        std::cout << "Usage: gct link [options] <object.gobj> ...\n";
+        std::cout << "  The first object holds the entry point and is placed at address 0.\n";
+        std::cout << "  -f <FORMAT>    Output format: hex, uint, int, binary (default: hex)\n";
+        std::cout << "  -o <BASE>      Output base for <BASE>_ALPHA/BETA.out (default: rom_out/<first object>)\n";
+        std::cout << "  --keep-unused  Keep functions that nothing references\n";
+        std::cout << "  --map          Print the address of every function\n";
+        std::cout << "  --sim          Also update the Digital Logic Sim project\n";
+    }
+
+public:
+    int run(const std::vector<std::string>& args) {
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "-f" && hasValue) {
+                if (!parseRomFormat(args[++i], outputFormat)) {
+                    std::cerr << "Error: Unknown output format '" << args[i] << "'\n";
+                    return 1;
+                }
+            } else if (arg == "-o" && hasValue) {
+                outputBase = args[++i];
+            } else if (arg == "--keep-unused") {
+                stripUnused = false;
+            } else if (arg == "--map") {
+                printMap = true;
+            } else if (arg == "--sim") {
+                updateSimulator = true;
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                std::cerr << "Error: Unknown option '" << arg << "'\n";
+                printUsage();
+                return 1;
+            } else {
+                objects.push_back(arg);
+            }
+        }
+
+        if (objects.empty()) {
+            printUsage();
+            return 1;
+        }
+        if (outputBase.empty()) {
+            outputBase = "rom_out/" + std::filesystem::path(objects[0]).stem().string();
+        }
+
+        std::vector<ObjectModule> modules(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            if (!modules[i].readFromFile(objects[i])) return 1;
+        }
+
+        Linker linker;
+        linker.setStripUnused(stripUnused);
+        std::vector<uint32_t> image;
+        if (!linker.link(modules, image, std::cerr)) return 1;
+
+        size_t stripped = 0;
+        size_t strippedInstructions = 0;
+        for (const auto& fn : linker.getFunctions()) {
+            if (!fn.live) {
+                stripped++;
+                strippedInstructions += fn.end - fn.start;
+            }
+            if (printMap) {
+                if (fn.live) std::cout << "  " << std::setw(3) << fn.address;
+                else std::cout << "    -";
+                std::cout << "  " << std::setw(3) << (fn.end - fn.start) << "  " << fn.name
+                          << " (" << modules[fn.module].source << ")\n";
+            }
+        }
+
+        std::vector<uint16_t> alphaData(256, 0);
+        std::vector<uint16_t> betaData(256, 0);
+        for (size_t i = 0; i < image.size(); i++) {
+            alphaData[i] = (image[i] >> 16) & 0xFFFF;
+            betaData[i] = image[i] & 0xFFFF;
+        }
+
+        RomWriter alphaWriter(outputBase + "_ALPHA.out", outputFormat);
+        RomWriter betaWriter(outputBase + "_BETA.out", outputFormat);
+        for (size_t i = 0; i < 256; i++) {
+            alphaWriter.set(i, alphaData[i]);
+            betaWriter.set(i, betaData[i]);
+        }
+        bool success = alphaWriter.writeToFile() && betaWriter.writeToFile();
+
+        std::cout << "\nLinked " << modules.size() << " objects into " << image.size() << " instructions";
+        std::cout << " (stripped " << stripped << " unused functions, " << strippedInstructions << " instructions)\n";
+        if (success) {
+            std::cout << "Generated ALPHA ROM: " << outputBase << "_ALPHA.out\n";
+            std::cout << "Generated BETA ROM:  " << outputBase << "_BETA.out\n";
+        }
+
+        if (updateSimulator) {
+            std::cout << "\nUpdating Digital Logic Sim project...\n";
+            DigitalLogicSimHelper simHelper("16-CPU");
+            success &= simHelper.updateMultipleSubchips({
+                {"Machine Code ALPHA", alphaData},
+                {"Machine Code BETA", betaData}
+            });
+        }
+        return success ? 0 : 1;
+    }
+};
+
+// Superoptimizer Command - "gct superopt": search the cheapest equivalent of a short instruction sequence,
+// optionally adding it to a rewrite database for gct asm --rewrites
+class SuperoptCommand {
+private:
+    size_t jobs = 0;
+    size_t maxLength = 4;
+    int scratchRegisters = 1;
+    std::string databasePath;
+    std::string sequence;
+
+    void printUsage() {
+        std::cout << "Usage: gct superopt [options] <\"INSTR; INSTR; ...\" | file.s>\n";
+        std::cout << "  The sequence must be straight-line ALU ops, MOV and CMP.\n";
+        std::cout << "  -j <N>            Worker threads (default: one per hardware thread)\n";
+        std::cout << "  --max-length <N>  Longest replacement to search, 1-6 (default: 4)\n";
+        std::cout << "  --scratch <N>     Extra registers a replacement may clobber, 0-3 (default: 1)\n";
+        std::cout << "  --db <FILE>       Add what is found to this rewrite database (created if missing)\n";
+    }
+
+public:
+    int run(const std::vector<std::string>& args) {
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "-j" && hasValue) {
+                jobs = std::max(1, std::atoi(args[++i].c_str()));
+            } else if (arg == "--max-length" && hasValue) {
+                maxLength = (size_t)std::clamp(std::atoi(args[++i].c_str()), 1, 6);
+            } else if (arg == "--scratch" && hasValue) {
+                scratchRegisters = std::clamp(std::atoi(args[++i].c_str()), 0, 3);
+            } else if (arg == "--db" && hasValue) {
+                databasePath = args[++i];
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                std::cerr << "Error: Unknown option '" << arg << "'\n";
+                printUsage();
+                return 1;
+            } else if (sequence.empty()) {
+                sequence = arg;
+            } else {
+                std::cerr << "Error: More than one sequence given\n";
+                return 1;
+            }
+        }
+
+        if (sequence.empty()) {
+            printUsage();
+            return 1;
+        }
+
+        // A source file, or instructions separated by ';'
+        std::string source;
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(sequence, ec)) {
+            MappedFile input(sequence);
+            if (!input.isOpen()) {
+                std::cerr << "Error: Could not open file '" << sequence << "'\n";
+                return 1;
+            }
+            source = std::string(input.view());
+        } else {
+            source = sequence;
+            std::replace(source.begin(), source.end(), ';', '\n');
+        }
+
+        const IsaSpec::ISA_SPEC& isaSpec = IsaSpec::sharedISASpec();
+        AssemblyResult result = Assembler(isaSpec).assemble(source);
+        for (const auto& diagnostic : result.diagnostics) {
+            std::cerr << (diagnostic.severity == AsmDiagnostic::SEVERITY_ERROR ? "Error: " : "Warning: ")
+                      << diagnostic.message << "\n";
+        }
+        if (!result.ok()) return 1;
+
+        Superoptimizer superoptimizer(isaSpec);
+        superoptimizer.setMaxLength(maxLength);
+        superoptimizer.setScratchRegisters(scratchRegisters);
+        superoptimizer.setThreads(jobs);
+        std::vector<RewriteDatabase::Rewrite> found;
+        auto start = std::chrono::steady_clock::now();
+        if (!superoptimizer.search(result.instructions, found, std::cerr)) return 1;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        int variables[8], registers = 0;
+        std::vector<uint32_t> pattern = RewriteDatabase::canonicalize(isaSpec, result.instructions, variables, registers);
+        const Superoptimizer::Stats& stats = superoptimizer.getStats();
+        std::cout << "Target:   " << RewriteDatabase::assembly(isaSpec, pattern) << " ("
+                  << pattern.size() << " instructions, " << RewriteDatabase::cycles(isaSpec, pattern) << " cycles)\n";
+        std::cout << "Searched " << stats.sequences << " sequences of up to " << maxLength << " instructions from "
+                  << stats.candidates << " candidates, " << stats.verified << " verified, in "
+                  << std::fixed << std::setprecision(3) << elapsed.count() << "s\n";
+        if (found.empty()) {
+            std::cout << "No cheaper sequence found\n";
+            return 0;
+        }
+        for (const auto& rewrite : found) {
+            std::cout << "Found:    " << RewriteDatabase::assembly(isaSpec, rewrite.replacement) << " ("
+                      << rewrite.replacement.size() << " instructions, " << RewriteDatabase::cycles(isaSpec, rewrite.replacement)
+                      << " cycles; " << (rewrite.flags == RewriteDatabase::FLAGS_NZ ? "N and Z kept" : "flags changed") << ", "
+                      << (rewrite.exhaustive ? "verified exhaustively" : "verified on random states") << ")\n";
+        }
+        if (registers < 8 && scratchRegisters > 0) {
+            std::cout << "          (X" << registers << " and up are scratch registers)\n";
+        }
+
+        if (databasePath.empty()) return 0;
+        RewriteDatabase database;
+        if (std::filesystem::exists(databasePath, ec) && !database.readFromFile(databasePath, isaSpec)) return 1;
+        for (const auto& rewrite : found) database.add(isaSpec, rewrite);
+        if (!database.writeToFile(databasePath, isaSpec)) return 1;
+        std::cout << "Rewrite database " << databasePath << ": " << database.rewrites.size() << " rewrites\n";
+        return 0;
+    }
+};
+
+// Run Command - "gct run": execute a program on the emulator, assembling it first if it is a source
+class RunCommand {
+private:
+    RomFormat inputFormat = ROM_HEX;
+    int optimizeLevel = 0;
+    uint64_t maxSteps = 100000000;
+    std::string profilePath;
+    bool showMemory = false;
+    bool quiet = false;
+    bool useJit = false;
+    int sweepRegister = -1;                           // --sweep: one instance per value of this register
+    uint16_t sweepFirst = 0, sweepLast = 0;
+    std::vector<std::pair<int, uint16_t>> registers;  // Initial values
+    std::vector<std::pair<int, uint16_t>> memory;
+    std::string program;
+
+    void printUsage() {
+        std::cout << "Usage: gct run [options] <source.s | ROM base>\n";
+        std::cout << "  A ROM base names <base>_ALPHA.out and <base>_BETA.out (either file may be given).\n";
+        std::cout << "  -f <FORMAT>      ROM format: hex, uint, int, binary (default: hex)\n";
+        std::cout << "  -O1, -Os         Optimize a source before running it (-O0: as written, the default)\n";
+        std::cout << "  --steps <N>      Stop after N instructions (default: 100000000)\n";
+        std::cout << "  --reg <Xn=V>     Start with register Xn holding V\n";
+        std::cout << "  --mem <A=V>      Start with RAM address A holding V\n";
+        std::cout << "  --profile <FILE> Write the edges taken as a profile for gct asm --profile\n";
+        std::cout << "  --jit            Translate to x86-64 where possible (ignored with --profile)\n";
+        std::cout << "  --sweep <Xn=A..B> Run one instance per value A to B of Xn, in lockstep; a line per instance\n";
+        std::cout << "  --ram            Also print the RAM words that are not zero\n";
+        std::cout << "  -q               Print only how the run ended\n";
+    }
+
+    // "<left>=<value>", left is Xn for a register (0-7) or a RAM address (0-255); numbers as in assembly
+    static bool parseAssignment(const std::string& text, bool isRegister, int& target, uint16_t& value) {
+        size_t equals = text.find('=');
+        if (equals == std::string::npos) return false;
+        std::string left = text.substr(0, equals), right = text.substr(equals + 1);
+        auto number = [](const std::string& word, long limit, long& result) {
+            char* end = nullptr;
+            bool hex = word.size() > 2 && word[0] == '0' && (word[1] == 'x' || word[1] == 'X');
+            result = std::strtol(word.c_str(), &end, hex ? 16 : 10);
+            return !word.empty() && *end == '\0' && result >= (limit == 0xFFFF ? -32768 : 0) && result <= limit;
+        };
+        long reg = 0, number16 = 0;
+        if (isRegister) {
+            if (left.size() != 2 || (left[0] != 'X' && left[0] != 'x') || !number(left.substr(1), 7, reg)) return false;
+        } else if (!number(left, 255, reg)) {
+            return false;
+        }
+        if (!number(right, 0xFFFF, number16)) return false;
+        target = (int)reg;
+        value = (uint16_t)number16;
+        return true;
+    }
+
+    // "Xn=A..B", both ends included and in order
+    bool parseSweep(const std::string& text) {
+        size_t dots = text.find("..");
+        if (dots == std::string::npos) return false;
+        int reg = 0, ignored = 0;
+        uint16_t first = 0, last = 0;
+        if (!parseAssignment(text.substr(0, dots), true, reg, first) ||
+            !parseAssignment("X0=" + text.substr(dots + 2), true, ignored, last) || first > last) {
+            return false;
+        }
+        sweepRegister = reg;
+        sweepFirst = first;
+        sweepLast = last;
+        return true;
+    }
+
+    static std::string statusText(Emulator::Status status, uint16_t pc, const std::vector<uint32_t>& rom) {
+        std::ostringstream text;
+        switch (status) {
+            case Emulator::STATUS_EXITED: text << "Exited at " << pc; break;
+            case Emulator::STATUS_STEP_LIMIT: text << "Stopped at " << pc << " after the step limit"; break;
+            case Emulator::STATUS_OFF_ROM: text << "Error: Program counter left the ROM (" << pc << ")"; break;
+            default:
+                text << "Error: Invalid instruction " << std::hex << std::uppercase << std::setfill('0') << std::setw(8)
+                     << rom[pc] << std::dec << " at " << pc;
+                break;
+        }
+        return text.str();
+    }
+
+    // --sweep: every value of the swept register as one instance of a BatchEmulator
+    int runSweep(const std::vector<uint32_t>& rom, const Emulator::Machine& machine) {
+        BatchEmulator batch;
+        batch.load(rom);
+        size_t instances = (size_t)sweepLast - sweepFirst + 1;
+        batch.reset(instances, machine);
+        for (size_t instance = 0; instance < instances; instance++) {
+            batch.setRegister(instance, sweepRegister, (uint16_t)(sweepFirst + instance));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        batch.run(maxSteps);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        size_t exited = 0;
+        uint64_t steps = 0;
+        Emulator::Machine result;
+        for (size_t instance = 0; instance < instances; instance++) {
+            Emulator::Stats stats;
+            Emulator::Status status = batch.getMachine(instance, result, stats);
+            exited += status == Emulator::STATUS_EXITED;
+            steps += stats.steps;
+            if (quiet) continue;
+            std::cout << "X" << sweepRegister << "=" << std::hex << std::uppercase << std::setfill('0') << std::setw(4)
+                      << sweepFirst + instance << std::dec << std::setfill(' ') << ": " << statusText(status, result.pc, rom)
+                      << ", " << stats.steps << " instructions, " << stats.cycles << " cycles;";
+            for (int reg = 0; reg < 8; reg++) {
+                std::cout << " X" << reg << "=" << std::hex << std::uppercase << std::setfill('0') << std::setw(4)
+                          << result.cpu.regs[reg] << std::dec << std::setfill(' ');
+            }
+            std::cout << " \"" << Emulator::screenText(result) << "\"\n";
+        }
+        const BatchEmulator::Stats& stats = batch.getStats();
+        std::cout << instances << " instances, " << exited << " exited: " << steps << " instructions in " << std::fixed
+                  << std::setprecision(1) << elapsed.count() * 1000 << " ms (" << steps / std::max(elapsed.count(), 1e-9) / 1e6
+                  << " MIPS, " << stats.utilization() * 100 << "% of lanes busy, " << stats.regroups << " regroups)\n"
+                  << std::defaultfloat;
+        return exited == instances ? 0 : 1;
+    }
+
+public:
+    // A source is assembled in memory; otherwise read the ROM pair of its base (either file may be given)
+    static bool loadProgram(const std::string& program, RomFormat format, int optimizeLevel, Emulator& emulator,
+                            std::ostream& log = std::cerr) {
+        std::filesystem::path path(program);
+        if (path.extension() == ".s" || path.extension() == ".asm") {
+            std::ostringstream assemblerLog;
+            AssemblerTool assembler(program, "", assemblerLog);
+            assembler.setOptimizeLevel(optimizeLevel);
+            if (!assembler.assemble(ROM_HEX)) {
+                log << assemblerLog.str();
+                return false;
+            }
+            if (!emulator.load(assembler.getInstructions())) {
+                log << "Error: '" << program << "' does not fit in " << Emulator::ROM_SIZE << " instructions\n";
+                return false;
+            }
+            return true;
+        }
+        std::string base = program;
+        for (const char* suffix : {"_ALPHA.out", "_BETA.out"}) {
+            size_t length = std::strlen(suffix);
+            if (base.size() > length && base.compare(base.size() - length, length, suffix) == 0) base.resize(base.size() - length);
+        }
+        std::vector<uint16_t> alpha, beta;
+        if (!RomReader::readFromFile(base + "_ALPHA.out", format, alpha, log) ||
+            !RomReader::readFromFile(base + "_BETA.out", format, beta, log)) {
+            return false;
+        }
+        if (!emulator.load(alpha, beta)) {
+            log << "Error: '" << base << "' does not fit in " << Emulator::ROM_SIZE << " instructions\n";
+            return false;
+        }
+        return true;
+    }
+
+    int run(const std::vector<std::string>& args) {
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "-f" && hasValue) {
+                if (!parseRomFormat(args[++i], inputFormat)) {
+                    std::cerr << "Error: Unknown ROM format '" << args[i] << "'\n";
+                    return 1;
+                }
+            } else if (arg == "-O0" || arg == "-O1") {
+                optimizeLevel = arg[2] - '0';
+            } else if (arg == "-Os") {
+                optimizeLevel = 2;
+            } else if (arg == "--steps" && hasValue) {
+                maxSteps = std::strtoull(args[++i].c_str(), nullptr, 10);
+            } else if ((arg == "--reg" || arg == "--mem") && hasValue) {
+                int target = 0;
+                uint16_t value = 0;
+                if (!parseAssignment(args[++i], arg == "--reg", target, value)) {
+                    std::cerr << "Error: Invalid " << (arg == "--reg" ? "register" : "RAM") << " value '" << args[i] << "'\n";
+                    return 1;
+                }
+                (arg == "--reg" ? registers : memory).push_back({target, value});
+            } else if (arg == "--profile" && hasValue) {
+                profilePath = args[++i];
+            } else if (arg == "--ram") {
+                showMemory = true;
+            } else if (arg == "--jit") {
+                useJit = true;
+            } else if (arg == "--sweep" && hasValue) {
+                if (!parseSweep(args[++i])) {
+                    std::cerr << "Error: Invalid sweep '" << args[i] << "', expected Xn=A..B\n";
+                    return 1;
+                }
+            } else if (arg == "-q") {
+                quiet = true;
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                std::cerr << "Error: Unknown option '" << arg << "'\n";
+                printUsage();
+                return 1;
+            } else if (program.empty()) {
+                program = arg;
+            } else {
+                std::cerr << "Error: More than one program given\n";
+                return 1;
+            }
+        }
+        if (program.empty()) {
+            printUsage();
+            return 1;
+        }
+
+        Emulator emulator;
+        if (!loadProgram(program, inputFormat, optimizeLevel, emulator)) return 1;
+
+        Emulator::Machine machine;
+        for (const auto& [reg, value] : registers) machine.cpu.regs[reg] = value;
+        for (const auto& [address, value] : memory) machine.memory[address] = value;
+        if (sweepRegister >= 0) {
+            if (useJit || !profilePath.empty()) std::cerr << "Warning: --jit and --profile are ignored with --sweep\n";
+            return runSweep(emulator.getRom(), machine);
+        }
+        emulator.setProfiling(!profilePath.empty());
+        if (useJit && !emulator.setJit(true)) std::cerr << "Warning: No JIT on this host, interpreting\n";
+
+        auto start = std::chrono::steady_clock::now();
+        Emulator::Status status = emulator.run(machine, maxSteps);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const Emulator::Stats& stats = emulator.getStats();
+
+        std::cout << statusText(status, machine.pc, emulator.getRom()) << ": " << stats.steps << " instructions, " << stats.cycles << " cycles, " << stats.taken
+                  << " branches taken (" << std::fixed << std::setprecision(1)
+                  << stats.steps / std::max(elapsed.count(), 1e-9) / 1e6 << " MIPS)\n" << std::defaultfloat;
+
+        if (!quiet) {
+            std::cout << "Registers:";
+            for (int reg = 0; reg < 8; reg++) {
+                std::cout << " X" << reg << "=" << std::hex << std::uppercase << std::setfill('0') << std::setw(4)
+                          << machine.cpu.regs[reg] << std::dec << std::setfill(' ');
+            }
+            std::cout << "\nFlags: N=" << machine.cpu.n << " Z=" << machine.cpu.z << " C=" << machine.cpu.c
+                      << " V=" << machine.cpu.v << "\n";
+            std::cout << "Screen: \"" << Emulator::screenText(machine) << "\"\n";
+            if (showMemory) {
+                std::cout << "RAM:";
+                for (size_t address = 0; address < Emulator::MEMORY_SIZE; address++) {
+                    if (machine.memory[address] == 0) continue;
+                    std::cout << " " << address << "=" << std::hex << std::uppercase << std::setfill('0') << std::setw(4)
+                              << machine.memory[address] << std::dec << std::setfill(' ');
+                }
+                std::cout << "\n";
+            }
+        }
+
+        if (!profilePath.empty() && !emulator.getProfile().writeToFile(profilePath)) return 1;
+        return status == Emulator::STATUS_EXITED ? 0 : 1;
+    }
+};
+
+// Test Command - "gct test": run the tests of GCT-TESTS manifests on every core and report the failures.
+// Each program is loaded once; tests are ordered by program and spread over the workers by work stealing,
+// every worker keeping its own emulator and the program it last loaded.
+class TestCommand {
+private:
+    RomFormat inputFormat = ROM_HEX;
+    int optimizeLevel = 0;
+    uint64_t maxSteps = 100000000;
+    size_t jobs = 0;
+    bool useJit = false;
+    bool quiet = false;
+    std::vector<std::string> manifests;
+
+    struct Program {
+        std::string path;
+        std::vector<uint32_t> rom;
+        bool loaded = false;
+        std::string log;
+    };
+
+    struct Result {
+        bool passed = false;
+        Emulator::Stats stats;
+        std::string failures;
+    };
+
+    // One per worker, on a cache line of its own
+    struct alignas(64) Worker {
+        std::unique_ptr<Emulator> emulator;
+        size_t program = SIZE_MAX;  // Loaded in emulator
+    };
+
+    void printUsage() {
+        std::cout << "Usage: gct test [options] <manifest> ...\n";
+        std::cout << "  A manifest starts with 'GCT-TESTS 1' and lists tests, each a program, its initial state\n";
+        std::cout << "  and the expected outcome (see utils/TestManifest.hpp).\n";
+        std::cout << "  -j <N>           Worker threads (default: one per hardware thread)\n";
+        std::cout << "  -f <FORMAT>      ROM format: hex, uint, int, binary (default: hex)\n";
+        std::cout << "  -O1, -Os         Optimize sources before running them (-O0: as written, the default)\n";
+        std::cout << "  --steps <N>      Step limit of tests that set none (default: 100000000)\n";
+        std::cout << "  --jit            Translate to x86-64 where possible\n";
+        std::cout << "  -q               Print only the failures and the totals\n";
+    }
+
+public:
+    int run(const std::vector<std::string>& args) {
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "-j" && hasValue) {
+                jobs = (size_t)std::max(0, std::atoi(args[++i].c_str()));
+            } else if (arg == "-f" && hasValue) {
+                if (!parseRomFormat(args[++i], inputFormat)) {
+                    std::cerr << "Error: Unknown ROM format '" << args[i] << "'\n";
+                    return 1;
+                }
+            } else if (arg == "-O0" || arg == "-O1") {
+                optimizeLevel = arg[2] - '0';
+            } else if (arg == "-Os") {
+                optimizeLevel = 2;
+            } else if (arg == "--steps" && hasValue) {
+                maxSteps = std::strtoull(args[++i].c_str(), nullptr, 10);
+            } else if (arg == "--jit") {
+                useJit = true;
+            } else if (arg == "-q") {
+                quiet = true;
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                std::cerr << "Error: Unknown option '" << arg << "'\n";
+                printUsage();
+                return 1;
+            } else {
+                manifests.push_back(arg);
+            }
+        }
+        if (manifests.empty()) {
+            printUsage();
+            return 1;
+        }
+
+        TestManifest manifest;
+        for (const std::string& path : manifests) {
+            if (!manifest.readFromFile(path)) return 1;
+        }
+        const std::vector<TestManifest::Test>& tests = manifest.tests;
+
+        // Every program once, assembled or read on the thread pool
+        std::vector<Program> programs;
+        std::vector<size_t> programOf(tests.size());
+        {
+            std::map<std::string, size_t> indexOf;
+            for (size_t test = 0; test < tests.size(); test++) {
+                auto [it, added] = indexOf.emplace(tests[test].program, programs.size());
+                if (added) programs.push_back({tests[test].program, {}, false, {}});
+                programOf[test] = it->second;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        {
+            ThreadPool pool(std::min(jobs ? jobs : std::thread::hardware_concurrency(), programs.size()));
+            for (Program& program : programs) {
+                pool.submit([this, &program] {
+                    std::ostringstream log;
+                    Emulator emulator;
+                    program.loaded = RunCommand::loadProgram(program.path, inputFormat, optimizeLevel, emulator, log);
+                    if (program.loaded) program.rom = emulator.getRom();
+                    program.log = log.str();
+                });
+            }
+            pool.wait();
+        }
+        std::chrono::duration<double> loading = std::chrono::steady_clock::now() - start;
+
+        // Tests of a program next to each other, so a worker's share mostly reuses the program it has loaded
+        std::vector<size_t> order(tests.size());
+        for (size_t test = 0; test < tests.size(); test++) order[test] = test;
+        std::stable_sort(order.begin(), order.end(), [&](size_t first, size_t second) { return programOf[first] < programOf[second]; });
+
+        std::vector<Result> results(tests.size());
+        WorkStealing scheduler(std::min(jobs ? jobs : std::thread::hardware_concurrency(), std::max<size_t>(tests.size(), 1)));
+        std::vector<Worker> workers(scheduler.size());
+        start = std::chrono::steady_clock::now();
+        scheduler.run(tests.size(), [&](size_t index, size_t worker) {
+            size_t test = order[index];
+            const Program& program = programs[programOf[test]];
+            Result& result = results[test];
+            if (!program.loaded) {
+                result.failures = program.log;
+                return;
+            }
+            Worker& state = workers[worker];
+            if (!state.emulator) {
+                state.emulator = std::make_unique<Emulator>();
+                if (useJit) state.emulator->setJit(true);
+            }
+            if (state.program != programOf[test]) {
+                state.emulator->load(program.rom);
+                state.program = programOf[test];
+            }
+            Emulator::Machine machine;
+            TestManifest::prepare(tests[test], machine);
+            Emulator::Status status = state.emulator->run(machine, tests[test].maxSteps ? tests[test].maxSteps : maxSteps);
+            result.stats = state.emulator->getStats();
+            result.failures = TestManifest::check(tests[test], status, machine, result.stats);
+            result.passed = result.failures.empty();
+        });
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        size_t failures = 0;
+        uint64_t steps = 0;
+        for (size_t test = 0; test < tests.size(); test++) {
+            const Result& result = results[test];
+            failures += !result.passed;
+            steps += result.stats.steps;
+            if (quiet && result.passed) continue;
+            std::cout << (result.passed ? "PASS  " : "FAIL  ") << tests[test].name << " (" << result.stats.steps << " instructions)\n";
+            std::istringstream lines(result.failures);
+            for (std::string line; std::getline(lines, line);) std::cout << "      " << line << "\n";
+        }
+        std::cout << "\nRan " << tests.size() << " tests from " << programs.size() << " programs, " << failures << " failed, in "
+                  << std::fixed << std::setprecision(3) << elapsed.count() << "s on " << scheduler.size() << " workers ("
+                  << scheduler.getSteals() << " steals; loading took " << loading.count() << "s)\n";
+        std::cout << steps << " instructions (" << std::setprecision(1) << steps / std::max(elapsed.count(), 1e-9) / 1e6
+                  << " MIPS)\n" << std::defaultfloat;
+        return failures ? 1 : 0;
+    }
+};
+
+// Language Server - "gct lsp": Language Server Protocol over stdin/stdout for .s files.
+// Documents are kept as AsmDocuments and updated incrementally on every edit.
+// Columns are treated as bytes (assembly sources are ASCII).
+class LanguageServer {
+private:
+    std::map<std::string, AsmDocument> documents;
+    bool logTimings = false;
+    bool shutdownRequested = false;
+
+    // Read one "Content-Length" framed message, false at end of input
+    bool readMessage(std::string& body) {
+        size_t length = 0;
+        std::string header;
+        while (std::getline(std::cin, header)) {
+            if (!header.empty() && header.back() == '\r') header.pop_back();
+            if (header.empty()) break;
+            if (header.compare(0, 15, "Content-Length:") == 0) length = std::strtoul(header.c_str() + 15, nullptr, 10);
+        }
+        if (!std::cin || length == 0) return false;
+        body.resize(length);
+        return (bool)std::cin.read(&body[0], length);
+    }
+
+    void sendMessage(JsonValue message) {
+        message.set("jsonrpc", "2.0");
+        std::string body = message.dump();
+        std::cout << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+        std::cout.flush();
+    }
+
+    void sendResult(const JsonValue& id, JsonValue result) {
+        sendMessage(JsonValue::object().set("id", id).set("result", std::move(result)));
+    }
+
+    static JsonValue position(size_t line, size_t character) {
+        return JsonValue::object().set("line", line).set("character", character);
+    }
+
+    // Range covering a line's text without leading indentation
+    static JsonValue lineRange(const AsmDocument& document, size_t index) {
+        const std::string& text = document.line(index).text;
+        size_t start = text.find_first_not_of(" \t");
+        if (start == std::string::npos) start = 0;
+        return JsonValue::object().set("start", position(index, start)).set("end", position(index, text.size()));
+    }
+
+    void publishDiagnostics(const std::string& uri) {
+        JsonValue list = JsonValue::array();
+        auto it = documents.find(uri);
+        if (it != documents.end()) {
+            for (const auto& diagnostic : it->second.getDiagnostics()) {
+                list.push(JsonValue::object()
+                    .set("range", lineRange(it->second, diagnostic.line))
+                    .set("severity", diagnostic.severity == AsmDiagnostic::SEVERITY_ERROR ? 1 : 2)
+                    .set("source", "gct")
+                    .set("message", diagnostic.message));
+            }
+        }
+        sendMessage(JsonValue::object()
+            .set("method", "textDocument/publishDiagnostics")
+            .set("params", JsonValue::object().set("uri", uri).set("diagnostics", std::move(list))));
+    }
+
+    static std::string hex(uint32_t value, int digits) {
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+        return buffer;
+    }
+
+    // Re-assemble after an edit and report what it cost
+    void refresh(const std::string& uri, AsmDocument& document, std::chrono::steady_clock::time_point start) {
+        document.update();
+        if (logTimings) {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            std::cerr << "gct lsp: " << uri << ": " << document.lineCount() << " lines, relexed "
+                      << document.getRelexedLines() << ", reparsed " << document.getReparsedLines() << ", "
+                      << std::fixed << std::setprecision(3) << elapsed.count() << " ms\n";
+        }
+        publishDiagnostics(uri);
+    }
+
+    AsmDocument* findDocument(const JsonValue& params) {
+        auto it = documents.find(params["textDocument"]["uri"].asString());
+        return (it == documents.end()) ? nullptr : &it->second;
+    }
+
+    // Line under the cursor, false if outside the document
+    static bool cursorLine(const AsmDocument* document, const JsonValue& params, size_t& index) {
+        if (!document) return false;
+        index = (size_t)params["position"]["line"].asInt();
+        return index < document->lineCount();
+    }
+
+    JsonValue definition(const JsonValue& params) {
+        AsmDocument* document = findDocument(params);
+        size_t index;
+        if (!cursorLine(document, params, index)) return JsonValue();
+
+        size_t labelLine;
+        if (document->findLabel(document->line(index).label, labelLine)) {
+            return JsonValue::object()
+                .set("uri", params["textDocument"]["uri"])
+                .set("range", lineRange(*document, labelLine));
+        }
+        return JsonValue();
+    }
+
+    JsonValue hover(const JsonValue& params) {
+        AsmDocument* document = findDocument(params);
+        size_t index;
+        if (!cursorLine(document, params, index)) return JsonValue();
+
+        const AsmDocument::Line& line = document->line(index);
+        if (line.address < 0) return JsonValue();
+        std::string text;
+        if (line.kind == AsmDocument::LINE_LABEL) {
+            text = "Label address " + std::to_string(line.address);
+        } else {
+            text = "ROM address " + std::to_string(line.address) + ": " + hex(line.finalEncoding, 8) +
+                   " (ALPHA " + hex(line.finalEncoding >> 16, 4) + ", BETA " + hex(line.finalEncoding & 0xFFFF, 4) + ")";
+        }
+        return JsonValue::object().set("contents", JsonValue::object().set("kind", "plaintext").set("value", text));
+    }
+
+    // ROM address shown at the end of every instruction line in the requested range
+    JsonValue inlayHints(const JsonValue& params) {
+        JsonValue hints = JsonValue::array();
+        AsmDocument* document = findDocument(params);
+        if (!document) return hints;
+
+        size_t first = (size_t)params["range"]["start"]["line"].asInt();
+        size_t last = std::min((size_t)params["range"]["end"]["line"].asInt(), document->lineCount() - 1);
+        for (size_t i = first; i <= last && i < document->lineCount(); i++) {
+            const AsmDocument::Line& line = document->line(i);
+            if (line.kind != AsmDocument::LINE_INSTRUCTION || line.address < 0) continue;
+            hints.push(JsonValue::object()
+                .set("position", position(i, line.text.size()))
+                .set("label", "@" + std::to_string(line.address))
+                .set("paddingLeft", true));
+        }
+        return hints;
+    }
+
+    // Handle one message, false once the client asked the server to exit
+    bool handle(const JsonValue& message) {
+        auto start = std::chrono::steady_clock::now();
+        const std::string& method = message["method"].asString();
+        const JsonValue& params = message["params"];
+        const JsonValue& id = message["id"];
+        bool isRequest = message.has("id");
+
+        if (method == "initialize") {
+            JsonValue capabilities = JsonValue::object()
+                .set("textDocumentSync", JsonValue::object().set("openClose", true).set("change", 2))
+                .set("definitionProvider", true)
+                .set("hoverProvider", true)
+                .set("inlayHintProvider", true);
+            sendResult(id, JsonValue::object()
+                .set("capabilities", std::move(capabilities))
+                .set("serverInfo", JsonValue::object().set("name", "gct").set("version", IsaSpec::sharedISASpec().version)));
+        } else if (method == "shutdown") {
+            shutdownRequested = true;
+            sendResult(id, JsonValue());
+        } else if (method == "exit") {
+            return false;
+        } else if (method == "textDocument/didOpen") {
+            const std::string& uri = params["textDocument"]["uri"].asString();
+            AsmDocument& document = documents.emplace(uri, AsmDocument()).first->second;
+            document.setText(params["textDocument"]["text"].asString());
+            refresh(uri, document, start);
+        } else if (method == "textDocument/didChange") {
+            const std::string& uri = params["textDocument"]["uri"].asString();
+            AsmDocument* document = findDocument(params);
+            if (!document) return true;
+            for (const auto& change : params["contentChanges"].getItems()) {
+                if (!change.has("range")) {
+                    document->setText(change["text"].asString());
+                    continue;
+                }
+                const JsonValue& range = change["range"];
+                document->applyEdit((size_t)range["start"]["line"].asInt(), (size_t)range["start"]["character"].asInt(),
+                                    (size_t)range["end"]["line"].asInt(), (size_t)range["end"]["character"].asInt(),
+                                    change["text"].asString());
+            }
+            refresh(uri, *document, start);
+        } else if (method == "textDocument/didClose") {
+            const std::string& uri = params["textDocument"]["uri"].asString();
+            documents.erase(uri);
+            publishDiagnostics(uri);
+        } else if (method == "textDocument/definition") {
+            sendResult(id, definition(params));
+        } else if (method == "textDocument/hover") {
+            sendResult(id, hover(params));
+        } else if (method == "textDocument/inlayHint") {
+            sendResult(id, inlayHints(params));
+        } else if (isRequest) {
+            sendMessage(JsonValue::object().set("id", id).set("error",
+                JsonValue::object().set("code", -32601).set("message", "Method not found: " + method)));
+        }
+        return true;
+    }
+
+public:
+    int run(const std::vector<std::string>& args) {
+        for (const auto& arg : args) {
+            if (arg == "--log") {
+                logTimings = true;
+            } else {
+                std::cerr << "Usage: gct lsp [--log]   (Language Server Protocol on stdin/stdout)\n";
+                return (arg == "-h" || arg == "--help") ? 0 : 1;
+            }
+        }
+
+        std::ios::sync_with_stdio(false);
+        std::string body;
+        while (readMessage(body)) {
+            JsonValue message;
+            if (!JsonValue::parse(body, message)) {
+                sendMessage(JsonValue::object().set("id", JsonValue()).set("error",
+                    JsonValue::object().set("code", -32700).set("message", "Parse error")));
+                continue;
+            }
+            if (!handle(message)) break;
+        }
+        return shutdownRequested ? 0 : 1;
+    }
+};
+
+// ROM Command - "gct rom": run ROM generator tools without the menu, locally or in the daemon
+class RomCommand {
+private:
+    RomFormat outputFormat = ROM_HEX;
+    bool useDaemon = false;
+    std::string socketPath = LocalSocket::defaultPath();
+    std::vector<std::string> toolNames;
+
+    void printUsage() {
+        std::cout << "Usage: gct rom [options] <tool name> ...\n";
+        std::cout << "  -f <FORMAT>      Output format: hex, uint, int, binary (default: hex)\n";
+        std::cout << "  --list           List tools that can run without prompts\n";
+        std::cout << "  --daemon         Run in a running gct daemon (falls back to running locally)\n";
+        std::cout << "  --socket <PATH>  Daemon socket (default: " << LocalSocket::defaultPath() << ")\n";
+    }
+
+public:
+    // Registered tool with this name (case-insensitive) that needs no prompts, nullptr with error set otherwise
+    static Tool* findHeadlessTool(const std::string& name, std::string& error) {
+        auto lower = [](std::string text) {
+            for (char& c : text) c = std::tolower((unsigned char)c);
+            return text;
+        };
+        for (Tool* tool : ToolRegistry::getAllTools()) {
+            if (lower(tool->name) != lower(name)) continue;
+            if (tool->hasInputs()) {
+                error = "Tool '" + tool->name + "' needs interactive input";
+                return nullptr;
+            }
+            return tool;
+        }
+        error = "Unknown tool '" + name + "' (see gct rom --list)";
+        return nullptr;
+    }
+
+    int run(const std::vector<std::string>& args) {
+        bool list = false;
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "-f" && hasValue) {
+                if (!parseRomFormat(args[++i], outputFormat)) {
+                    std::cerr << "Error: Unknown output format '" << args[i] << "'\n";
+                    return 1;
+                }
+            } else if (arg == "--list") {
+                list = true;
+            } else if (arg == "--daemon") {
+                useDaemon = true;
+            } else if (arg == "--socket" && hasValue) {
+                socketPath = args[++i];
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                std::cerr << "Error: Unknown option '" << arg << "'\n";
+                printUsage();
+                return 1;
+            } else {
+                toolNames.push_back(arg);
+            }
+        }
+        if (!list && toolNames.empty()) {
+            printUsage();
+            return 1;
+        }
+
+        JsonValue pong;
+        bool remote = useDaemon && daemonRequest(socketPath, JsonValue::object().set("command", "ping"), pong);
+        if (useDaemon && !remote) {
+            std::cerr << "Warning: No gct daemon at " << socketPath << ", running locally\n";
+        }
+        if (!remote) registerAllTools();
+
+        if (list) {
+            for (Tool* tool : ToolRegistry::getAllTools()) {
+                if (!tool->hasInputs()) std::cout << "  " << tool->name << " - " << tool->description << "\n";
+            }
+            return 0;
+        }
+
+        int status = 0;
+        for (const auto& name : toolNames) {
+            if (remote) {
+                std::error_code ec;
+                JsonValue request = JsonValue::object()
+                    .set("command", "rom")
+                    .set("tool", name)
+                    .set("format", romFormatName(outputFormat))
+                    .set("cwd", std::filesystem::current_path(ec).string());
+                JsonValue response;
+                if (!daemonRequest(socketPath, request, response)) {
+                    std::cerr << "Error: Lost connection to gct daemon at " << socketPath << "\n";
+                    return 1;
+                }
+                std::cout << response["log"].asString();
+                if (!response["ok"].asBool()) status = 1;
+                continue;
+            }
+
+            std::string error;
+            Tool* tool = findHeadlessTool(name, error);
+            if (!tool) {
+                std::cerr << "Error: " << error << "\n";
+                status = 1;
+                continue;
+            }
+            tool->execute(outputFormat);
+        }
+        return status;
+    }
+};
+
+// Assembler Daemon - "gct daemon": keeps the ISA spec, the registered tools and the assembly
+// cache (in memory as well as on disk) resident, and serves "gct asm --daemon" and
+// "gct rom --daemon" over a Unix domain socket. One JSON request and response per line.
+class AssemblerDaemon {
+private:
+    std::string socketPath = LocalSocket::defaultPath();
+    std::string cacheDir = ".gct_cache";
+    size_t jobs = 0;
+    std::unique_ptr<AssemblyCache> cache;
+    LocalSocket listener;
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> requestCount{0};
+    std::chrono::steady_clock::time_point startTime;
+
+    // ROM tools print to std::cout and write relative to the working directory, which a rom request
+    // redirects; so they run one at a time, and never while an asm request is in progress
+    std::shared_mutex toolMutex;
+
+    void printUsage() {
+        std::cout << "Usage: gct daemon [options]\n";
+        std::cout << "  --socket <PATH>  Socket to listen on (default: " << LocalSocket::defaultPath() << ")\n";
+        std::cout << "  --cache <DIR>    Assembly cache directory (default: .gct_cache)\n";
+        std::cout << "  --no-cache       Do not cache assemblies\n";
+        std::cout << "  -j <N>           Concurrent clients (default: one per hardware thread)\n";
+        std::cout << "  --stats          Print statistics of the running daemon\n";
+        std::cout << "  --stop           Stop the running daemon\n";
+    }
+
+    JsonValue handleAssemble(const JsonValue& request) {
+        RomFormat format = ROM_HEX;
+        parseRomFormat(request["format"].asString(), format);
+        bool object = request["object"].asBool();
+
+        std::shared_lock<std::shared_mutex> lock(toolMutex);
+        std::ostringstream log;
+        AssemblerTool assembler(request["source"].asString(), request["output"].asString(), log);
+        assembler.setUpdateSimulator(request["sim"].asBool() && !object);
+        assembler.setObjectOutput(object);
+        assembler.setOptimizeLevel((int)request["optimize"].asInt());
+        assembler.setCfgFormat(request["cfg"].asString());
+        assembler.setProfile(request["profile"].asString());
+        assembler.setRewrites(request["rewrites"].asString());
+        if (request.has("unroll_budget")) assembler.setUnrollBudget((size_t)request["unroll_budget"].asInt());
+        assembler.setCache(object ? nullptr : cache.get());
+        bool ok = assembler.assemble(format);
+
+        return JsonValue::object()
+            .set("ok", ok)
+            .set("instructions", assembler.getInstructionCount())
+            .set("cached", assembler.wasCacheHit())
+            .set("log", log.str());
+    }
+
+    JsonValue handleRom(const JsonValue& request) {
+        RomFormat format = ROM_HEX;
+        parseRomFormat(request["format"].asString(), format);
+
+        std::string error;
+        Tool* tool = RomCommand::findHeadlessTool(request["tool"].asString(), error);
+        if (!tool) return JsonValue::object().set("ok", false).set("log", "Error: " + error + "\n");
+
+        std::unique_lock<std::shared_mutex> lock(toolMutex);
+        std::error_code ec;
+        std::filesystem::path previousDir = std::filesystem::current_path(ec);
+        std::filesystem::current_path(request["cwd"].asString(), ec);
+        if (ec) {
+            return JsonValue::object().set("ok", false).set("log", "Error: Cannot enter directory '" + request["cwd"].asString() + "'\n");
+        }
+
+        std::ostringstream log;
+        std::streambuf* previousOut = std::cout.rdbuf(log.rdbuf());
+        std::streambuf* previousErr = std::cerr.rdbuf(log.rdbuf());
+        tool->execute(format);
+        std::cout.rdbuf(previousOut);
+        std::cerr.rdbuf(previousErr);
+        std::filesystem::current_path(previousDir, ec);
+        return JsonValue::object().set("ok", true).set("log", log.str());
+    }
+
+    JsonValue handleRequest(const JsonValue& request) {
+        requestCount++;
+        const std::string& command = request["command"].asString();
+        if (command == "asm") return handleAssemble(request);
+        if (command == "rom") return handleRom(request);
+        if (command == "ping") return JsonValue::object().set("ok", true);
+        if (command == "stats") {
+            std::chrono::duration<double> uptime = std::chrono::steady_clock::now() - startTime;
+            return JsonValue::object()
+                .set("ok", true)
+                .set("requests", requestCount.load())
+                .set("cacheHits", cache ? cache->getHits() : 0)
+                .set("memoryHits", cache ? cache->getMemoryHits() : 0)
+                .set("cacheMisses", cache ? cache->getMisses() : 0)
+                .set("uptime", uptime.count());
+        }
+        if (command == "stop") {
+            stopping = true;
+            listener.shutdown();
+            return JsonValue::object().set("ok", true);
+        }
+        return JsonValue::object().set("ok", false).set("log", "Error: Unknown command '" + command + "'\n");
+    }
+
+    // Serve requests on one connection until the client closes it
+    void serveClient(LocalSocket& client) {
+        std::string line;
+        while (client.readLine(line)) {
+            JsonValue request;
+            JsonValue response = JsonValue::parse(line, request)
+                ? handleRequest(request)
+                : JsonValue::object().set("ok", false).set("log", "Error: Malformed request\n");
+            if (!client.sendLine(response.dump())) break;
+        }
+    }
+
+public:
+    int run(const std::vector<std::string>& args) {
+        std::string clientCommand;
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "--socket" && hasValue) {
+                socketPath = args[++i];
+            } else if (arg == "--cache" && hasValue) {
+                cacheDir = args[++i];
+            } else if (arg == "--no-cache") {
+                cacheDir.clear();
+            } else if (arg == "-j" && hasValue) {
+                jobs = std::max(1, std::atoi(args[++i].c_str()));
+            } else if (arg == "--stats" || arg == "--stop") {
+                clientCommand = arg.substr(2);
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else {
+                std::cerr << "Error: Unknown option '" << arg << "'\n";
+                printUsage();
+                return 1;
+            }
+        }
+
+        if (!LocalSocket::isSupported()) {
+            std::cerr << "Error: gct daemon needs Unix domain sockets, which this build does not support\n";
+            return 1;
+        }
+
+        // Control an already running daemon
+        if (!clientCommand.empty()) {
+            JsonValue response;
+            if (!daemonRequest(socketPath, JsonValue::object().set("command", clientCommand), response)) {
+                std::cerr << "Error: No gct daemon at " << socketPath << "\n";
+                return 1;
+            }
+            if (clientCommand == "stats") {
+                std::cout << "Requests:     " << response["requests"].asInt() << "\n";
+                std::cout << "Cache hits:   " << response["cacheHits"].asInt() << " (" << response["memoryHits"].asInt() << " from memory)\n";
+                std::cout << "Cache misses: " << response["cacheMisses"].asInt() << "\n";
+                std::cout << "Uptime:       " << std::fixed << std::setprecision(1) << response["uptime"].asNumber() << "s\n";
+            } else {
+                std::cout << "Stopped gct daemon at " << socketPath << "\n";
+            }
+            return 0;
+        }
+
+        // Warm everything a request needs before accepting any
+        startTime = std::chrono::steady_clock::now();
+        IsaSpec::sharedISASpec();
+        registerAllTools();
+        if (!cacheDir.empty()) {
+            std::error_code ec;
+            cache = std::make_unique<AssemblyCache>(std::filesystem::absolute(cacheDir, ec).string());
+            cache->setKeepInMemory(true);
+        }
+
+        if (!listener.listen(socketPath)) {
+            std::cerr << "Error: Cannot listen on " << socketPath << " (is another gct daemon running?)\n";
+            return 1;
+        }
+
+        {
+            ThreadPool pool(jobs);
+            std::cout << "gct daemon listening on " << socketPath << " (" << pool.size() << " workers)\n";
+            std::cout.flush();
+            while (!stopping) {
+                auto client = std::make_shared<LocalSocket>(listener.accept());
+                if (!client->isOpen()) break;
+                pool.submit([this, client] { serveClient(*client); });
+            }
+            pool.wait();
+        }
+
+        listener.close();
+        std::error_code ec;
+        std::filesystem::remove(socketPath, ec);
+        std::cout << "gct daemon stopped after " << requestCount.load() << " requests\n";
+        return 0;
+    }
+};
+
+void printCommandUsage() {
+    std::cout << "Usage: gct                 Interactive menu\n";
+    std::cout << "       gct asm [options]   Batch-assemble sources (gct asm --help)\n";
+    std::cout << "       gct link [options]  Link objects from gct asm -c into ROMs (gct link --help)\n";
+    std::cout << "       gct superopt [options] Search cheaper equivalents of a short sequence (gct superopt --help)\n";
+    std::cout << "       gct run [options]   Run a source or ROM on the emulator (gct run --help)\n";
+    std::cout << "       gct test [options]  Run the regression tests of manifests on every core (gct test --help)\n";
+    std::cout << "       gct lsp [--log]     Language server for .s files on stdin/stdout\n";
+    std::cout << "       gct rom [options]   Run ROM generator tools without the menu (gct rom --help)\n";
+    std::cout << "       gct daemon [options] Keep spec and caches warm for --daemon clients (gct daemon --help)\n";
+}
+
+int main(int argc, char* argv[]) {
+    // Headless commands bypass the interactive menu
+    if (argc > 1) {
+        std::string command = argv[1];
+        std::vector<std::string> args(argv + 2, argv + argc);
+        if (command == "asm") return BatchAssembler().run(args);
+        if (command == "link") return LinkCommand().run(args);
+        if (command == "superopt") return SuperoptCommand().run(args);
+        if (command == "run") return RunCommand().run(args);
+        if (command == "test") return TestCommand().run(args);
+        if (command == "lsp") return LanguageServer().run(args);
+        if (command == "rom") return RomCommand().run(args);
+        if (command == "daemon") return AssemblerDaemon().run(args);
+
+        printCommandUsage();
+        return (command == "-h" || command == "--help") ? 0 : 1;
+    }
 
-int main() {
     // Register all tools first
     registerAllTools();
 
@@ -19,7 +19,7 @@ PRINT_NUMBER_UNSIGNED:
     #ALIAS X3 SHIFT
 
     MOV SHIFT 12
-    BCDECIMAL BCDECIMAL NUMBER
+    BCDH BCDECIMAL NUMBER
 
 .digit_loop:
 
@@ -0,0 +1,27 @@
+MOV X2 0
+MOV X3 0
+MOV X4 0
+MOV X0 0x7FFF
+WRITE X0 0x00
+READ X0 0x00      // X0 = MEM[0x00], a value the optimizers cannot fold
+
+ADD X1 X0 1       // X1 = 0x8000 overflowed: N and V set
+BLT overflow_less
+MOV X2 1          // X2 = 1: BLT (N != V) not taken
+overflow_less:
+
+ADD X1 X0 1
+BLE overflow_not_greater
+MOV X3 1          // X3 = 1: BLE (Z set or N != V) not taken
+overflow_not_greater:
+
+ADD X1 X0 1
+CMP X1 0          // 0x8000 is less than 0: N set, V clear
+BGE not_negative
+MOV X4 1          // X4 = 1: BGE (N == V) not taken
+not_negative:
+
+EXIT
+// X0: 0x7FFF  X1: 0x8000
+// X2: 0x0001  X3: 0x0001
+// X4: 0x0001
@@ -0,0 +1,116 @@
+#!/bin/sh
+# Build gct and run its regression tests
+#
+#   scripts/run_tests.sh [gct]   (default: build ./gct from gate_computer_toolset.cpp)
+
+cd "$(dirname "$0")/.." || exit 1
+GCT=${1:-./gct}
+if [ -z "$1" ]; then
+    echo "Compiling gate_computer_toolset.cpp..."
+    g++ -std=c++17 -Wall -O2 -o gct gate_computer_toolset.cpp || exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+fail() {
+    echo "FAIL  $1"
+    FAILED=1
+}
+
+# A program too large for the ROM is an error and leaves no ROM behind
+: > "$WORK/too_large.s"
+i=0
+while [ $i -lt 257 ]; do
+    echo "ADD X1 X1 1" >> "$WORK/too_large.s"
+    i=$((i + 1))
+done
+echo "EXIT" >> "$WORK/too_large.s"
+if "$GCT" asm --no-cache -o "$WORK/rom" "$WORK/too_large.s" > "$WORK/too_large.log" 2>&1; then
+    fail "too_large.s assembled"
+elif ! grep -q "ROM holds 256" "$WORK/too_large.log"; then
+    fail "too_large.s did not report its size"
+elif [ -e "$WORK/rom/too_large_ALPHA.out" ] || [ -e "$WORK/rom/too_large_BETA.out" ]; then
+    fail "too_large.s wrote ROMs"
+fi
+
+# Two sources with one name would write the same ROMs, so assembly refuses them
+mkdir -p "$WORK/a" "$WORK/b"
+printf 'MOV X1 1\nEXIT\n' > "$WORK/a/same.s"
+printf 'MOV X1 2\nEXIT\n' > "$WORK/b/same.s"
+if "$GCT" asm --no-cache -o "$WORK/rom" "$WORK/a/same.s" "$WORK/b/same.s" > "$WORK/same.log" 2>&1; then
+    fail "a/same.s and b/same.s assembled into one output"
+elif [ -e "$WORK/rom/same_ALPHA.out" ]; then
+    fail "a/same.s and b/same.s wrote ROMs"
+fi
+
+# There is one Digital Logic Sim project, so --sim refuses several sources
+printf 'MOV X1 3\nEXIT\n' > "$WORK/sim.s"
+if "$GCT" asm --sim --no-cache -o "$WORK/rom" "$WORK/a/same.s" "$WORK/sim.s" > "$WORK/sim.log" 2>&1; then
+    fail "--sim assembled two sources"
+elif ! grep -q "single source" "$WORK/sim.log"; then
+    fail "--sim with two sources did not say why it refused them"
+fi
+
+# A cache hit repeats the warnings of the assembly it stored
+printf 'a:\na:\nEXIT\n' > "$WORK/warn.s"
+for run in miss hit; do
+    "$GCT" asm -v --cache "$WORK/cache" -o "$WORK/rom" "$WORK/warn.s" > "$WORK/warn_$run.log" 2>&1
+    grep -q "Warning: Duplicate label 'a' ignored" "$WORK/warn_$run.log" || fail "warn.s cache $run lost its warning"
+done
+grep -q "cached" "$WORK/warn_hit.log" || fail "warn.s was not cached"
+
+# An object is reused only if it was built with the same options
+"$GCT" asm -c -O0 -o "$WORK/obj" scripts/FIBONACCI.s > /dev/null 2>&1
+"$GCT" asm -c -O0 -o "$WORK/obj" scripts/FIBONACCI.s 2>&1 | grep -q "up to date" || fail "FIBONACCI.gobj rebuilt at the same options"
+"$GCT" asm -c -O1 -o "$WORK/obj" scripts/FIBONACCI.s 2>&1 | grep -q "up to date" && fail "FIBONACCI.gobj reused at another -O level"
+
+# Operands split on spaces and commas alike, except inside parentheses
+printf '%s\n' "ADD X0 X1, 5" "MOV X2 X1," "ADD X3,X3 , 1" "MOV X4 (2 + 3)" "PRINT 1, ','" > "$WORK/separators.s"
+"$GCT" asm --no-cache -o "$WORK/rom" "$WORK/separators.s" > "$WORK/separators.log" 2>&1 || fail "separators.s did not assemble"
+EXPECTED="00051014 00001240 00013314 00050441 2C01004D "
+ACTUAL=$(paste -d '' "$WORK/rom/separators_ALPHA.out" "$WORK/rom/separators_BETA.out" 2>/dev/null | head -5 | tr '\n' ' ')
+[ "$ACTUAL" = "$EXPECTED" ] || fail "separators.s assembled to $ACTUAL, expected $EXPECTED"
+
+# The example programs, as written, optimized and translated
+for options in -O0 -O1 -Os "-O0 --jit" "-O1 --jit"; do
+    "$GCT" test -q $options scripts/tests.gct > "$WORK/tests.log" 2>&1 || {
+        cat "$WORK/tests.log"
+        fail "scripts/tests.gct at $options"
+    }
+done
+
+# A sweep ends every instance where a run of its own ends; the loop length depends on X0,
+# so the instances diverge and regroup
+printf '%s\n' "loop:" "CMP X0 0" "BEQ done" "AND X2 X0 1" "CMP X2 0" "BEQ even" "ADD X1 X1 X0" "B next" \
+    "even:" "PRINT 0 'E'" "ADD X3 X3 1" "next:" "SUB X0 X0 1" "B loop" "done:" "EXIT" > "$WORK/sweep.s"
+for level in -O0 -O1; do
+    "$GCT" run $level --sweep X0=0..40 "$WORK/sweep.s" > "$WORK/sweep.log" 2>&1
+    value=0
+    while [ $value -le 40 ]; do
+        "$GCT" run $level --reg X0=$value "$WORK/sweep.s" > "$WORK/single.log" 2>&1
+        registers=$(sed -n 's/^Registers: //p' "$WORK/single.log")
+        screen=$(sed -n 's/^Screen: //p' "$WORK/single.log")
+        grep -q "^X0=$(printf %04X $value): Exited at .*; $registers $screen\$" "$WORK/sweep.log" ||
+            fail "sweep.s instance X0=$value at $level"
+        value=$((value + 1))
+    done
+done
+
+# A label plus a constant keeps, and lands in, the function the sum points into
+mkdir -p "$WORK/link"
+printf '%s\n' "B foo+1" > "$WORK/link/main.s"
+printf '%s\n' "foo:" "EXIT" "bar:" "MOV X1 7" "EXIT" > "$WORK/link/lib.s"
+"$GCT" asm -c --no-cache -o "$WORK/link" "$WORK/link/main.s" "$WORK/link/lib.s" > /dev/null 2>&1
+if ! "$GCT" link -o "$WORK/link/out" "$WORK/link/main.gobj" "$WORK/link/lib.gobj" > "$WORK/link.log" 2>&1; then
+    fail "main.gobj and lib.gobj did not link"
+elif ! "$GCT" run "$WORK/link/out" 2>&1 | grep -q "X1=0007"; then
+    fail "B foo+1 did not reach bar"
+fi
+
+if [ $FAILED -ne 0 ]; then
+    echo "Tests failed"
+    exit 1
+fi
+echo "All tests passed"
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "AsmLexer.hpp"
+#include "AsmExpression.hpp"
+#include "Assembler.hpp"
+
+// Incrementally assembled source file, kept by the language server.
+//
+// Edits re-lex only the changed lines (plus following lines while the /* */
+// state they carry differs) and re-parse only changed instruction lines.
+// Parsed lines keep operands that use labels or '.' (label branches, LR) as
+// expressions, so label and address changes never force a re-parse; update()
+// re-lays out the cached encodings in one pass over the lines. A changed #ALIAS line re-parses the lines after it.
+class AsmDocument {
+public:
+    enum LineKind { LINE_BLANK, LINE_LABEL, LINE_ALIAS, LINE_DIRECTIVE, LINE_INSTRUCTION };
+
+    struct Line {
+        std::string text;           // Raw source text
+        std::string code;           // Comments stripped, trimmed
+        bool endsInComment = false; // Inside /* */ at end of line
+        LineKind kind = LINE_BLANK;
+        bool dirty = true;          // Instruction needs re-parse
+
+        // Instruction lines
+        uint32_t encoding = 0;      // Label and '.' immediates still zero
+        bool parseError = false;
+        std::string expression;     // Operand using labels or '.', evaluated at layout
+        std::string label;          // First label it names, for go-to-definition
+
+        // Layout, recomputed by update()
+        int address = -1;           // ROM address of the instruction, or of the next one for labels
+        uint32_t finalEncoding = 0;
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    std::vector<Line> lines;
+    std::unordered_map<std::string, size_t> labels;    // Name -> line index
+    std::vector<AsmDiagnostic> diagnostics;            // 0-based line numbers
+    size_t reparseFrom = 0;                            // Re-parse every instruction from here (alias change)
+    size_t instructionCount = 0;
+
+    // Lines (re)lexed by the last edit, for statistics
+    size_t relexedLines = 0;
+    size_t reparsedLines = 0;
+
+    static LineKind classify(std::string_view code) {
+        if (code.empty()) return LINE_BLANK;
+        if (code.length() > 6 && code.substr(0, 6) == "#ALIAS") return LINE_ALIAS;
+        if (Assembler::isLabel(code)) return LINE_LABEL;
+        if (code[0] == '#' || code[0] == ';') return LINE_DIRECTIVE;
+        return LINE_INSTRUCTION;
+    }
+
+    // Lex one line given the comment state before it; true if its code or outgoing state changed
+    bool relex(size_t index) {
+        Line& line = lines[index];
+        bool startInComment = index > 0 && lines[index - 1].endsInComment;
+        AsmLexer lexer(line.text, startInComment);
+        std::string_view code;
+        lexer.nextLine(code);
+        relexedLines++;
+
+        bool changed = line.code != code || line.endsInComment != lexer.inComment();
+        if (!changed) return false;
+
+        LineKind oldKind = line.kind;
+        line.code = std::string(code);
+        line.endsInComment = lexer.inComment();
+        line.kind = classify(line.code);
+        line.dirty = true;
+        if (oldKind == LINE_ALIAS || line.kind == LINE_ALIAS) reparseFrom = std::min(reparseFrom, index);
+        return true;
+    }
+
+    static std::vector<std::string> splitLines(std::string_view text) {
+        std::vector<std::string> result;
+        size_t start = 0;
+        while (true) {
+            size_t end = text.find('\n', start);
+            if (end == std::string_view::npos) {
+                result.emplace_back(text.substr(start));
+                return result;
+            }
+            result.emplace_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+public:
+    explicit AsmDocument(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    // Replace the whole text
+    void setText(std::string_view text) {
+        lines.clear();
+        for (auto& lineText : splitLines(text)) {
+            lines.emplace_back();
+            lines.back().text = std::move(lineText);
+        }
+        relexedLines = 0;
+        for (size_t i = 0; i < lines.size(); i++) {
+            lines[i].code = "\x01";  // Force a change so every line is classified
+            relex(i);
+        }
+        reparseFrom = 0;
+    }
+
+    // Replace the text between two (line, column) positions, column in bytes
+    void applyEdit(size_t startLine, size_t startColumn, size_t endLine, size_t endColumn, std::string_view newText) {
+        if (lines.empty()) lines.emplace_back();
+        startLine = std::min(startLine, lines.size() - 1);
+        endLine = std::min(std::max(endLine, startLine), lines.size() - 1);
+        startColumn = std::min(startColumn, lines[startLine].text.size());
+        endColumn = std::min(endColumn, lines[endLine].text.size());
+        if (endLine == startLine) endColumn = std::max(endColumn, startColumn);
+
+        std::string merged = lines[startLine].text.substr(0, startColumn);
+        merged += newText;
+        merged += lines[endLine].text.substr(endColumn);
+        std::vector<std::string> replacement = splitLines(merged);
+
+        // Removed alias lines change the alias state of everything after them
+        for (size_t i = startLine; i <= endLine; i++) {
+            if (lines[i].kind == LINE_ALIAS) reparseFrom = std::min(reparseFrom, startLine);
+        }
+
+        std::vector<Line> inserted(replacement.size());
+        for (size_t i = 0; i < replacement.size(); i++) {
+            inserted[i].text = std::move(replacement[i]);
+            inserted[i].code = "\x01";
+        }
+        lines.erase(lines.begin() + startLine, lines.begin() + endLine + 1);
+        lines.insert(lines.begin() + startLine, inserted.begin(), inserted.end());
+        if (reparseFrom > startLine && reparseFrom != (size_t)-1) {
+            reparseFrom = reparseFrom + replacement.size() - (endLine - startLine + 1);
+        }
+
+        // Re-lex the new lines, then continue while the carried comment state keeps changing
+        relexedLines = 0;
+        size_t end = startLine + inserted.size();
+        for (size_t i = startLine; i < lines.size(); i++) {
+            if (!relex(i) && i >= end) break;
+        }
+    }
+
+    // Re-parse dirty lines and recompute layout, labels and diagnostics
+    void update() {
+        Assembler assembler(isaSpec);
+        labels.clear();
+        diagnostics.clear();
+        reparsedLines = 0;
+        int address = 0;
+
+        for (size_t i = 0; i < lines.size(); i++) {
+            Line& line = lines[i];
+            line.address = -1;
+            switch (line.kind) {
+                case LINE_ALIAS:
+                    assembler.defineAlias(line.code);
+                    for (auto& diagnostic : assembler.takeDiagnostics()) {
+                        diagnostic.line = i;
+                        diagnostics.push_back(std::move(diagnostic));
+                    }
+                    break;
+
+                case LINE_LABEL: {
+                    std::string name(Assembler::parseLabel(line.code));
+                    line.address = address;
+                    if (!labels.emplace(name, i).second) {
+                        diagnostics.push_back({AsmDiagnostic::SEVERITY_WARNING, i, "Duplicate label '" + name + "' ignored"});
+                    }
+                    break;
+                }
+
+                case LINE_INSTRUCTION:
+                    if (line.dirty || i >= reparseFrom) {
+                        line.encoding = assembler.parseDetached(line.code, line.parseError, line.expression);
+                        assembler.takeDiagnostics();
+                        line.dirty = false;
+                        reparsedLines++;
+                    }
+                    if (line.parseError) {
+                        diagnostics.push_back({AsmDiagnostic::SEVERITY_ERROR, i,
+                                               "Failed to parse line " + std::to_string(i + 1) + ": " + line.code});
+                        break;
+                    }
+                    if (address == 256) {
+                        diagnostics.push_back({AsmDiagnostic::SEVERITY_ERROR, i, "Program exceeds the 256-instruction ROM"});
+                    }
+                    line.address = address++;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        reparseFrom = (size_t)-1;
+        instructionCount = (size_t)address;
+
+        // Evaluate label and '.' operands into the cached encodings
+        auto lookup = [this](std::string_view name) {
+            auto it = labels.find(std::string(name));
+            return (it == labels.end()) ? -1 : lines[it->second].address;
+        };
+        for (size_t i = 0; i < lines.size(); i++) {
+            Line& line = lines[i];
+            if (line.address < 0 || line.kind != LINE_INSTRUCTION) continue;
+            line.finalEncoding = line.encoding;
+            line.label.clear();
+            if (line.expression.empty()) continue;
+
+            AsmExpressionValue result;
+            evaluateAsmExpression(line.expression, line.address, lookup, result);
+            line.label = std::string(result.firstLabel);
+            if (result.unresolved) {
+                diagnostics.push_back({AsmDiagnostic::SEVERITY_ERROR, i,
+                                       "Undefined label '" + std::string(result.undefinedLabel) + "' on line " + std::to_string(i + 1)});
+                continue;
+            }
+            if (result.value < -32768 || result.value > 65535) {
+                diagnostics.push_back({AsmDiagnostic::SEVERITY_ERROR, i,
+                                       "Expression '" + line.expression + "' out of range on line " + std::to_string(i + 1)});
+                continue;
+            }
+            line.finalEncoding = (line.finalEncoding & 0xFFFF) | ((uint32_t)(result.value & 0xFFFF) << 16);
+        }
+    }
+
+    size_t lineCount() const { return lines.size(); }
+    const Line& line(size_t index) const { return lines[index]; }
+    const std::vector<AsmDiagnostic>& getDiagnostics() const { return diagnostics; }
+    size_t getInstructionCount() const { return instructionCount; }
+    size_t getRelexedLines() const { return relexedLines; }
+    size_t getReparsedLines() const { return reparsedLines; }
+
+    // Line defining a label, false if undefined
+    bool findLabel(const std::string& name, size_t& lineIndex) const {
+        auto it = labels.find(name);
+        if (it == labels.end()) return false;
+        lineIndex = it->second;
+        return true;
+    }
+
+    std::string getText() const {
+        std::string text;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (i) text += '\n';
+            text += lines[i].text;
+        }
+        return text;
+    }
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cctype>
+#include <string_view>
+
+// Constant expressions in instruction operands:
+//   numbers (decimal, 0x hex, 0b binary, 'c'), labels, '.' (address of the
+//   current instruction), parentheses, unary - ~ +, and binary * / % + - << >>
+//   & ^ | with C precedence.
+//
+// Besides the value, the result records how it depends on code addresses, so
+// the assembler can defer expressions that use labels defined later and emit
+// relocations for "label + constant" and ". + constant".
+struct AsmExpressionValue {
+    long value = 0;                // Undefined labels and an unknown '.' count as 0
+    bool usesAddress = false;      // Mentions a label or '.'
+    bool unresolved = false;       // Mentions an undefined label, or '.' while unknown
+    std::string_view firstLabel;   // First label mentioned
+    std::string_view undefinedLabel;
+
+    // Shape, for relocation: the one address term and how it is combined
+    int addressMentions = 0;       // Labels and '.' mentioned
+    int addressTerms = 0;          // Added minus subtracted
+    bool scaled = false;           // An address feeds an operator other than + and -
+    bool pcRelative = false;       // The address term is '.'
+    long base = 0;                 // Value of the address term
+
+    // "label + constant" or ". + constant"
+    bool isAddress() const { return addressMentions == 1 && addressTerms == 1 && !scaled; }
+};
+
+// Recursive descent evaluator. lookup(name) returns a label's address, or -1
+// if it is undefined; pc is the value of '.', or -1 if unknown.
+template <typename LabelLookup>
+class AsmExpressionParser {
+private:
+    std::string_view text;
+    size_t pos = 0;
+    int pc;
+    LabelLookup& lookup;
+    bool failed = false;
+
+    // Intermediate values stay within 32 bits so nothing overflows a long
+    static const long LIMIT = 0xFFFFFFFFL;
+
+    static bool isIdentifierStart(char c) { return std::isalpha((unsigned char)c) || c == '_' || c == '.'; }
+    static bool isIdentifierChar(char c) { return std::isalnum((unsigned char)c) || c == '_' || c == '.'; }
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) pos++;
+    }
+
+    bool accept(std::string_view op) {
+        skipSpace();
+        if (text.substr(pos, op.size()) != op) return false;
+        pos += op.size();
+        return true;
+    }
+
+    AsmExpressionValue fail() {
+        failed = true;
+        return AsmExpressionValue();
+    }
+
+    AsmExpressionValue number() {
+        int base = 10;
+        if (text[pos] == '0' && pos + 1 < text.size() && (text[pos + 1] == 'x' || text[pos + 1] == 'X')) base = 16;
+        if (text[pos] == '0' && pos + 1 < text.size() && (text[pos + 1] == 'b' || text[pos + 1] == 'B')) base = 2;
+        if (base != 10) pos += 2;
+
+        AsmExpressionValue result;
+        size_t start = pos;
+        for (; pos < text.size(); pos++) {
+            char c = text[pos];
+            int digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else break;
+            if (digit >= base) break;
+            result.value = result.value * base + digit;
+            if (result.value > LIMIT) return fail();
+        }
+        if (pos == start || (pos < text.size() && isIdentifierChar(text[pos]))) return fail();
+        return result;
+    }
+
+    AsmExpressionValue address(std::string_view name) {
+        AsmExpressionValue result;
+        result.usesAddress = true;
+        result.addressMentions = 1;
+        result.addressTerms = 1;
+        int address;
+        if (name == ".") {
+            result.pcRelative = true;
+            address = pc;
+        } else {
+            result.firstLabel = name;
+            address = lookup(name);
+            if (address < 0) result.undefinedLabel = name;
+        }
+        if (address < 0) {
+            result.unresolved = true;
+            address = 0;
+        }
+        result.value = result.base = address;
+        return result;
+    }
+
+    AsmExpressionValue primary() {
+        skipSpace();
+        if (pos >= text.size()) return fail();
+        char c = text[pos];
+
+        if (c == '(') {
+            pos++;
+            AsmExpressionValue inner = binary(0);
+            if (!accept(")")) return fail();
+            return inner;
+        }
+        if (c == '\'') {
+            // ASCII character literal: 'A' -> 65
+            if (pos + 2 >= text.size() || text[pos + 2] != '\'') return fail();
+            AsmExpressionValue result;
+            result.value = (unsigned char)text[pos + 1];
+            pos += 3;
+            return result;
+        }
+        if (c >= '0' && c <= '9') return number();
+        if (isIdentifierStart(c)) {
+            size_t start = pos;
+            while (pos < text.size() && isIdentifierChar(text[pos])) pos++;
+            return address(text.substr(start, pos - start));
+        }
+        return fail();
+    }
+
+    AsmExpressionValue unary() {
+        skipSpace();
+        if (pos < text.size() && (text[pos] == '-' || text[pos] == '~' || text[pos] == '+')) {
+            char op = text[pos++];
+            AsmExpressionValue operand = unary();
+            if (op == '-') {
+                operand.value = -operand.value;
+                operand.addressTerms = -operand.addressTerms;
+            } else if (op == '~') {
+                operand.value = ~operand.value;
+                operand.scaled = operand.scaled || operand.usesAddress;
+            }
+            return operand;
+        }
+        return primary();
+    }
+
+    // Binary operators from loosest (level 0) to tightest binding
+    static int precedence(std::string_view op) {
+        if (op == "|") return 0;
+        if (op == "^") return 1;
+        if (op == "&") return 2;
+        if (op == "<<" || op == ">>") return 3;
+        if (op == "+" || op == "-") return 4;
+        return 5;  // * / %
+    }
+
+    std::string_view peekOperator() {
+        skipSpace();
+        static const std::string_view operators[] = {"<<", ">>", "|", "^", "&", "+", "-", "*", "/", "%"};
+        for (std::string_view op : operators) {
+            if (text.substr(pos, op.size()) == op) return op;
+        }
+        return std::string_view();
+    }
+
+    AsmExpressionValue combine(const AsmExpressionValue& a, std::string_view op, const AsmExpressionValue& b) {
+        AsmExpressionValue result;
+        result.usesAddress = a.usesAddress || b.usesAddress;
+        result.unresolved = a.unresolved || b.unresolved;
+        result.firstLabel = a.firstLabel.empty() ? b.firstLabel : a.firstLabel;
+        result.undefinedLabel = a.undefinedLabel.empty() ? b.undefinedLabel : a.undefinedLabel;
+        result.addressMentions = a.addressMentions + b.addressMentions;
+        result.scaled = a.scaled || b.scaled;
+        const AsmExpressionValue& term = a.addressMentions ? a : b;
+        result.pcRelative = term.pcRelative;
+        result.base = term.base;
+
+        if (op == "+") {
+            result.value = a.value + b.value;
+            result.addressTerms = a.addressTerms + b.addressTerms;
+        } else if (op == "-") {
+            result.value = a.value - b.value;
+            result.addressTerms = a.addressTerms - b.addressTerms;
+        } else {
+            result.scaled = result.scaled || result.usesAddress;
+            if (op == "*") {
+                result.value = a.value * b.value;
+            } else if (op == "/" || op == "%") {
+                // Undefined labels are 0 until resolved, so only a known divisor can fail
+                if (b.value == 0) {
+                    if (b.unresolved) return result;
+                    return fail();
+                }
+                result.value = (op == "/") ? a.value / b.value : a.value % b.value;
+            } else if (op == "<<" || op == ">>") {
+                if (b.value < 0 || b.value > 31) return fail();
+                result.value = (op == "<<") ? (long)((unsigned long)a.value << b.value) : a.value >> b.value;
+            } else if (op == "&") {
+                result.value = a.value & b.value;
+            } else if (op == "^") {
+                result.value = a.value ^ b.value;
+            } else {
+                result.value = a.value | b.value;
+            }
+        }
+        if (result.value > LIMIT || result.value < -LIMIT) return fail();
+        return result;
+    }
+
+    AsmExpressionValue binary(int level) {
+        AsmExpressionValue left = unary();
+        while (!failed) {
+            std::string_view op = peekOperator();
+            if (op.empty() || precedence(op) < level) break;
+            pos += op.size();
+            AsmExpressionValue right = binary(precedence(op) + 1);
+            if (failed) break;
+            left = combine(left, op, right);
+        }
+        return left;
+    }
+
+public:
+    AsmExpressionParser(std::string_view source, int currentPc, LabelLookup& labelLookup)
+        : text(source), pc(currentPc), lookup(labelLookup) {}
+
+    // Evaluate the whole text, false on a syntax error, division by zero or overflow
+    bool evaluate(AsmExpressionValue& result) {
+        result = binary(0);
+        skipSpace();
+        return !failed && pos == text.size();
+    }
+};
+
+// Helper: Evaluate an operand expression (does not allocate)
+template <typename LabelLookup>
+inline bool evaluateAsmExpression(std::string_view text, int pc, LabelLookup lookup, AsmExpressionValue& result) {
+    if (text.empty()) return false;
+    AsmExpressionParser<LabelLookup> parser(text, pc, lookup);
+    return parser.evaluate(result);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Line lexer for assembly source held in memory (e.g. a MappedFile).
+// Yields each line with // and /* */ comments removed and surrounding
+// whitespace trimmed. Lines are views into the source buffer; only a line
+// with a comment in the middle of its code is copied, into a scratch buffer
+// that is reused for every line, so lexing does not allocate per line.
+class AsmLexer {
+private:
+    std::string_view source;
+    size_t pos = 0;
+    size_t lineNumber = 0;
+    bool inMultiline = false;     // Inside /* */ across line boundaries
+    std::string scratch;
+
+    static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+public:
+    // startInComment: source begins inside a /* */ comment (lexing a single edited line)
+    explicit AsmLexer(std::string_view src, bool startInComment = false)
+        : source(src), inMultiline(startInComment) { scratch.reserve(256); }
+
+    // Advance to the next source line, false at end of input.
+    // The view stays valid until the next call.
+    bool nextLine(std::string_view& line) {
+        if (pos >= source.size()) return false;
+
+        size_t end = source.find('\n', pos);
+        if (end == std::string_view::npos) end = source.size();
+        std::string_view raw = source.substr(pos, end - pos);
+        pos = end + 1;
+        lineNumber++;
+
+        // Kept characters stay a single view unless a comment splits them,
+        // in which case they are spliced together in the scratch buffer
+        size_t keptStart = std::string_view::npos;
+        size_t keptEnd = 0;
+        bool contiguous = true;
+
+        size_t i = 0;
+        size_t len = raw.size();
+        while (i < len) {
+            if (inMultiline) {
+                if (i + 1 < len && raw[i] == '*' && raw[i + 1] == '/') {
+                    inMultiline = false;
+                    i += 2;
+                } else {
+                    i++;
+                }
+            } else if (i + 1 < len && raw[i] == '/' && raw[i + 1] == '*') {
+                inMultiline = true;
+                i += 2;
+            } else if (i + 1 < len && raw[i] == '/' && raw[i + 1] == '/') {
+                break;
+            } else {
+                if (keptStart == std::string_view::npos) {
+                    keptStart = i;
+                } else if (contiguous && i != keptEnd) {
+                    contiguous = false;
+                    scratch.assign(raw.data() + keptStart, keptEnd - keptStart);
+                }
+                if (!contiguous) scratch += raw[i];
+                keptEnd = ++i;
+            }
+        }
+
+        if (keptStart == std::string_view::npos) {
+            line = std::string_view();
+            return true;
+        }
+        std::string_view code = contiguous ? raw.substr(keptStart, keptEnd - keptStart) : std::string_view(scratch);
+
+        size_t first = 0;
+        while (first < code.size() && isBlank(code[first])) first++;
+        size_t last = code.size();
+        while (last > first && isBlank(code[last - 1])) last--;
+        line = code.substr(first, last - first);
+        return true;
+    }
+
+    // 1-based number of the line last returned by nextLine()
+    size_t currentLine() const { return lineNumber; }
+
+    // True if the last line returned ended inside a /* */ comment
+    bool inComment() const { return inMultiline; }
+};
+
+// Operand separators: commas and whitespace
+inline bool isTokenSeparator(char c) {
+    return c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+// Split operands into a caller-provided array.
+// Returns the token count, or maxTokens + 1 if there were too many.
+inline size_t splitTokens(std::string_view text, std::string_view* tokens, size_t maxTokens) {
+    size_t count = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (isTokenSeparator(text[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < text.size() && !isTokenSeparator(text[i])) i++;
+        if (count == maxTokens) return maxTokens + 1;
+        tokens[count++] = text.substr(start, i - start);
+    }
+    return count;
+}
+
+// Split instruction operands into a caller-provided array. Commas and
+// whitespace separate operands as in splitTokens(), except inside
+// parentheses, so an expression with spaces is written in parentheses
+// ("MOV X7 (ret + 2)"). Character literals such as ',' or ' ' are never split.
+// Returns the token count, or maxTokens + 1 if there were too many.
+inline size_t splitOperands(std::string_view text, std::string_view* tokens, size_t maxTokens) {
+    auto isCharLiteral = [&text](size_t i) { return text[i] == '\'' && i + 2 < text.size() && text[i + 2] == '\''; };
+
+    size_t count = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (isTokenSeparator(text[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        int depth = 0;
+        while (i < text.size()) {
+            if (isCharLiteral(i)) {
+                i += 3;
+                continue;
+            }
+            if (depth == 0 && isTokenSeparator(text[i])) break;
+            if (text[i] == '(') depth++;
+            else if (text[i] == ')' && depth > 0) depth--;
+            i++;
+        }
+        if (count == maxTokens) return maxTokens + 1;
+        tokens[count++] = text.substr(start, i - start);
+    }
+    return count;
+}
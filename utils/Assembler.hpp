@@ -0,0 +1,938 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "AsmLexer.hpp"
+#include "AsmExpression.hpp"
+#include "ObjectModule.hpp"
+
+// In-memory assembler library: source text in, instructions, symbols and
+// diagnostics out. It does no file or console I/O. Each Assembler owns its
+// tables and only reads the ISA spec, so separate instances (or calls to
+// assemble()) can run on many threads at once against one shared spec.
+
+struct AsmSymbol {
+    std::string name;
+    uint16_t address;
+};
+
+struct AsmDiagnostic {
+    enum Severity { SEVERITY_ERROR, SEVERITY_WARNING };
+    Severity severity;
+    size_t line;          // 1-based source line, 0 if not tied to a line
+    std::string message;
+};
+
+// Immediate computed from labels or '.', kept for passes that move code
+struct AsmAddressOperand {
+    size_t index;              // Instruction whose immediate (bits 16-31) holds the value
+    std::string expression;
+};
+
+// Register operand naming a virtual register (%name), encoded as X0 until allocated
+struct AsmVirtualOperand {
+    size_t index;              // Instruction
+    uint8_t shift;             // Register field: 8 (DST), 12 (A) or 16 (B)
+    uint16_t reg;              // Index into AssemblyResult::virtualRegisters
+    size_t line;               // Source line, for allocation errors
+};
+
+struct AssemblyResult {
+    std::vector<uint32_t> instructions;
+    std::vector<AsmSymbol> symbols;
+    std::vector<ObjectModule::Relocation> relocations;  // Only filled for relocatable output
+    std::vector<AsmAddressOperand> addressOperands;
+    std::vector<std::string> virtualRegisters;          // Names without the '%'
+    std::vector<AsmVirtualOperand> virtualOperands;     // Emptied once registers are allocated
+    uint16_t spillBase = 240;                           // RAM words the allocator may spill to (#SPILL)
+    uint16_t spillCount = 16;
+    std::vector<AsmDiagnostic> diagnostics;
+    size_t errorCount = 0;
+
+    bool ok() const { return errorCount == 0; }
+};
+
+class Assembler {
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+
+    // Relocatable output: record relocations and leave undefined labels to the linker
+    bool relocatable = false;
+    // Line-at-a-time parsing (parseDetached): '.' is unknown and label expressions are handed back
+    bool detached = false;
+    std::vector<ObjectModule::Relocation> relocations;
+    std::vector<AsmDiagnostic> diagnostics;
+    size_t errorCount = 0;
+
+    // Helper: Check if mnemonic is an ALU operation (based on type in spec)
+    bool isAluOperation(std::string_view mnemonic) {
+        const IsaSpec::MnemonicInfo* info = IsaSpec::findMnemonic(isaSpec, mnemonic);
+        return info && info->is_alu;
+    }
+
+    // Helper: Find opcode from mnemonic and operand types using ISA spec
+    // The compiler differentiates by checking if the last operand is a register or immediate
+    uint8_t findOpcode(std::string_view mnemonic, bool immediate) {
+        const IsaSpec::MnemonicInfo* info = IsaSpec::findMnemonic(isaSpec, mnemonic);
+        return info ? info->opcode[immediate] : 0xFF;
+    }
+
+    // Helper: Find opcode from mnemonic, type, and immediate flag
+    uint8_t findOpcodeByType(std::string_view mnemonic, IsaSpec::InstructionType type, bool immediate) {
+        return IsaSpec::findOpcode(isaSpec, mnemonic, type, immediate);
+    }
+
+    // Helper: Find branch condition code from mnemonic
+    int findBranchCondition(std::string_view mnemonic) { return IsaSpec::findBranchCondition(isaSpec, mnemonic); }
+
+    // Symbol table for labels
+    std::vector<AsmSymbol> symbolTable;
+
+    // Immediates using labels defined later, evaluated once the whole source is read
+    struct Fixup {
+        std::string expression;
+        size_t instructionIndex;
+        size_t lineNumber;         // Source line, for unresolved-label errors
+        int pc;                    // Value of '.'
+    };
+    std::vector<Fixup> fixups;
+    std::vector<uint32_t> instructions;
+    std::vector<AsmAddressOperand> addressOperands;
+    std::vector<std::string> virtualRegisters;
+    std::vector<AsmVirtualOperand> virtualOperands;
+    uint16_t spillBase = 240;
+    uint16_t spillCount = 16;
+    size_t currentLine = 0;
+
+    // Operand expression of the instruction being parsed that uses a label or '.'
+    int currentPc = -1;
+    std::string_view addressExpression;
+    AsmExpressionValue addressValue;
+    bool narrowImmediate = false;  // Operand is not in bits 16-31 (PRINT, 2-operand ALU): no label or '.'
+
+    static const size_t MAX_OPERANDS = 4;
+
+    // Alias table for register aliasing
+    struct RegisterAlias {
+        std::string alias;
+        std::string registerName;  // e.g., "X0", "X1"
+    };
+    std::vector<RegisterAlias> aliasTable;
+
+    // Helper: Validate alias name (alphanumeric + underscore only)
+    bool isValidAliasName(std::string_view name) {
+        if (name.empty()) return false;
+
+        // Check that name contains only alphanumeric characters and underscores
+        for (char c : name) {
+            if (!std::isalnum((unsigned char)c) && c != '_') {
+                return false;
+            }
+        }
+
+        // Check that alias doesn't conflict with instruction mnemonics
+        if (isAluOperation(name)) return false;
+
+        // Check against other instruction mnemonics
+        const char* reserved[] = {
+            "MOV", "CMP", "B", "BEQ", "BNE", "BLT", "BLE", "BGT", "BGE",
+            "BCS", "BCC", "BMI", "BPL", "BVS", "BVC", "BHI", "BLS",
+            "READ", "WRITE", "PRINT", "EXIT", "NOT"
+        };
+
+        for (const char* mnemonic : reserved) {
+            if (name == mnemonic) return false;
+        }
+
+        return true;
+    }
+
+    // Helper: Resolve alias to register name
+    std::string_view resolveAlias(std::string_view str) {
+        // Check if this is an alias
+        for (const auto& alias : aliasTable) {
+            if (alias.alias == str) {
+                return alias.registerName;
+            }
+        }
+        // Not an alias, return original
+        return str;
+    }
+
+    // Helper: Parse leading digits in the given base (atoi/strtol semantics, saturating)
+    static long parseDigits(std::string_view str, int base) {
+        size_t i = 0;
+        bool negative = false;
+        if (i < str.size() && (str[i] == '+' || str[i] == '-')) negative = (str[i++] == '-');
+
+        long value = 0;
+        for (; i < str.size(); i++) {
+            char c = str[i];
+            int digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'z') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'Z') digit = c - 'A' + 10;
+            else break;
+            if (digit >= base) break;
+            if (value < 0x7FFFFFF) value = value * base + digit;
+        }
+        return negative ? -value : value;
+    }
+
+    // Helper: Check virtual register syntax: '%' then a letter or '_', then alphanumerics
+    static bool isVirtualRegister(std::string_view str) {
+        if (str.size() < 2 || str[0] != '%') return false;
+        if (!std::isalpha((unsigned char)str[1]) && str[1] != '_') return false;
+        for (size_t i = 2; i < str.size(); i++) {
+            if (!std::isalnum((unsigned char)str[i]) && str[i] != '_') return false;
+        }
+        return true;
+    }
+
+    // Helper: Parse register (e.g., "X0" -> 0), with alias support.
+    // A virtual register parses as X0; assembleSource() records where it went.
+    int parseRegister(std::string_view str) {
+        if (isVirtualRegister(str)) return 0;
+
+        // First check if it's an alias
+        std::string_view resolved = resolveAlias(str);
+
+        if (resolved.length() < 2) return -1;
+        if (resolved[0] != 'X' && resolved[0] != 'x') return -1;
+        for (char c : resolved.substr(1)) {
+            if (c < '0' || c > '9') return -1;  // "X1)" or "X0 X1" is not a register
+        }
+        long reg = parseDigits(resolved.substr(1), 10);
+        if (reg < 0 || reg > 7) return -1;
+        return (int)reg;
+    }
+
+    // Helper: Parse constant expression (hex, binary, decimal, ASCII, labels, '.', operators).
+    // Results wrap to 16 bits, so negative values down to -32768 are accepted.
+    // An expression using a label or '.' is kept in addressExpression for parseInstruction();
+    // if it needs a label defined later it evaluates to 0 for now.
+    int parseConstant(std::string_view str) {
+        AsmExpressionValue result;
+        auto lookup = [this](std::string_view name) { return lookupLabel(name); };
+        if (!evaluateAsmExpression(str, currentPc, lookup, result)) return -1;
+        if (result.usesAddress) {
+            if (narrowImmediate) return -1;
+            addressExpression = str;
+            addressValue = result;
+            if (result.unresolved) return 0;
+        }
+        if (result.value < -32768 || result.value > 65535) return -1;
+        return (int)(result.value & 0xFFFF);
+    }
+
+    // Helper: Lookup label in symbol table
+    int lookupLabel(std::string_view name) {
+        for (const auto& label : symbolTable) {
+            if (label.name == name) return label.address;
+        }
+        return -1;
+    }
+
+    // Helper: Define label at the current instruction
+    void defineLabel(std::string_view name) {
+        if (lookupLabel(name) >= 0) {
+            report(AsmDiagnostic::SEVERITY_WARNING, "Duplicate label '" + std::string(name) + "' ignored");
+            return;
+        }
+        symbolTable.push_back({std::string(name), (uint16_t)instructions.size()});
+    }
+
+    // Helper: Patch forward references once every label is known
+    void resolveFixups() {
+        auto lookup = [this](std::string_view name) { return lookupLabel(name); };
+        for (const auto& fixup : fixups) {
+            currentLine = fixup.lineNumber;
+            AsmExpressionValue result;
+            evaluateAsmExpression(fixup.expression, fixup.pc, lookup, result);
+            if (result.unresolved) {
+                // In object output, "label + constant" with an external label is left to the linker
+                if (relocatable && result.isAddress()) continue;
+                report(AsmDiagnostic::SEVERITY_ERROR, "Undefined label '" + std::string(result.undefinedLabel) + "' on line " + std::to_string(fixup.lineNumber));
+                continue;
+            }
+            if (result.value < -32768 || result.value > 65535) {
+                report(AsmDiagnostic::SEVERITY_ERROR, "Expression '" + fixup.expression + "' out of range on line " + std::to_string(fixup.lineNumber));
+                continue;
+            }
+            // Every immediate that can hold an expression lives in bits 16-31
+            uint32_t& instr = instructions[fixup.instructionIndex];
+            instr = (instr & 0xFFFF) | ((uint32_t)(result.value & 0xFFFF) << 16);
+        }
+        fixups.clear();
+    }
+
+    // Helper: Record what an address expression needs beyond its current value:
+    // a relocation in object output, a fixup if it uses a label defined later
+    bool finishAddressExpression(uint32_t instr, int instructionNumber) {
+        if (relocatable && instructionNumber != -1) {
+            if (!addressValue.isAddress()) {
+                report(AsmDiagnostic::SEVERITY_ERROR, "Expression '" + std::string(addressExpression) +
+                       "' is not relocatable, object output supports only label + constant and . + constant");
+                return false;
+            }
+            bool branch = (instr & 0xFF) == findOpcode("B", true);
+            long addend = addressValue.pcRelative ? addressValue.value : addressValue.value - addressValue.base;
+            relocations.push_back({(uint16_t)instructionNumber, branch ? ObjectModule::RELOC_BRANCH : ObjectModule::RELOC_ADDRESS,
+                                   addressValue.pcRelative ? std::string() : std::string(addressValue.firstLabel), (int32_t)addend});
+        }
+        if (addressValue.unresolved) {
+            if (instructionNumber == -1) return false;
+            fixups.push_back({std::string(addressExpression), (size_t)instructionNumber, currentLine, currentPc});
+        }
+        return true;
+    }
+
+    // Helper: Parse "#ALIAS <register> <alias>" directive into the alias table
+    void parseAliasDirective(std::string_view directive) {
+        std::string_view args[3];
+        size_t argCount = splitTokens(directive.substr(6), args, 2);
+        std::string_view regName = argCount > 0 ? args[0] : std::string_view();
+        std::string_view aliasName = argCount > 1 ? args[1] : std::string_view();
+
+        // Validate register name (need to temporarily disable alias resolution)
+        long regNum = -1;
+        if (regName.length() >= 2 && (regName[0] == 'X' || regName[0] == 'x')) {
+            regNum = parseDigits(regName.substr(1), 10);
+        }
+
+        if (regNum < 0 || regNum > 7) {
+            report(AsmDiagnostic::SEVERITY_ERROR, "Invalid register in #ALIAS: " + std::string(regName));
+            return;
+        }
+
+        // Validate alias name
+        if (!isValidAliasName(aliasName)) {
+            report(AsmDiagnostic::SEVERITY_ERROR, "Invalid alias name: " + std::string(aliasName) +
+                   "\n       Alias names must be alphanumeric with underscores only,"
+                   "\n       and must not conflict with instruction mnemonics.");
+            return;
+        }
+
+        // Add or update alias (subsequent calls overwrite)
+        for (auto& alias : aliasTable) {
+            if (alias.alias == aliasName) {
+                alias.registerName = std::string(regName);
+                return;
+            }
+        }
+        aliasTable.push_back({std::string(aliasName), std::string(regName)});
+    }
+
+    // Helper: Parse "#SPILL <address>, <count>": the RAM words register allocation may spill to
+    void parseSpillDirective(std::string_view directive) {
+        std::string_view args[3];
+        size_t argCount = splitOperands(directive.substr(6), args, 2);
+        auto noLabels = [](std::string_view) { return -1; };
+        AsmExpressionValue address, count;
+        if (argCount != 2 || !evaluateAsmExpression(args[0], -1, noLabels, address) || address.usesAddress ||
+            !evaluateAsmExpression(args[1], -1, noLabels, count) || count.usesAddress) {
+            report(AsmDiagnostic::SEVERITY_ERROR, "Expected #SPILL <address>, <count>");
+            return;
+        }
+        if (address.value < 0 || count.value < 0 || address.value + count.value > 256) {
+            report(AsmDiagnostic::SEVERITY_ERROR, "#SPILL area must lie within RAM addresses 0-255");
+            return;
+        }
+        spillBase = (uint16_t)address.value;
+        spillCount = (uint16_t)count.value;
+    }
+
+    // Helper: Record the %name operands of an assembled instruction with the field each one landed in
+    void recordVirtualOperands(std::string_view line, uint32_t instr) {
+        auto it = isaSpec.opcode_map.find(instr & 0xFF);
+        if (it == isaSpec.opcode_map.end()) return;
+        const IsaSpec::InstructionTech& tech = *it->second;
+
+        size_t start = line.find_first_not_of(" \t");
+        size_t spacePos = line.find_first_of(" \t", start);
+        if (spacePos == std::string_view::npos) return;
+        std::string_view tokens[MAX_OPERANDS];
+        size_t tokenCount = splitOperands(line.substr(spacePos + 1), tokens, MAX_OPERANDS);
+
+        // Register field of each operand, in source order
+        uint8_t fields[3] = {8, 12, 16};  // ALU, NOT, MOV, LR
+        switch (tech.type) {
+            case IsaSpec::InstructionType::TYPE_CMP: fields[0] = 12; fields[1] = 16; break;
+            case IsaSpec::InstructionType::TYPE_BRANCH: fields[0] = 16; break;
+            case IsaSpec::InstructionType::TYPE_MEMORY: fields[0] = tech.mnemonic == "READ" ? 8 : 12; fields[1] = 16; break;
+            case IsaSpec::InstructionType::TYPE_PRINT_REG:
+            case IsaSpec::InstructionType::TYPE_PRINT_CONST: fields[0] = 16; fields[1] = 12; break;
+            default: break;
+        }
+
+        for (size_t i = 0; i < tokenCount && i < 3; i++) {
+            if (!isVirtualRegister(tokens[i])) continue;
+            std::string_view name = tokens[i].substr(1);
+            size_t reg = 0;
+            while (reg < virtualRegisters.size() && virtualRegisters[reg] != name) reg++;
+            if (reg == virtualRegisters.size()) virtualRegisters.emplace_back(name);
+            virtualOperands.push_back({instructions.size(), fields[i], (uint16_t)reg, currentLine});
+        }
+    }
+
+    // Helper: Parse branch condition
+    int parseBranchCondition(std::string_view mnemonic) {
+        return findBranchCondition(mnemonic);
+    }
+
+    // Encoding functions
+    uint32_t encodeAlu(uint8_t op, uint8_t dst, uint16_t src1, uint16_t src2, bool isImmediate) {
+        uint32_t instr = 0;
+        uint8_t actualOpcode = isImmediate ? (op | 0x10) : op;
+        instr |= actualOpcode;
+        instr |= ((dst & 0x7) << 8);
+
+        if (!isImmediate) {
+            instr |= ((src1 & 0x7) << 12);
+            instr |= ((src2 & 0x7) << 16);
+        } else {
+            instr |= ((src1 & 0x7) << 12);
+            instr |= ((src2 & 0xFFFF) << 16);
+        }
+        return instr;
+    }
+
+    uint32_t encodeMove(uint8_t dst, uint16_t srcOrImm, bool isImmediate) {
+        uint32_t instr = 0;
+        uint8_t moveOp = findOpcode("MOV", isImmediate);
+        instr |= moveOp;
+        instr |= ((dst & 0x7) << 8);
+
+        if (!isImmediate) {
+            instr |= ((srcOrImm & 0x7) << 12);
+        } else {
+            instr |= ((uint32_t)(srcOrImm & 0xFFFF) << 16);
+        }
+        return instr;
+    }
+
+    uint32_t encodeCmp(uint8_t src1, uint16_t src2, bool isImmediate) {
+        uint32_t instr = 0;
+        uint8_t cmpOp = findOpcode("CMP", isImmediate);
+        instr |= cmpOp;
+
+        if (!isImmediate) {
+            instr |= ((src1 & 0x7) << 12);
+            instr |= ((src2 & 0x7) << 16);
+        } else {
+            instr |= ((src1 & 0x7) << 12);
+            instr |= ((uint32_t)(src2 & 0xFFFF) << 16);
+        }
+        return instr;
+    }
+
+    uint32_t encodeBranch(uint8_t condition, uint16_t target, bool isImmediate) {
+        uint32_t instr = 0;
+        uint8_t branchOp = findOpcode("B", isImmediate);
+        instr |= branchOp;
+
+        if (isImmediate) {
+            // JI format: OPCODE[8] CONDITION[4] [0000] IMMEDIATE[16]
+            // Bits 0-7:   Opcode
+            // Bits 8-11:  Condition
+            // Bits 12-15: Always 0000
+            // Bits 16-31: Immediate address (16 bits)
+            instr |= ((condition & 0xF) << 8);
+            instr |= ((uint32_t)(target & 0xFFFF) << 16);
+        } else {
+            // J format: OPCODE[8] CONDITION[4] [0000] REG[4] [unused]
+            // Bits 0-7:   Opcode
+            // Bits 8-11:  Condition
+            // Bits 12-15: Always 0000
+            // Bits 16-19: Register to jump to
+            // Bits 20-31: Unused
+            instr |= ((condition & 0xF) << 8);
+            instr |= ((target & 0xF) << 16);
+        }
+        return instr;
+    }
+
+    uint32_t encodeRead(uint8_t dst, uint8_t addrReg) {
+        uint32_t instr = 0;
+        uint8_t readOp = findOpcode("READ", false);
+        instr |= readOp;
+        instr |= ((dst & 0x7) << 8);
+        instr |= ((addrReg & 0x7) << 16);
+        return instr;
+    }
+
+    uint32_t encodeReadI(uint8_t dst, uint16_t addrImm) {
+        uint32_t instr = 0;
+        uint8_t readOp = findOpcode("READ", true);
+        instr |= readOp;
+        instr |= ((dst & 0x7) << 8);
+        instr |= ((uint32_t)(addrImm & 0xFFFF) << 16);
+        return instr;
+    }
+
+    uint32_t encodeWrite(uint8_t dataReg, uint8_t addrReg) {
+        uint32_t instr = 0;
+        uint8_t writeOp = findOpcode("WRITE", false);
+        instr |= writeOp;
+        instr |= ((dataReg & 0x7) << 12);
+        instr |= ((addrReg & 0x7) << 16);
+        return instr;
+    }
+
+    uint32_t encodeWriteI(uint8_t dataReg, uint16_t addrImm) {
+        uint32_t instr = 0;
+        uint8_t writeOp = findOpcode("WRITE", true);
+        instr |= writeOp;
+        instr |= ((dataReg & 0x7) << 12);
+        instr |= ((uint32_t)(addrImm & 0xFFFF) << 16);
+        return instr;
+    }
+
+    // PRINT encoding per ISA: PRINT <address>, <data>
+    // PRINT_REG:    SCN[R[B]] = R[A]  -> address in B (bits 16-18), data in A (bits 12-14)
+    // PRINT_REG_I:  SCN[X] = R[A]     -> address in X (bits 16-23), data in A (bits 12-14)
+    // PRINT_CONST:  SCN[R[B]] = Y     -> address in B (bits 16-18), data in Y (bits 24-31)
+    // PRINT_CONST_I: SCN[X] = Y       -> address in X (bits 16-23), data in Y (bits 24-31)
+
+    uint32_t encodePrintReg(uint8_t dataReg, uint8_t posReg) {
+        uint32_t instr = 0;
+        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_REG, false);
+        instr |= printOp;
+        instr |= ((dataReg & 0x7) << 12);   // A field: data register
+        instr |= ((posReg & 0x7) << 16);    // B field: position register
+        return instr;
+    }
+
+    uint32_t encodePrintRegI(uint8_t dataReg, uint8_t posImm) {
+        uint32_t instr = 0;
+        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_REG, true);
+        instr |= printOp;
+        instr |= ((dataReg & 0x7) << 12);          // A field: data register
+        instr |= ((uint32_t)(posImm & 0xFF) << 16); // X (lower byte of immediate): position
+        return instr;
+    }
+
+    uint32_t encodePrintConst(uint8_t dataConst, uint8_t posReg) {
+        uint32_t instr = 0;
+        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_CONST, false);
+        instr |= printOp;
+        instr |= ((posReg & 0x7) << 16);           // B field: position register
+        instr |= ((uint32_t)(dataConst & 0xFF) << 24); // Y (upper byte): data constant
+        return instr;
+    }
+
+    uint32_t encodePrintConstI(uint16_t dataConst, uint8_t posImm) {
+        uint32_t instr = 0;
+        uint8_t printOp = findOpcodeByType("PRINT", IsaSpec::InstructionType::TYPE_PRINT_CONST, true);
+        instr |= printOp;
+        instr |= ((uint32_t)(posImm & 0xFF) << 16);    // X (lower byte): position
+        instr |= ((uint32_t)(dataConst & 0xFF) << 24); // Y (upper byte): data constant
+        return instr;
+    }
+
+
+    void report(AsmDiagnostic::Severity severity, std::string message) {
+        if (severity == AsmDiagnostic::SEVERITY_ERROR) errorCount++;
+        diagnostics.push_back({severity, currentLine, std::move(message)});
+    }
+
+    // Assemble source text into instructions/symbolTable, counting errors
+    void assembleSource(std::string_view source) {
+        // Single pass: labels resolve immediately or through the fixup list at the end
+        symbolTable.clear();
+        aliasTable.clear();
+        fixups.clear();
+        relocations.clear();
+        instructions.clear();
+        addressOperands.clear();
+        virtualRegisters.clear();
+        virtualOperands.clear();
+        spillBase = 240;
+        spillCount = 16;
+        AsmLexer lexer(source);
+        std::string_view line;
+
+        while (instructions.size() < 0xFFFF && lexer.nextLine(line)) {
+            if (line.empty()) continue;
+            currentLine = lexer.currentLine();
+
+            // Check for #ALIAS directive
+            if (line.length() > 6 && line.substr(0, 6) == "#ALIAS") {
+                parseAliasDirective(line);
+            }
+            else if (line.length() > 6 && line.substr(0, 6) == "#SPILL") {
+                parseSpillDirective(line);
+            }
+            else if (isLabel(line)) {
+                defineLabel(parseLabel(line));
+            }
+            else if (line[0] != '#' && line[0] != ';') {
+                bool error = false;
+                // Pass current instruction number for LR pseudo-instruction
+                uint32_t instr = parseInstruction(line, error, instructions.size());
+
+                if (error) {
+                    report(AsmDiagnostic::SEVERITY_ERROR, "Failed to parse line " + std::to_string(currentLine) + ": " + std::string(line));
+                    continue;
+                }
+                if (!addressExpression.empty()) addressOperands.push_back({instructions.size(), std::string(addressExpression)});
+                if (line.find('%') != std::string_view::npos) recordVirtualOperands(line, instr);
+                instructions.push_back(instr);
+            }
+        }
+
+        resolveFixups();
+    }
+
+public:
+    explicit Assembler(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    void setRelocatable(bool enable) { relocatable = enable; }
+
+    // Predefine labels for parseInstruction() calls made outside assemble()
+    void setSymbols(std::vector<AsmSymbol> symbols) { symbolTable = std::move(symbols); }
+
+    // Helper: Check label name syntax (letter, '_' or '.' first)
+    static bool isLabelName(std::string_view name) {
+        if (name.empty()) return false;
+        return std::isalpha((unsigned char)name[0]) || name[0] == '_' || name[0] == '.';
+    }
+
+    // Helper: Check if line is a label
+    static bool isLabel(std::string_view line) {
+        size_t colonPos = line.find(':');
+        if (colonPos == std::string_view::npos) return false;
+        return isLabelName(parseLabel(line));
+    }
+
+    // Helper: Parse label name
+    static std::string_view parseLabel(std::string_view line) {
+        std::string_view labelName = line.substr(0, line.find(':'));
+        // Trim whitespace
+        size_t start = labelName.find_first_not_of(" \t");
+        return (start == std::string_view::npos) ? std::string_view() : labelName.substr(start);
+    }
+
+    // Line-at-a-time interface for incremental tools such as the language server.
+    // Lines are fed in source order: alias directives through defineAlias(),
+    // instructions through parseDetached(). Labels and '.' are never resolved
+    // here: an operand using them (label branches, LR) comes back in expression
+    // with a zero immediate, to be evaluated once the layout is known.
+    void defineAlias(std::string_view directive) { parseAliasDirective(directive); }
+
+    uint32_t parseDetached(std::string_view line, bool& error, std::string& expression) {
+        bool wasRelocatable = relocatable;
+        relocatable = false;
+        detached = true;
+        uint32_t instr = parseInstruction(line, error, 0);
+        relocatable = wasRelocatable;
+        detached = false;
+        expression = fixups.empty() ? std::string() : std::move(fixups.back().expression);
+        fixups.clear();
+        return instr;
+    }
+
+    std::vector<AsmDiagnostic> takeDiagnostics() {
+        std::vector<AsmDiagnostic> taken;
+        taken.swap(diagnostics);
+        errorCount = 0;
+        return taken;
+    }
+
+    // Assemble a whole source; the Assembler can be reused for further calls
+    AssemblyResult assemble(std::string_view source) {
+        errorCount = 0;
+        diagnostics.clear();
+        assembleSource(source);
+
+        AssemblyResult result;
+        result.instructions = std::move(instructions);
+        result.symbols = std::move(symbolTable);
+        result.relocations = std::move(relocations);
+        result.addressOperands = std::move(addressOperands);
+        result.virtualRegisters = std::move(virtualRegisters);
+        result.virtualOperands = std::move(virtualOperands);
+        result.spillBase = spillBase;
+        result.spillCount = spillCount;
+        result.diagnostics = std::move(diagnostics);
+        result.errorCount = errorCount;
+        instructions.clear();
+        symbolTable.clear();
+        relocations.clear();
+        addressOperands.clear();
+        virtualRegisters.clear();
+        virtualOperands.clear();
+        diagnostics.clear();
+        return result;
+    }
+
+    // Parse a single instruction line (comments already stripped); does not allocate
+    // unless an operand refers to a label defined later or relocations are recorded
+    uint32_t parseInstruction(std::string_view line, bool& error, int instructionNumber = -1) {
+        currentPc = detached ? -1 : instructionNumber;
+        addressExpression = std::string_view();
+        narrowImmediate = false;
+        uint32_t instr = encodeInstruction(line, error);
+        if (!error && !addressExpression.empty() && !finishAddressExpression(instr, instructionNumber)) {
+            error = true;
+            return 0;
+        }
+        return instr;
+    }
+
+private:
+    uint32_t encodeInstruction(std::string_view line, bool& error) {
+        error = false;
+
+        // Trim leading whitespace
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string_view::npos) return 0;
+        std::string_view trimmed = line.substr(start);
+
+        if (trimmed.empty() || trimmed[0] == ';' || trimmed[0] == '#') return 0;
+        if (isLabel(trimmed)) return 0;
+
+        // Extract mnemonic
+        size_t spacePos = trimmed.find_first_of(" \t");
+        std::string_view mnemonicText = trimmed.substr(0, spacePos);
+
+        // Convert to uppercase (anything longer than a mnemonic is unknown)
+        char mnemonicBuffer[8];
+        if (mnemonicText.size() >= sizeof(mnemonicBuffer)) { error = true; return 0; }
+        for (size_t i = 0; i < mnemonicText.size(); i++) {
+            mnemonicBuffer[i] = std::toupper((unsigned char)mnemonicText[i]);
+        }
+        std::string_view mnemonic(mnemonicBuffer, mnemonicText.size());
+
+        // Extract operands
+        std::string_view operands = (spacePos == std::string_view::npos) ? std::string_view() : trimmed.substr(spacePos + 1);
+        std::string_view tokens[MAX_OPERANDS];
+        size_t tokenCount = splitOperands(operands, tokens, MAX_OPERANDS);
+
+        // LR pseudo-instruction (Load Register with instruction number)
+        if (mnemonic == "LR") {
+            if (tokenCount != 1) { error = true; return 0; }
+            int dst = parseRegister(tokens[0]);
+            if (dst == -1) { error = true; return 0; }
+            // Replace with MOV dst, .
+            return encodeMove(dst, parseConstant("."), true);
+        }
+
+        // EXIT instruction
+        if (mnemonic == "EXIT") return 0xFFFFFFFF;
+
+        // ALU operations
+        if (isAluOperation(mnemonic)) {
+            uint8_t op = findOpcode(mnemonic, false);
+
+            if (tokenCount == 3) {
+                int dst = parseRegister(tokens[0]);
+                int src1 = parseRegister(tokens[1]);
+                if (dst == -1 || src1 == -1) { error = true; return 0; }
+
+                int src2Reg = parseRegister(tokens[2]);
+                if (src2Reg != -1) {
+                    return encodeAlu(op, dst, src1, src2Reg, false);
+                } else {
+                    int src2Const = parseConstant(tokens[2]);
+                    if (src2Const == -1) { error = true; return 0; }
+                    return encodeAlu(op, dst, src1, src2Const, true);
+                }
+            } else if (tokenCount == 2) {
+                int dst = parseRegister(tokens[0]);
+                if (dst == -1) { error = true; return 0; }
+
+                int srcReg = parseRegister(tokens[1]);
+                if (srcReg != -1) {
+                    return encodeAlu(op, dst, srcReg, 0, false);
+                } else {
+                    // The constant lands in the 3-bit A field
+                    narrowImmediate = true;
+                    int srcConst = parseConstant(tokens[1]);
+                    if (srcConst == -1) { error = true; return 0; }
+                    return encodeAlu(op, dst, srcConst, 0, true);
+                }
+            }
+            error = true;
+            return 0;
+        }
+
+        // NOT operation
+        if (mnemonic == "NOT") {
+            if (tokenCount != 1) { error = true; return 0; }
+            int dst = parseRegister(tokens[0]);
+            if (dst == -1) { error = true; return 0; }
+            uint8_t notOp = findOpcode("NOT", false);
+            return encodeAlu(notOp, dst, 0, 0, false);
+        }
+
+        // MOV operation
+        if (mnemonic == "MOV") {
+            if (tokenCount != 2) { error = true; return 0; }
+            int dst = parseRegister(tokens[0]);
+            if (dst == -1) { error = true; return 0; }
+
+            int srcReg = parseRegister(tokens[1]);
+            if (srcReg != -1) {
+                return encodeMove(dst, srcReg, false);
+            } else {
+                int srcConst = parseConstant(tokens[1]);
+                if (srcConst == -1) { error = true; return 0; }
+                return encodeMove(dst, srcConst, true);
+            }
+        }
+
+        // CMP operation
+        if (mnemonic == "CMP") {
+            if (tokenCount != 2) { error = true; return 0; }
+            int src1 = parseRegister(tokens[0]);
+            if (src1 == -1) { error = true; return 0; }
+
+            int src2Reg = parseRegister(tokens[1]);
+            if (src2Reg != -1) {
+                return encodeCmp(src1, src2Reg, false);
+            } else {
+                int src2Const = parseConstant(tokens[1]);
+                if (src2Const == -1) { error = true; return 0; }
+                return encodeCmp(src1, src2Const, true);
+            }
+        }
+
+        // Branch operations
+        int condition = parseBranchCondition(mnemonic);
+        if (condition >= 0) {
+            if (tokenCount != 1) { error = true; return 0; }
+
+            int targetReg = parseRegister(tokens[0]);
+            if (targetReg != -1) {
+                return encodeBranch(condition, targetReg, false);
+            } else {
+                // Immediate, label or expression
+                int target = parseConstant(tokens[0]);
+                if (target == -1) { error = true; return 0; }
+                return encodeBranch(condition, target, true);
+            }
+        }
+
+        // READ operation
+        if (mnemonic == "READ") {
+            if (tokenCount != 2) { error = true; return 0; }
+            int dst = parseRegister(tokens[0]);
+            if (dst == -1) { error = true; return 0; }
+
+            int addrReg = parseRegister(tokens[1]);
+            if (addrReg != -1) {
+                return encodeRead(dst, addrReg);
+            } else {
+                int addrImm = parseConstant(tokens[1]);
+                if (addrImm < 0 || addrImm > 65535) { error = true; return 0; }
+                return encodeReadI(dst, addrImm);
+            }
+        }
+
+        // WRITE operation
+        if (mnemonic == "WRITE") {
+            if (tokenCount != 2) { error = true; return 0; }
+            int dataReg = parseRegister(tokens[0]);
+            if (dataReg == -1) { error = true; return 0; }
+
+            int addrReg = parseRegister(tokens[1]);
+            if (addrReg != -1) {
+                return encodeWrite(dataReg, addrReg);
+            } else {
+                int addrImm = parseConstant(tokens[1]);
+                if (addrImm < 0 || addrImm > 65535) { error = true; return 0; }
+                return encodeWriteI(dataReg, addrImm);
+            }
+        }
+
+        // PRINT operation
+        if (mnemonic == "PRINT") {
+            if (tokenCount != 2) { error = true; return 0; }
+            narrowImmediate = true;
+
+            bool isAddrReg = (parseRegister(tokens[0]) != -1);
+            bool isCodeReg = (parseRegister(tokens[1]) != -1);
+
+            if (isAddrReg && isCodeReg) {
+                int addrReg = parseRegister(tokens[0]);
+                int codeReg = parseRegister(tokens[1]);
+                return encodePrintReg(codeReg, addrReg);
+            } else if (!isAddrReg && isCodeReg) {
+                int addrImm = parseConstant(tokens[0]);
+                int codeReg = parseRegister(tokens[1]);
+                if (addrImm < 0 || addrImm > 255) { error = true; return 0; }
+                return encodePrintRegI(codeReg, addrImm);
+            } else if (isAddrReg && !isCodeReg) {
+                int addrReg = parseRegister(tokens[0]);
+                int codeConst = parseConstant(tokens[1]);
+                if (codeConst < 0 || codeConst > 255) { error = true; return 0; }
+                return encodePrintConst(codeConst, addrReg);
+            } else {
+                int addrImm = parseConstant(tokens[0]);
+                int codeConst = parseConstant(tokens[1]);
+                if (addrImm < 0 || addrImm > 255 || codeConst < 0 || codeConst > 255) { error = true; return 0; }
+                return encodePrintConstI(codeConst, addrImm);
+            }
+        }
+
+        error = true;
+        return 0;
+    }
+};
+
+// Assemble source text with the shared ISA spec
+inline AssemblyResult assemble(std::string_view source, bool relocatable = false) {
+    Assembler assembler;
+    assembler.setRelocatable(relocatable);
+    return assembler.assemble(source);
+}
+
+// Assembly text of one encoded instruction, in a form assemble() encodes back to
+// the same word (two-operand ALU forms are written with all three operands)
+inline std::string disassemble(uint32_t instr, const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) {
+    auto it = spec.opcode_map.find(instr & 0xFF);
+    if (it == spec.opcode_map.end() || it->second->type == IsaSpec::InstructionType::TYPE_FPU) {
+        char unknown[24];
+        std::snprintf(unknown, sizeof(unknown), "?? 0x%08X", (unsigned)instr);
+        return unknown;
+    }
+    const IsaSpec::InstructionTech& tech = *it->second;
+    bool immediate = tech.flags.IMMEDIATE;
+    auto reg = [](uint32_t index) { return "X" + std::to_string(index); };
+    std::string dst = reg((instr >> 8) & 0x7);
+    std::string a = reg((instr >> 12) & 0x7);
+    std::string b = reg((instr >> 16) & 0x7);
+    std::string imm = std::to_string(instr >> 16);
+
+    switch (tech.type) {
+        case IsaSpec::InstructionType::TYPE_ALU:
+            return tech.mnemonic + " " + dst + ", " + a + ", " + (immediate ? imm : b);
+        case IsaSpec::InstructionType::TYPE_MOVE:
+            return "MOV " + dst + ", " + (immediate ? imm : a);
+        case IsaSpec::InstructionType::TYPE_CMP:
+            return "CMP " + a + ", " + (immediate ? imm : b);
+        case IsaSpec::InstructionType::TYPE_BRANCH: {
+            std::string mnemonic = "B";
+            for (const auto& bc : spec.branch_conditions) {
+                if (bc.code == ((instr >> 8) & 0xF)) mnemonic = bc.mnemonic;
+            }
+            return mnemonic + " " + (immediate ? imm : b);
+        }
+        case IsaSpec::InstructionType::TYPE_MEMORY:
+            if (tech.mnemonic == "READ") return "READ " + dst + ", " + (immediate ? imm : b);
+            return "WRITE " + a + ", " + (immediate ? imm : b);
+        case IsaSpec::InstructionType::TYPE_PRINT_REG:
+            return "PRINT " + (immediate ? std::to_string((instr >> 16) & 0xFF) : b) + ", " + a;
+        case IsaSpec::InstructionType::TYPE_PRINT_CONST:
+            return "PRINT " + (immediate ? std::to_string((instr >> 16) & 0xFF) : b) + ", " + std::to_string(instr >> 24);
+        default:
+            return tech.mnemonic;
+    }
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "IsaSpec.hpp"
+
+// On-disk cache of assembled programs, keyed by a hash of the source text,
+// the ISA spec, the options and the assembler version. Aliases and labels
+// are defined inside the source, so the source hash covers them. Only
+// assemblies without errors are stored, with their warnings, so a hit
+// reproduces the exact instructions, symbol table and messages without parsing.
+class AssemblyCache {
+public:
+    struct Symbol {
+        std::string name;
+        uint16_t address;
+    };
+
+    struct Entry {
+        std::vector<uint32_t> instructions;
+        std::vector<Symbol> symbols;
+        std::vector<std::string> warnings;  // Diagnostic messages, without the "Warning: " prefix
+    };
+
+    // Bump when the assembler or its optimizers emit different code (or warnings) for the same input
+    static constexpr int ASSEMBLER_VERSION = 1;
+
+private:
+    static constexpr int FORMAT_VERSION = 2;
+
+    std::string directory;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+
+    // Optional in-memory copy of every entry seen, for long-running processes (gct daemon)
+    bool keepInMemory = false;
+    std::unordered_map<uint64_t, Entry> memory;
+    std::mutex memoryMutex;
+    std::atomic<size_t> memoryHits{0};
+
+    void remember(uint64_t key, const Entry& entry) {
+        if (!keepInMemory) return;
+        std::lock_guard<std::mutex> lock(memoryMutex);
+        memory[key] = entry;
+    }
+
+    std::string entryPath(uint64_t key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.gcc", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+public:
+    explicit AssemblyCache(const std::string& dir) : directory(dir) {}
+
+    void setKeepInMemory(bool keep) { keepInMemory = keep; }
+
+    // 64-bit FNV-1a, chainable through seed
+    static uint64_t hashBytes(std::string_view bytes, uint64_t seed = 14695981039346656037ull) {
+        uint64_t hash = seed;
+        for (char c : bytes) {
+            hash ^= (uint8_t)c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Hash of everything in the spec that affects encoding, and the cycle counts the optimizers weigh
+    static uint64_t specFingerprint(const IsaSpec::ISA_SPEC& spec) {
+        uint64_t hash = hashBytes(spec.version);
+        for (const auto& instr : spec.instructions_tech) {
+            const auto& f = instr.flags;
+            char fields[] = {
+                (char)instr.opcode, (char)instr.format, (char)instr.type, (char)instr.cycles,
+                (char)(f.VALID | f.TRY_WRITE << 1 | f.TRY_READ_A << 2 | f.TRY_READ_B << 3 |
+                       f.OVERRIDE_B << 4 | f.OVERRIDE_WRITE << 5 | f.IMMEDIATE << 6)
+            };
+            hash = hashBytes(instr.mnemonic, hash);
+            hash = hashBytes(std::string_view(fields, sizeof(fields)), hash);
+        }
+        for (const auto& bc : spec.branch_conditions) {
+            hash = hashBytes(bc.mnemonic, hash);
+            hash = hashBytes(std::string_view((const char*)&bc.code, 1), hash);
+        }
+        return hash;
+    }
+
+    static uint64_t makeKey(std::string_view source, const IsaSpec::ISA_SPEC& spec, uint32_t options = 0) {
+        uint64_t hash = hashBytes(std::string_view((const char*)&FORMAT_VERSION, sizeof(FORMAT_VERSION)));
+        hash = hashBytes(std::string_view((const char*)&ASSEMBLER_VERSION, sizeof(ASSEMBLER_VERSION)), hash);
+        uint64_t specHash = specFingerprint(spec);
+        hash = hashBytes(std::string_view((const char*)&specHash, sizeof(specHash)), hash);
+        if (options) hash = hashBytes(std::string_view((const char*)&options, sizeof(options)), hash);
+        return hashBytes(source, hash);
+    }
+
+    // Look up an entry, counting the hit or miss
+    bool load(uint64_t key, Entry& entry) {
+        if (keepInMemory) {
+            std::lock_guard<std::mutex> lock(memoryMutex);
+            auto it = memory.find(key);
+            if (it != memory.end()) {
+                entry = it->second;
+                hits++;
+                memoryHits++;
+                return true;
+            }
+        }
+
+        std::ifstream in(entryPath(key));
+        std::string magic, keyText;
+        int version = 0;
+        size_t count = 0;
+        bool ok = in.is_open() && (in >> magic >> version >> keyText) && magic == "GCT-CACHE" &&
+                  version == FORMAT_VERSION && std::strtoull(keyText.c_str(), nullptr, 16) == key;
+
+        entry.instructions.clear();
+        entry.symbols.clear();
+        entry.warnings.clear();
+        if (ok && (in >> count)) {
+            for (size_t i = 0; i < count && ok; i++) {
+                uint32_t instr;
+                ok = (bool)(in >> std::hex >> instr >> std::dec);
+                entry.instructions.push_back(instr);
+            }
+            if (ok && (in >> count)) {
+                for (size_t i = 0; i < count && ok; i++) {
+                    // Label names run to end of line (they may contain spaces)
+                    Symbol symbol;
+                    int address;
+                    ok = (bool)(in >> address) && in.get() == ' ' && (bool)std::getline(in, symbol.name);
+                    symbol.address = (uint16_t)address;
+                    entry.symbols.push_back(symbol);
+                }
+            } else {
+                ok = false;
+            }
+            // Warnings are one per line, like label names
+            if (ok && (in >> count) && in.get() == '\n') {
+                for (size_t i = 0; i < count && ok; i++) {
+                    std::string warning;
+                    ok = (bool)std::getline(in, warning);
+                    entry.warnings.push_back(warning);
+                }
+            } else {
+                ok = false;
+            }
+        } else {
+            ok = false;
+        }
+
+        (ok ? hits : misses)++;
+        if (ok) remember(key, entry);
+        return ok;
+    }
+
+    // Store an entry; written to a temporary file and renamed so concurrent readers never see it partially
+    bool store(uint64_t key, const Entry& entry) {
+        remember(key, entry);
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+
+        std::ostringstream tid;
+        tid << std::this_thread::get_id();
+        std::string path = entryPath(key);
+        std::string tempPath = path + "." + tid.str() + ".tmp";
+        {
+            std::ofstream out(tempPath);
+            if (!out.is_open()) return false;
+            char keyText[20];
+            std::snprintf(keyText, sizeof(keyText), "%016llx", (unsigned long long)key);
+            out << "GCT-CACHE " << FORMAT_VERSION << " " << keyText << "\n";
+            out << entry.instructions.size() << "\n" << std::hex;
+            for (uint32_t instr : entry.instructions) out << instr << "\n";
+            out << std::dec << entry.symbols.size() << "\n";
+            for (const auto& symbol : entry.symbols) out << (int)symbol.address << " " << symbol.name << "\n";
+            out << entry.warnings.size() << "\n";
+            for (const auto& warning : entry.warnings) out << warning << "\n";
+            if (!out) return false;
+        }
+        std::filesystem::rename(tempPath, path, ec);
+        if (ec) std::filesystem::remove(tempPath, ec);
+        return true;
+    }
+
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+    size_t getMemoryHits() const { return memoryHits; }
+};
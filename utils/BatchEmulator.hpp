@@ -0,0 +1,560 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Semantics.hpp"
+#include "Emulator.hpp"
+
+// Lockstep emulator for many instances of one program ("gct run --sweep"),
+// typically the same routine over a range of inputs.
+//
+// Instances are packed sixteen to a group, and a group's state is stored
+// lane-wise: each register is one vector of sixteen 16-bit lanes, so an ALU
+// instruction is executed for the whole group with a few 256-bit operations
+// (GCC/Clang vector extensions, compiled for AVX2 where the CPU has it).
+// Each lane keeps its own program counter. A group executes the lowest
+// address any of its running lanes is at, under a mask of the lanes that
+// are there, so lanes that took different branches wait for each other and
+// run together again where their paths meet. When too many lanes sit
+// masked out, running lanes are regrouped: sorted by program counter and
+// packed into as few groups as possible.
+//
+// Every instance ends exactly as Emulator would leave it (state, status and
+// counts); step counts are 32-bit per instance. Without vector extensions
+// each instance runs on Emulator instead.
+#ifndef GCT_BATCH_VECTORS
+#if defined(__GNUC__) || defined(__clang__)
+#define GCT_BATCH_VECTORS 1
+#else
+#define GCT_BATCH_VECTORS 0
+#endif
+#endif
+#if GCT_BATCH_VECTORS && defined(__x86_64__)
+#define GCT_BATCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+class BatchEmulator {
+public:
+    static constexpr size_t LANES = 16;
+    static constexpr size_t ROM_SIZE = Emulator::ROM_SIZE;
+    static constexpr size_t MEMORY_SIZE = Emulator::MEMORY_SIZE;
+    static constexpr size_t SCREEN_SIZE = Emulator::SCREEN_SIZE;
+    static constexpr uint64_t MAX_STEPS = 0xFFFFFFFFu;
+
+    struct Stats {
+        uint64_t dispatches = 0;  // Instructions issued to a group
+        uint64_t laneSteps = 0;   // Instructions executed by instances
+        uint64_t regroups = 0;
+        double utilization() const { return dispatches ? (double)laneSteps / (dispatches * LANES) : 1.0; }
+    };
+
+private:
+    static constexpr size_t QUANTUM = 256;           // Dispatches per group between regrouping checks
+    static constexpr uint32_t EMPTY = 0xFFFFFFFFu;   // Lane without an instance
+
+    // An instruction, decoded once per program
+    struct Slot {
+        Emulator::Kind kind = Emulator::KIND_REGISTER;
+        Semantics::Op op = Semantics::Op::AND;
+        bool immediate = false;
+        uint8_t dst = 0, a = 0, b = 0, cycles = 1;
+        uint16_t imm = 0;
+        uint16_t conditions = 0;
+    };
+
+#if GCT_BATCH_VECTORS
+    // Aligned explicitly: without -mavx the compiler would align them to 16 bytes, but the AVX2 copy of the
+    // kernel loads them with aligned 32-byte moves
+    typedef uint16_t Lanes __attribute__((vector_size(LANES * 2), aligned(LANES * 2)));
+    typedef int16_t Mask __attribute__((vector_size(LANES * 2), aligned(LANES * 2)));  // -1 in the lanes that are set
+    typedef int16_t SignedLanes __attribute__((vector_size(LANES * 2), aligned(LANES * 2)));
+    typedef uint32_t Wide __attribute__((vector_size(LANES * 4), aligned(LANES * 4)));
+    typedef int32_t SignedWide __attribute__((vector_size(LANES * 4), aligned(LANES * 4)));
+    typedef uint64_t Quads __attribute__((vector_size(LANES * 2), aligned(LANES * 2)));
+
+    struct Group {
+        Lanes regs[8];
+        Lanes pc;
+        Mask n, z, c, v;
+        Mask running;
+        Wide steps, cycles, taken;
+        uint8_t status[LANES];
+        uint32_t instance[LANES];
+    };
+#else
+    struct Group {
+        Emulator::Machine machines[LANES];
+        Emulator::Stats stats[LANES];
+        uint8_t status[LANES];
+        uint32_t instance[LANES];
+    };
+#endif
+
+    Emulator::DecodeTable table;
+    std::vector<uint32_t> rom;
+    Slot slots[ROM_SIZE];
+    bool usesMemory = false, usesScreen = false;
+    std::vector<Group> groups;
+    std::vector<uint16_t> memory;   // (group * MEMORY_SIZE + address) * LANES + lane, when used
+    std::vector<uint16_t> screen;
+    std::vector<uint32_t> slotOf;   // Instance -> group * LANES + lane
+    size_t count = 0;
+    Stats stats;
+
+    uint16_t* memoryRow(size_t group, size_t address) { return &memory[(group * MEMORY_SIZE + address) * LANES]; }
+    uint16_t* screenRow(size_t group, size_t address) { return &screen[(group * SCREEN_SIZE + address) * LANES]; }
+
+#if GCT_BATCH_VECTORS
+#define GCT_SELECT(mask, yes, no) (((Lanes)(mask) & (yes)) | (~(Lanes)(mask) & (no)))
+#define GCT_SELECT_MASK(mask, yes, no) (((mask) & (yes)) | (~(mask) & (no)))
+
+    // Smallest lane, by halving the vector four times
+    __attribute__((always_inline)) static inline uint16_t lowestLane(const Lanes& vector) {
+        Lanes lanes = vector;
+        Lanes other = __builtin_shufflevector(lanes, lanes, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+        lanes = GCT_SELECT(other < lanes, other, lanes);
+        other = __builtin_shufflevector(lanes, lanes, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3);
+        lanes = GCT_SELECT(other < lanes, other, lanes);
+        other = __builtin_shufflevector(lanes, lanes, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1);
+        lanes = GCT_SELECT(other < lanes, other, lanes);
+        return std::min(lanes[0], lanes[1]);
+    }
+
+    __attribute__((always_inline)) static inline bool anyLane(const Mask& mask) {
+        Quads quads = (Quads)mask;
+        return (quads[0] | quads[1] | quads[2] | quads[3]) != 0;
+    }
+
+    // Run group for at most QUANTUM dispatches or until none of its lanes runs; returns the dispatches.
+    // Counts are kept in 16-bit lanes for the quantum (at most QUANTUM steps of at most 255 cycles) and
+    // widened once at its end. While every running lane is at the same address (converged), the next
+    // address is followed as a scalar instead of searched for across the lanes.
+    __attribute__((always_inline)) inline size_t runGroup(size_t index, uint32_t maxSteps) {
+        Group& group = groups[index];
+        Lanes budget;  // Steps each lane may take before its limit, beyond the quantum if more
+        uint32_t leastBudget = QUANTUM + 1;
+        for (size_t lane = 0; lane < LANES; lane++) {
+            budget[lane] = (uint16_t)std::min<uint32_t>(maxSteps - group.steps[lane], QUANTUM + 1);
+            if (group.running[lane]) leastBudget = std::min<uint32_t>(leastBudget, budget[lane]);
+        }
+        Lanes steps = Lanes{}, cycles = Lanes{}, taken = Lanes{};
+        size_t dispatches = 0;
+        bool converged = false;
+        uint16_t pc = 0;
+        while (dispatches < QUANTUM) {
+            Mask active;
+            if (converged) {
+                active = group.running;
+            } else {
+                // Lowest address a running lane is at (stopped lanes count as the highest, 0xFFFF), and the lanes there
+                pc = lowestLane(GCT_SELECT(group.running, group.pc, Lanes{} + 0xFFFF));
+                if (pc == 0xFFFF && !anyLane(group.running)) break;
+                active = group.running & (Mask)(group.pc == pc);
+                converged = !anyLane(group.running & ~active);
+            }
+            if (pc >= ROM_SIZE) {
+                for (size_t lane = 0; lane < LANES; lane++) {
+                    if (active[lane]) group.status[lane] = Emulator::STATUS_OFF_ROM;
+                }
+                group.running &= ~active;
+                converged = false;
+                continue;
+            }
+
+            const Slot& slot = slots[pc];
+            Lanes next = group.pc + 1;
+            uint16_t following = pc + 1;  // Where converged lanes go
+            Mask branched = Mask{};
+            switch (slot.kind) {
+                case Emulator::KIND_REGISTER: {
+                    using Semantics::Op;
+                    const Lanes x = group.regs[slot.a];
+                    const Lanes y = slot.immediate ? Lanes{} + slot.imm : group.regs[slot.b];
+                    Lanes result = Lanes{};
+                    Mask carry = Mask{}, overflow = Mask{};
+                    switch (slot.op) {
+                        case Op::AND: result = x & y; break;
+                        case Op::OR: result = x | y; break;
+                        case Op::XOR: result = x ^ y; break;
+                        case Op::NOT: result = ~x; break;
+                        case Op::ADD:
+                            result = x + y;
+                            carry = (Mask)(result < x);
+                            overflow = (Mask)((~(x ^ y) & (x ^ result) & 0x8000) != 0);
+                            break;
+                        case Op::SUB:
+                        case Op::CMP:
+                            result = x - y;
+                            carry = (Mask)(x >= y);
+                            overflow = (Mask)(((x ^ y) & (x ^ result) & 0x8000) != 0);
+                            break;
+                        // A shift by one count for every lane is a single instruction; AVX2 has no per-lane 16-bit shifts
+                        case Op::LSL:
+                            if (slot.immediate) {
+                                result = slot.imm > 15 ? Lanes{} : x << slot.imm;
+                            } else {
+                                result = GCT_SELECT(y > 15, Lanes{}, x << (y & 15));
+                            }
+                            break;
+                        case Op::LSR:
+                            if (slot.immediate) {
+                                result = slot.imm > 15 ? Lanes{} : x >> slot.imm;
+                            } else {
+                                result = GCT_SELECT(y > 15, Lanes{}, x >> (y & 15));
+                            }
+                            break;
+                        case Op::BCDL:
+                        case Op::BCDH:
+                            for (size_t lane = 0; lane < LANES; lane++) {
+                                if (active[lane]) result[lane] = Semantics::bcd(x[lane], slot.op == Op::BCDH);
+                            }
+                            break;
+                        case Op::UMUL_L:
+                        case Op::MUL_L: result = x * y; break;
+                        case Op::UMUL_H:
+                            result = __builtin_convertvector((__builtin_convertvector(x, Wide) * __builtin_convertvector(y, Wide)) >> 16, Lanes);
+                            break;
+                        case Op::MUL_H:
+                            result = __builtin_convertvector((__builtin_convertvector((SignedLanes)x, SignedWide) *
+                                                              __builtin_convertvector((SignedLanes)y, SignedWide)) >> 16, Lanes);
+                            break;
+                        case Op::MOV: result = slot.immediate ? y : x; break;
+                        case Op::OTHER: break;
+                    }
+                    if (slot.op != Op::CMP) group.regs[slot.dst] = GCT_SELECT(active, result, group.regs[slot.dst]);
+                    if (slot.op != Op::MOV) {
+                        group.n = GCT_SELECT_MASK(active, (Mask)((SignedLanes)result < 0), group.n);
+                        group.z = GCT_SELECT_MASK(active, (Mask)(result == 0), group.z);
+                        group.c = GCT_SELECT_MASK(active, carry, group.c);
+                        group.v = GCT_SELECT_MASK(active, overflow, group.v);
+                    }
+                    break;
+                }
+                case Emulator::KIND_BRANCH: {
+                    // Bit NZCV of the condition's table, as 1 << (8N + 4Z + 2C + V) without a per-lane shift
+                    Lanes bit = GCT_SELECT(group.n, Lanes{} + 256, Lanes{} + 1) * GCT_SELECT(group.z, Lanes{} + 16, Lanes{} + 1) *
+                                GCT_SELECT(group.c, Lanes{} + 4, Lanes{} + 1) * GCT_SELECT(group.v, Lanes{} + 2, Lanes{} + 1);
+                    branched = active & (Mask)(((Lanes{} + slot.conditions) & bit) != 0);
+                    Lanes target = slot.immediate ? Lanes{} + slot.imm : group.regs[slot.b];
+                    next = GCT_SELECT(branched, target, next);
+                    if (converged && slot.immediate && !anyLane(active & ~branched)) {
+                        following = slot.imm;
+                    } else if (anyLane(branched)) {
+                        converged = false;
+                    }
+                    break;
+                }
+                case Emulator::KIND_READ:
+                case Emulator::KIND_WRITE:
+                case Emulator::KIND_PRINT_REG:
+                case Emulator::KIND_PRINT_CONST: {
+                    bool read = slot.kind == Emulator::KIND_READ;
+                    bool toMemory = read || slot.kind == Emulator::KIND_WRITE;
+                    Lanes value = slot.kind == Emulator::KIND_PRINT_CONST ? Lanes{} + (uint16_t)(slot.imm >> 8) : group.regs[slot.a];
+                    if (slot.immediate) {
+                        // One address for every lane: a row of the lane-wise memory
+                        uint16_t* row = toMemory ? memoryRow(index, slot.imm & 0xFF) : screenRow(index, slot.imm & 0xFF);
+                        Lanes stored;
+                        std::memcpy(&stored, row, sizeof(stored));
+                        if (read) {
+                            group.regs[slot.dst] = GCT_SELECT(active, stored, group.regs[slot.dst]);
+                        } else {
+                            stored = GCT_SELECT(active, value, stored);
+                            std::memcpy(row, &stored, sizeof(stored));
+                        }
+                    } else {
+                        Lanes address = group.regs[slot.b] & 0xFF;
+                        for (size_t lane = 0; lane < LANES; lane++) {
+                            if (!active[lane]) continue;
+                            uint16_t* row = toMemory ? memoryRow(index, address[lane]) : screenRow(index, address[lane]);
+                            if (read) {
+                                group.regs[slot.dst][lane] = row[lane];
+                            } else {
+                                row[lane] = value[lane];
+                            }
+                        }
+                    }
+                    break;
+                }
+                case Emulator::KIND_EXIT:
+                    for (size_t lane = 0; lane < LANES; lane++) {
+                        if (active[lane]) group.status[lane] = Emulator::STATUS_EXITED;
+                    }
+                    group.running &= ~active;
+                    next = group.pc;
+                    converged = false;
+                    break;
+                case Emulator::KIND_INVALID:
+                    for (size_t lane = 0; lane < LANES; lane++) {
+                        if (active[lane]) group.status[lane] = Emulator::STATUS_INVALID;
+                    }
+                    group.running &= ~active;
+                    converged = false;
+                    dispatches++;
+                    continue;
+            }
+
+            group.pc = GCT_SELECT(active, next, group.pc);
+            steps -= (Lanes)active;
+            cycles += (Lanes)active & slot.cycles;
+            taken -= (Lanes)branched;
+            group.running &= ~(Mask)(steps >= budget);
+            dispatches++;
+            // A lane may reach its step limit from here on, and leave the group with none running
+            if (dispatches + 1 >= leastBudget) converged = false;
+            pc = following;
+        }
+        group.steps += __builtin_convertvector(steps, Wide);
+        group.cycles += __builtin_convertvector(cycles, Wide);
+        group.taken += __builtin_convertvector(taken, Wide);
+        for (size_t lane = 0; lane < LANES; lane++) {
+            if (!group.running[lane] && group.status[lane] == Emulator::STATUS_RUNNING) group.status[lane] = Emulator::STATUS_STEP_LIMIT;
+        }
+        return dispatches;
+    }
+#undef GCT_SELECT
+#undef GCT_SELECT_MASK
+
+    // One round: every group with running lanes for up to QUANTUM dispatches; returns the dispatches
+    __attribute__((always_inline)) inline size_t runRoundKernel(uint32_t maxSteps) {
+        size_t dispatches = 0;
+        for (size_t index = 0; index < groups.size(); index++) dispatches += runGroup(index, maxSteps);
+        return dispatches;
+    }
+
+#ifdef GCT_BATCH_TARGET_AVX2
+    GCT_BATCH_TARGET_AVX2 size_t runRoundAvx2(uint32_t maxSteps) { return runRoundKernel(maxSteps); }
+#endif
+    size_t runRoundGeneric(uint32_t maxSteps) { return runRoundKernel(maxSteps); }
+
+    size_t runRound(uint32_t maxSteps) {
+#ifdef GCT_BATCH_TARGET_AVX2
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        if (hasAvx2) return runRoundAvx2(maxSteps);
+#endif
+        return runRoundGeneric(maxSteps);
+    }
+
+    // Move the lane at from to the lane at to of target (lane-wise copy of its whole state)
+    void copyLane(std::vector<Group>& target, std::vector<uint16_t>& targetMemory, std::vector<uint16_t>& targetScreen,
+                  uint32_t from, uint32_t to) {
+        const Group& source = groups[from / LANES];
+        Group& destination = target[to / LANES];
+        size_t s = from % LANES, d = to % LANES;
+        for (int reg = 0; reg < 8; reg++) destination.regs[reg][d] = source.regs[reg][s];
+        destination.pc[d] = source.pc[s];
+        destination.n[d] = source.n[s];
+        destination.z[d] = source.z[s];
+        destination.c[d] = source.c[s];
+        destination.v[d] = source.v[s];
+        destination.running[d] = source.running[s];
+        destination.steps[d] = source.steps[s];
+        destination.cycles[d] = source.cycles[s];
+        destination.taken[d] = source.taken[s];
+        destination.status[d] = source.status[s];
+        destination.instance[d] = source.instance[s];
+        for (size_t address = 0; usesMemory && address < MEMORY_SIZE; address++) {
+            targetMemory[((to / LANES) * MEMORY_SIZE + address) * LANES + d] = memoryRow(from / LANES, address)[s];
+        }
+        for (size_t address = 0; usesScreen && address < SCREEN_SIZE; address++) {
+            targetScreen[((to / LANES) * SCREEN_SIZE + address) * LANES + d] = screenRow(from / LANES, address)[s];
+        }
+        if (destination.instance[d] != EMPTY) slotOf[destination.instance[d]] = to;
+    }
+
+    // Pack running lanes by program counter into the first groups, stopped and empty lanes after them
+    void regroup() {
+        std::vector<uint32_t> order(groups.size() * LANES);
+        for (uint32_t slot = 0; slot < order.size(); slot++) order[slot] = slot;
+        auto key = [&](uint32_t slot) {
+            const Group& group = groups[slot / LANES];
+            size_t lane = slot % LANES;
+            return group.running[lane] ? (uint32_t)group.pc[lane] : group.instance[lane] != EMPTY ? 0x10000u : 0x20000u;
+        };
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t first, uint32_t second) { return key(first) < key(second); });
+
+        std::vector<Group> packed(groups.size());
+        std::vector<uint16_t> packedMemory(memory.size()), packedScreen(screen.size());
+        for (uint32_t to = 0; to < order.size(); to++) copyLane(packed, packedMemory, packedScreen, order[to], to);
+        groups.swap(packed);
+        memory.swap(packedMemory);
+        screen.swap(packedScreen);
+        stats.regroups++;
+    }
+#endif
+
+public:
+    explicit BatchEmulator(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : table(spec) {}
+
+    // Load a program for every instance; false if it does not fit
+    bool load(const std::vector<uint32_t>& program) {
+        if (program.size() > ROM_SIZE) return false;
+        rom = program;
+        rom.resize(ROM_SIZE, 0);
+        usesMemory = usesScreen = false;
+        for (size_t pc = 0; pc < ROM_SIZE; pc++) {
+            uint32_t raw = rom[pc];
+            const Emulator::Decoder& decoder = table.decoders[raw & 0xFF];
+            Slot& slot = slots[pc];
+            slot.kind = decoder.kind;
+            slot.op = decoder.op;
+            slot.immediate = decoder.immediate;
+            slot.dst = (raw >> 8) & 0x7;
+            slot.a = (raw >> 12) & 0x7;
+            slot.b = (raw >> 16) & 0x7;
+            slot.cycles = decoder.cycles;
+            slot.imm = (uint16_t)(raw >> 16);
+            slot.conditions = decoder.kind == Emulator::KIND_BRANCH ? table.conditions[(raw >> 8) & 0xF] : 0;
+            usesMemory |= decoder.kind == Emulator::KIND_READ || decoder.kind == Emulator::KIND_WRITE;
+            usesScreen |= decoder.kind == Emulator::KIND_PRINT_REG || decoder.kind == Emulator::KIND_PRINT_CONST;
+        }
+        return true;
+    }
+
+    // Start over with instances copies of machine
+    void reset(size_t instances, const Emulator::Machine& machine = Emulator::Machine()) {
+        count = instances;
+        stats = Stats();
+        groups.assign((instances + LANES - 1) / LANES, Group());
+        slotOf.resize(instances);
+        for (uint32_t instance = 0; instance < instances; instance++) slotOf[instance] = instance;
+#if GCT_BATCH_VECTORS
+        bool memoryUsed = usesMemory || std::any_of(machine.memory, machine.memory + MEMORY_SIZE, [](uint16_t word) { return word != 0; });
+        bool screenUsed = usesScreen || std::any_of(machine.screen, machine.screen + SCREEN_SIZE, [](uint16_t cell) { return cell != 0; });
+        usesMemory = memoryUsed;
+        usesScreen = screenUsed;
+        memory.assign(usesMemory ? groups.size() * MEMORY_SIZE * LANES : 0, 0);
+        screen.assign(usesScreen ? groups.size() * SCREEN_SIZE * LANES : 0, 0);
+        for (size_t index = 0; index < groups.size(); index++) {
+            Group& group = groups[index];
+            for (size_t lane = 0; lane < LANES; lane++) {
+                size_t instance = index * LANES + lane;
+                bool used = instance < instances;
+                for (int reg = 0; reg < 8; reg++) group.regs[reg][lane] = machine.cpu.regs[reg];
+                group.pc[lane] = machine.pc;
+                group.n[lane] = machine.cpu.n ? -1 : 0;
+                group.z[lane] = machine.cpu.z ? -1 : 0;
+                group.c[lane] = machine.cpu.c ? -1 : 0;
+                group.v[lane] = machine.cpu.v ? -1 : 0;
+                group.running[lane] = used ? -1 : 0;
+                group.status[lane] = used ? Emulator::STATUS_RUNNING : Emulator::STATUS_STEP_LIMIT;
+                group.instance[lane] = used ? (uint32_t)instance : EMPTY;
+                for (size_t address = 0; usesMemory && address < MEMORY_SIZE; address++) memoryRow(index, address)[lane] = machine.memory[address];
+                for (size_t address = 0; usesScreen && address < SCREEN_SIZE; address++) screenRow(index, address)[lane] = machine.screen[address];
+            }
+        }
+#else
+        for (Group& group : groups) std::fill(group.instance, group.instance + LANES, EMPTY);
+        for (size_t instance = 0; instance < instances; instance++) {
+            Group& group = groups[instance / LANES];
+            group.machines[instance % LANES] = machine;
+            group.status[instance % LANES] = Emulator::STATUS_RUNNING;
+            group.instance[instance % LANES] = (uint32_t)instance;
+        }
+#endif
+    }
+
+    size_t size() const { return count; }
+    const Stats& getStats() const { return stats; }
+
+    void setRegister(size_t instance, int reg, uint16_t value) {
+        uint32_t slot = slotOf[instance];
+#if GCT_BATCH_VECTORS
+        groups[slot / LANES].regs[reg][slot % LANES] = value;
+#else
+        groups[slot / LANES].machines[slot % LANES].cpu.regs[reg] = value;
+#endif
+    }
+
+    // State, status and counts of an instance, as Emulator::run() would have left them
+    Emulator::Status getMachine(size_t instance, Emulator::Machine& machine, Emulator::Stats& counts) const {
+        uint32_t slot = slotOf[instance];
+        const Group& group = groups[slot / LANES];
+        size_t lane = slot % LANES;
+#if GCT_BATCH_VECTORS
+        for (int reg = 0; reg < 8; reg++) machine.cpu.regs[reg] = group.regs[reg][lane];
+        machine.pc = group.pc[lane];
+        machine.cpu.n = group.n[lane];
+        machine.cpu.z = group.z[lane];
+        machine.cpu.c = group.c[lane];
+        machine.cpu.v = group.v[lane];
+        for (size_t address = 0; address < MEMORY_SIZE; address++) {
+            machine.memory[address] = usesMemory ? memory[((slot / LANES) * MEMORY_SIZE + address) * LANES + lane] : 0;
+        }
+        for (size_t address = 0; address < SCREEN_SIZE; address++) {
+            machine.screen[address] = usesScreen ? screen[((slot / LANES) * SCREEN_SIZE + address) * LANES + lane] : 0;
+        }
+        counts.steps = group.steps[lane];
+        counts.cycles = group.cycles[lane];
+        counts.taken = group.taken[lane];
+#else
+        machine = group.machines[lane];
+        counts = group.stats[lane];
+#endif
+        return (Emulator::Status)group.status[lane];
+    }
+
+    // Run every instance until it stops, each for at most maxSteps (up to MAX_STEPS) instructions
+    void run(uint64_t maxSteps) {
+        uint32_t limit = (uint32_t)std::min(maxSteps, MAX_STEPS);
+#if GCT_BATCH_VECTORS
+        if (limit == 0) {
+            for (Group& group : groups) {
+                for (size_t lane = 0; lane < LANES; lane++) {
+                    if (group.running[lane]) group.status[lane] = Emulator::STATUS_STEP_LIMIT;
+                }
+                group.running = Mask{};
+            }
+            return;
+        }
+        auto stepsSoFar = [&]() {
+            uint64_t steps = 0;
+            for (const Group& group : groups) {
+                for (size_t lane = 0; lane < LANES; lane++) steps += group.steps[lane];
+            }
+            return steps;
+        };
+        uint64_t stepsBefore = stepsSoFar();
+        size_t rounds = 0, wait = 1;  // Rounds since the last regroup, and how many to leave before the next
+        double regroupedFrom = 1.0;   // Utilization that led to the last regroup
+        for (;;) {
+            size_t dispatches = runRound(limit);
+            stats.dispatches += dispatches;
+            if (dispatches == 0) break;
+            uint64_t stepsAfter = stepsSoFar();
+            uint64_t executed = stepsAfter - stepsBefore;
+            stats.laneSteps += executed;
+            stepsBefore = stepsAfter;
+
+            // Regroup when under three quarters of the lanes dispatched to did work, unless the round did less
+            // work than moving the lanes costs. If the last regroup did not help, wait twice as long.
+            double utilization = (double)executed / (dispatches * LANES);
+            if (++rounds == 1 && stats.regroups > 0) wait = utilization < regroupedFrom + 0.1 ? wait * 2 : 1;
+            size_t running = 0;
+            for (const Group& group : groups) {
+                for (size_t lane = 0; lane < LANES; lane++) running += group.running[lane] & 1;
+            }
+            if (rounds >= wait && utilization < 0.75 && running > 0 && dispatches >= running) {
+                regroup();
+                regroupedFrom = utilization;
+                rounds = 0;
+            }
+        }
+#else
+        Emulator emulator;
+        emulator.load(rom);
+        for (Group& group : groups) {
+            for (size_t lane = 0; lane < LANES; lane++) {
+                if (group.instance[lane] == EMPTY || group.status[lane] != Emulator::STATUS_RUNNING) continue;
+                group.status[lane] = emulator.run(group.machines[lane], limit);
+                group.stats[lane] = emulator.getStats();
+                stats.laneSteps += group.stats[lane].steps;
+                stats.dispatches += group.stats[lane].steps;
+            }
+        }
+#endif
+    }
+};
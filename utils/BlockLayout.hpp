@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ControlFlow.hpp"
+#include "ExecutionProfile.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Profile-guided basic-block layout (gct asm -O1 --profile): blocks are
+// reordered so the edges taken most often in the profile become
+// fall-throughs, since a taken branch costs a cycle a fall-through does not.
+//
+// Blocks are chained along edges in order of their counts (Pettis-Hansen):
+// an edge joins two chains when its source ends one and its target starts
+// the other. Where two edges are equally hot, the one whose source ends in
+// an unconditional branch wins, as that branch then goes away entirely; this
+// rotates loops so the test sits at the bottom. The chain holding the entry
+// point comes first, the others follow hottest first, and a last block that
+// runs past the end of the program stays last.
+//
+// Each block's branch is then fixed for its new successor: an unconditional
+// branch to the next block is deleted, a conditional branch whose target is
+// now next is inverted (through branch_conditions), and a block that lost the
+// block it fell through to gets a B to it.
+//
+// The profile must come from the ROM built from the same source and options
+// without a profile; edges that are not edges of the program leave it alone.
+class BlockLayout {
+public:
+    struct Stats {
+        size_t moved = 0;          // Blocks that changed place
+        size_t inverted = 0;       // Conditional branches inverted to fall through to their hot successor
+        size_t removed = 0;        // Unconditional branches to the next block deleted
+        size_t added = 0;          // Branches added where a block no longer falls through
+        uint64_t takenBefore = 0;  // Taken branches in the profile
+        uint64_t takenAfter = 0;   // The same run's taken branches with the new layout
+        size_t mismatches = 0;     // Profile edges that are not edges of this program
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    Stats stats;
+
+    static constexpr size_t NONE = (size_t)-1;
+
+    // Control can go from instruction from to instruction to
+    bool isEdge(const std::vector<uint32_t>& code, uint16_t from, uint16_t to) const {
+        if (from >= code.size() || to >= code.size()) return false;
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, code[from]);
+        if (!tech || tech->type == IsaSpec::InstructionType::TYPE_SERVICE) return false;
+        if (tech->type != IsaSpec::InstructionType::TYPE_BRANCH) return to == from + 1;
+        if (!tech->flags.IMMEDIATE) return true;
+        return to == (code[from] >> 16) || (Semantics::conditionOf(code[from]) != 0 && to == from + 1);
+    }
+
+    // Block falls through to the one after it (no EXIT or unconditional branch at its end)
+    bool fallsThrough(uint32_t raw) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        if (!tech) return true;
+        if (tech->type == IsaSpec::InstructionType::TYPE_SERVICE) return false;
+        return tech->type != IsaSpec::InstructionType::TYPE_BRANCH || Semantics::conditionOf(raw) != 0;
+    }
+
+    bool isBranchImmediate(uint32_t raw) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        return tech && tech->type == IsaSpec::InstructionType::TYPE_BRANCH && tech->flags.IMMEDIATE;
+    }
+
+public:
+    explicit BlockLayout(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Lay out the blocks of an assembled ROM program for profile, returns the number of blocks moved
+    size_t optimize(AssemblyResult& program, const ExecutionProfile& profile) {
+        stats = Stats();
+        std::vector<uint32_t>& code = program.instructions;
+        for (const auto& [edge, times] : profile.edges) {
+            if (!isEdge(code, edge.first, edge.second)) stats.mismatches++;
+            else if (edge.second != edge.first + 1) stats.takenBefore += times;
+        }
+        if (stats.mismatches > 0 || code.empty()) return 0;
+
+        ControlFlowGraph cfg(isaSpec);
+        cfg.build(program, false);
+        const auto& blocks = cfg.getBlocks();
+        size_t count = blocks.size();
+        ProgramEditor editor(program, isaSpec);
+
+        // Block weights (executions of its last instruction) and a block that runs past the end
+        std::vector<uint64_t> weight(count, 0);
+        for (const auto& [edge, times] : profile.edges) {
+            size_t b = cfg.blockAt(edge.first);
+            if (edge.first == blocks[b].end - 1) weight[b] += times;
+        }
+        size_t pinnedLast = fallsThrough(code.back()) ? count - 1 : NONE;
+
+        struct Link {
+            uint64_t times;
+            bool dropsBranch;  // Source ends in an unconditional branch or no branch at all
+            size_t from, to;
+        };
+        std::vector<Link> links;
+        for (size_t b = 0; b < count; b++) {
+            uint32_t raw = code[blocks[b].end - 1];
+            bool dropsBranch = !isBranchImmediate(raw) || Semantics::conditionOf(raw) == 0;
+            for (const auto& edge : blocks[b].successors) {
+                if (edge.kind == ControlFlowGraph::EDGE_INDIRECT || edge.block == b || edge.block == 0) continue;
+                links.push_back({profile.count((uint16_t)(blocks[b].end - 1), (uint16_t)blocks[edge.block].start),
+                                 dropsBranch, b, edge.block});
+            }
+        }
+        std::stable_sort(links.begin(), links.end(), [](const Link& a, const Link& b) {
+            return a.times != b.times ? a.times > b.times : a.dropsBranch > b.dropsBranch;
+        });
+
+        // Chains
+        std::vector<std::vector<size_t>> chains(count);
+        std::vector<size_t> chainOf(count);
+        for (size_t b = 0; b < count; b++) {
+            chains[b] = {b};
+            chainOf[b] = b;
+        }
+        for (const Link& link : links) {
+            size_t a = chainOf[link.from], c = chainOf[link.to];
+            if (a == c || chains[a].back() != link.from || chains[c].front() != link.to || link.from == pinnedLast) continue;
+            if (pinnedLast != NONE && ((a == chainOf[0] && c == chainOf[pinnedLast]) || (c == chainOf[0] && a == chainOf[pinnedLast]))) continue;
+            for (size_t b : chains[c]) chainOf[b] = a;
+            chains[a].insert(chains[a].end(), chains[c].begin(), chains[c].end());
+            chains[c].clear();
+        }
+
+        // Entry chain first, then hottest first, the one running past the end last
+        std::vector<size_t> order;
+        std::vector<uint64_t> heat(count, 0);
+        for (size_t c = 0; c < count; c++) {
+            if (c == chainOf[0] || chains[c].empty() || (pinnedLast != NONE && c == chainOf[pinnedLast])) continue;
+            order.push_back(c);
+            for (size_t b : chains[c]) heat[c] = std::max(heat[c], weight[b]);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return heat[a] > heat[b]; });
+        order.insert(order.begin(), chainOf[0]);
+        if (pinnedLast != NONE && chainOf[pinnedLast] != chainOf[0]) order.push_back(chainOf[pinnedLast]);
+
+        std::vector<size_t> layout, next(count, NONE);
+        for (size_t c : order) layout.insert(layout.end(), chains[c].begin(), chains[c].end());
+        for (size_t k = 0; k + 1 < count; k++) next[layout[k]] = layout[k + 1];
+        size_t movedBlocks = 0;
+        for (size_t k = 0; k < count; k++) movedBlocks += layout[k] != k;
+        if (movedBlocks == 0) {
+            stats.takenAfter = stats.takenBefore;
+            return 0;
+        }
+
+        // Branch fixes, by old instruction index
+        std::vector<long> invertTo(code.size(), -1), appendTo(code.size(), -1);
+        std::vector<char> drop(code.size(), 0);
+        size_t size = code.size();
+        for (size_t b = 0; b < count; b++) {
+            size_t last = blocks[b].end - 1;
+            uint32_t raw = code[last];
+            size_t fall = b + 1 < count ? b + 1 : NONE;
+            bool local = isBranchImmediate(raw) && !editor.isExternal(last) && (raw >> 16) < code.size();
+            if (local && Semantics::conditionOf(raw) == 0) {
+                if (next[b] == cfg.blockAt(raw >> 16)) {
+                    drop[last] = 1;
+                    size--;
+                }
+            } else if (fallsThrough(raw) && fall != NONE && next[b] != fall) {
+                int opposite = local ? invertBranchCondition(isaSpec, Semantics::conditionOf(raw)) : -1;
+                if (opposite >= 0 && next[b] == cfg.blockAt(raw >> 16)) {
+                    invertTo[last] = (long)blocks[fall].start;
+                } else {
+                    appendTo[last] = (long)blocks[fall].start;
+                    size++;
+                }
+            }
+        }
+        if (size > 256 && size > code.size()) {  // Would no longer fit the ROM, so the program stays as it is
+            stats.takenAfter = stats.takenBefore;
+            return 0;
+        }
+        stats.moved = movedBlocks;
+
+        // The same run with the new layout: an edge out of a block falls through if its target is placed next
+        for (const auto& [edge, times] : profile.edges) {
+            size_t b = cfg.blockAt(edge.first), c = cfg.blockAt(edge.second);
+            if (edge.first != blocks[b].end - 1) continue;
+            uint32_t raw = code[edge.first];
+            bool sequential = edge.second == edge.first + 1 && fallsThrough(raw);
+            bool direct = isBranchImmediate(raw) && edge.second == (raw >> 16);
+            if (!(next[b] == c && appendTo[edge.first] < 0 && (sequential || direct))) stats.takenAfter += times;
+        }
+
+        // Move the blocks
+        std::vector<size_t> permutation;
+        for (size_t b : layout) {
+            for (size_t i = blocks[b].start; i < blocks[b].end; i++) permutation.push_back(i);
+        }
+        std::vector<size_t> position(code.size());
+        for (size_t k = 0; k < permutation.size(); k++) position[permutation[k]] = k;
+        editor.reorder(permutation);
+
+        // Invert, and append branches (targets set once the new instructions exist)
+        uint32_t branch = IsaSpec::findOpcode(isaSpec, "B", IsaSpec::InstructionType::TYPE_BRANCH, true);
+        ProgramEditor moved(program, isaSpec);
+        std::vector<std::vector<uint32_t>> before(code.size()), after(code.size());
+        for (size_t i = 0; i < code.size(); i++) {
+            if (invertTo[i] >= 0) {
+                uint32_t& raw = code[position[i]];
+                raw = (raw & ~(0xFu << 8)) | ((uint32_t)invertBranchCondition(isaSpec, Semantics::conditionOf(raw)) << 8);
+                moved.setBranchTarget(position[i], (long)position[invertTo[i]]);
+                stats.inverted++;
+            }
+            if (appendTo[i] >= 0) after[position[i]].push_back(branch);
+        }
+        stats.added = moved.insert(before, after);
+
+        std::vector<size_t> shifted(position.size());  // Index after insertion of each reordered instruction
+        for (size_t k = 0, extra = 0; k < position.size(); k++) {
+            shifted[k] = k + extra;
+            extra += after[k].size();
+        }
+        ProgramEditor grown(program, isaSpec);
+        std::vector<char> removed(code.size(), 0);
+        for (size_t i = 0; i < position.size(); i++) {
+            if (appendTo[i] >= 0) grown.setBranchTarget(shifted[position[i]] + 1, (long)shifted[position[appendTo[i]]]);
+            if (drop[i]) removed[shifted[position[i]]] = 1;
+        }
+        stats.removed = ProgramEditor(program, isaSpec).erase(removed);
+        return stats.moved;
+    }
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ControlFlow.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Global constant propagation (-O1): which registers hold a value known at
+// assembly time is tracked over the control-flow graph, following only the
+// edges a branch can take with the flags known there (sparse conditional
+// constant propagation). With those values
+//
+//   ALU op or MOV whose register already holds its result   deleted
+//   ALU op or MOV with a known result                       MOV Xd, value
+//   ALU op, CMP, READ, WRITE, PRINT with a known Xb         immediate form
+//     (or known Xa of a commutative ALU op)
+//   conditional branch decided by known flags               B, or deleted
+//
+// Values come from MOV of a number and from ALU ops and CMP on known values
+// (Semantics.hpp); everything is unknown at the entry point, at global labels
+// in object output and wherever a code address is loaded (an address reached
+// through "B Xn"). Instructions holding or adjusting a code address give
+// unknown values, since code moves, and apart from decided branches are never
+// touched. CMP sets all four flags from known operands, an ALU op N and Z;
+// MOV may set them, so afterwards they are unknown. Replacing an ALU op by
+// MOV, or deleting either, needs the flags to be dead; folding an operand
+// keeps them. Shifts by 16 or more are left alone.
+class ConstantPropagator {
+public:
+    struct Stats {
+        size_t folded = 0;     // Register operands replaced by their known value
+        size_t known = 0;      // Instructions replaced by a MOV of their known result
+        size_t redundant = 0;  // Instructions deleted because their register already held the result
+        size_t taken = 0;      // Conditional branches always taken, made unconditional
+        size_t notTaken = 0;   // Conditional branches never taken, deleted
+
+        size_t removed() const { return redundant + notTaken; }
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    Stats stats;
+
+    // Values known before an instruction
+    struct Known {
+        bool reached = false;
+        uint8_t registers = 0;  // Bit per register whose value is known
+        uint16_t values[8] = {};
+        uint8_t flags = 0;      // Flag bits whose value is known
+        uint8_t flagValues = 0;
+
+        bool has(int reg) const { return (registers >> reg) & 1; }
+        void set(int reg, uint16_t value) {
+            registers |= 1 << reg;
+            values[reg] = value;
+        }
+        void forget(int reg) { registers &= ~(1 << reg); }
+
+        // Keep what other also knows, true if anything changed
+        bool meet(const Known& other) {
+            if (!other.reached) return false;
+            if (!reached) {
+                *this = other;
+                return true;
+            }
+            uint8_t oldRegisters = registers, oldFlags = flags;
+            for (int reg = 0; reg < 8; reg++) {
+                if (has(reg) && (!other.has(reg) || other.values[reg] != values[reg])) forget(reg);
+            }
+            flags &= other.flags & ~(flagValues ^ other.flagValues);
+            return registers != oldRegisters || flags != oldFlags;
+        }
+    };
+
+    bool isType(uint32_t raw, IsaSpec::InstructionType type) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        return tech && tech->type == type;
+    }
+
+    static bool isShift(const Semantics::Operation& operation) {
+        return operation.op == Semantics::Op::LSL || operation.op == Semantics::Op::LSR;
+    }
+
+    // Outcome of branch condition code with the flags in known: 1 taken, 0 not, -1 unknown
+    int decide(int condition, const Known& known) const {
+        Semantics::State state;
+        state.n = known.flagValues & Semantics::FLAG_N;
+        state.z = known.flagValues & Semantics::FLAG_Z;
+        state.c = known.flagValues & Semantics::FLAG_C;
+        state.v = known.flagValues & Semantics::FLAG_V;
+        bool holds = false;
+        uint8_t needs = 0;
+        if (!Semantics::testCondition(isaSpec, condition, state, holds, needs) || (known.flags & needs) != needs) return -1;
+        return holds;
+    }
+
+    // Result of a register operation with known operands, false if not computable here
+    bool evaluate(const Semantics::Operation& operation, const Known& known, Semantics::State& state) const {
+        if (operation.op == Semantics::Op::OTHER) return false;
+        if ((operation.readsA() && !known.has(operation.a)) || (operation.readsB() && !known.has(operation.b))) return false;
+        if (isShift(operation) && (operation.immediate ? operation.imm : known.values[operation.b]) > 15) return false;
+        for (int reg = 0; reg < 8; reg++) state.regs[reg] = known.values[reg];
+        Semantics::execute(operation, state);
+        return true;
+    }
+
+    // Values known after raw, from those before it
+    void transfer(uint32_t raw, bool pinned, Known& known) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        if (!tech) {
+            known.registers = 0;
+            known.flags = 0;
+            return;
+        }
+        Semantics::Operation operation = Semantics::decode(isaSpec, raw);
+        Semantics::State state;
+        bool computed = !pinned && evaluate(operation, known, state);
+
+        if (tech->flags.TRY_WRITE && tech->type != IsaSpec::InstructionType::TYPE_CMP) {
+            if (computed && operation.writesDst()) known.set(operation.dst, state.regs[operation.dst]);
+            else known.forget((raw >> 8) & 0x7);
+        }
+        if (operation.op == Semantics::Op::CMP && computed) {
+            known.flags = Semantics::FLAG_N | Semantics::FLAG_Z | Semantics::FLAG_C | Semantics::FLAG_V;
+            known.flagValues = (state.n ? Semantics::FLAG_N : 0) | (state.z ? Semantics::FLAG_Z : 0) |
+                               (state.c ? Semantics::FLAG_C : 0) | (state.v ? Semantics::FLAG_V : 0);
+        } else if (operation.setsFlags() && computed) {
+            known.flags = Semantics::FLAG_N | Semantics::FLAG_Z;
+            known.flagValues = (state.n ? Semantics::FLAG_N : 0) | (state.z ? Semantics::FLAG_Z : 0);
+        } else if (tech->type == IsaSpec::InstructionType::TYPE_ALU || tech->type == IsaSpec::InstructionType::TYPE_FPU ||
+                   tech->type == IsaSpec::InstructionType::TYPE_MOVE || tech->type == IsaSpec::InstructionType::TYPE_CMP) {
+            known.flags = 0;
+        }
+    }
+
+    // Immediate form of the instruction at raw with its B register replaced by value, 0 if there is none
+    uint32_t foldB(uint32_t raw, const IsaSpec::InstructionTech& tech, uint16_t value) const {
+        uint8_t immediate = IsaSpec::findOpcode(isaSpec, tech.mnemonic, tech.type, true);
+        if (immediate == 0xFF || tech.flags.IMMEDIATE) return 0;
+        switch (tech.type) {
+            case IsaSpec::InstructionType::TYPE_ALU:
+            case IsaSpec::InstructionType::TYPE_CMP:
+            case IsaSpec::InstructionType::TYPE_MEMORY:
+                return immediate | (raw & 0xFF00) | ((uint32_t)value << 16);
+            case IsaSpec::InstructionType::TYPE_PRINT_REG:
+            case IsaSpec::InstructionType::TYPE_PRINT_CONST:
+                // The screen position is 8 bits; PRINT_CNS keeps its character in bits 24-31
+                if (value > 0xFF) return 0;
+                return immediate | (raw & 0xFF00FF00) | ((uint32_t)value << 16);
+            default:
+                return 0;
+        }
+    }
+
+public:
+    explicit ConstantPropagator(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Propagate constants through an assembled program in place, returns the number of instructions changed or removed
+    size_t optimize(AssemblyResult& program, bool objectOutput) {
+        stats = Stats();
+        std::vector<uint32_t>& code = program.instructions;
+        if (code.empty()) return 0;
+        ControlFlowGraph cfg(isaSpec);
+        cfg.build(program, objectOutput);
+        const auto& blocks = cfg.getBlocks();
+        ProgramEditor editor(program, isaSpec);
+        size_t size = code.size();
+
+        // Values at block entries, following only the edges a decided branch takes
+        std::vector<Known> entry(blocks.size());
+        std::vector<size_t> worklist;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            if (!blocks[b].entry && !blocks[b].addressTaken) continue;
+            entry[b].reached = true;
+            worklist.push_back(b);
+        }
+        while (!worklist.empty()) {
+            size_t b = worklist.back();
+            worklist.pop_back();
+            Known known = entry[b];
+            for (size_t i = blocks[b].start; i < blocks[b].end; i++) transfer(code[i], editor.isPinned(i), known);
+
+            // Branches leave the values alone, so those after the block decide its branch
+            uint32_t last = code[blocks[b].end - 1];
+            int outcome = isType(last, IsaSpec::InstructionType::TYPE_BRANCH) && Semantics::conditionOf(last) != 0
+                              ? decide(Semantics::conditionOf(last), known) : -1;
+            for (const auto& edge : blocks[b].successors) {
+                if (outcome == 1 && edge.kind == ControlFlowGraph::EDGE_FALLTHROUGH) continue;
+                if (outcome == 0 && edge.kind != ControlFlowGraph::EDGE_FALLTHROUGH) continue;
+                if (entry[edge.block].meet(known)) worklist.push_back(edge.block);
+            }
+        }
+
+        // Rewrite with the values before each instruction
+        std::vector<uint8_t> flagsLive = editor.flagsLiveAfter();
+        std::vector<char> removed(size, 0);
+        for (size_t b = 0; b < blocks.size(); b++) {
+            Known known = entry[b];
+            if (!known.reached) continue;
+            for (size_t i = blocks[b].start; i < blocks[b].end; i++) {
+                uint32_t raw = code[i];
+                Known before = known;
+                transfer(raw, editor.isPinned(i), known);
+                const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+                if (!tech) continue;
+                Semantics::Operation operation = Semantics::decode(isaSpec, raw);
+
+                // Decided branch (its target label, if any, stays as it is)
+                if (tech->type == IsaSpec::InstructionType::TYPE_BRANCH && tech->flags.IMMEDIATE && Semantics::conditionOf(raw) != 0) {
+                    int outcome = decide(Semantics::conditionOf(raw), before);
+                    if (outcome == 1) {
+                        code[i] = raw & ~(0xFu << 8);
+                        stats.taken++;
+                    } else if (outcome == 0) {
+                        removed[i] = 1;
+                        stats.notTaken++;
+                    }
+                    continue;
+                }
+                if (editor.isPinned(i)) continue;
+
+                // Known result
+                bool writes = operation.writesDst() && operation.op != Semantics::Op::OTHER;
+                if (writes && known.has(operation.dst)) {
+                    uint16_t value = known.values[operation.dst];
+                    if (before.has(operation.dst) && before.values[operation.dst] == value && !flagsLive[i]) {
+                        removed[i] = 1;
+                        stats.redundant++;
+                        continue;
+                    }
+                    uint32_t mov = IsaSpec::findOpcode(isaSpec, "MOV", IsaSpec::InstructionType::TYPE_MOVE, true) |
+                                   ((uint32_t)operation.dst << 8) | ((uint32_t)value << 16);
+                    if (mov != raw && (operation.op == Semantics::Op::MOV || !flagsLive[i])) {
+                        code[i] = mov;
+                        stats.known++;
+                        continue;
+                    }
+                }
+
+                // Known register operand into an immediate form
+                bool usesB = operation.op == Semantics::Op::OTHER ? tech->flags.TRY_READ_B && !tech->flags.IMMEDIATE
+                                                                  : operation.readsB();
+                uint8_t b = (raw >> 16) & 0x7;
+                if (tech->type == IsaSpec::InstructionType::TYPE_BRANCH || !usesB) continue;
+                if (((raw >> 16) & 0xF) > 7) continue;
+                uint32_t folded = 0;
+                if (before.has(b) && !(isShift(operation) && before.values[b] > 15)) {
+                    folded = foldB(raw, *tech, before.values[b]);
+                } else if (before.has(operation.a) && (operation.op == Semantics::Op::AND || operation.op == Semantics::Op::OR ||
+                           operation.op == Semantics::Op::XOR || operation.op == Semantics::Op::ADD ||
+                           operation.op == Semantics::Op::UMUL_L || operation.op == Semantics::Op::UMUL_H ||
+                           operation.op == Semantics::Op::MUL_L || operation.op == Semantics::Op::MUL_H)) {
+                    uint32_t swapped = (raw & ~(0x7u << 12)) | ((uint32_t)b << 12);
+                    folded = foldB(swapped, *tech, before.values[operation.a]);
+                }
+                if (folded) {
+                    code[i] = folded;
+                    stats.folded++;
+                }
+            }
+        }
+
+        editor.erase(removed);
+        return stats.folded + stats.known + stats.redundant + stats.taken + stats.notTaken;
+    }
+};
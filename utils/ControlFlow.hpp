@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "Json.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Basic-block control-flow graph of an assembled program.
+//
+// Blocks start at the entry point, at labels, at code addresses (branch
+// targets, LR and MOV of a label) and after every branch or EXIT. Edges come
+// from BRANCH_I targets and fall-through; a register branch ("B Xn") may go to
+// any block whose address is loaded into a register somewhere.
+//
+// A block is reachable from the entry point (and, in object output, from every
+// global label) through edges, or because a reachable instruction loads its
+// address. Code only reached through a plain number in a register is not
+// seen, as with the other optimizer passes.
+class ControlFlowGraph {
+public:
+    enum EdgeKind { EDGE_FALLTHROUGH, EDGE_TAKEN, EDGE_INDIRECT };
+
+    struct Edge {
+        size_t block;
+        EdgeKind kind;
+        bool back = false;          // Closes a loop (target is on the depth-first path from the entry)
+    };
+
+    struct Block {
+        size_t start;               // First instruction
+        size_t end;                 // One past the last instruction
+        std::string label;          // Last label defined at start, empty if none
+        std::vector<Edge> successors;
+        std::vector<size_t> predecessors;
+        bool entry = false;         // Program entry, or a global label in object output
+        bool addressTaken = false;  // Address loaded into a register (LR, MOV of a label)
+        bool exits = false;         // Ends in EXIT
+        bool leaves = false;        // Branches to another module or runs past the last instruction
+        bool reachable = false;
+        size_t loopDepth = 0;       // Natural loops (closed by back edges) containing the block
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    std::vector<uint32_t> code;
+    std::vector<Block> blocks;
+    std::vector<size_t> blockOf;    // Instruction -> block
+
+    bool isType(uint32_t raw, IsaSpec::InstructionType type) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        return tech && tech->type == type;
+    }
+
+    void addEdge(size_t from, size_t to, EdgeKind kind) {
+        for (const Edge& edge : blocks[from].successors) {
+            if (edge.block == to && edge.kind == kind) return;
+        }
+        blocks[from].successors.push_back({to, kind});
+        blocks[to].predecessors.push_back(from);
+    }
+
+    // Mark edges to blocks on the current depth-first path as back edges
+    void findBackEdges() {
+        std::vector<char> state(blocks.size(), 0);  // 0 = unvisited, 1 = on path, 2 = done
+        std::vector<std::pair<size_t, size_t>> stack;  // Block, next successor
+        for (size_t root = 0; root < blocks.size(); root++) {
+            if (state[root] || !(blocks[root].entry || blocks[root].addressTaken)) continue;
+            stack.push_back({root, 0});
+            state[root] = 1;
+            while (!stack.empty()) {
+                auto& [block, next] = stack.back();
+                if (next == blocks[block].successors.size()) {
+                    state[block] = 2;
+                    stack.pop_back();
+                    continue;
+                }
+                Edge& edge = blocks[block].successors[next++];
+                if (state[edge.block] == 1) {
+                    edge.back = true;
+                } else if (state[edge.block] == 0) {
+                    state[edge.block] = 1;
+                    stack.push_back({edge.block, 0});
+                }
+            }
+        }
+    }
+
+    // Natural loop of each header: the blocks reaching a back edge into it without passing it
+    void findLoopDepths() {
+        for (size_t header = 0; header < blocks.size(); header++) {
+            std::vector<char> inLoop(blocks.size(), 0);
+            std::vector<size_t> worklist;
+            bool isHeader = false;
+            inLoop[header] = 1;
+            for (size_t tail : blocks[header].predecessors) {
+                for (const Edge& edge : blocks[tail].successors) {
+                    if (edge.block != header || !edge.back) continue;
+                    isHeader = true;
+                    if (!inLoop[tail]) {
+                        inLoop[tail] = 1;
+                        worklist.push_back(tail);
+                    }
+                }
+            }
+            if (!isHeader) continue;
+            while (!worklist.empty()) {
+                size_t b = worklist.back();
+                worklist.pop_back();
+                for (size_t p : blocks[b].predecessors) {
+                    if (!inLoop[p]) {
+                        inLoop[p] = 1;
+                        worklist.push_back(p);
+                    }
+                }
+            }
+            for (size_t b = 0; b < blocks.size(); b++) blocks[b].loopDepth += inLoop[b];
+        }
+    }
+
+    static const char* edgeName(EdgeKind kind) {
+        switch (kind) {
+            case EDGE_FALLTHROUGH: return "fallthrough";
+            case EDGE_TAKEN: return "taken";
+            default: return "indirect";
+        }
+    }
+
+    static std::string escapeDot(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+public:
+    explicit ControlFlowGraph(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const std::vector<Block>& getBlocks() const { return blocks; }
+    size_t blockAt(size_t index) const { return blockOf[index]; }
+
+    // Build the graph of an assembled program; objectOutput makes global labels entry points too
+    void build(AssemblyResult& program, bool objectOutput) {
+        code = program.instructions;
+        blocks.clear();
+        blockOf.assign(code.size(), 0);
+        if (code.empty()) return;
+
+        ProgramEditor editor(program, isaSpec);
+        const std::vector<ProgramEditor::CodeAddress>& addresses = editor.getCodeAddresses();
+
+        // Leaders
+        std::vector<char> leader(code.size() + 1, 0);
+        leader[0] = 1;
+        for (const auto& symbol : program.symbols) {
+            if (symbol.address < code.size()) leader[symbol.address] = 1;
+        }
+        for (const auto& address : addresses) {
+            if (address.target >= 0 && (size_t)address.target < code.size()) leader[address.target] = 1;
+        }
+        for (size_t i = 0; i < code.size(); i++) {
+            if (isType(code[i], IsaSpec::InstructionType::TYPE_BRANCH) || isType(code[i], IsaSpec::InstructionType::TYPE_SERVICE)) {
+                leader[i + 1] = 1;
+            }
+        }
+
+        for (size_t i = 0; i < code.size(); i++) {
+            if (leader[i]) {
+                Block block;
+                block.start = i;
+                blocks.push_back(block);
+            }
+            blockOf[i] = blocks.size() - 1;
+            blocks.back().end = i + 1;
+        }
+
+        blocks[0].entry = true;
+        for (const auto& symbol : program.symbols) {
+            if (symbol.address >= code.size()) continue;
+            Block& block = blocks[blockOf[symbol.address]];
+            block.label = symbol.name;  // Labels start blocks; the last one is nearest the code
+            if (objectOutput && symbol.name[0] != '.') block.entry = true;
+        }
+        for (const auto& address : addresses) {
+            if (!address.branch && address.target >= 0 && (size_t)address.target < code.size()) {
+                blocks[blockOf[address.target]].addressTaken = true;
+            }
+        }
+
+        // Edges
+        for (size_t b = 0; b < blocks.size(); b++) {
+            size_t last = blocks[b].end - 1;
+            uint32_t raw = code[last];
+            bool fallsThrough = true;
+            if (isType(raw, IsaSpec::InstructionType::TYPE_SERVICE)) {
+                blocks[b].exits = true;
+                fallsThrough = false;
+            } else if (isType(raw, IsaSpec::InstructionType::TYPE_BRANCH)) {
+                fallsThrough = Semantics::conditionOf(raw) != 0;
+                if (!Semantics::techOf(isaSpec, raw)->flags.IMMEDIATE) {
+                    for (size_t t = 0; t < blocks.size(); t++) {
+                        if (blocks[t].addressTaken) addEdge(b, t, EDGE_INDIRECT);
+                    }
+                } else if (editor.isExternal(last) || (raw >> 16) >= code.size()) {
+                    blocks[b].leaves = true;
+                } else {
+                    addEdge(b, blockOf[raw >> 16], EDGE_TAKEN);
+                }
+            }
+            if (fallsThrough) {
+                if (b + 1 < blocks.size()) addEdge(b, b + 1, EDGE_FALLTHROUGH);
+                else blocks[b].leaves = true;
+            }
+        }
+
+        // Reachability: follow edges, and the addresses reachable instructions load
+        std::vector<std::vector<size_t>> loads(blocks.size());
+        for (const auto& address : addresses) {
+            if (!address.branch && address.target >= 0 && (size_t)address.target < code.size()) {
+                loads[blockOf[address.index]].push_back(blockOf[address.target]);
+            }
+        }
+        std::vector<size_t> worklist;
+        auto markReachable = [&](size_t b) {
+            if (!blocks[b].reachable) {
+                blocks[b].reachable = true;
+                worklist.push_back(b);
+            }
+        };
+        for (size_t b = 0; b < blocks.size(); b++) {
+            if (blocks[b].entry) markReachable(b);
+        }
+        while (!worklist.empty()) {
+            size_t b = worklist.back();
+            worklist.pop_back();
+            for (const Edge& edge : blocks[b].successors) {
+                if (edge.kind != EDGE_INDIRECT) markReachable(edge.block);
+            }
+            for (size_t target : loads[b]) markReachable(target);
+        }
+
+        findBackEdges();
+        findLoopDepths();
+    }
+
+    // Delete every unreachable block from the program and rebuild the graph, returns the number of instructions removed
+    size_t removeUnreachable(AssemblyResult& program, bool objectOutput) {
+        build(program, objectOutput);
+        std::vector<char> removed(code.size(), 0);
+        for (const Block& block : blocks) {
+            if (block.reachable) continue;
+            for (size_t i = block.start; i < block.end; i++) removed[i] = 1;
+        }
+        ProgramEditor editor(program, isaSpec);
+        size_t count = editor.erase(removed);
+        if (count) build(program, objectOutput);
+        return count;
+    }
+
+    // Graphviz digraph: one box per block listing its instructions, back edges in red
+    void writeDot(std::ostream& out, const std::string& name) const {
+        out << "digraph \"" << escapeDot(name) << "\" {\n";
+        out << "    node [shape=box, fontname=\"monospace\"];\n";
+        for (size_t b = 0; b < blocks.size(); b++) {
+            const Block& block = blocks[b];
+            out << "    b" << b << " [label=\"";
+            if (!block.label.empty()) out << escapeDot(block.label) << ":\\l";
+            for (size_t i = block.start; i < block.end; i++) {
+                out << i << ": " << escapeDot(disassemble(code[i], isaSpec)) << "\\l";
+            }
+            out << "\"";
+            if (block.entry) out << ", penwidth=2";
+            if (!block.reachable) out << ", style=dashed, color=gray";
+            out << "];\n";
+        }
+        for (size_t b = 0; b < blocks.size(); b++) {
+            for (const Edge& edge : blocks[b].successors) {
+                out << "    b" << b << " -> b" << edge.block;
+                if (edge.back) out << " [color=red]";
+                else if (edge.kind == EDGE_INDIRECT) out << " [style=dotted]";
+                else if (edge.kind == EDGE_FALLTHROUGH) out << " [style=dashed]";
+                out << ";\n";
+            }
+        }
+        out << "}\n";
+    }
+
+    // {"blocks": [{"id", "start", "end", "label", "entry", ..., "instructions": [...], "successors": [...]}]}
+    void writeJson(std::ostream& out) const {
+        JsonValue list = JsonValue::array();
+        for (size_t b = 0; b < blocks.size(); b++) {
+            const Block& block = blocks[b];
+            JsonValue instructions = JsonValue::array();
+            for (size_t i = block.start; i < block.end; i++) instructions.push(disassemble(code[i], isaSpec));
+            JsonValue successors = JsonValue::array();
+            for (const Edge& edge : block.successors) {
+                successors.push(JsonValue::object()
+                    .set("block", edge.block)
+                    .set("kind", edgeName(edge.kind))
+                    .set("back", edge.back));
+            }
+            JsonValue predecessors = JsonValue::array();
+            for (size_t p : block.predecessors) predecessors.push(p);
+            list.push(JsonValue::object()
+                .set("id", b)
+                .set("start", block.start)
+                .set("end", block.end)
+                .set("label", block.label)
+                .set("entry", block.entry)
+                .set("addressTaken", block.addressTaken)
+                .set("exits", block.exits)
+                .set("leaves", block.leaves)
+                .set("reachable", block.reachable)
+                .set("loopDepth", block.loopDepth)
+                .set("instructions", std::move(instructions))
+                .set("successors", std::move(successors))
+                .set("predecessors", std::move(predecessors)));
+        }
+        out << JsonValue::object().set("blocks", std::move(list)).dump() << "\n";
+    }
+};
@@ -0,0 +1,574 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Semantics.hpp"
+#include "ExecutionProfile.hpp"
+#include "EmulatorJit.hpp"
+
+// Emulator of the V2 machine ("gct run"): eight 16-bit registers, the N, Z,
+// C and V flags, 256 words of RAM, a 256-cell screen written by PRINT, and a
+// 256-instruction ROM (ALPHA high half, BETA low half of each word).
+//
+// Every opcode is decoded through the ISA spec once, into what it does and
+// how many cycles it takes. Loading a program then predecodes each ROM slot
+// it writes into a handler number and its fields, stored as parallel arrays
+// (under 2 KB, so the whole program stays in L1), and run() dispatches on
+// the handler with a computed goto (a switch where the compiler has no
+// label addresses). With setJit(true) blocks are translated to x86-64 instead
+// (EmulatorJit.hpp) and the interpreter runs what is not translated. The
+// reference loop that decodes every step is kept for comparison ("Emulator
+// Benchmark"). Register operations mean what they do
+// in Semantics.hpp and branch conditions are evaluated by mnemonic, so the
+// emulator, the optimizers and the superoptimizer agree on what an
+// instruction does. RAM and screen addresses use their low 8 bits.
+// Execution stops at EXIT, at an opcode the spec does not define (or one it
+// reserves, FPU and NUL), when the program counter leaves the ROM, or after
+// a given number of steps.
+#ifndef GCT_EMULATOR_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define GCT_EMULATOR_COMPUTED_GOTO 1
+#else
+#define GCT_EMULATOR_COMPUTED_GOTO 0
+#endif
+#endif
+
+// Predecoded handlers: each register operation in Semantics::Op order, register form then immediate form
+#define GCT_EMULATOR_HANDLERS(X) \
+    X(AND) X(AND_I) X(OR) X(OR_I) X(XOR) X(XOR_I) X(NOT) X(NOT_I) X(ADD) X(ADD_I) X(SUB) X(SUB_I) \
+    X(LSL) X(LSL_I) X(LSR) X(LSR_I) X(BCDL) X(BCDL_I) X(BCDH) X(BCDH_I) X(UMUL_L) X(UMUL_L_I) \
+    X(UMUL_H) X(UMUL_H_I) X(MUL_L) X(MUL_L_I) X(MUL_H) X(MUL_H_I) X(MOV) X(MOV_I) X(CMP) X(CMP_I) \
+    X(BRANCH) X(BRANCH_I) X(READ) X(READ_I) X(WRITE) X(WRITE_I) X(PRINT_REG) X(PRINT_REG_I) \
+    X(PRINT_CONST) X(PRINT_CONST_I) X(EXIT) X(INVALID) X(OFF_ROM)
+
+class Emulator {
+public:
+    static constexpr size_t ROM_SIZE = 256;
+    static constexpr size_t MEMORY_SIZE = 256;
+    static constexpr size_t SCREEN_SIZE = 256;
+
+    enum Status { STATUS_RUNNING, STATUS_EXITED, STATUS_STEP_LIMIT, STATUS_OFF_ROM, STATUS_INVALID };
+
+    struct Machine {
+        Semantics::State cpu;
+        uint16_t pc = 0;
+        uint16_t memory[MEMORY_SIZE] = {};
+        uint16_t screen[SCREEN_SIZE] = {};
+    };
+
+    struct Stats {
+        uint64_t steps = 0;   // Instructions executed, EXIT included
+        uint64_t cycles = 0;  // By the cycle table of the ISA spec
+        uint64_t taken = 0;   // Branches taken
+    };
+
+    enum Kind : uint8_t { KIND_INVALID, KIND_REGISTER, KIND_BRANCH, KIND_READ, KIND_WRITE, KIND_PRINT_REG, KIND_PRINT_CONST, KIND_EXIT };
+
+    // What an opcode does, from the spec
+    struct Decoder {
+        Kind kind = KIND_INVALID;
+        Semantics::Op op = Semantics::Op::OTHER;
+        bool immediate = false;
+        uint8_t cycles = 1;
+    };
+
+    // Every opcode and branch condition of a spec, decoded once (shared with BatchEmulator)
+    struct DecodeTable {
+        Decoder decoders[256];
+        uint16_t conditions[16] = {};  // Per condition code, bit n set if it holds with flags n (N=8, Z=4, C=2, V=1)
+
+        explicit DecodeTable(const IsaSpec::ISA_SPEC& spec) {
+            for (const auto& tech : spec.instructions_tech) {
+                Decoder& decoder = decoders[tech.opcode];
+                decoder.immediate = tech.flags.IMMEDIATE;
+                decoder.cycles = tech.cycles;
+                decoder.op = Semantics::operationOf(tech);
+                switch (tech.type) {
+                    case IsaSpec::InstructionType::TYPE_ALU:
+                    case IsaSpec::InstructionType::TYPE_MOVE:
+                    case IsaSpec::InstructionType::TYPE_CMP:
+                        if (decoder.op != Semantics::Op::OTHER) decoder.kind = KIND_REGISTER;
+                        break;
+                    case IsaSpec::InstructionType::TYPE_BRANCH: decoder.kind = KIND_BRANCH; break;
+                    case IsaSpec::InstructionType::TYPE_MEMORY: decoder.kind = tech.flags.TRY_WRITE ? KIND_READ : KIND_WRITE; break;
+                    case IsaSpec::InstructionType::TYPE_PRINT_REG: decoder.kind = KIND_PRINT_REG; break;
+                    case IsaSpec::InstructionType::TYPE_PRINT_CONST: decoder.kind = KIND_PRINT_CONST; break;
+                    case IsaSpec::InstructionType::TYPE_SERVICE: decoder.kind = KIND_EXIT; break;
+                    default: break;
+                }
+            }
+            for (int code = 0; code < 16; code++) {
+                for (int flags = 0; flags < 16; flags++) {
+                    Semantics::State state;
+                    state.n = flags & 8;
+                    state.z = flags & 4;
+                    state.c = flags & 2;
+                    state.v = flags & 1;
+                    bool holds = false;
+                    uint8_t needs = 0;
+                    if (Semantics::testCondition(spec, code, state, holds, needs) && holds) conditions[code] |= 1 << flags;
+                }
+            }
+        }
+    };
+
+private:
+
+#define GCT_EMULATOR_ENUM(name) HANDLER_##name,
+    enum Handler : uint8_t { GCT_EMULATOR_HANDLERS(GCT_EMULATOR_ENUM) };
+#undef GCT_EMULATOR_ENUM
+
+    // The ROM predecoded, one entry per slot and one past the end (OFF_ROM) where execution runs off it
+    struct Predecoded {
+        uint8_t handler[ROM_SIZE + 1];
+        uint8_t dst[ROM_SIZE + 1];  // Condition code for branches
+        uint8_t a[ROM_SIZE + 1];
+        uint8_t b[ROM_SIZE + 1];
+        uint8_t cycles[ROM_SIZE + 1];
+        uint16_t imm[ROM_SIZE + 1];
+    };
+
+    DecodeTable table;
+    std::vector<uint32_t> rom = std::vector<uint32_t>(ROM_SIZE, 0);
+    Predecoded program;
+    bool usePredecoded = true;
+    std::unique_ptr<EmulatorJit> jit;  // When enabled and available
+    Stats stats;
+    std::vector<uint64_t> edges;   // from * ROM_SIZE + to, when profiling
+
+    void predecode(size_t slot, uint32_t raw) {
+        const Decoder& decoder = table.decoders[raw & 0xFF];
+        uint8_t handler = HANDLER_INVALID;
+        switch (decoder.kind) {
+            case KIND_REGISTER: handler = (uint8_t)decoder.op * 2; break;
+            case KIND_BRANCH: handler = HANDLER_BRANCH; break;
+            case KIND_READ: handler = HANDLER_READ; break;
+            case KIND_WRITE: handler = HANDLER_WRITE; break;
+            case KIND_PRINT_REG: handler = HANDLER_PRINT_REG; break;
+            case KIND_PRINT_CONST: handler = HANDLER_PRINT_CONST; break;
+            case KIND_EXIT: handler = HANDLER_EXIT; break;
+            case KIND_INVALID: break;
+        }
+        if (decoder.immediate && handler != HANDLER_EXIT && handler != HANDLER_INVALID) handler++;
+        program.handler[slot] = handler;
+        program.dst[slot] = decoder.kind == KIND_BRANCH ? (raw >> 8) & 0xF : (raw >> 8) & 0x7;
+        program.a[slot] = (raw >> 12) & 0x7;
+        program.b[slot] = (raw >> 16) & 0x7;
+        program.cycles[slot] = decoder.cycles;
+        program.imm[slot] = (uint16_t)(raw >> 16);
+    }
+
+    // Predecode the first used slots of the ROM; the rest hold zero, decoded once and copied
+    void predecodeRom(size_t used) {
+        predecode(ROM_SIZE - 1, 0);
+        for (size_t slot = used; slot + 1 < ROM_SIZE; slot++) {
+            program.handler[slot] = program.handler[ROM_SIZE - 1];
+            program.dst[slot] = program.dst[ROM_SIZE - 1];
+            program.a[slot] = program.a[ROM_SIZE - 1];
+            program.b[slot] = program.b[ROM_SIZE - 1];
+            program.cycles[slot] = program.cycles[ROM_SIZE - 1];
+            program.imm[slot] = program.imm[ROM_SIZE - 1];
+        }
+        for (size_t slot = 0; slot < used; slot++) predecode(slot, rom[slot]);
+        program.handler[ROM_SIZE] = HANDLER_OFF_ROM;
+    }
+
+    // Decode each instruction as it is executed
+    Status runDecoding(Machine& machine, uint64_t maxSteps) {
+        Semantics::State& cpu = machine.cpu;
+        bool profiling = !edges.empty();
+        while (stats.steps < maxSteps) {
+            if (machine.pc >= ROM_SIZE) return STATUS_OFF_ROM;
+            uint32_t raw = rom[machine.pc];
+            const Decoder& decoder = table.decoders[raw & 0xFF];
+            uint8_t dst = (raw >> 8) & 0x7, a = (raw >> 12) & 0x7, b = (raw >> 16) & 0x7;
+            uint16_t imm = (uint16_t)(raw >> 16);
+            uint16_t next = machine.pc + 1;
+
+            switch (decoder.kind) {
+                case KIND_REGISTER: {
+                    Semantics::Operation operation;
+                    operation.op = decoder.op;
+                    operation.immediate = decoder.immediate;
+                    operation.dst = dst;
+                    operation.a = a;
+                    operation.b = b;
+                    operation.imm = imm;
+                    Semantics::execute(operation, cpu);
+                    break;
+                }
+                case KIND_BRANCH: {
+                    int flags = (cpu.n << 3) | (cpu.z << 2) | (cpu.c << 1) | (int)cpu.v;
+                    if ((table.conditions[(raw >> 8) & 0xF] >> flags) & 1) {
+                        next = decoder.immediate ? imm : cpu.regs[(raw >> 16) & 0x7];
+                        stats.taken++;
+                    }
+                    break;
+                }
+                case KIND_READ: cpu.regs[dst] = machine.memory[(decoder.immediate ? imm : cpu.regs[b]) & 0xFF]; break;
+                case KIND_WRITE: machine.memory[(decoder.immediate ? imm : cpu.regs[b]) & 0xFF] = cpu.regs[a]; break;
+                case KIND_PRINT_REG: machine.screen[(decoder.immediate ? imm : cpu.regs[b]) & 0xFF] = cpu.regs[a]; break;
+                case KIND_PRINT_CONST: machine.screen[(decoder.immediate ? imm : cpu.regs[b]) & 0xFF] = raw >> 24; break;
+                case KIND_EXIT:
+                    stats.steps++;
+                    stats.cycles += decoder.cycles;
+                    return STATUS_EXITED;
+                case KIND_INVALID:
+                    return STATUS_INVALID;
+            }
+            stats.steps++;
+            stats.cycles += decoder.cycles;
+            if (profiling && next < ROM_SIZE) edges[machine.pc * ROM_SIZE + next]++;
+            machine.pc = next;
+        }
+        return STATUS_STEP_LIMIT;
+    }
+
+    // Run the predecoded program. Registers, flags and counters live in locals for the duration; every
+    // handler ends by counting its instruction and dispatching straight to the next one.
+    template <bool Profiling>
+    Status runPredecoded(Machine& machine, uint64_t maxSteps) {
+        const uint8_t* const handler = program.handler;
+        const uint8_t* const dst = program.dst;
+        const uint8_t* const a = program.a;
+        const uint8_t* const b = program.b;
+        const uint8_t* const cycles = program.cycles;
+        const uint16_t* const imm = program.imm;
+        const uint16_t* const conditions = table.conditions;
+        uint16_t* const memory = machine.memory;
+        uint16_t* const screen = machine.screen;
+        uint64_t* const edgeCounts = edges.data();
+
+        uint16_t regs[8];
+        std::copy(machine.cpu.regs, machine.cpu.regs + 8, regs);
+        bool n = machine.cpu.n, z = machine.cpu.z, c = machine.cpu.c, v = machine.cpu.v;
+        uint64_t steps = 0, cycleCount = 0, taken = 0;
+        uint32_t pc = machine.pc;
+        uint16_t offRom = pc < ROM_SIZE ? ROM_SIZE : machine.pc;  // Where the program counter left the ROM
+        Status status = STATUS_STEP_LIMIT;
+        if (maxSteps == 0) return STATUS_STEP_LIMIT;
+        if (pc >= ROM_SIZE) pc = ROM_SIZE;
+
+#if GCT_EMULATOR_COMPUTED_GOTO
+#define GCT_EMULATOR_LABEL(name) &&handle_##name,
+        static const void* const labels[] = {GCT_EMULATOR_HANDLERS(GCT_EMULATOR_LABEL)};
+#undef GCT_EMULATOR_LABEL
+#define HANDLE(name) handle_##name:
+#define DISPATCH() goto *labels[handler[pc]]
+#else
+#define HANDLE(name) case HANDLER_##name:
+#define DISPATCH() continue
+#endif
+#define NEXT(target)                                                                     \
+    {                                                                                    \
+        uint32_t next = (target);                                                        \
+        steps++;                                                                         \
+        cycleCount += cycles[pc];                                                        \
+        if constexpr (Profiling) {                                                       \
+            if (next < ROM_SIZE) edgeCounts[pc * ROM_SIZE + next]++;                     \
+        }                                                                                \
+        pc = next;                                                                       \
+        if (steps >= maxSteps) goto done;                                                \
+        DISPATCH();                                                                      \
+    }
+#define FLAGS(result, carry, overflow)   \
+    n = ((result) & 0x8000) != 0;        \
+    z = (uint16_t)(result) == 0;         \
+    c = (carry);                         \
+    v = (overflow);
+// Operations that only set N and Z, from x (register A) and y (register B or the immediate)
+#define SIMPLE(name, expression)                                                          \
+    HANDLE(name) {                                                                       \
+        uint16_t x = regs[a[pc]], y = regs[b[pc]];                                       \
+        uint16_t result = (uint16_t)(expression);                                        \
+        (void)y;                                                                         \
+        regs[dst[pc]] = result;                                                          \
+        FLAGS(result, false, false)                                                      \
+        NEXT(pc + 1)                                                                     \
+    }                                                                                    \
+    HANDLE(name##_I) {                                                                   \
+        uint16_t x = regs[a[pc]], y = imm[pc];                                           \
+        uint16_t result = (uint16_t)(expression);                                        \
+        (void)y;                                                                         \
+        regs[dst[pc]] = result;                                                          \
+        FLAGS(result, false, false)                                                      \
+        NEXT(pc + 1)                                                                     \
+    }
+#define SUBTRACT(name, store)                                                             \
+    HANDLE(name) {                                                                       \
+        uint16_t x = regs[a[pc]], y = regs[b[pc]], result = (uint16_t)(x - y);           \
+        if (store) regs[dst[pc]] = result;                                               \
+        FLAGS(result, x >= y, ((x ^ y) & (x ^ result) & 0x8000) != 0)                    \
+        NEXT(pc + 1)                                                                     \
+    }                                                                                    \
+    HANDLE(name##_I) {                                                                   \
+        uint16_t x = regs[a[pc]], y = imm[pc], result = (uint16_t)(x - y);               \
+        if (store) regs[dst[pc]] = result;                                               \
+        FLAGS(result, x >= y, ((x ^ y) & (x ^ result) & 0x8000) != 0)                    \
+        NEXT(pc + 1)                                                                     \
+    }
+#define ADDRESS(name, statement)                                                          \
+    HANDLE(name) {                                                                       \
+        uint8_t address = regs[b[pc]] & 0xFF;                                            \
+        statement;                                                                       \
+        NEXT(pc + 1)                                                                     \
+    }                                                                                    \
+    HANDLE(name##_I) {                                                                   \
+        uint8_t address = imm[pc] & 0xFF;                                                \
+        statement;                                                                       \
+        NEXT(pc + 1)                                                                     \
+    }
+#define BRANCH(name, target)                                                              \
+    HANDLE(name) {                                                                       \
+        if ((conditions[dst[pc]] >> ((n << 3) | (z << 2) | (c << 1) | (int)v)) & 1) {    \
+            uint16_t to = (target);                                                      \
+            taken++;                                                                     \
+            if (to >= ROM_SIZE) offRom = to;                                             \
+            NEXT(to < ROM_SIZE ? to : ROM_SIZE)                                          \
+        }                                                                                \
+        NEXT(pc + 1)                                                                     \
+    }
+
+#if GCT_EMULATOR_COMPUTED_GOTO
+        DISPATCH();
+        {
+#else
+        for (;;) {
+            switch (handler[pc]) {
+#endif
+            SIMPLE(AND, x & y)
+            SIMPLE(OR, x | y)
+            SIMPLE(XOR, x ^ y)
+            SIMPLE(NOT, ~x)
+            SIMPLE(LSL, y > 15 ? 0 : x << y)
+            SIMPLE(LSR, y > 15 ? 0 : x >> y)
+            SIMPLE(BCDL, Semantics::bcd(x, false))
+            SIMPLE(BCDH, Semantics::bcd(x, true))
+            SIMPLE(UMUL_L, (uint32_t)x * y)
+            SIMPLE(UMUL_H, ((uint32_t)x * y) >> 16)
+            SIMPLE(MUL_L, (int32_t)(int16_t)x * (int16_t)y)
+            SIMPLE(MUL_H, ((int32_t)(int16_t)x * (int16_t)y) >> 16)
+            HANDLE(ADD) {
+                uint16_t x = regs[a[pc]], y = regs[b[pc]];
+                uint32_t result = (uint32_t)x + y;
+                regs[dst[pc]] = (uint16_t)result;
+                FLAGS(result, result > 0xFFFF, (~(x ^ y) & (x ^ result) & 0x8000) != 0)
+                NEXT(pc + 1)
+            }
+            HANDLE(ADD_I) {
+                uint16_t x = regs[a[pc]], y = imm[pc];
+                uint32_t result = (uint32_t)x + y;
+                regs[dst[pc]] = (uint16_t)result;
+                FLAGS(result, result > 0xFFFF, (~(x ^ y) & (x ^ result) & 0x8000) != 0)
+                NEXT(pc + 1)
+            }
+            SUBTRACT(SUB, true)
+            SUBTRACT(CMP, false)
+            HANDLE(MOV) {
+                regs[dst[pc]] = regs[a[pc]];
+                NEXT(pc + 1)
+            }
+            HANDLE(MOV_I) {
+                regs[dst[pc]] = imm[pc];
+                NEXT(pc + 1)
+            }
+            BRANCH(BRANCH, regs[b[pc]])
+            BRANCH(BRANCH_I, imm[pc])
+            ADDRESS(READ, regs[dst[pc]] = memory[address])
+            ADDRESS(WRITE, memory[address] = regs[a[pc]])
+            ADDRESS(PRINT_REG, screen[address] = regs[a[pc]])
+            ADDRESS(PRINT_CONST, screen[address] = imm[pc] >> 8)
+            HANDLE(EXIT) {
+                steps++;
+                cycleCount += cycles[pc];
+                status = STATUS_EXITED;
+                goto done;
+            }
+            HANDLE(INVALID) {
+                status = STATUS_INVALID;
+                goto done;
+            }
+            HANDLE(OFF_ROM) {
+                status = STATUS_OFF_ROM;
+                goto done;
+            }
+#if !GCT_EMULATOR_COMPUTED_GOTO
+            }
+#endif
+        }
+#undef HANDLE
+#undef DISPATCH
+#undef NEXT
+#undef FLAGS
+#undef SIMPLE
+#undef SUBTRACT
+#undef ADDRESS
+#undef BRANCH
+
+    done:
+        std::copy(regs, regs + 8, machine.cpu.regs);
+        machine.cpu.n = n;
+        machine.cpu.z = z;
+        machine.cpu.c = c;
+        machine.cpu.v = v;
+        machine.pc = pc < ROM_SIZE ? (uint16_t)pc : offRom;
+        stats.steps = steps;
+        stats.cycles = cycleCount;
+        stats.taken = taken;
+        return status;
+    }
+
+    // Translate the block at pc from the predecoded program
+    void compileBlock(uint16_t pc) {
+        EmulatorJit::Instruction instructions[EmulatorJit::MAX_BLOCK];
+        size_t count = std::min(EmulatorJit::MAX_BLOCK, ROM_SIZE - pc);
+        for (size_t i = 0; i < count; i++) {
+            size_t slot = pc + i;
+            uint8_t handler = program.handler[slot];
+            EmulatorJit::Instruction& instruction = instructions[i];
+            instruction.immediate = handler < HANDLER_EXIT && (handler & 1);
+            instruction.dst = program.dst[slot];
+            instruction.a = program.a[slot];
+            instruction.b = program.b[slot];
+            instruction.imm = program.imm[slot];
+            instruction.cycles = program.cycles[slot];
+            if (handler < HANDLER_BRANCH) {
+                instruction.op = (Semantics::Op)(handler / 2);
+                bool decimal = instruction.op == Semantics::Op::BCDL || instruction.op == Semantics::Op::BCDH;
+                instruction.kind = decimal ? EmulatorJit::KIND_UNSUPPORTED : EmulatorJit::KIND_REGISTER;
+            } else if (handler <= HANDLER_BRANCH_I) {
+                instruction.kind = EmulatorJit::KIND_BRANCH;
+                instruction.conditions = table.conditions[instruction.dst];
+            } else if (handler <= HANDLER_READ_I) {
+                instruction.kind = EmulatorJit::KIND_READ;
+            } else if (handler <= HANDLER_WRITE_I) {
+                instruction.kind = EmulatorJit::KIND_WRITE;
+            } else if (handler <= HANDLER_PRINT_REG_I) {
+                instruction.kind = EmulatorJit::KIND_PRINT_REG;
+            } else if (handler <= HANDLER_PRINT_CONST_I) {
+                instruction.kind = EmulatorJit::KIND_PRINT_CONST;
+            }
+        }
+        jit->compile(pc, instructions, count);
+    }
+
+    // Run translated blocks where there are any, one instruction at a time on the interpreter elsewhere
+    // and where a block is longer than the steps left
+    Status runJit(Machine& machine, uint64_t maxSteps) {
+        uint64_t steps = 0, cycleCount = 0, taken = 0;
+        Status status = STATUS_STEP_LIMIT;
+        jit->cycles() = 0;
+        jit->taken() = 0;
+        while (steps < maxSteps) {
+            uint16_t pc = machine.pc;
+            if (pc < ROM_SIZE && !jit->hasTried(pc)) compileBlock(pc);
+            uint64_t budget = maxSteps - steps;
+            if (pc < ROM_SIZE && jit->blockLength(pc) > 0 && jit->blockLength(pc) <= budget) {
+                uint32_t flags = (machine.cpu.n << 3) | (machine.cpu.z << 2) | (machine.cpu.c << 1) | (uint32_t)machine.cpu.v;
+                machine.pc = (uint16_t)jit->enter(&machine, budget, flags, pc);
+                machine.cpu.n = flags & 8;
+                machine.cpu.z = flags & 4;
+                machine.cpu.c = flags & 2;
+                machine.cpu.v = flags & 1;
+                steps = maxSteps - budget;
+                continue;
+            }
+            status = runPredecoded<false>(machine, 1);
+            steps += stats.steps;
+            cycleCount += stats.cycles;
+            taken += stats.taken;
+            if (status != STATUS_STEP_LIMIT) break;
+        }
+        stats.steps = steps;
+        stats.cycles = cycleCount + jit->cycles();
+        stats.taken = taken + jit->taken();
+        return status;
+    }
+
+public:
+    explicit Emulator(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : table(spec) { predecodeRom(0); }
+
+    // Load a program, the rest of the ROM reads as zero (as the ROM images do); false if it does not fit
+    bool load(const std::vector<uint32_t>& program) {
+        if (program.size() > ROM_SIZE) return false;
+        rom.assign(ROM_SIZE, 0);
+        std::copy(program.begin(), program.end(), rom.begin());
+        predecodeRom(program.size());
+        if (jit) jit->reset();
+        return true;
+    }
+
+    // Load the two halves of a ROM image, as read from <base>_ALPHA.out and <base>_BETA.out
+    bool load(const std::vector<uint16_t>& alpha, const std::vector<uint16_t>& beta) {
+        if (alpha.size() > ROM_SIZE || beta.size() > ROM_SIZE) return false;
+        rom.assign(ROM_SIZE, 0);
+        for (size_t i = 0; i < ROM_SIZE; i++) {
+            rom[i] = (i < alpha.size() ? (uint32_t)alpha[i] << 16 : 0) | (i < beta.size() ? beta[i] : 0);
+        }
+        // ROM images are padded with zeros, only the slots before the padding need decoding
+        size_t used = ROM_SIZE;
+        while (used > 0 && rom[used - 1] == 0) used--;
+        predecodeRom(used);
+        if (jit) jit->reset();
+        return true;
+    }
+
+    // Screen cells up to the last one written, printable ASCII as itself and anything else as '.'
+    static std::string screenText(const Machine& machine) {
+        size_t used = SCREEN_SIZE;
+        while (used > 0 && machine.screen[used - 1] == 0) used--;
+        std::string text;
+        for (size_t i = 0; i < used; i++) {
+            uint16_t cell = machine.screen[i];
+            text += cell == 0 ? ' ' : (cell >= 0x20 && cell < 0x7F ? (char)cell : '.');
+        }
+        return text;
+    }
+
+    const std::vector<uint32_t>& getRom() const { return rom; }
+    const Stats& getStats() const { return stats; }
+
+    // Count control transfers between addresses from the next run on
+    void setProfiling(bool enabled) { edges.assign(enabled ? ROM_SIZE * ROM_SIZE : 0, 0); }
+
+    // Edges counted so far, addresses as in the ROM
+    ExecutionProfile getProfile() const {
+        ExecutionProfile profile;
+        for (size_t edge = 0; edge < edges.size(); edge++) {
+            if (edges[edge]) profile.add((uint16_t)(edge / ROM_SIZE), (uint16_t)(edge % ROM_SIZE), edges[edge]);
+        }
+        return profile;
+    }
+
+    // Decode every step instead of running the predecoded program (slower; for comparison)
+    void setPredecoded(bool enabled) { usePredecoded = enabled; }
+
+    // Translate to x86-64 where possible (not while profiling); false if this host cannot run translated code
+    bool setJit(bool enabled) {
+        if (!enabled) {
+            jit.reset();
+            return true;
+        }
+        if (!jit) {
+            EmulatorJit::Layout layout = {offsetof(Machine, cpu) + offsetof(Semantics::State, regs),
+                                          offsetof(Machine, memory), offsetof(Machine, screen)};
+            jit = std::make_unique<EmulatorJit>(layout);
+        }
+        if (!jit->available()) jit.reset();
+        return jit != nullptr;
+    }
+
+    // Run machine from its program counter for at most maxSteps instructions. The program counter is left
+    // on the instruction that stopped it (EXIT, an invalid one) or the next one to run.
+    Status run(Machine& machine, uint64_t maxSteps) {
+        stats = Stats();
+        if (!usePredecoded) return runDecoding(machine, maxSteps);
+        if (jit && edges.empty()) return runJit(machine, maxSteps);
+        return edges.empty() ? runPredecoded<false>(machine, maxSteps) : runPredecoded<true>(machine, maxSteps);
+    }
+};
@@ -0,0 +1,468 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+#include "Semantics.hpp"
+
+#ifndef GCT_JIT_AVAILABLE
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define GCT_JIT_AVAILABLE 1
+#else
+#define GCT_JIT_AVAILABLE 0
+#endif
+#endif
+#if GCT_JIT_AVAILABLE
+#include <sys/mman.h>
+#endif
+
+// x86-64 translator for the emulator ("gct run --jit"). A block is the
+// instructions from a start address up to and including the first branch,
+// translated on first use into an mmap'd executable buffer.
+//
+//   - Guest registers X0-X7 live in r8-r15 (zero-extended to 32 bits) for as
+//     long as translated code runs; flags are kept as an NZCV index in ebx
+//     (N=8, Z=4, C=2, V=1, as the emulator's condition table).
+//   - Flags are lazy. ADD, SUB, CMP and the logic operations are emitted as
+//     16-bit x86 instructions whose EFLAGS already hold N, Z, C (inverted for
+//     subtraction) and V; other operations get a TEST only when their flags
+//     are live. Only the last flag-setting instruction of a block has live
+//     flags, and its EFLAGS are folded into ebx once, where the block ends.
+//   - A block charges its instruction count against the step budget (rbp)
+//     on entry and adds its cycles to a counter, then ends by jumping to the
+//     next block through a table indexed by address. Entries that have no
+//     block return to the caller, which translates one or runs the
+//     instruction on the interpreter.
+//
+// BCDL/BCDH, EXIT and invalid opcodes are not translated, so the
+// interpreter runs them; a block never starts with a budget smaller than
+// its length. Where there is no x86-64 or no mmap, available() is false.
+class EmulatorJit {
+public:
+    static constexpr size_t ROM_SIZE = 256;
+    static constexpr size_t MAX_BLOCK = 64;          // Instructions per block
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    enum Kind : uint8_t { KIND_REGISTER, KIND_BRANCH, KIND_READ, KIND_WRITE, KIND_PRINT_REG, KIND_PRINT_CONST, KIND_UNSUPPORTED };
+
+    struct Instruction {
+        Kind kind = KIND_UNSUPPORTED;
+        Semantics::Op op = Semantics::Op::OTHER;
+        bool immediate = false;
+        uint8_t dst = 0, a = 0, b = 0;
+        uint16_t imm = 0;
+        uint16_t conditions = 0;  // Branches: bit n set if taken with flags n
+        uint8_t cycles = 1;
+    };
+
+    // Byte offsets of the machine state from the pointer given to enter()
+    struct Layout {
+        size_t regs, memory, screen;
+    };
+
+private:
+    enum Host { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI };
+    static constexpr int guest(int reg) { return 8 + reg; }
+
+    // Where the flags of the last flag-setting instruction are
+    enum FlagState { FLAGS_IN_EBX, FLAGS_IN_EFLAGS, FLAGS_IN_EFLAGS_BORROW };
+
+    static constexpr size_t TABLE_OFFSET = 0;
+    static constexpr size_t CYCLES_OFFSET = ROM_SIZE * 8;
+    static constexpr size_t TAKEN_OFFSET = CYCLES_OFFSET + 8;
+    static constexpr size_t CODE_OFFSET = 4096;  // Own page: stores near running code count as self-modifying
+
+    Layout layout;
+    uint8_t* buffer = nullptr;
+    size_t used = 0, codeStart = 0;
+    size_t exitStub = 0, chainStub = 0, entryStub = 0;
+    uint8_t lengths[ROM_SIZE] = {};
+    bool tried[ROM_SIZE] = {};
+    std::vector<uint8_t> code;  // Block being emitted, to be placed at buffer + used
+
+    void byte(uint8_t value) { code.push_back(value); }
+    void bytes(std::initializer_list<uint8_t> values) { code.insert(code.end(), values); }
+    void word(uint16_t value) {
+        byte(value & 0xFF);
+        byte(value >> 8);
+    }
+    void dword(uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) byte((value >> shift) & 0xFF);
+    }
+    void patch(size_t at, uint32_t value) {
+        for (int i = 0; i < 4; i++) code[at + i] = (value >> (8 * i)) & 0xFF;
+    }
+    uint64_t address(size_t at) const { return (uint64_t)(uintptr_t)(buffer + used + at); }
+
+    // Register to register: [66] [REX] opcode, ModRM with reg and rm
+    void rr(bool operand16, std::initializer_list<uint8_t> opcode, int reg, int rm, bool wide = false) {
+        if (operand16) byte(0x66);
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0);
+        if (rex != 0x40) byte(rex);
+        bytes(opcode);
+        byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    // reg with [rdi + displacement], or [rdi + rax*2 + displacement]
+    void rm(bool operand16, std::initializer_list<uint8_t> opcode, int reg, bool indexed, uint32_t displacement) {
+        if (operand16) byte(0x66);
+        if (reg & 8) byte(0x44);
+        bytes(opcode);
+        if (indexed) {
+            byte(0x84 | (reg & 7) << 3);
+            byte(0x47);
+        } else {
+            byte(0x87 | (reg & 7) << 3);
+        }
+        dword(displacement);
+    }
+
+    // [rip + offset of data in the buffer], for an instruction with trailing bytes after the displacement
+    void ripRelative(size_t data, size_t trailing) {
+        dword((uint32_t)((uint64_t)(uintptr_t)(buffer + data) - (address(code.size()) + 4 + trailing)));
+    }
+
+    void jump(size_t target) {  // jmp rel32 to an offset in the buffer
+        byte(0xE9);
+        dword((uint32_t)((uint64_t)(uintptr_t)(buffer + target) - (address(code.size()) + 4)));
+    }
+
+    // Continue at target: esi holds it for the exit, the table gives its block
+    void jumpTo(uint32_t target) {
+        byte(0xBE);
+        dword(target);
+        if (target >= ROM_SIZE) {
+            jump(exitStub);
+            return;
+        }
+        byte(0xFF);
+        byte(0x25);
+        ripRelative(TABLE_OFFSET + target * 8, 0);
+    }
+
+    // Fold EFLAGS into the NZCV index in ebx
+    void materializeFlags(FlagState& state) {
+        if (state == FLAGS_IN_EBX) return;
+        bytes({0x0F, 0x98, 0xC0, 0x0F, 0x94, 0xC1});   // sets al; setz cl
+        bytes({0x0F, (uint8_t)(state == FLAGS_IN_EFLAGS_BORROW ? 0x93 : 0x92), 0xC2});  // setnc/setc dl
+        bytes({0x0F, 0x90, 0xC3, 0x0F, 0xB6, 0xDB});   // seto bl; movzx ebx, bl
+        bytes({0x0F, 0xB6, 0xC0, 0x0F, 0xB6, 0xC9, 0x0F, 0xB6, 0xD2});  // movzx eax/ecx/edx
+        bytes({0xC1, 0xE0, 0x03, 0x8D, 0x04, 0x88, 0x8D, 0x04, 0x50, 0x09, 0xC3});
+        state = FLAGS_IN_EBX;  // eax = N*8 + Z*4 + C*2, ebx |= eax
+    }
+
+    // Store ax as the result of an operation; with its flags live they are set from it first (C and V clear)
+    void storeResult(int dst, bool flagsLive, FlagState& state) {
+        if (flagsLive) {
+            bytes({0x66, 0x85, 0xC0});  // test ax, ax
+            state = FLAGS_IN_EFLAGS;
+        }
+        rr(true, {0x89}, RAX, guest(dst));
+    }
+
+    void emitRegister(const Instruction& instruction, bool flagsLive, FlagState& state) {
+        using Semantics::Op;
+        int d = guest(instruction.dst), x = guest(instruction.a), y = guest(instruction.b);
+        uint16_t imm = instruction.imm;
+        switch (instruction.op) {
+            case Op::AND:
+            case Op::OR:
+            case Op::XOR:
+            case Op::ADD:
+            case Op::SUB: {
+                static const uint8_t opcodes[] = {0x21, 0x09, 0x31, 0, 0x01, 0x29};
+                static const uint8_t extensions[] = {4, 1, 6, 0, 0, 5};
+                int index = (int)instruction.op;
+                int target = instruction.dst == instruction.a ? d : RAX;
+                if (target == RAX) rr(false, {0x89}, x, RAX);
+                if (instruction.immediate) {
+                    rr(true, {0x81}, extensions[index], target);
+                    word(imm);
+                } else {
+                    rr(true, {opcodes[index]}, y, target);
+                }
+                if (target == RAX) rr(true, {0x89}, RAX, d);
+                state = instruction.op == Op::SUB ? FLAGS_IN_EFLAGS_BORROW : FLAGS_IN_EFLAGS;
+                break;
+            }
+            case Op::CMP:
+                if (instruction.immediate) {
+                    rr(true, {0x81}, 7, x);
+                    word(imm);
+                } else {
+                    rr(true, {0x39}, y, x);
+                }
+                state = FLAGS_IN_EFLAGS_BORROW;
+                break;
+            case Op::NOT:
+                rr(false, {0x89}, x, RAX);
+                bytes({0x66, 0xF7, 0xD0});  // not ax
+                storeResult(instruction.dst, flagsLive, state);
+                break;
+            case Op::LSL:
+            case Op::LSR: {
+                uint8_t modrm = instruction.op == Op::LSL ? 0xE0 : 0xE8;
+                if (instruction.immediate) {
+                    if (imm > 15) {
+                        bytes({0x31, 0xC0});  // xor eax, eax
+                    } else {
+                        rr(false, {0x89}, x, RAX);
+                        bytes({0xC1, modrm, (uint8_t)imm});
+                    }
+                } else {
+                    rr(false, {0x0F, 0xB7}, RCX, y);  // movzx ecx, Xb
+                    rr(false, {0x89}, x, RAX);
+                    bytes({0xD3, modrm});  // shl/shr eax, cl
+                    bytes({0x31, 0xD2, 0x83, 0xF9, 0x0F, 0x0F, 0x47, 0xC2});  // 0 past 15
+                }
+                storeResult(instruction.dst, flagsLive, state);
+                break;
+            }
+            case Op::UMUL_L:
+            case Op::UMUL_H:
+            case Op::MUL_L:
+            case Op::MUL_H: {
+                bool isSigned = instruction.op == Op::MUL_L || instruction.op == Op::MUL_H;
+                bool high = instruction.op == Op::UMUL_H || instruction.op == Op::MUL_H;
+                if (isSigned) {
+                    rr(false, {0x0F, 0xBF}, RAX, x);  // movsx eax, Xa
+                } else {
+                    rr(false, {0x89}, x, RAX);
+                }
+                if (instruction.immediate) {
+                    byte(0xB9);  // mov ecx, imm
+                    dword(isSigned ? (uint32_t)(int32_t)(int16_t)imm : imm);
+                } else if (isSigned) {
+                    rr(false, {0x0F, 0xBF}, RCX, y);
+                } else {
+                    rr(false, {0x89}, y, RCX);
+                }
+                bytes({0x0F, 0xAF, 0xC1});  // imul eax, ecx
+                if (high) {
+                    bytes({0xC1, (uint8_t)(isSigned ? 0xF8 : 0xE8), 16});
+                }
+                storeResult(instruction.dst, flagsLive, state);
+                break;
+            }
+            case Op::MOV:
+                if (instruction.immediate) {
+                    byte(0x41);
+                    byte(0xB8 + (d & 7));
+                    dword(imm);
+                } else {
+                    rr(true, {0x89}, x, d);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Address operand of a memory or print instruction: eax for a register, else the displacement itself
+    bool addressOperand(const Instruction& instruction, size_t base, uint32_t& displacement) {
+        if (instruction.immediate) {
+            displacement = (uint32_t)(base + (instruction.imm & 0xFF) * 2);
+            return false;
+        }
+        rr(false, {0x0F, 0xB6}, RAX, guest(instruction.b));  // movzx eax, Xb low byte
+        displacement = (uint32_t)base;
+        return true;
+    }
+
+    void emitInstruction(const Instruction& instruction, bool flagsLive, FlagState& state) {
+        uint32_t displacement = 0;
+        bool indexed = false;
+        switch (instruction.kind) {
+            case KIND_REGISTER: emitRegister(instruction, flagsLive, state); break;
+            case KIND_READ:
+                indexed = addressOperand(instruction, layout.memory, displacement);
+                rm(false, {0x0F, 0xB7}, guest(instruction.dst), indexed, displacement);
+                break;
+            case KIND_WRITE:
+            case KIND_PRINT_REG:
+                indexed = addressOperand(instruction, instruction.kind == KIND_WRITE ? layout.memory : layout.screen, displacement);
+                rm(true, {0x89}, guest(instruction.a), indexed, displacement);
+                break;
+            case KIND_PRINT_CONST:
+                indexed = addressOperand(instruction, layout.screen, displacement);
+                rm(true, {0xC7}, 0, indexed, displacement);
+                word(instruction.imm >> 8);
+                break;
+            default:
+                break;
+        }
+    }
+
+    static bool setsFlags(const Instruction& instruction) {
+        return instruction.kind == KIND_REGISTER && instruction.op != Semantics::Op::MOV;
+    }
+
+    // Copy code to the buffer, false if it is full
+    bool place(size_t& at) {
+        if (used + code.size() > BUFFER_SIZE) return false;
+        std::memcpy(buffer + used, code.data(), code.size());
+        at = used;
+        used += code.size();
+        code.clear();
+        return true;
+    }
+
+    void buildStubs() {
+        used = CODE_OFFSET;
+        size_t regs = layout.regs;
+
+        // Exit: esi = address to continue at; store the guest state and return esi
+        for (int reg = 0; reg < 8; reg++) rm(true, {0x89}, guest(reg), false, (uint32_t)(regs + reg * 2));
+        bytes({0x5A, 0x89, 0x1A, 0x59, 0x48, 0x89, 0x29, 0x89, 0xF0});
+        bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3});
+        place(exitStub);
+
+        // Chain: continue at esi through the table, or leave past the ROM
+        bytes({0x81, 0xFE});
+        dword(ROM_SIZE);
+        bytes({0x0F, 0x83});
+        dword((uint32_t)((uint64_t)(uintptr_t)(buffer + exitStub) - (address(code.size()) + 4)));
+        bytes({0x48, 0x8D, 0x05});  // lea rax, [rip + table]
+        ripRelative(TABLE_OFFSET, 0);
+        bytes({0xFF, 0x24, 0xF0});  // jmp [rax + rsi*8]
+        place(chainStub);
+
+        // Entry (machine, &budget, &flags, pc): save callee-saved registers and the two pointers, load the state
+        bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x56, 0x52});
+        bytes({0x48, 0x8B, 0x2E, 0x8B, 0x1A});  // mov rbp, [rsi]; mov ebx, [rdx]
+        for (int reg = 0; reg < 8; reg++) rm(false, {0x0F, 0xB7}, guest(reg), false, (uint32_t)(regs + reg * 2));
+        bytes({0x89, 0xCE});  // mov esi, ecx
+        jump(chainStub);
+        place(entryStub);
+        codeStart = used;
+    }
+
+public:
+    explicit EmulatorJit(const Layout& machineLayout) : layout(machineLayout) {
+#if GCT_JIT_AVAILABLE
+        void* memory = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return;
+        buffer = (uint8_t*)memory;
+        buildStubs();
+        reset();
+#endif
+    }
+
+    ~EmulatorJit() {
+#if GCT_JIT_AVAILABLE
+        if (buffer) munmap(buffer, BUFFER_SIZE);
+#endif
+    }
+
+    EmulatorJit(const EmulatorJit&) = delete;
+    EmulatorJit& operator=(const EmulatorJit&) = delete;
+
+    bool available() const { return buffer != nullptr; }
+
+    // Forget every block, for a new program
+    void reset() {
+        if (!buffer) return;
+        used = codeStart;
+        uint64_t exit = (uint64_t)(uintptr_t)(buffer + exitStub);
+        for (size_t slot = 0; slot < ROM_SIZE; slot++) std::memcpy(buffer + TABLE_OFFSET + slot * 8, &exit, 8);
+        std::memset(lengths, 0, sizeof(lengths));
+        std::memset(tried, 0, sizeof(tried));
+    }
+
+    bool hasTried(uint16_t pc) const { return tried[pc]; }
+    size_t blockLength(uint16_t pc) const { return lengths[pc]; }
+
+    uint64_t& cycles() { return *(uint64_t*)(buffer + CYCLES_OFFSET); }
+    uint64_t& taken() { return *(uint64_t*)(buffer + TAKEN_OFFSET); }
+
+    // Translate the block at pc from the rest of the ROM (instructions[0] is the one at pc); false if its
+    // first instruction is not translated or the buffer is full, it is not tried again
+    bool compile(uint16_t pc, const Instruction* instructions, size_t count) {
+        tried[pc] = true;
+        if (!buffer) return false;
+        size_t length = 0;
+        uint32_t cycles = 0;
+        while (length < std::min(count, MAX_BLOCK) && instructions[length].kind != KIND_UNSUPPORTED) {
+            cycles += instructions[length].cycles;
+            if (instructions[length++].kind == KIND_BRANCH) break;
+        }
+        if (length == 0) return false;
+        size_t lastFlags = length;
+        for (size_t i = 0; i < length; i++) {
+            if (setsFlags(instructions[i])) lastFlags = i;
+        }
+
+        code.clear();
+        bytes({0x48, 0x81, 0xED});  // sub rbp, length
+        dword((uint32_t)length);
+        bytes({0x0F, 0x82});  // jb undo
+        size_t undoJump = code.size();
+        dword(0);
+        bytes({0x48, 0x81, 0x05});  // add qword [cycles], block cycles
+        ripRelative(CYCLES_OFFSET, 4);
+        dword(cycles);
+
+        FlagState state = FLAGS_IN_EBX;
+        for (size_t i = 0; i < length; i++) {
+            const Instruction& instruction = instructions[i];
+            if (instruction.kind != KIND_BRANCH) {
+                emitInstruction(instruction, i == lastFlags, state);
+                continue;
+            }
+            materializeFlags(state);
+            size_t notTakenJump = 0;
+            bool conditional = instruction.conditions != 0xFFFF && instruction.conditions != 0;
+            if (conditional) {
+                byte(0xB8);  // mov eax, conditions; bt eax, ebx; jnc not taken
+                dword(instruction.conditions);
+                bytes({0x0F, 0xA3, 0xD8, 0x0F, 0x83});
+                notTakenJump = code.size();
+                dword(0);
+            }
+            if (instruction.conditions != 0) {
+                bytes({0x48, 0xFF, 0x05});  // inc qword [taken]
+                ripRelative(TAKEN_OFFSET, 0);
+                if (instruction.immediate) {
+                    jumpTo(instruction.imm);
+                } else {
+                    rr(false, {0x0F, 0xB7}, RSI, guest(instruction.b));  // movzx esi, Xb
+                    jump(chainStub);
+                }
+            }
+            if (conditional) patch(notTakenJump, (uint32_t)(code.size() - notTakenJump - 4));
+            if (instruction.conditions != 0xFFFF) jumpTo(pc + length);
+        }
+        if (instructions[length - 1].kind != KIND_BRANCH) {
+            materializeFlags(state);
+            jumpTo(pc + length);
+        }
+
+        patch(undoJump, (uint32_t)(code.size() - undoJump - 4));
+        bytes({0x48, 0x81, 0xC5});  // undo: add rbp, length; leave at pc
+        dword((uint32_t)length);
+        jump(exitStub);
+
+        size_t at = 0;
+        if (!place(at)) return false;
+        uint64_t entry = (uint64_t)(uintptr_t)(buffer + at);
+        std::memcpy(buffer + TABLE_OFFSET + pc * 8, &entry, 8);
+        lengths[pc] = (uint8_t)length;
+        return true;
+    }
+
+    // Run translated code from pc until it reaches an address without a block, leaves the ROM or would pass
+    // the budget; returns that address. budget and the NZCV index flags are updated.
+    uint32_t enter(void* machine, uint64_t& budget, uint32_t& flags, uint32_t pc) {
+#if GCT_JIT_AVAILABLE
+        using Entry = uint32_t (*)(void*, uint64_t*, uint32_t*, uint32_t);
+        Entry entry = (Entry)(void*)(buffer + entryStub);
+        return entry(machine, &budget, &flags, pc);
+#else
+        (void)machine, (void)budget, (void)flags;
+        return pc;
+#endif
+    }
+};
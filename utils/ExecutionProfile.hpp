@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+// Execution profile: how often control went from one instruction address to
+// another, for profile-guided optimization ("gct asm --profile"). Addresses
+// are those of the ROM the profile was recorded on.
+//
+// A profile file is either
+//
+//   GCT-PROFILE 1
+//   <from> <to> <count>       one line per edge
+//
+// or a trace: the executed program counters in order, one or more per line,
+// decimal or 0x hex, which are counted into edges as they are read.
+struct ExecutionProfile {
+    std::map<std::pair<uint16_t, uint16_t>, uint64_t> edges;
+
+    static constexpr int FORMAT_VERSION = 1;
+
+    uint64_t count(uint16_t from, uint16_t to) const {
+        auto it = edges.find({from, to});
+        return it == edges.end() ? 0 : it->second;
+    }
+
+    void add(uint16_t from, uint16_t to, uint64_t times = 1) { edges[{from, to}] += times; }
+
+    bool writeToFile(const std::string& path, std::ostream& log = std::cerr) const {
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            log << "Error: Cannot write profile '" << path << "'\n";
+            return false;
+        }
+        out << "GCT-PROFILE " << FORMAT_VERSION << "\n";
+        for (const auto& [edge, times] : edges) out << edge.first << " " << edge.second << " " << times << "\n";
+        return (bool)out;
+    }
+
+    bool readFromFile(const std::string& path, std::ostream& log = std::cerr) {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            log << "Error: Cannot open profile '" << path << "'\n";
+            return false;
+        }
+        edges.clear();
+
+        std::string word;
+        bool ok = (bool)(in >> word);
+        if (ok && word == "GCT-PROFILE") {
+            int version = 0;
+            ok = (in >> version) && version == FORMAT_VERSION;
+            unsigned long from, to;
+            uint64_t times;
+            while (ok && in >> from) {
+                ok = (in >> to >> times) && from <= 0xFFFF && to <= 0xFFFF;
+                if (ok) add((uint16_t)from, (uint16_t)to, times);
+            }
+            ok = ok && in.eof();
+        } else {
+            // Trace: consecutive program counters are edges
+            long previous = -1;
+            while (ok) {
+                char* end = nullptr;
+                bool hex = word.size() > 2 && word[0] == '0' && (word[1] == 'x' || word[1] == 'X');
+                unsigned long pc = std::strtoul(word.c_str(), &end, hex ? 16 : 10);
+                ok = word[0] != '-' && end == word.c_str() + word.size() && pc <= 0xFFFF;
+                if (!ok) break;
+                if (previous >= 0) add((uint16_t)previous, (uint16_t)pc);
+                previous = (long)pc;
+                if (!(in >> word)) break;
+            }
+        }
+
+        if (!ok) log << "Error: Malformed profile '" << path << "'\n";
+        return ok;
+    }
+};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <cstdint>
+#include <cstring>
 
 namespace IsaSpec {
 
@@ -47,11 +49,12 @@ struct InstructionTech {
     Format format;
     InstructionType type;
     InstructionFlags flags;
+    uint8_t cycles;               // Estimated execution cost in clock cycles, for cost models
 
     InstructionTech(const std::string& tech_name, const std::string& mnem, uint8_t op,
-                    Format fmt, InstructionType typ, InstructionFlags flg)
+                    Format fmt, InstructionType typ, InstructionFlags flg, uint8_t cyc = 1)
         : technical_name(tech_name), mnemonic(mnem), opcode(op), format(fmt),
-          type(typ), flags(flg) {}
+          type(typ), flags(flg), cycles(cyc) {}
 };
 
 // Documentation info (for humans/documentation generation)
@@ -78,6 +81,22 @@ struct BranchCondition {
         : mnemonic(mnem), code(c), name(n), description(desc) {}
 };
 
+// Mnemonic lookup entry - one per distinct mnemonic in instructions_tech
+struct MnemonicInfo {
+    char mnemonic[8] = {};        // NUL-terminated mnemonic text
+    bool is_alu = false;          // Some TYPE_ALU instruction uses this mnemonic
+    uint8_t opcode[2] = {0xFF, 0xFF};  // First opcode by [immediate], 0xFF if none
+    uint8_t opcode_by_type[9][2];      // Opcode by [type][immediate], 0xFF if none
+
+    MnemonicInfo() { std::memset(opcode_by_type, 0xFF, sizeof(opcode_by_type)); }
+};
+
+// Branch condition lookup slot (dense 256-entry table, open addressing)
+struct BranchConditionSlot {
+    char mnemonic[4] = {};        // Empty mnemonic marks a free slot
+    int8_t code = -1;
+};
+
 // Main ISA specification structure
 struct ISA_SPEC {
     std::string version;
@@ -100,8 +119,106 @@ struct ISA_SPEC {
     std::vector<InstructionDoc> instructions_doc;
 
     std::vector<BranchCondition> branch_conditions;
+
+    // Lookup indexes - built once by generateISASpec(), hold no pointers so copies stay valid
+    std::vector<MnemonicInfo> mnemonic_entries;
+    std::vector<int16_t> mnemonic_slots;          // Power-of-two hash table into mnemonic_entries, -1 = empty
+    BranchConditionSlot branch_condition_lut[256];
 };
 
+// FNV-1a hash used by the lookup indexes
+inline uint32_t hashMnemonic(std::string_view text) {
+    uint32_t hash = 2166136261u;
+    for (char c : text) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Lookup: mnemonic -> MnemonicInfo (nullptr if unknown)
+inline const MnemonicInfo* findMnemonic(const ISA_SPEC& spec, std::string_view mnemonic) {
+    if (spec.mnemonic_slots.empty() || mnemonic.size() >= sizeof(MnemonicInfo::mnemonic)) return nullptr;
+    size_t mask = spec.mnemonic_slots.size() - 1;
+    for (size_t slot = hashMnemonic(mnemonic) & mask; ; slot = (slot + 1) & mask) {
+        int16_t index = spec.mnemonic_slots[slot];
+        if (index < 0) return nullptr;
+        const MnemonicInfo& info = spec.mnemonic_entries[index];
+        if (mnemonic == info.mnemonic) return &info;
+    }
+}
+
+// Lookup: opcode by (mnemonic, type, immediate), 0xFF if none
+inline uint8_t findOpcode(const ISA_SPEC& spec, std::string_view mnemonic, InstructionType type, bool immediate) {
+    const MnemonicInfo* info = findMnemonic(spec, mnemonic);
+    return info ? info->opcode_by_type[(int)type][immediate] : 0xFF;
+}
+
+// Lookup: branch mnemonic -> condition code, -1 if not a branch
+inline int findBranchCondition(const ISA_SPEC& spec, std::string_view mnemonic) {
+    if (mnemonic.size() >= sizeof(BranchConditionSlot::mnemonic)) return -1;
+    for (uint32_t slot = hashMnemonic(mnemonic) & 0xFF; ; slot = (slot + 1) & 0xFF) {
+        const BranchConditionSlot& entry = spec.branch_condition_lut[slot];
+        if (entry.code < 0) return -1;
+        if (mnemonic == entry.mnemonic) return entry.code;
+    }
+}
+
+// Lookup: condition code that holds exactly when the given one does not, -1 if none (B)
+inline int invertBranchCondition(const ISA_SPEC& spec, int code) {
+    static const char* const opposites[][2] = {
+        {"BEQ", "BNE"}, {"BLT", "BGE"}, {"BLE", "BGT"}, {"BCS", "BCC"},
+        {"BMI", "BPL"}, {"BVS", "BVC"}, {"BHI", "BLS"}
+    };
+    for (const auto& bc : spec.branch_conditions) {
+        if (bc.code != code) continue;
+        for (const auto& pair : opposites) {
+            if (bc.mnemonic == pair[0]) return findBranchCondition(spec, pair[1]);
+            if (bc.mnemonic == pair[1]) return findBranchCondition(spec, pair[0]);
+        }
+    }
+    return -1;
+}
+
+// Build the mnemonic and branch condition indexes from the spec tables
+inline void buildLookupIndex(ISA_SPEC& spec) {
+    spec.mnemonic_entries.clear();
+    for (const auto& instr : spec.instructions_tech) {
+        MnemonicInfo* info = nullptr;
+        for (auto& entry : spec.mnemonic_entries) {
+            if (instr.mnemonic == entry.mnemonic) { info = &entry; break; }
+        }
+        if (!info) {
+            spec.mnemonic_entries.emplace_back();
+            info = &spec.mnemonic_entries.back();
+            std::strncpy(info->mnemonic, instr.mnemonic.c_str(), sizeof(info->mnemonic) - 1);
+        }
+
+        bool imm = instr.flags.IMMEDIATE;
+        if (instr.type == InstructionType::TYPE_ALU) info->is_alu = true;
+        if (info->opcode[imm] == 0xFF) info->opcode[imm] = instr.opcode;
+        if (info->opcode_by_type[(int)instr.type][imm] == 0xFF) info->opcode_by_type[(int)instr.type][imm] = instr.opcode;
+    }
+
+    // Hash table at most half full keeps probe chains short
+    size_t slotCount = 16;
+    while (slotCount < spec.mnemonic_entries.size() * 2) slotCount *= 2;
+    spec.mnemonic_slots.assign(slotCount, -1);
+    for (size_t i = 0; i < spec.mnemonic_entries.size(); i++) {
+        size_t slot = hashMnemonic(spec.mnemonic_entries[i].mnemonic) & (slotCount - 1);
+        while (spec.mnemonic_slots[slot] >= 0) slot = (slot + 1) & (slotCount - 1);
+        spec.mnemonic_slots[slot] = (int16_t)i;
+    }
+
+    for (auto& entry : spec.branch_condition_lut) entry = BranchConditionSlot();
+    for (const auto& bc : spec.branch_conditions) {
+        uint32_t slot = hashMnemonic(bc.mnemonic) & 0xFF;
+        while (spec.branch_condition_lut[slot].code >= 0) slot = (slot + 1) & 0xFF;
+        std::strncpy(spec.branch_condition_lut[slot].mnemonic, bc.mnemonic.c_str(), sizeof(BranchConditionSlot::mnemonic) - 1);
+        spec.branch_condition_lut[slot].code = (int8_t)bc.code;
+    }
+}
+
 // Algorithmic ISA spec generator
 inline ISA_SPEC generateISASpec() {
     ISA_SPEC spec;
@@ -139,37 +256,38 @@ inline ISA_SPEC generateISASpec() {
         const char* usage_imm;
         const char* explain_reg;
         const char* explain_imm;
+        uint8_t cycles;           // Multiplies and BCD conversion are iterative
     };
 
     ALUDef aluOps[] = {
-        {"AND", "AND", "R[DST] = R[A] & R[B]", "R[DST] = R[A] & IMM", "AND X0, X1, X2", "AND X0, X1, 0xFF", "Bitwise AND of X1 and X2, store in X0", "Bitwise AND of X1 and 0xFF, store in X0"},
-        {"OR", "OR", "R[DST] = R[A] | R[B]", "R[DST] = R[A] | IMM", "OR X0, X1, X2", "OR X0, X1, 0x10", "Bitwise OR of X1 and X2, store in X0", "Bitwise OR of X1 and 0x10, store in X0"},
-        {"XOR", "XOR", "R[DST] = R[A] ^ R[B]", "R[DST] = R[A] ^ IMM", "XOR X0, X1, X2", "XOR X0, X1, 0xFFFF", "Bitwise XOR of X1 and X2, store in X0", "Bitwise XOR of X1 and 0xFFFF, store in X0"},
-        {"NOT", "NOT", "R[DST] = ~R[A]", "R[DST] = ~R[A]", "NOT X0", "NOT X0", "Bitwise NOT of X0, store in X0", "Bitwise NOT of X0, store in X0"},
-        {"ADD", "ADD", "R[DST] = R[A] + R[B]", "R[DST] = R[A] + IMM", "ADD X0, X1, X2", "ADD X0, X1, 5", "Add X1 and X2, store sum in X0", "Add X1 and 5, store sum in X0"},
-        {"SUB", "SUB", "R[DST] = R[A] - R[B]", "R[DST] = R[A] - IMM", "SUB X0, X1, X2", "SUB X0, X1, 10", "Subtract X2 from X1, store in X0", "Subtract 10 from X1, store in X0"},
-        {"LSL", "LSL", "R[DST] = R[A] << R[B]", "R[DST] = R[A] << IMM", "LSL X0, X1, X2", "LSL X0, X1, 3", "Shift X1 left by X2 bits, store in X0", "Shift X1 left by 3 bits, store in X0"},
-        {"LSR", "LSR", "R[DST] = R[A] >> R[B]", "R[DST] = R[A] >> IMM", "LSR X0, X1, X2", "LSR X0, X1, 2", "Shift X1 right by X2 bits, store in X0", "Shift X1 right by 2 bits, store in X0"},
-        {"BCDL", "BCDL", "R[DST] = BCD_LOW(R[A])", "R[DST] = BCD_LOW(R[A])", "BCDL X0, X1", "BCDL X0, X1", "Convert X1 to BCD, extract lower 4 digits to X0", "Convert X1 to BCD, extract lower 4 digits to X0"},
-        {"BCDH", "BCDH", "R[DST] = BCD_HIGH(R[A])", "R[DST] = BCD_HIGH(R[A])", "BCDH X0, X1", "BCDH X0, X1", "Convert X1 to BCD, extract upper 4 digits to X0", "Convert X1 to BCD, extract upper 4 digits to X0"},
-        {"UMUL_L", "UMUL_L", "R[DST] = LOW(R[A] * R[B]) (unsigned)", "R[DST] = LOW(R[A] * IMM) (unsigned)", "UMUL_L X0, X1, X2", "UMUL_L X0, X1, 3", "Unsigned multiply X1 by X2, store lower 16 bits in X0", "Unsigned multiply X1 by 3, store lower 16 bits in X0"},
-        {"UMUL_H", "UMUL_H", "R[DST] = HIGH(R[A] * R[B]) (unsigned)", "R[DST] = HIGH(R[A] * IMM) (unsigned)", "UMUL_H X0, X1, X2", "UMUL_H X0, X1, 3", "Unsigned multiply X1 by X2, store upper 16 bits in X0", "Unsigned multiply X1 by 3, store upper 16 bits in X0"},
-        {"MUL_L", "MUL_L", "R[DST] = LOW(R[A] * R[B]) (signed)", "R[DST] = LOW(R[A] * IMM) (signed)", "MUL_L X0, X1, X2", "MUL_L X0, X1, -2", "Signed multiply X1 by X2, store lower 16 bits in X0", "Signed multiply X1 by -2, store lower 16 bits in X0"},
-        {"MUL_H", "MUL_H", "R[DST] = HIGH(R[A] * R[B]) (signed)", "R[DST] = HIGH(R[A] * IMM) (signed)", "MUL_H X0, X1, X2", "MUL_H X0, X1, -2", "Signed multiply X1 by X2, store upper 16 bits in X0", "Signed multiply X1 by -2, store upper 16 bits in X0"},
-        {"NUL0E", "NUL0E", "Reserved ALU 0x0E", "Reserved ALU 0x1E", "NUL0E", "NUL0E", "Reserved for future ALU operation", "Reserved for future ALU operation"},
-        {"NUL0F", "NUL0F", "Reserved ALU 0x0F", "Reserved ALU 0x1F", "NUL0F", "NUL0F", "Reserved for future ALU operation", "Reserved for future ALU operation"}
+        {"AND", "AND", "R[DST] = R[A] & R[B]", "R[DST] = R[A] & IMM", "AND X0, X1, X2", "AND X0, X1, 0xFF", "Bitwise AND of X1 and X2, store in X0", "Bitwise AND of X1 and 0xFF, store in X0", 1},
+        {"OR", "OR", "R[DST] = R[A] | R[B]", "R[DST] = R[A] | IMM", "OR X0, X1, X2", "OR X0, X1, 0x10", "Bitwise OR of X1 and X2, store in X0", "Bitwise OR of X1 and 0x10, store in X0", 1},
+        {"XOR", "XOR", "R[DST] = R[A] ^ R[B]", "R[DST] = R[A] ^ IMM", "XOR X0, X1, X2", "XOR X0, X1, 0xFFFF", "Bitwise XOR of X1 and X2, store in X0", "Bitwise XOR of X1 and 0xFFFF, store in X0", 1},
+        {"NOT", "NOT", "R[DST] = ~R[A]", "R[DST] = ~R[A]", "NOT X0", "NOT X0", "Bitwise NOT of X0, store in X0", "Bitwise NOT of X0, store in X0", 1},
+        {"ADD", "ADD", "R[DST] = R[A] + R[B]", "R[DST] = R[A] + IMM", "ADD X0, X1, X2", "ADD X0, X1, 5", "Add X1 and X2, store sum in X0", "Add X1 and 5, store sum in X0", 1},
+        {"SUB", "SUB", "R[DST] = R[A] - R[B]", "R[DST] = R[A] - IMM", "SUB X0, X1, X2", "SUB X0, X1, 10", "Subtract X2 from X1, store in X0", "Subtract 10 from X1, store in X0", 1},
+        {"LSL", "LSL", "R[DST] = R[A] << R[B]", "R[DST] = R[A] << IMM", "LSL X0, X1, X2", "LSL X0, X1, 3", "Shift X1 left by X2 bits, store in X0", "Shift X1 left by 3 bits, store in X0", 1},
+        {"LSR", "LSR", "R[DST] = R[A] >> R[B]", "R[DST] = R[A] >> IMM", "LSR X0, X1, X2", "LSR X0, X1, 2", "Shift X1 right by X2 bits, store in X0", "Shift X1 right by 2 bits, store in X0", 1},
+        {"BCDL", "BCDL", "R[DST] = BCD_LOW(R[A])", "R[DST] = BCD_LOW(R[A])", "BCDL X0, X1", "BCDL X0, X1", "Convert X1 to BCD, extract lower 4 digits to X0", "Convert X1 to BCD, extract lower 4 digits to X0", 6},
+        {"BCDH", "BCDH", "R[DST] = BCD_HIGH(R[A])", "R[DST] = BCD_HIGH(R[A])", "BCDH X0, X1", "BCDH X0, X1", "Convert X1 to BCD, extract upper 4 digits to X0", "Convert X1 to BCD, extract upper 4 digits to X0", 6},
+        {"UMUL_L", "UMUL_L", "R[DST] = LOW(R[A] * R[B]) (unsigned)", "R[DST] = LOW(R[A] * IMM) (unsigned)", "UMUL_L X0, X1, X2", "UMUL_L X0, X1, 3", "Unsigned multiply X1 by X2, store lower 16 bits in X0", "Unsigned multiply X1 by 3, store lower 16 bits in X0", 4},
+        {"UMUL_H", "UMUL_H", "R[DST] = HIGH(R[A] * R[B]) (unsigned)", "R[DST] = HIGH(R[A] * IMM) (unsigned)", "UMUL_H X0, X1, X2", "UMUL_H X0, X1, 3", "Unsigned multiply X1 by X2, store upper 16 bits in X0", "Unsigned multiply X1 by 3, store upper 16 bits in X0", 4},
+        {"MUL_L", "MUL_L", "R[DST] = LOW(R[A] * R[B]) (signed)", "R[DST] = LOW(R[A] * IMM) (signed)", "MUL_L X0, X1, X2", "MUL_L X0, X1, -2", "Signed multiply X1 by X2, store lower 16 bits in X0", "Signed multiply X1 by -2, store lower 16 bits in X0", 4},
+        {"MUL_H", "MUL_H", "R[DST] = HIGH(R[A] * R[B]) (signed)", "R[DST] = HIGH(R[A] * IMM) (signed)", "MUL_H X0, X1, X2", "MUL_H X0, X1, -2", "Signed multiply X1 by X2, store upper 16 bits in X0", "Signed multiply X1 by -2, store upper 16 bits in X0", 4},
+        {"NUL0E", "NUL0E", "Reserved ALU 0x0E", "Reserved ALU 0x1E", "NUL0E", "NUL0E", "Reserved for future ALU operation", "Reserved for future ALU operation", 1},
+        {"NUL0F", "NUL0F", "Reserved ALU 0x0F", "Reserved ALU 0x1F", "NUL0F", "NUL0F", "Reserved for future ALU operation", "Reserved for future ALU operation", 1}
     };
 
     // Generate ALU instructions algorithmically
     for (int i = 0; i < 16; i++) {
         // Register format (0x00 + i)
         std::string techNameReg = std::string("ALU_") + aluOps[i].tech_suffix;
-        spec.instructions_tech.emplace_back(techNameReg, aluOps[i].mnemonic, 0x00 + i, Format::R, InstructionType::TYPE_ALU, aluRegFlags);
+        spec.instructions_tech.emplace_back(techNameReg, aluOps[i].mnemonic, 0x00 + i, Format::R, InstructionType::TYPE_ALU, aluRegFlags, aluOps[i].cycles);
         spec.instructions_doc.emplace_back(techNameReg, aluOps[i].desc_reg, aluOps[i].usage_reg, aluOps[i].explain_reg);
 
         // Immediate format (0x10 + i)
         std::string techNameImm = std::string("ALU_") + aluOps[i].tech_suffix + "_I";
-        spec.instructions_tech.emplace_back(techNameImm, aluOps[i].mnemonic, 0x10 + i, Format::I, InstructionType::TYPE_ALU, aluImmFlags);
+        spec.instructions_tech.emplace_back(techNameImm, aluOps[i].mnemonic, 0x10 + i, Format::I, InstructionType::TYPE_ALU, aluImmFlags, aluOps[i].cycles);
         spec.instructions_doc.emplace_back(techNameImm, aluOps[i].desc_imm, aluOps[i].usage_imm, aluOps[i].explain_imm);
     }
 
@@ -310,8 +428,8 @@ inline ISA_SPEC generateISASpec() {
         .IMMEDIATE = true
     };
     // Technical table
-    spec.instructions_tech.emplace_back("READ", "READ", 0x46, Format::R, InstructionType::TYPE_MEMORY, readRegFlags);
-    spec.instructions_tech.emplace_back("READ_I", "READ", 0x47, Format::I, InstructionType::TYPE_MEMORY, readImmFlags);
+    spec.instructions_tech.emplace_back("READ", "READ", 0x46, Format::R, InstructionType::TYPE_MEMORY, readRegFlags, 2);
+    spec.instructions_tech.emplace_back("READ_I", "READ", 0x47, Format::I, InstructionType::TYPE_MEMORY, readImmFlags, 2);
 
     // Documentation table
     spec.instructions_doc.emplace_back("READ", "R[DST] = MEM[R[B]]", "READ X0, X1", "Load value from memory address in X1 into X0");
@@ -336,8 +454,8 @@ inline ISA_SPEC generateISASpec() {
         .IMMEDIATE = true
     };
     // Technical table
-    spec.instructions_tech.emplace_back("WRITE", "WRITE", 0x48, Format::R, InstructionType::TYPE_MEMORY, writeRegFlags);
-    spec.instructions_tech.emplace_back("WRITE_I", "WRITE", 0x49, Format::I, InstructionType::TYPE_MEMORY, writeImmFlags);
+    spec.instructions_tech.emplace_back("WRITE", "WRITE", 0x48, Format::R, InstructionType::TYPE_MEMORY, writeRegFlags, 2);
+    spec.instructions_tech.emplace_back("WRITE_I", "WRITE", 0x49, Format::I, InstructionType::TYPE_MEMORY, writeImmFlags, 2);
 
     // Documentation table
     spec.instructions_doc.emplace_back("WRITE", "MEM[R[B]] = R[A]", "WRITE X0, X1", "Store value from X0 to memory address in X1");
@@ -422,10 +540,10 @@ inline ISA_SPEC generateISASpec() {
     spec.branch_conditions.emplace_back("B", 0, "Unconditional", "Always branch");
     spec.branch_conditions.emplace_back("BEQ", 1, "Equal", "Branch if equal (Z set)");
     spec.branch_conditions.emplace_back("BNE", 2, "Not Equal", "Branch if not equal (Z clear)");
-    spec.branch_conditions.emplace_back("BLT", 3, "Less Than", "Branch if less than (N set)");
-    spec.branch_conditions.emplace_back("BLE", 4, "Less or Equal", "Branch if less than or equal (N set or Z set)");
-    spec.branch_conditions.emplace_back("BGT", 5, "Greater Than", "Branch if greater than (N clear and Z clear)");
-    spec.branch_conditions.emplace_back("BGE", 6, "Greater or Equal", "Branch if greater than or equal (N clear)");
+    spec.branch_conditions.emplace_back("BLT", 3, "Less Than", "Branch if less than (N != V)");
+    spec.branch_conditions.emplace_back("BLE", 4, "Less or Equal", "Branch if less than or equal (Z set or N != V)");
+    spec.branch_conditions.emplace_back("BGT", 5, "Greater Than", "Branch if greater than (Z clear and N == V)");
+    spec.branch_conditions.emplace_back("BGE", 6, "Greater or Equal", "Branch if greater than or equal (N == V)");
     spec.branch_conditions.emplace_back("BCS", 7, "Carry Set", "Branch if carry set (C set)");
     spec.branch_conditions.emplace_back("BCC", 8, "Carry Clear", "Branch if carry clear (C clear)");
     spec.branch_conditions.emplace_back("BMI", 9, "Minus", "Branch if negative (N set)");
@@ -435,6 +553,20 @@ inline ISA_SPEC generateISASpec() {
     spec.branch_conditions.emplace_back("BHI", 13, "Higher", "Branch if higher (unsigned)");
     spec.branch_conditions.emplace_back("BLS", 14, "Lower or Same", "Branch if lower or same (unsigned)");
 
+    buildLookupIndex(spec);
+
+    return spec;
+}
+
+// Estimated clock cycles of an encoded instruction (InstructionTech::cycles), 1 for unknown opcodes
+inline unsigned instructionCycles(const ISA_SPEC& spec, uint32_t raw) {
+    auto it = spec.opcode_map.find(raw & 0xFF);
+    return it == spec.opcode_map.end() ? 1 : it->second->cycles;
+}
+
+// Spec shared by every caller, built once on first use (thread-safe); read-only afterwards
+inline const ISA_SPEC& sharedISASpec() {
+    static const ISA_SPEC spec = generateISASpec();
     return spec;
 }
 
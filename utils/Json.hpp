@@ -0,0 +1,299 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Minimal JSON value with a parser and writer, enough for the language server
+// protocol. Objects keep their members in insertion order.
+class JsonValue {
+public:
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+private:
+    Type type = JSON_NULL;
+    bool boolean = false;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    static const JsonValue& nullValue() {
+        static const JsonValue value;
+        return value;
+    }
+
+    static void escapeTo(std::string_view str, std::string& out) {
+        out += '"';
+        for (char c : str) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if ((unsigned char)c < 0x20) {
+                        char code[8];
+                        std::snprintf(code, sizeof(code), "\\u%04x", (unsigned)c);
+                        out += code;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+        out += '"';
+    }
+
+    // Recursive descent parser over a string_view
+    struct Parser {
+        std::string_view in;
+        size_t pos = 0;
+        int depth = 0;
+
+        void skipSpace() {
+            while (pos < in.size() && (in[pos] == ' ' || in[pos] == '\t' || in[pos] == '\n' || in[pos] == '\r')) pos++;
+        }
+
+        bool literal(std::string_view word) {
+            if (in.substr(pos, word.size()) != word) return false;
+            pos += word.size();
+            return true;
+        }
+
+        static void appendUtf8(uint32_t cp, std::string& out) {
+            if (cp < 0x80) {
+                out += (char)cp;
+            } else if (cp < 0x800) {
+                out += (char)(0xC0 | (cp >> 6));
+                out += (char)(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                out += (char)(0xE0 | (cp >> 12));
+                out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                out += (char)(0x80 | (cp & 0x3F));
+            } else {
+                out += (char)(0xF0 | (cp >> 18));
+                out += (char)(0x80 | ((cp >> 12) & 0x3F));
+                out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                out += (char)(0x80 | (cp & 0x3F));
+            }
+        }
+
+        bool hex4(uint32_t& value) {
+            if (pos + 4 > in.size()) return false;
+            value = 0;
+            for (int i = 0; i < 4; i++) {
+                char c = in[pos++];
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= c - '0';
+                else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+                else return false;
+            }
+            return true;
+        }
+
+        bool string(std::string& out) {
+            if (pos >= in.size() || in[pos] != '"') return false;
+            pos++;
+            while (pos < in.size()) {
+                char c = in[pos++];
+                if (c == '"') return true;
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (pos >= in.size()) return false;
+                char e = in[pos++];
+                switch (e) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        uint32_t cp;
+                        if (!hex4(cp)) return false;
+                        // Surrogate pair
+                        if (cp >= 0xD800 && cp < 0xDC00 && literal("\\u")) {
+                            uint32_t low;
+                            if (!hex4(low)) return false;
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUtf8(cp, out);
+                        break;
+                    }
+                    default: return false;
+                }
+            }
+            return false;
+        }
+
+        bool value(JsonValue& out) {
+            if (++depth > 64) return false;
+            skipSpace();
+            if (pos >= in.size()) return false;
+            bool ok = true;
+            char c = in[pos];
+            if (c == '{') {
+                pos++;
+                out = JsonValue::object();
+                skipSpace();
+                if (pos < in.size() && in[pos] == '}') {
+                    pos++;
+                } else {
+                    while (ok) {
+                        skipSpace();
+                        std::string key;
+                        JsonValue member;
+                        ok = string(key);
+                        skipSpace();
+                        ok = ok && pos < in.size() && in[pos++] == ':' && value(member);
+                        if (ok) out.members.emplace_back(std::move(key), std::move(member));
+                        skipSpace();
+                        if (ok && pos < in.size() && in[pos] == ',') { pos++; continue; }
+                        ok = ok && pos < in.size() && in[pos++] == '}';
+                        break;
+                    }
+                }
+            } else if (c == '[') {
+                pos++;
+                out = JsonValue::array();
+                skipSpace();
+                if (pos < in.size() && in[pos] == ']') {
+                    pos++;
+                } else {
+                    while (ok) {
+                        JsonValue item;
+                        ok = value(item);
+                        if (ok) out.items.push_back(std::move(item));
+                        skipSpace();
+                        if (ok && pos < in.size() && in[pos] == ',') { pos++; continue; }
+                        ok = ok && pos < in.size() && in[pos++] == ']';
+                        break;
+                    }
+                }
+            } else if (c == '"') {
+                out = JsonValue(std::string());
+                ok = string(out.text);
+            } else if (literal("true")) {
+                out = JsonValue(true);
+            } else if (literal("false")) {
+                out = JsonValue(false);
+            } else if (literal("null")) {
+                out = JsonValue();
+            } else {
+                std::string numberText;
+                while (pos < in.size() && std::string_view("+-0123456789.eE").find(in[pos]) != std::string_view::npos) {
+                    numberText += in[pos++];
+                }
+                char* end = nullptr;
+                double parsed = std::strtod(numberText.c_str(), &end);
+                ok = !numberText.empty() && end && *end == '\0';
+                out = JsonValue(parsed);
+            }
+            depth--;
+            return ok;
+        }
+    };
+
+public:
+    JsonValue() = default;
+    JsonValue(bool value) : type(JSON_BOOL), boolean(value) {}
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>>
+    JsonValue(T value) : type(JSON_NUMBER), number((double)value) {}
+    JsonValue(const char* value) : type(JSON_STRING), text(value) {}
+    JsonValue(std::string value) : type(JSON_STRING), text(std::move(value)) {}
+    JsonValue(std::string_view value) : type(JSON_STRING), text(value) {}
+
+    static JsonValue array() { JsonValue value; value.type = JSON_ARRAY; return value; }
+    static JsonValue object() { JsonValue value; value.type = JSON_OBJECT; return value; }
+
+    Type getType() const { return type; }
+    bool isNull() const { return type == JSON_NULL; }
+    bool asBool() const { return type == JSON_BOOL && boolean; }
+    double asNumber() const { return type == JSON_NUMBER ? number : 0; }
+    long asInt() const { return (long)asNumber(); }
+    const std::string& asString() const { return text; }
+    const std::vector<JsonValue>& getItems() const { return items; }
+
+    // Member lookup, null if missing
+    const JsonValue& operator[](std::string_view key) const {
+        for (const auto& member : members) {
+            if (member.first == key) return member.second;
+        }
+        return nullValue();
+    }
+    bool has(std::string_view key) const { return !(*this)[key].isNull(); }
+
+    // Builders, chainable
+    JsonValue& set(std::string_view key, JsonValue value) {
+        for (auto& member : members) {
+            if (member.first == key) {
+                member.second = std::move(value);
+                return *this;
+            }
+        }
+        members.emplace_back(std::string(key), std::move(value));
+        return *this;
+    }
+    JsonValue& push(JsonValue value) {
+        items.push_back(std::move(value));
+        return *this;
+    }
+
+    void dumpTo(std::string& out) const {
+        switch (type) {
+            case JSON_NULL: out += "null"; break;
+            case JSON_BOOL: out += boolean ? "true" : "false"; break;
+            case JSON_NUMBER: {
+                char buffer[32];
+                if (number > -1e15 && number < 1e15 && number == (double)(long long)number) std::snprintf(buffer, sizeof(buffer), "%lld", (long long)number);
+                else std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+                out += buffer;
+                break;
+            }
+            case JSON_STRING: escapeTo(text, out); break;
+            case JSON_ARRAY:
+                out += '[';
+                for (size_t i = 0; i < items.size(); i++) {
+                    if (i) out += ',';
+                    items[i].dumpTo(out);
+                }
+                out += ']';
+                break;
+            case JSON_OBJECT:
+                out += '{';
+                for (size_t i = 0; i < members.size(); i++) {
+                    if (i) out += ',';
+                    escapeTo(members[i].first, out);
+                    out += ':';
+                    members[i].second.dumpTo(out);
+                }
+                out += '}';
+                break;
+        }
+    }
+
+    std::string dump() const {
+        std::string out;
+        dumpTo(out);
+        return out;
+    }
+
+    // Parse a complete JSON document, false on malformed input
+    static bool parse(std::string_view text, JsonValue& value) {
+        Parser parser{text};
+        if (!parser.value(value)) return false;
+        parser.skipSpace();
+        return parser.pos == text.size();
+    }
+};
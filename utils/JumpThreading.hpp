@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Jump threading (-O1) over an assembled program:
+//
+//   branch to an unconditional B          goes straight to that B's target
+//   BEQ to another BEQ                    goes straight to the second one's target
+//   BEQ to a BNE (the opposite)           goes straight past it
+//   Bcc skip / B there / skip:            B(not cc) there
+//   branch to the next instruction        deleted
+//
+// Branches leave the flags alone, so a condition that held at one branch
+// still holds at the next. The B in the inversion pattern must not be a
+// label, branch target or code address itself.
+class JumpThreader {
+public:
+    struct Stats {
+        size_t threaded = 0;       // Branches retargeted past another branch
+        size_t inverted = 0;       // Conditional branches inverted over an unconditional one
+        size_t fallthroughs = 0;   // Branches to the next instruction deleted
+
+        size_t removed() const { return inverted + fallthroughs; }
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    Stats stats;
+
+    bool isBranchImmediate(uint32_t raw) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        return tech && tech->type == IsaSpec::InstructionType::TYPE_BRANCH && tech->flags.IMMEDIATE;
+    }
+
+    static long targetOf(uint32_t raw) { return raw >> 16; }
+
+    // Follow the branch at index through the branches it lands on. Sets either
+    // copyFrom (take that branch's target) or destination; false if nothing to do.
+    bool thread(const std::vector<uint32_t>& code, const ProgramEditor& editor, size_t index,
+                long& copyFrom, long& destination) const {
+        int condition = Semantics::conditionOf(code[index]);
+        int opposite = invertBranchCondition(isaSpec, condition);
+        std::vector<char> seen(code.size(), 0);
+        seen[index] = 1;
+        copyFrom = -1;
+        destination = targetOf(code[index]);
+
+        while (destination >= 0 && (size_t)destination < code.size() && isBranchImmediate(code[destination])) {
+            size_t at = (size_t)destination;
+            if (seen[at]) return false;  // Endless loop of branches, leave it be
+            seen[at] = 1;
+            int next = Semantics::conditionOf(code[at]);
+            if (next == 0 || next == condition) {
+                copyFrom = (long)at;
+                if (editor.isExternal(at)) break;
+                destination = targetOf(code[at]);
+            } else if (next == opposite) {
+                copyFrom = -1;
+                destination = (long)at + 1;
+            } else {
+                break;
+            }
+        }
+        return destination != targetOf(code[index]) || (copyFrom >= 0 && editor.isExternal(copyFrom));
+    }
+
+    // One round over the program, true if anything changed
+    bool round(AssemblyResult& program) {
+        ProgramEditor editor(program, isaSpec);
+        std::vector<uint32_t>& code = program.instructions;
+        size_t size = code.size();
+        bool changed = false;
+
+        // Branches landing on branches
+        for (size_t i = 0; i < size; i++) {
+            if (!isBranchImmediate(code[i]) || editor.isExternal(i)) continue;
+            long copyFrom, destination;
+            if (!thread(code, editor, i, copyFrom, destination)) continue;
+            if (copyFrom >= 0) {
+                if (!editor.retarget(i, (size_t)copyFrom)) continue;
+            } else {
+                editor.setBranchTarget(i, destination);
+            }
+            stats.threaded++;
+            changed = true;
+        }
+
+        // Bcc skip / B there / skip:
+        std::vector<char> join(size + 1, 0);
+        for (const auto& symbol : program.symbols) {
+            if (symbol.address <= size) join[symbol.address] = 1;
+        }
+        for (const auto& address : editor.getCodeAddresses()) {
+            if (address.target >= 0 && (size_t)address.target <= size) join[address.target] = 1;
+        }
+        std::vector<char> removed(size, 0);
+        for (size_t i = 0; i + 1 < size; i++) {
+            if (!isBranchImmediate(code[i]) || editor.isExternal(i) || removed[i]) continue;
+            int opposite = invertBranchCondition(isaSpec, Semantics::conditionOf(code[i]));
+            size_t next = i + 1;
+            if (opposite < 0 || targetOf(code[i]) != (long)i + 2) continue;
+            if (!isBranchImmediate(code[next]) || Semantics::conditionOf(code[next]) != 0 || join[next]) continue;
+            if (!editor.retarget(i, next)) continue;
+            code[i] = (code[i] & ~(0xFu << 8)) | ((uint32_t)opposite << 8);
+            removed[next] = 1;
+            stats.inverted++;
+        }
+
+        // Branches to the next kept instruction
+        for (size_t i = 0; i < size; i++) {
+            if (!isBranchImmediate(code[i]) || editor.isExternal(i) || removed[i]) continue;
+            size_t next = i + 1;
+            while (next < size && removed[next]) next++;
+            long target = targetOf(code[i]);
+            if (target > (long)i && target <= (long)next) {
+                removed[i] = 1;
+                stats.fallthroughs++;
+            }
+        }
+
+        return editor.erase(removed) > 0 || changed;
+    }
+
+public:
+    explicit JumpThreader(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Thread the jumps of an assembled program in place, returns the number of instructions removed
+    size_t optimize(AssemblyResult& program) {
+        stats = Stats();
+        while (round(program)) {}
+        return stats.removed();
+    }
+};
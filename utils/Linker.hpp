@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "ObjectModule.hpp"
+
+// Links object modules into one program image. The first module is placed at
+// address 0 and its first instruction is the entry point.
+//
+// With stripping enabled, each module is cut into functions at its global
+// labels and only functions reachable from the entry point are kept.
+// A function is reachable if a kept function refers to an address in it (a
+// label plus any constant, so "foo+1" may reach past foo into the next
+// function), or if a kept function can fall through into it. A kept function
+// that uses LR also keeps the function after it, since LR return addresses
+// are formed by adding a constant and may land past a label.
+class Linker {
+public:
+    struct Function {
+        size_t module;
+        uint16_t start;
+        uint16_t end;
+        std::string name;     // Global label at start, "<module entry>" before the first one
+        bool live = false;
+        uint16_t address = 0; // Linked address, valid when live
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    bool stripUnused = true;
+    std::vector<Function> functions;
+
+    struct Definition {
+        size_t module;
+        uint16_t offset;
+    };
+    std::map<std::string, Definition> globalSymbols;
+
+    // Unconditional branch or EXIT: control never falls through to the next instruction
+    bool endsFlow(uint32_t instr) const {
+        auto it = isaSpec.opcode_map.find(instr & 0xFF);
+        if (it == isaSpec.opcode_map.end()) return false;
+        const IsaSpec::InstructionTech* tech = it->second;
+        if (tech->type == IsaSpec::InstructionType::TYPE_SERVICE) return true;
+        return tech->type == IsaSpec::InstructionType::TYPE_BRANCH && ((instr >> 8) & 0xF) == 0;
+    }
+
+    size_t functionAt(size_t module, uint16_t offset) const {
+        for (size_t i = 0; i < functions.size(); i++) {
+            const Function& fn = functions[i];
+            if (fn.module == module && fn.start <= offset && offset < fn.end) return i;
+        }
+        // Label at the very end of a module owns an empty function
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (functions[i].module == module && functions[i].start == offset) return i;
+        }
+        return functions.size();
+    }
+
+    // Resolve a symbol from a module: module-local labels first, then globals
+    bool resolve(const std::vector<ObjectModule>& modules, size_t module, const std::string& name, Definition& def) const {
+        for (const auto& symbol : modules[module].symbols) {
+            if (symbol.name == name) {
+                def = {module, symbol.offset};
+                return true;
+            }
+        }
+        auto it = globalSymbols.find(name);
+        if (it == globalSymbols.end()) return false;
+        def = it->second;
+        return true;
+    }
+
+    // The module offset a relocation points to: its symbol plus its addend (the addend alone for the
+    // module's own base address). False if the symbol is undefined or the target lies outside the module.
+    bool relocationTarget(const std::vector<ObjectModule>& modules, size_t module, const ObjectModule::Relocation& reloc,
+                          Definition& def) const {
+        def = {module, 0};
+        if (!reloc.symbol.empty() && !resolve(modules, module, reloc.symbol, def)) return false;
+        int32_t target = def.offset + reloc.addend;
+        if (target < 0 || target > (int32_t)modules[def.module].code.size()) return false;
+        def.offset = (uint16_t)target;
+        return true;
+    }
+
+    // Linked address of a module offset (an offset at the very end maps past the module's last kept function)
+    uint16_t linkedAddress(const Definition& def) const {
+        for (const auto& fn : functions) {
+            if (fn.live && fn.module == def.module && fn.start <= def.offset && def.offset < fn.end) {
+                return fn.address + (def.offset - fn.start);
+            }
+        }
+        uint16_t address = 0;
+        for (const auto& fn : functions) {
+            if (fn.live && fn.module == def.module && fn.end <= def.offset) address = fn.address + (fn.end - fn.start);
+        }
+        return address;
+    }
+
+public:
+    explicit Linker(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    void setStripUnused(bool strip) { stripUnused = strip; }
+    const std::vector<Function>& getFunctions() const { return functions; }
+
+    bool link(const std::vector<ObjectModule>& modules, std::vector<uint32_t>& image, std::ostream& log) {
+        functions.clear();
+        globalSymbols.clear();
+        image.clear();
+        if (modules.empty()) {
+            log << "Error: Nothing to link\n";
+            return false;
+        }
+
+        bool ok = true;
+        for (size_t m = 0; m < modules.size(); m++) {
+            const ObjectModule& module = modules[m];
+
+            // Cut the module into functions at its global labels
+            std::vector<std::pair<uint16_t, std::string>> cuts = {{0, "<" + module.source + " entry>"}};
+            for (const auto& symbol : module.symbols) {
+                if (symbol.offset > module.code.size()) {
+                    log << "Error: Symbol '" << symbol.name << "' outside module " << module.source << "\n";
+                    return false;
+                }
+                if (!symbol.global) continue;
+                auto existing = globalSymbols.find(symbol.name);
+                if (existing != globalSymbols.end()) {
+                    log << "Error: Duplicate symbol '" << symbol.name << "' in " << module.source
+                        << " and " << modules[existing->second.module].source << "\n";
+                    ok = false;
+                    continue;
+                }
+                globalSymbols[symbol.name] = {m, symbol.offset};
+                if (symbol.offset == 0) cuts[0].second = symbol.name;
+                else cuts.push_back({symbol.offset, symbol.name});
+            }
+            std::stable_sort(cuts.begin(), cuts.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (size_t i = 0; i < cuts.size(); i++) {
+                uint16_t end = (i + 1 < cuts.size()) ? cuts[i + 1].first : (uint16_t)module.code.size();
+                if (i + 1 < cuts.size() && end == cuts[i].first) continue;  // Several labels at one address
+                functions.push_back({m, cuts[i].first, end, cuts[i].second});
+            }
+        }
+        if (!ok) return false;
+
+        // Mark reachable functions, starting from the entry point
+        std::vector<size_t> worklist;
+        auto markLive = [&](size_t index) {
+            if (index < functions.size() && !functions[index].live) {
+                functions[index].live = true;
+                worklist.push_back(index);
+            }
+        };
+        if (stripUnused) {
+            markLive(0);
+        } else {
+            for (size_t i = 0; i < functions.size(); i++) markLive(i);
+        }
+
+        while (!worklist.empty()) {
+            size_t index = worklist.back();
+            worklist.pop_back();
+            const Function fn = functions[index];
+            const ObjectModule& module = modules[fn.module];
+
+            bool usesLr = false;
+            for (const auto& reloc : module.relocations) {
+                if (reloc.index < fn.start || reloc.index >= fn.end) continue;
+                Definition def;
+                if (reloc.symbol.empty()) usesLr = true;
+                if (!relocationTarget(modules, fn.module, reloc, def)) {
+                    if (reloc.symbol.empty() || resolve(modules, fn.module, reloc.symbol, def)) {
+                        log << "Error: Relocation of '" << (reloc.symbol.empty() ? "." : reloc.symbol) << "'"
+                            << (reloc.addend < 0 ? "" : "+") << reloc.addend << " in " << module.source
+                            << " points outside its module\n";
+                    } else {
+                        log << "Error: Undefined symbol '" << reloc.symbol << "' referenced from " << module.source << "\n";
+                    }
+                    ok = false;
+                    continue;
+                }
+                markLive(functionAt(def.module, def.offset));
+            }
+
+            bool fallsThrough = (fn.end == fn.start) || !endsFlow(module.code[fn.end - 1]);
+            if ((fallsThrough || usesLr) && index + 1 < functions.size() && functions[index + 1].module == fn.module) {
+                markLive(index + 1);
+            }
+        }
+        if (!ok) return false;
+
+        // Lay out kept functions in module order
+        uint32_t address = 0;
+        for (auto& fn : functions) {
+            if (!fn.live) continue;
+            fn.address = (uint16_t)address;
+            address += fn.end - fn.start;
+        }
+        if (address > 256) {
+            log << "Error: Linked program is " << address << " instructions, ROM holds 256\n";
+            return false;
+        }
+
+        // Copy code and apply relocations
+        for (const auto& fn : functions) {
+            if (!fn.live) continue;
+            const ObjectModule& module = modules[fn.module];
+            image.insert(image.end(), module.code.begin() + fn.start, module.code.begin() + fn.end);
+
+            for (const auto& reloc : module.relocations) {
+                if (reloc.index < fn.start || reloc.index >= fn.end) continue;
+                Definition def = {fn.module, 0};
+                relocationTarget(modules, fn.module, reloc, def);
+                uint16_t value = linkedAddress(def);
+
+                uint32_t& instr = image[fn.address + (reloc.index - fn.start)];
+                instr = (instr & 0xFFFF) | ((uint32_t)(value & 0xFFFF) << 16);
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#ifndef _WIN32
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+// Unix domain stream socket carrying newline-terminated messages, used by the
+// assembler daemon and its clients. Windows builds have no implementation
+// (isSupported() is false and every operation fails).
+class LocalSocket {
+private:
+    int fd = -1;
+    std::string pending;    // Bytes received past the last returned line
+
+#ifndef _WIN32
+    static bool makeAddress(const std::string& path, sockaddr_un& address) {
+        if (path.size() >= sizeof(address.sun_path)) return false;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+#endif
+
+public:
+    LocalSocket() = default;
+    ~LocalSocket() { close(); }
+
+    LocalSocket(const LocalSocket&) = delete;
+    LocalSocket& operator=(const LocalSocket&) = delete;
+    LocalSocket(LocalSocket&& other) noexcept : fd(other.fd), pending(std::move(other.pending)) { other.fd = -1; }
+    LocalSocket& operator=(LocalSocket&& other) noexcept {
+        if (this != &other) {
+            close();
+            fd = other.fd;
+            pending = std::move(other.pending);
+            other.fd = -1;
+        }
+        return *this;
+    }
+
+    static bool isSupported() {
+#ifdef _WIN32
+        return false;
+#else
+        return true;
+#endif
+    }
+
+    // $XDG_RUNTIME_DIR/gct.sock, or a per-user name in /tmp
+    static std::string defaultPath() {
+#ifdef _WIN32
+        return "";
+#else
+        const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+        if (runtimeDir && *runtimeDir) return std::string(runtimeDir) + "/gct.sock";
+        return "/tmp/gct-" + std::to_string(::getuid()) + ".sock";
+#endif
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    void close() {
+#ifndef _WIN32
+        if (fd >= 0) ::close(fd);
+#endif
+        fd = -1;
+        pending.clear();
+    }
+
+    // Stop a blocking accept()/readLine() on this socket from another thread
+    void shutdown() {
+#ifndef _WIN32
+        if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+#endif
+    }
+
+    bool connect(const std::string& path) {
+        close();
+#ifndef _WIN32
+        sockaddr_un address;
+        if (!makeAddress(path, address)) return false;
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        if (::connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            close();
+            return false;
+        }
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // Listen on path, replacing a stale socket file; fails if a server already answers there
+    bool listen(const std::string& path) {
+        close();
+#ifndef _WIN32
+        sockaddr_un address;
+        if (!makeAddress(path, address)) return false;
+        LocalSocket probe;
+        if (probe.connect(path)) return false;
+        ::unlink(path.c_str());
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        if (::bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, 16) != 0) {
+            close();
+            return false;
+        }
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // Wait for a client, returns a closed socket once the listener is shut down
+    LocalSocket accept() {
+        LocalSocket client;
+#ifndef _WIN32
+        if (fd >= 0) client.fd = ::accept(fd, nullptr, nullptr);
+#endif
+        return client;
+    }
+
+    bool sendLine(std::string_view line) {
+#ifndef _WIN32
+        std::string message(line);
+        message += '\n';
+        size_t sent = 0;
+        while (sent < message.size()) {
+            ssize_t n = ::send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += (size_t)n;
+        }
+        return true;
+#else
+        (void)line;
+        return false;
+#endif
+    }
+
+    // Next message without its newline, false once the peer has closed
+    bool readLine(std::string& line) {
+#ifndef _WIN32
+        while (true) {
+            size_t newline = pending.find('\n');
+            if (newline != std::string::npos) {
+                line.assign(pending, 0, newline);
+                pending.erase(0, newline + 1);
+                return true;
+            }
+            char buffer[4096];
+            ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) return false;
+            pending.append(buffer, (size_t)n);
+        }
+#else
+        (void)line;
+        return false;
+#endif
+    }
+};
@@ -0,0 +1,354 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ControlFlow.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Loop unrolling (-O1) of counted loops, within an instruction budget.
+//
+//   loop: ...                             ...            (first pass)
+//         CMP Xi, bound                   ...            (next pass)
+//         Bcc done            fully  ->   ...
+//         ...                             (last pass up to the CMP)
+//         ADD Xi, Xi, step
+//         B loop              partly ->   loop: ... CMP / Bcc done / ... (k times)
+//   done:                                       B loop
+//
+// A loop is a run of instructions whose last one branches back to its first,
+// entered only by falling into that first instruction. It leaves through one
+// conditional branch, right after a CMP of an induction variable Xi (written
+// in the loop only by one ADD or SUB Xi, Xi, constant) against a number or a
+// register the loop does not write; a loop ending in "Bcc loop" leaves by
+// falling out of it. Inside, branches may only go forward within the loop and
+// must not skip the CMP or the update of Xi; nothing in it may hold a code
+// address, leave the program or be reached from outside.
+//
+// When MOV Xi, number (and MOV of the bound, if it is a register) come
+// earlier in the block that falls into the loop, the passes are counted at
+// assembly time and the loop is replaced by that many copies of its body, in
+// which the exit branch and the back edge are gone and the CMP too if no
+// other branch in the loop reads the flags; the last pass keeps its CMP only
+// where the flags are read after the loop. Otherwise a loop ending in "B loop"
+// gets k copies of its body, each with its own test, and one back edge per k
+// passes. Constant propagation run afterwards folds the now-known Xi into the
+// copies. Cycle savings are estimated from the ISA cycle table as if every
+// instruction of a pass ran.
+class LoopUnroller {
+public:
+    struct Loop {
+        std::string label;  // Label of the loop's first instruction, or "instruction N"
+        long passes;        // Times the back edge was taken, -1 if not known at assembly time
+        size_t factor;      // Copies of the body per back edge, 0 when fully unrolled
+        long added;         // Instructions added
+        long cycles;        // Estimated cycles saved: all told when fully unrolled, per factor passes otherwise
+    };
+
+    struct Stats {
+        size_t full = 0;     // Loops replaced by straight-line copies
+        size_t partial = 0;  // Loops unrolled by a factor
+        long added = 0;      // Instructions added by both
+        std::vector<Loop> loops;
+    };
+
+    static constexpr size_t DEFAULT_BUDGET = 64;  // Instructions unrolling may add to a program
+    static constexpr long MAX_PASSES = 256;       // Longest loop counted at assembly time
+    static constexpr size_t MAX_FACTOR = 4;
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    Stats stats;
+    size_t budget = DEFAULT_BUDGET;
+
+    // A loop found in the program: instructions head..tail, left by the branch at exit
+    struct Candidate {
+        size_t head = 0, tail = 0;
+        size_t exit = 0;        // Exit branch (tail itself when the loop ends in "Bcc head"), after its CMP
+        size_t update = 0;      // ADD/SUB of the induction variable
+        long destination = 0;   // Where the exit branch goes
+        bool bottom = false;    // Ends in "Bcc head" rather than "B head"
+        bool testsFlags = false;  // Another branch in the loop reads the flags
+        long passes = -1;       // Back edges taken, -1 if unknown
+    };
+
+    bool isType(uint32_t raw, IsaSpec::InstructionType type) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        return tech && tech->type == type;
+    }
+
+    static long targetOf(uint32_t raw) { return raw >> 16; }
+
+    long cost(const std::vector<uint32_t>& code, size_t first, size_t last) const {
+        long total = 0;
+        for (size_t i = first; i <= last; i++) total += IsaSpec::instructionCycles(isaSpec, code[i]);
+        return total;
+    }
+
+    // Register written by raw, -1 if none
+    int writtenRegister(uint32_t raw) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        if (!tech || !tech->flags.TRY_WRITE || tech->type == IsaSpec::InstructionType::TYPE_CMP) return -1;
+        return (raw >> 8) & 0x7;
+    }
+
+    // Value reg is known to hold before index: the last write to it in index's block must be MOV Xn, number
+    bool valueBefore(const std::vector<uint32_t>& code, const ProgramEditor& editor, const ControlFlowGraph& cfg,
+                     size_t index, int reg, uint16_t& value) const {
+        if (index == 0) return false;
+        size_t start = cfg.getBlocks()[cfg.blockAt(index - 1)].start;
+        for (size_t i = index; i-- > start;) {
+            if (writtenRegister(code[i]) != reg) continue;
+            Semantics::Operation operation = Semantics::decode(isaSpec, code[i]);
+            if (operation.op != Semantics::Op::MOV || !operation.immediate || editor.isPinned(i)) return false;
+            value = operation.imm;
+            return true;
+        }
+        return false;
+    }
+
+    // The loop closed by the backward branch at tail, false if it is not one this pass unrolls
+    bool findLoop(const std::vector<uint32_t>& code, const ProgramEditor& editor, const ControlFlowGraph& cfg,
+                  size_t tail, Candidate& loop) const {
+        uint32_t back = code[tail];
+        if (!isType(back, IsaSpec::InstructionType::TYPE_BRANCH) || !Semantics::techOf(isaSpec, back)->flags.IMMEDIATE || editor.isExternal(tail)) return false;
+        long head = targetOf(back);
+        if (head <= 0 || (size_t)head >= tail) return false;
+        loop.head = (size_t)head;
+        loop.tail = tail;
+        loop.bottom = Semantics::conditionOf(back) != 0;
+        loop.exit = tail;
+        loop.destination = (long)tail + 1;
+
+        // Straight-line code, forward branches within the loop and one exit
+        size_t exits = 0;
+        for (size_t i = loop.head; i < tail; i++) {
+            const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, code[i]);
+            if (!tech || tech->type == IsaSpec::InstructionType::TYPE_SERVICE) return false;
+            const ControlFlowGraph::Block& block = cfg.getBlocks()[cfg.blockAt(i)];
+            if (block.entry || block.addressTaken) return false;
+            if (tech->type != IsaSpec::InstructionType::TYPE_BRANCH) {
+                if (editor.isPinned(i)) return false;
+                continue;
+            }
+            if (!tech->flags.IMMEDIATE || editor.isExternal(i)) return false;
+            long target = targetOf(code[i]);
+            if (target > (long)i && target <= (long)tail) {
+                if (Semantics::conditionOf(code[i]) != 0) loop.testsFlags = true;
+                continue;
+            }
+            if (Semantics::conditionOf(code[i]) == 0 || loop.bottom || (target >= head && target <= (long)tail)) return false;
+            loop.exit = i;
+            loop.destination = target;
+            exits++;
+        }
+        if (loop.bottom ? exits != 0 : exits != 1) return false;
+        if (loop.exit == loop.head || !isType(code[loop.exit - 1], IsaSpec::InstructionType::TYPE_CMP)) return false;
+        if (isType(code[loop.head - 1], IsaSpec::InstructionType::TYPE_SERVICE)) return false;
+        if (isType(code[loop.head - 1], IsaSpec::InstructionType::TYPE_BRANCH) && Semantics::conditionOf(code[loop.head - 1]) == 0) return false;
+
+        // Entered only through its first instruction, from the instruction before it
+        for (const auto& address : editor.getCodeAddresses()) {
+            bool inside = address.index >= loop.head && address.index <= tail;
+            if (address.target >= head && address.target <= (long)tail && (!inside || !address.branch)) return false;
+        }
+
+        // No branch skips the CMP
+        size_t compare = loop.exit - 1;
+        for (size_t i = loop.head; i < compare; i++) {
+            if (isType(code[i], IsaSpec::InstructionType::TYPE_BRANCH) && targetOf(code[i]) > (long)compare) return false;
+        }
+
+        // The induction variable: the CMP operand updated once per pass by ADD/SUB of a constant
+        Semantics::Operation test = Semantics::decode(isaSpec, code[compare]);
+        for (int side = 0; side < 2; side++) {
+            if (side == 1 && test.immediate) return false;
+            int variable = side == 0 ? test.a : test.b;
+            int bound = test.immediate ? -1 : (side == 0 ? test.b : test.a);
+            if (bound == variable) return false;
+            long update = -1;
+            bool invariant = true;
+            for (size_t i = loop.head; i <= tail; i++) {
+                int reg = writtenRegister(code[i]);
+                if (bound >= 0 && reg == bound) invariant = false;
+                if (reg != variable) continue;
+                Semantics::Operation step = Semantics::decode(isaSpec, code[i]);
+                bool counts = (step.op == Semantics::Op::ADD || step.op == Semantics::Op::SUB) && step.immediate &&
+                              step.a == variable && step.imm != 0;
+                update = (update == -1 && counts) ? (long)i : -2;  // -2: written some other way, or twice
+            }
+            if (update < 0 || !invariant) continue;
+            for (size_t i = loop.head; i < (size_t)update; i++) {
+                if (i != loop.exit && isType(code[i], IsaSpec::InstructionType::TYPE_BRANCH) && targetOf(code[i]) > update) return false;
+            }
+            loop.update = (size_t)update;
+
+            // Passes, when the values the loop starts from are known
+            Semantics::State state;
+            uint16_t value = 0;
+            if (!valueBefore(code, editor, cfg, loop.head, variable, value)) return true;
+            state.regs[variable] = value;
+            if (bound >= 0) {
+                if (!valueBefore(code, editor, cfg, loop.head, bound, value)) return true;
+                state.regs[bound] = value;
+            }
+            Semantics::Operation step = Semantics::decode(isaSpec, code[loop.update]);
+            for (long passes = 0; passes <= MAX_PASSES; passes++) {
+                if (loop.update < compare) Semantics::execute(step, state);
+                Semantics::execute(test, state);
+                bool holds = false;
+                uint8_t needs = 0;
+                if (!Semantics::testCondition(isaSpec, Semantics::conditionOf(code[loop.exit]), state, holds, needs)) return true;
+                if (holds != loop.bottom) {
+                    loop.passes = passes;
+                    return true;
+                }
+                if (loop.update > compare) Semantics::execute(step, state);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Replace the loop by loop.passes copies of its body and the last pass up to its CMP; false if over room
+    bool unrollFully(AssemblyResult& program, const Candidate& loop, long room, bool objectOutput, Loop& report) {
+        std::vector<uint32_t>& code = program.instructions;
+        size_t head = loop.head, tail = loop.tail, compare = loop.exit - 1, span = tail - head + 2;
+        std::vector<uint8_t> flagsAfter = ProgramEditor(program, isaSpec).flagsLiveAfter();
+        size_t exit = (size_t)loop.destination;
+        bool flagsRead = exit >= code.size() || Semantics::flagsLiveBefore(isaSpec, code[exit], flagsAfter[exit]) != 0;
+        auto keeps = [&](bool last, size_t i) {
+            if (i == compare) return last ? flagsRead : loop.testsFlags;
+            return i != loop.exit && i != tail && !(last && i > compare);
+        };
+
+        // Copies, with where each original instruction (or the next one kept, for one left out) is in each pass
+        std::vector<uint32_t> unrolled;
+        std::vector<std::vector<long>> at((size_t)loop.passes + 1, std::vector<long>(span, 0));
+        for (long pass = 0; pass <= loop.passes; pass++) {
+            bool last = pass == loop.passes;
+            std::vector<long>& where = at[pass];
+            for (size_t i = head; i <= tail; i++) {
+                if (!keeps(last, i)) continue;
+                where[i - head] = (long)unrolled.size();
+                unrolled.push_back(code[i]);
+            }
+            long next = (long)unrolled.size();  // The next pass, or what follows the loop
+            for (size_t i = tail + 2; i-- > head;) {
+                if (i <= tail && keeps(last, i)) next = where[i - head];
+                where[i - head] = next;
+            }
+        }
+
+        // Branches kept in the copies go within their pass, the exit (where it is not the next instruction) by a B
+        std::vector<std::pair<size_t, long>> branches;  // Position in unrolled, target position or -1 for the exit
+        for (long pass = 0; pass <= loop.passes; pass++) {
+            for (size_t i = head; i <= tail; i++) {
+                if (!keeps(pass == loop.passes, i) || !isType(code[i], IsaSpec::InstructionType::TYPE_BRANCH)) continue;
+                branches.push_back({(size_t)at[pass][i - head], at[pass][targetOf(code[i]) - (long)head]});
+            }
+        }
+        if (!loop.bottom && loop.destination != (long)tail + 1) {
+            branches.push_back({unrolled.size(), -1});
+            unrolled.push_back(IsaSpec::findOpcode(isaSpec, "B", IsaSpec::InstructionType::TYPE_BRANCH, true));
+        }
+        long added = (long)unrolled.size() - (long)(tail - head + 1);
+        if (added > room) return false;
+
+        long before = loop.passes * cost(code, head, tail) + cost(code, head, loop.exit), after = 0;
+        for (uint32_t raw : unrolled) after += IsaSpec::instructionCycles(isaSpec, raw);
+
+        std::vector<std::vector<uint32_t>> ahead(code.size()), behind(code.size());
+        behind[tail] = unrolled;
+        ProgramEditor(program, isaSpec).insert(ahead, behind);
+        ProgramEditor grown(program, isaSpec);
+        long destination = loop.destination > (long)tail ? loop.destination + (long)unrolled.size() : loop.destination;
+        for (const auto& branch : branches) {
+            long target = branch.second < 0 ? destination : (long)tail + 1 + branch.second;
+            grown.setCodeAddress(tail + 1 + branch.first, target, objectOutput);
+        }
+        std::vector<char> removed(code.size(), 0);
+        for (size_t i = head; i <= tail; i++) removed[i] = 1;
+        ProgramEditor(program, isaSpec).erase(removed);
+
+        stats.full++;
+        stats.added += added;
+        report.passes = loop.passes;
+        report.added = added;
+        report.cycles = before - after;
+        return true;
+    }
+
+    // Give a loop ending in "B head" factor copies of its body, each with its own test; false if over room
+    bool unrollPartly(AssemblyResult& program, const Candidate& loop, long room, bool objectOutput, Loop& report) {
+        std::vector<uint32_t>& code = program.instructions;
+        size_t head = loop.head, tail = loop.tail, length = tail - head;
+        size_t factor = MAX_FACTOR;
+        if (loop.passes >= 0 && (size_t)loop.passes < factor) factor = (size_t)loop.passes;
+        while (factor >= 2 && (long)((factor - 1) * length) > room) factor--;
+        if (factor < 2) return false;
+        long saved = (long)(factor - 1) * IsaSpec::instructionCycles(isaSpec, code[tail]);
+
+        // Copies go ahead of the back edge, so branches to it (and the body's end) now reach the first copy
+        std::vector<std::vector<uint32_t>> before(code.size()), after(code.size());
+        for (size_t copy = 1; copy < factor; copy++) before[tail].insert(before[tail].end(), code.begin() + head, code.begin() + tail);
+        long added = (long)ProgramEditor(program, isaSpec).insert(before, after);
+        ProgramEditor grown(program, isaSpec);
+        long destination = loop.destination > (long)tail ? loop.destination + added : loop.destination;
+        for (size_t copy = 1; copy < factor; copy++) {
+            size_t first = tail + (copy - 1) * length;
+            for (size_t i = head; i < tail; i++) {
+                if (!isType(code[i], IsaSpec::InstructionType::TYPE_BRANCH)) continue;
+                long target = targetOf(code[i]) - (long)head + (long)first;  // Into the next copy for the back edge
+                grown.setCodeAddress(first + i - head, i == loop.exit ? destination : target, objectOutput);
+            }
+        }
+
+        stats.partial++;
+        stats.added += added;
+        report.passes = loop.passes;
+        report.factor = factor;
+        report.added = added;
+        report.cycles = saved;
+        return true;
+    }
+
+public:
+    explicit LoopUnroller(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Instructions the pass may add in all, 0 to unroll nothing
+    void setBudget(size_t instructions) { budget = instructions; }
+
+    // Unroll the program's counted loops in place, first to last while the budget lasts (and ROM output still
+    // fits 256 instructions); returns the number of loops unrolled
+    size_t optimize(AssemblyResult& program, bool objectOutput) {
+        stats = Stats();
+        std::vector<uint32_t>& code = program.instructions;
+        bool changed = budget > 0;
+        while (changed) {
+            changed = false;
+            long room = (long)budget - stats.added;
+            if (!objectOutput) room = std::min(room, 256 - (long)code.size());
+
+            ControlFlowGraph cfg(isaSpec);
+            cfg.build(program, objectOutput);
+            ProgramEditor editor(program, isaSpec);
+            for (size_t tail = 1; tail < code.size() && !changed; tail++) {
+                Candidate loop;
+                if (!findLoop(code, editor, cfg, tail, loop)) continue;
+                const std::string& label = cfg.getBlocks()[cfg.blockAt(loop.head)].label;
+                Loop report = {label.empty() ? "instruction " + std::to_string(loop.head) : label, -1, 0, 0, 0};
+                changed = (loop.passes >= 0 && unrollFully(program, loop, room, objectOutput, report)) ||
+                          (!loop.bottom && unrollPartly(program, loop, room, objectOutput, report));
+                if (changed) stats.loops.push_back(report);
+            }
+        }
+        return stats.full + stats.partial;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. POSIX builds memory-map the file; Windows
+// builds read it into a single buffer.
+class MappedFile {
+private:
+    bool opened = false;
+#ifdef _WIN32
+    std::string buffer;
+#else
+    void* mapping = nullptr;
+    size_t size = 0;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        opened = true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (::fstat(fd, &info) == 0) {
+            size = (size_t)info.st_size;
+            if (size == 0) {
+                opened = true;
+            } else {
+                void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED) {
+                    mapping = mapped;
+                    opened = true;
+                }
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapping) ::munmap(mapping, size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+
+    std::string_view view() const {
+#ifdef _WIN32
+        return buffer;
+#else
+        return mapping ? std::string_view((const char*)mapping, size) : std::string_view();
+#endif
+    }
+};
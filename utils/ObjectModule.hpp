@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Relocatable object module produced by "gct asm -c" and consumed by the linker.
+// Code addresses are relative to the start of the module; every immediate that
+// holds a code address is listed as a relocation and rewritten at link time.
+struct ObjectModule {
+    enum RelocationKind {
+        RELOC_BRANCH,    // BRANCH_I target
+        RELOC_ADDRESS    // Absolute code address materialized into a register (LR)
+    };
+
+    struct Symbol {
+        std::string name;
+        uint16_t offset;
+        bool global;     // Labels starting with '.' are local to the module
+    };
+
+    struct Relocation {
+        uint16_t index;       // Instruction whose immediate (bits 16-31) is patched
+        RelocationKind kind;
+        std::string symbol;   // Empty = the module's own base address
+        int32_t addend;
+    };
+
+    std::string source;
+    uint64_t buildKey = 0;  // Hash of the source, the assembler version and options it was built with
+    std::vector<uint32_t> code;
+    std::vector<Symbol> symbols;
+    std::vector<Relocation> relocations;
+
+    static constexpr int FORMAT_VERSION = 2;
+
+    bool writeToFile(const std::string& path, std::ostream& log = std::cerr) const {
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            log << "Error: Cannot write object '" << path << "'\n";
+            return false;
+        }
+        out << "GCT-OBJECT " << FORMAT_VERSION << "\n";
+        out << "source " << source << "\n";
+        out << "key " << std::hex << buildKey << std::dec << "\n";
+        out << "code " << code.size() << "\n" << std::hex;
+        for (uint32_t instr : code) out << instr << "\n";
+        out << std::dec << "symbols " << symbols.size() << "\n";
+        for (const auto& symbol : symbols) {
+            out << symbol.offset << " " << (symbol.global ? "global" : "local") << " " << symbol.name << "\n";
+        }
+        out << "relocations " << relocations.size() << "\n";
+        for (const auto& reloc : relocations) {
+            out << reloc.index << " " << (reloc.kind == RELOC_BRANCH ? "branch" : "address") << " "
+                << reloc.addend << " " << (reloc.symbol.empty() ? "-" : reloc.symbol) << "\n";
+        }
+        return (bool)out;
+    }
+
+    bool readFromFile(const std::string& path, std::ostream& log = std::cerr) {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            log << "Error: Cannot open object '" << path << "'\n";
+            return false;
+        }
+
+        // Names run to end of line (labels may contain spaces)
+        auto readRest = [&in](std::string& text) {
+            return in.get() == ' ' && (bool)std::getline(in, text);
+        };
+
+        std::string word;
+        int version = 0;
+        size_t count = 0;
+        bool ok = (in >> word >> version) && word == "GCT-OBJECT" && version == FORMAT_VERSION;
+        ok = ok && (in >> word) && word == "source" && readRest(source);
+        ok = ok && (in >> word >> std::hex >> buildKey >> std::dec) && word == "key";
+
+        code.clear();
+        ok = ok && (in >> word >> count) && word == "code";
+        for (size_t i = 0; ok && i < count; i++) {
+            uint32_t instr;
+            ok = (bool)(in >> std::hex >> instr >> std::dec);
+            code.push_back(instr);
+        }
+
+        symbols.clear();
+        ok = ok && (in >> word >> count) && word == "symbols";
+        for (size_t i = 0; ok && i < count; i++) {
+            Symbol symbol;
+            std::string scope;
+            ok = (in >> symbol.offset >> scope) && readRest(symbol.name);
+            symbol.global = (scope == "global");
+            symbols.push_back(symbol);
+        }
+
+        relocations.clear();
+        ok = ok && (in >> word >> count) && word == "relocations";
+        for (size_t i = 0; ok && i < count; i++) {
+            Relocation reloc;
+            std::string kind;
+            ok = (in >> reloc.index >> kind >> reloc.addend) && readRest(reloc.symbol);
+            reloc.kind = (kind == "branch") ? RELOC_BRANCH : RELOC_ADDRESS;
+            if (reloc.symbol == "-") reloc.symbol.clear();
+            relocations.push_back(reloc);
+        }
+
+        if (!ok) log << "Error: Malformed object file '" << path << "'\n";
+        return ok;
+    }
+};
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Machine outliner (-Os, and -O1 when a program would not fit the ROM):
+// instruction sequences that occur several times are moved into one shared
+// subroutine at the end of the program, called through a link register:
+//
+//   ADD X1, X1, X2                      MOV X7, .+2
+//   LSL X1, X1, 2                       B outlined
+//   PRINT X1, X3                        ...
+//   ...                            outlined:
+//                                       ADD X1, X1, X2
+//                                       LSL X1, X1, 2
+//                                       PRINT X1, X3
+//                                       B X7
+//
+// Repeats are found with a suffix array (and its LCP array) over the encoded
+// instruction stream, in which branches, EXIT and instructions holding code
+// addresses are unique separators. A sequence of L instructions outlined
+// from n places costs 2n + L + 1 instructions instead of nL, so it is only
+// outlined where that is smaller.
+//
+// The link register must be untouched by the sequence and dead after every
+// place it is taken from. The call's MOV may change the flags, so a sequence
+// that does not set them again must leave them dead too. Liveness follows
+// the register allocator's convention: the registers the program writes are
+// its results, live at EXIT; a register branch or a branch out of the module
+// may use anything. No label or code address may point inside a sequence,
+// and the program must end in a branch or EXIT so the subroutines can be
+// appended.
+class Outliner {
+public:
+    struct Stats {
+        size_t functions = 0;   // Subroutines created
+        size_t calls = 0;       // Sequences replaced by a call
+        size_t saved = 0;       // Instructions saved overall
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    Stats stats;
+
+    static constexpr size_t MIN_LENGTH = 3;  // Shorter sequences never pay for their call
+
+    struct Candidate {
+        size_t length;
+        std::vector<size_t> starts;  // Places it may be taken from, ascending
+        uint8_t touched;              // Registers the sequence reads or writes
+        long win;                     // Instructions saved taking all of starts
+    };
+
+    // Registers read and written, as RegisterAllocator sees them
+    void operands(uint32_t raw, uint8_t& uses, uint8_t& defs) const {
+        uses = defs = 0;
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        if (!tech) return;
+        bool move = tech->type == IsaSpec::InstructionType::TYPE_MOVE;
+        if (tech->flags.TRY_READ_A && !(move && tech->flags.IMMEDIATE)) uses |= 1 << ((raw >> 12) & 0x7);
+        if (tech->flags.TRY_READ_B && !tech->flags.IMMEDIATE && !move) uses |= 1 << ((raw >> 16) & 0x7);
+        if (tech->flags.TRY_WRITE) defs |= 1 << ((raw >> 8) & 0x7);
+    }
+
+    static long win(size_t length, size_t count) { return (long)(count * length) - (long)(2 * count + length + 1); }
+
+    // Suffix array of the token stream by prefix doubling, and the LCP of each suffix with the one before it
+    static void suffixArray(const std::vector<uint64_t>& tokens, std::vector<size_t>& sa, std::vector<size_t>& lcp) {
+        size_t n = tokens.size();
+        sa.resize(n);
+        std::vector<size_t> rank(n), next(n);
+        for (size_t i = 0; i < n; i++) sa[i] = i;
+        std::sort(sa.begin(), sa.end(), [&](size_t a, size_t b) { return tokens[a] < tokens[b]; });
+        for (size_t i = 0; i < n; i++) rank[sa[i]] = (i > 0 && tokens[sa[i]] == tokens[sa[i - 1]]) ? rank[sa[i - 1]] : i;
+
+        for (size_t k = 1; k < n; k *= 2) {
+            auto key = [&](size_t i) { return std::make_pair(rank[i], i + k < n ? (long)rank[i + k] : -1L); };
+            std::sort(sa.begin(), sa.end(), [&](size_t a, size_t b) { return key(a) < key(b); });
+            next[sa[0]] = 0;
+            bool distinct = true;
+            for (size_t i = 1; i < n; i++) {
+                bool tied = key(sa[i]) == key(sa[i - 1]);
+                next[sa[i]] = tied ? next[sa[i - 1]] : i;
+                distinct = distinct && !tied;
+            }
+            rank.swap(next);
+            if (distinct) break;
+        }
+
+        // Kasai
+        lcp.assign(n, 0);
+        size_t h = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (rank[i] == 0) {
+                h = 0;
+                continue;
+            }
+            size_t j = sa[rank[i] - 1];
+            while (i + h < n && j + h < n && tokens[i + h] == tokens[j + h]) h++;
+            lcp[rank[i]] = h;
+            if (h > 0) h--;
+        }
+    }
+
+    // Per instruction: registers that may be used after it
+    void liveness(const std::vector<uint32_t>& code, const ProgramEditor& editor, std::vector<uint8_t>& registersAfter) const {
+        size_t n = code.size();
+        uint8_t results = 0;
+        for (uint32_t raw : code) {
+            uint8_t uses, defs;
+            operands(raw, uses, defs);
+            results |= defs;
+        }
+
+        // Successors of each instruction; unknown = control may go anywhere
+        std::vector<std::vector<size_t>> successors(n);
+        std::vector<char> unknown(n, 0), exits(n, 0);
+        for (size_t i = 0; i < n; i++) {
+            const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, code[i]);
+            if (!tech) {
+                unknown[i] = 1;
+                continue;
+            }
+            if (tech->type == IsaSpec::InstructionType::TYPE_SERVICE) {
+                exits[i] = 1;
+                continue;
+            }
+            bool fallsThrough = true;
+            if (tech->type == IsaSpec::InstructionType::TYPE_BRANCH) {
+                fallsThrough = Semantics::conditionOf(code[i]) != 0;
+                size_t target = code[i] >> 16;
+                if (!tech->flags.IMMEDIATE || editor.isExternal(i) || target >= n) unknown[i] = 1;
+                else successors[i].push_back(target);
+            }
+            if (fallsThrough) {
+                if (i + 1 < n) successors[i].push_back(i + 1);
+                else unknown[i] = 1;
+            }
+        }
+
+        // Backward to a fixed point; live only grows
+        std::vector<uint8_t> registersBefore(n, 0);
+        registersAfter.assign(n, 0);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = n; i-- > 0;) {
+                uint8_t live = unknown[i] ? 0xFF : (exits[i] ? results : 0);
+                for (size_t s : successors[i]) live |= registersBefore[s];
+                registersAfter[i] = live;
+
+                uint8_t uses, defs;
+                operands(code[i], uses, defs);
+                uint8_t before = (uint8_t)((live & ~defs) | uses);
+                if (before != registersBefore[i]) {
+                    registersBefore[i] = before;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Link register for a candidate's starts that saves the most, with the starts it allows (non-overlapping)
+    long chooseRegister(const Candidate& candidate, const std::vector<uint8_t>& registersAfter,
+                        const std::vector<char>& taken, int& reg, std::vector<size_t>& chosen) const {
+        long best = 0;
+        reg = -1;
+        for (int r = 0; r < 8; r++) {
+            if (candidate.touched & (1 << r)) continue;
+            std::vector<size_t> starts;
+            size_t free = 0;
+            for (size_t p : candidate.starts) {
+                if (p < free || (registersAfter[p + candidate.length - 1] & (1 << r))) continue;
+                bool clear = true;
+                for (size_t i = p; i < p + candidate.length && clear; i++) clear = !taken[i];
+                if (!clear) continue;
+                starts.push_back(p);
+                free = p + candidate.length;
+            }
+            long saved = starts.size() >= 2 ? win(candidate.length, starts.size()) : 0;
+            if (saved > best) {
+                best = saved;
+                reg = r;
+                chosen = std::move(starts);
+            }
+        }
+        return best;
+    }
+
+public:
+    explicit Outliner(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Outline repeated sequences of an assembled program in place, returns the number of instructions saved
+    size_t optimize(AssemblyResult& program, bool objectOutput) {
+        stats = Stats();
+        std::vector<uint32_t>& code = program.instructions;
+        size_t n = code.size();
+        if (n < 2 * MIN_LENGTH) return 0;
+
+        // Subroutines go after the last instruction, so nothing may run or jump past it
+        const IsaSpec::InstructionTech* last = Semantics::techOf(isaSpec, code[n - 1]);
+        bool ends = last && (last->type == IsaSpec::InstructionType::TYPE_SERVICE ||
+                             (last->type == IsaSpec::InstructionType::TYPE_BRANCH && Semantics::conditionOf(code[n - 1]) == 0));
+        if (!ends) return 0;
+
+        ProgramEditor editor(program, isaSpec);
+        std::vector<char> join(n + 1, 0);
+        for (const auto& symbol : program.symbols) {
+            if (symbol.address <= n) join[symbol.address] = 1;
+        }
+        for (const auto& address : editor.getCodeAddresses()) {
+            if (address.target >= 0 && (size_t)address.target <= n) join[address.target] = 1;
+        }
+        if (join[n]) return 0;
+
+        std::vector<uint8_t> registersAfter;
+        liveness(code, editor, registersAfter);
+        std::vector<uint8_t> flagsAfter = editor.flagsLiveAfter();
+
+        // Token stream: outlinable instructions by encoding, anything else unique
+        std::vector<uint64_t> tokens(n);
+        for (size_t i = 0; i < n; i++) {
+            const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, code[i]);
+            bool outlinable = tech && tech->type != IsaSpec::InstructionType::TYPE_BRANCH &&
+                              tech->type != IsaSpec::InstructionType::TYPE_SERVICE && !editor.isPinned(i);
+            tokens[i] = outlinable ? code[i] : (1ull << 32) + i;
+        }
+        std::vector<size_t> sa, lcp;
+        suffixArray(tokens, sa, lcp);
+
+        // Every run of suffixes sharing at least length instructions is a candidate
+        std::vector<size_t> joinsBefore(n + 1, 0);
+        for (size_t i = 0; i < n; i++) joinsBefore[i + 1] = joinsBefore[i] + join[i];
+        size_t longest = *std::max_element(lcp.begin(), lcp.end());
+        std::vector<Candidate> candidates;
+        for (size_t length = MIN_LENGTH; length <= longest; length++) {
+            for (size_t k = 1; k < n; k++) {
+                if (lcp[k] < length || (k > 1 && lcp[k - 1] >= length)) continue;
+                std::vector<size_t> run = {sa[k - 1]};
+                for (size_t j = k; j < n && lcp[j] >= length; j++) run.push_back(sa[j]);
+
+                Candidate candidate = {length, {}, 0, 0};
+                bool resetsFlags = false;
+                for (size_t i = run[0]; i < run[0] + length; i++) {
+                    uint8_t uses, defs;
+                    operands(code[i], uses, defs);
+                    candidate.touched |= uses | defs;
+                    resetsFlags = resetsFlags || Semantics::flagsLiveBefore(isaSpec, code[i], Semantics::FLAGS_ALL) == 0;
+                }
+                std::sort(run.begin(), run.end());
+                for (size_t p : run) {
+                    size_t end = p + length;
+                    if (joinsBefore[end] - joinsBefore[p + 1] > 0) continue;
+                    if (!resetsFlags && flagsAfter[end - 1]) continue;
+                    candidate.starts.push_back(p);
+                }
+                int reg;
+                std::vector<size_t> chosen;
+                candidate.win = chooseRegister(candidate, registersAfter, std::vector<char>(n, 0), reg, chosen);
+                if (candidate.win > 0) candidates.push_back(std::move(candidate));
+            }
+        }
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const Candidate& a, const Candidate& b) { return a.win > b.win; });
+
+        // Greedily, best first, dropping the starts an earlier choice already took
+        uint32_t mov = IsaSpec::findOpcode(isaSpec, "MOV", IsaSpec::InstructionType::TYPE_MOVE, true);
+        uint32_t branch = IsaSpec::findOpcode(isaSpec, "B", IsaSpec::InstructionType::TYPE_BRANCH, true);
+        uint32_t branchRegister = IsaSpec::findOpcode(isaSpec, "B", IsaSpec::InstructionType::TYPE_BRANCH, false);
+        std::vector<char> taken(n, 0), removed(n, 0);
+        std::vector<std::vector<uint32_t>> bodies;
+        std::vector<std::pair<size_t, size_t>> calls;  // Call site (old index), subroutine
+        for (const Candidate& candidate : candidates) {
+            int reg;
+            std::vector<size_t> chosen;
+            if (chooseRegister(candidate, registersAfter, taken, reg, chosen) <= 0) continue;
+
+            std::vector<uint32_t> body(code.begin() + chosen[0], code.begin() + chosen[0] + candidate.length);
+            body.push_back(branchRegister | ((uint32_t)reg << 16));
+            for (size_t p : chosen) {
+                for (size_t i = p; i < p + candidate.length; i++) {
+                    taken[i] = 1;
+                    removed[i] = i >= p + 2;
+                }
+                code[p] = mov | ((uint32_t)reg << 8);
+                code[p + 1] = branch;
+                calls.push_back({p, bodies.size()});
+            }
+            stats.functions++;
+            stats.calls += chosen.size();
+            stats.saved += win(candidate.length, chosen.size());
+            bodies.push_back(std::move(body));
+        }
+        if (bodies.empty()) return 0;
+
+        // Delete the outlined instructions, append the subroutines, then point the calls at them
+        std::vector<size_t> newIndex(n);
+        size_t kept = 0;
+        for (size_t i = 0; i < n; i++) {
+            newIndex[i] = kept;
+            if (!removed[i]) kept++;
+        }
+        editor.erase(removed);
+        std::vector<size_t> starts;
+        for (const auto& body : bodies) {
+            starts.push_back(code.size());
+            code.insert(code.end(), body.begin(), body.end());
+        }
+        ProgramEditor linked(program, isaSpec);
+        for (const auto& call : calls) {
+            size_t site = newIndex[call.first];
+            linked.setCodeAddress(site, (long)site + 2, objectOutput);
+            linked.setCodeAddress(site + 1, (long)starts[call.second], objectOutput);
+        }
+        return stats.saved;
+    }
+};
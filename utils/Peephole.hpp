@@ -0,0 +1,313 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ProgramEditor.hpp"
+#include "RewriteDatabase.hpp"
+#include "Semantics.hpp"
+
+// Peephole optimizer (-O1) over an assembled program: decodes each instruction
+// through the ISA spec, deletes or rewrites redundant sequences, then moves
+// branch targets, labels, address operands and relocations to the new layout
+// (ProgramEditor).
+//
+//   MOV Xn, Xn                   deleted
+//   ADD Xn, Xn, 0 (and friends)  deleted
+//   MOV Xa, Xb / MOV Xc, Xa      second becomes MOV Xc, Xb
+//   write to a register that is overwritten before any read: deleted
+//   CMP whose flags are set again before any branch tests them: deleted
+//   ALU op into Xn / CMP Xn, 0   CMP deleted if later branches only test N and Z
+//   sequence in the rewrite database (setRewrites, from gct superopt): replaced
+//
+// Register reads and writes come from the TRY_READ_A/TRY_READ_B/TRY_WRITE
+// flags. ALU ops and CMP set the condition flags, ALU ops from their result;
+// MOV is assumed to possibly set them too, so deleting an ALU op or MOV needs
+// its flags to be dead. Instructions that hold or adjust a code address are
+// never touched.
+class PeepholeOptimizer {
+public:
+    struct Stats {
+        size_t selfMoves = 0;
+        size_t identities = 0;
+        size_t copies = 0;        // MOV chains shortened
+        size_t deadWrites = 0;
+        size_t compares = 0;      // CMP Xn, 0 after an ALU op
+        size_t deadCompares = 0;  // CMP never tested
+        size_t rewrites = 0;      // Sequences replaced from the rewrite database
+        size_t rewritten = 0;     // Instructions those replacements saved
+
+        size_t removed() const { return selfMoves + identities + deadWrites + compares + deadCompares + rewritten; }
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    const RewriteDatabase* rewrites = nullptr;
+
+    struct Decoded {
+        uint32_t raw;
+        const IsaSpec::InstructionTech* tech;  // nullptr for unknown opcodes
+        uint8_t dst, a, b;
+        uint16_t imm;
+        uint8_t condition;
+        bool join = false;     // Reached other than by falling through (label, branch target, code address)
+        bool pinned = false;   // Holds or adjusts a code address, never touched
+        bool external = false; // Branch to a label in another module (object output)
+        bool removed = false;
+    };
+    std::vector<Decoded> code;
+    Stats stats;
+
+    enum Visit { VISIT_CONTINUE, VISIT_STOP, VISIT_FAIL };
+
+    void decode(Decoded& d) const {
+        d.tech = Semantics::techOf(isaSpec, d.raw);
+        d.dst = (d.raw >> 8) & 0x7;
+        d.a = (d.raw >> 12) & 0x7;
+        d.b = (d.raw >> 16) & 0xF;
+        d.imm = (uint16_t)(d.raw >> 16);
+        d.condition = Semantics::conditionOf(d.raw);
+    }
+
+    bool isType(const Decoded& d, IsaSpec::InstructionType type) const { return d.tech && d.tech->type == type; }
+    bool is(const Decoded& d, std::string_view mnemonic, bool immediate) const {
+        return d.tech && d.tech->mnemonic == mnemonic && d.tech->flags.IMMEDIATE == immediate;
+    }
+
+    bool reads(const Decoded& d, int reg) const {
+        if (!d.tech) return true;
+        if (d.tech->flags.TRY_READ_A && d.a == reg) return true;
+        return d.tech->flags.TRY_READ_B && !d.tech->flags.IMMEDIATE && d.b == reg;
+    }
+    bool writes(const Decoded& d, int reg) const { return d.tech && d.tech->flags.TRY_WRITE && d.dst == reg; }
+
+    // Next live instruction at or after index, code.size() past the end
+    size_t liveAt(size_t index) const {
+        while (index < code.size() && code[index].removed) index++;
+        return index;
+    }
+
+    // Visit every instruction reachable from index's successors until each path stops;
+    // false if a path fails, runs past the end, or leaves through a register branch or to another module
+    template <typename Visitor>
+    bool allPaths(size_t index, Visitor visit) const {
+        std::vector<char> seen(code.size(), 0);
+        std::vector<size_t> pending;
+        auto successors = [&](size_t i) {
+            const Decoded& d = code[i];
+            if (isType(d, IsaSpec::InstructionType::TYPE_SERVICE)) return true;
+            if (isType(d, IsaSpec::InstructionType::TYPE_BRANCH)) {
+                if (!d.tech->flags.IMMEDIATE || d.external) return false;
+                pending.push_back(liveAt(d.imm));
+                if (d.condition == 0) return true;
+            }
+            pending.push_back(liveAt(i + 1));
+            return true;
+        };
+
+        if (!successors(index)) return false;
+        while (!pending.empty()) {
+            size_t j = pending.back();
+            pending.pop_back();
+            if (j >= code.size()) return false;
+            if (seen[j]) continue;
+            seen[j] = 1;
+            Visit result = visit(code[j]);
+            if (result == VISIT_FAIL) return false;
+            if (result == VISIT_CONTINUE && !successors(j)) return false;
+        }
+        return true;
+    }
+
+    // Registers stay visible after EXIT, so a value that reaches it is live
+    bool registerDeadAfter(size_t index, int reg) const {
+        return allPaths(index, [&](const Decoded& d) {
+            if (reads(d, reg) || isType(d, IsaSpec::InstructionType::TYPE_SERVICE)) return VISIT_FAIL;
+            return writes(d, reg) ? VISIT_STOP : VISIT_CONTINUE;
+        });
+    }
+
+    // A branch may test one of flags after index before they are set again (Semantics::flagsLiveBefore);
+    // stopAtMove takes a MOV to set them as well
+    bool flagsTestedAfter(size_t index, uint8_t flags, bool stopAtMove = false) const {
+        return !allPaths(index, [&](const Decoded& d) {
+            if (Semantics::flagsLiveBefore(isaSpec, d.raw, 0) & flags) return VISIT_FAIL;
+            if (Semantics::flagsLiveBefore(isaSpec, d.raw, flags) == 0) return VISIT_STOP;
+            if (stopAtMove && isType(d, IsaSpec::InstructionType::TYPE_MOVE)) return VISIT_STOP;
+            return VISIT_CONTINUE;
+        });
+    }
+
+    // The flags an instruction may set are never tested before being set again
+    bool flagsDeadAfter(size_t index) const {
+        const Decoded& removed = code[index];
+        if (!isType(removed, IsaSpec::InstructionType::TYPE_ALU) && !isType(removed, IsaSpec::InstructionType::TYPE_MOVE)) return true;
+        // A later MOV sets the flags exactly when MOV sets them at all
+        return !flagsTestedAfter(index, Semantics::FLAGS_ALL, isType(removed, IsaSpec::InstructionType::TYPE_MOVE));
+    }
+
+    // ALU immediate that leaves its source unchanged (ADD Xd, Xa, 0, AND Xd, Xa, 0xFFFF, ...)
+    bool isIdentity(const Decoded& d) const {
+        if (!isType(d, IsaSpec::InstructionType::TYPE_ALU) || !d.tech->flags.IMMEDIATE) return false;
+        const std::string& op = d.tech->mnemonic;
+        if (op == "ADD" || op == "SUB" || op == "OR" || op == "XOR" || op == "LSL" || op == "LSR") return d.imm == 0;
+        if (op == "AND") return d.imm == 0xFFFF;
+        if (op == "UMUL_L" || op == "MUL_L") return d.imm == 1;
+        return false;
+    }
+
+    // A real ALU result (not a reserved opcode) written to dst
+    bool setsFlagsFromResult(const Decoded& d) const {
+        return isType(d, IsaSpec::InstructionType::TYPE_ALU) && d.tech->mnemonic.compare(0, 3, "NUL") != 0;
+    }
+
+    void remove(size_t index, size_t& counter) {
+        code[index].removed = true;
+        counter++;
+    }
+
+    // Replace the window of live instructions from first that matches a rewrite: only first may be a join,
+    // scratch registers must be dead after the window and the flags it changes unused
+    bool applyRewrite(size_t first) {
+        std::vector<size_t> window = {first};
+        std::vector<uint32_t> raws = {code[first].raw};
+        std::vector<uint32_t> replacement;
+        for (const RewriteDatabase::Rewrite& rewrite : rewrites->rewrites) {
+            size_t length = rewrite.pattern.size();
+            while (window.size() < length) {
+                size_t next = liveAt(window.back() + 1);
+                if (next >= code.size() || code[next].join || code[next].pinned) break;
+                window.push_back(next);
+                raws.push_back(code[next].raw);
+            }
+            if (window.size() < length) continue;
+
+            size_t last = window[length - 1];
+            auto isFree = [&](int reg) { return registerDeadAfter(last, reg); };
+            if (!RewriteDatabase::match(isaSpec, rewrite, raws.data(), replacement, isFree)) continue;
+            uint8_t clobbered = rewrite.flags == RewriteDatabase::FLAGS_NZ ? Semantics::FLAG_C | Semantics::FLAG_V : Semantics::FLAGS_ALL;
+            if (flagsTestedAfter(last, clobbered)) continue;
+
+            for (size_t k = 0; k < length; k++) {
+                if (k < replacement.size()) {
+                    code[window[k]].raw = replacement[k];
+                    decode(code[window[k]]);
+                } else {
+                    remove(window[k], stats.rewritten);
+                }
+            }
+            stats.rewrites++;
+            return true;
+        }
+        return false;
+    }
+
+    // One sweep over the program, true if anything changed
+    bool sweep() {
+        bool changed = false;
+        for (size_t i = 0; i < code.size(); i++) {
+            Decoded& d = code[i];
+            if (d.removed || d.pinned || !d.tech) continue;
+            size_t next = liveAt(i + 1);
+
+            // MOV Xn, Xn
+            if (is(d, "MOV", false) && d.dst == d.a && flagsDeadAfter(i)) {
+                remove(i, stats.selfMoves);
+                changed = true;
+                continue;
+            }
+
+            // ADD Xn, Xn, 0 and other identities in place
+            if (isIdentity(d) && d.dst == d.a && flagsDeadAfter(i)) {
+                remove(i, stats.identities);
+                changed = true;
+                continue;
+            }
+
+            // MOV Xa, Xb followed by MOV Xc, Xa: copy from Xb directly
+            if (is(d, "MOV", false) && d.dst != d.a && next < code.size()) {
+                Decoded& n = code[next];
+                if (!n.join && !n.pinned && is(n, "MOV", false) && n.a == d.dst) {
+                    n.raw = (n.raw & ~(0x7u << 12)) | ((uint32_t)d.a << 12);
+                    decode(n);
+                    stats.copies++;
+                    changed = true;
+                }
+            }
+
+            // Result overwritten before any read
+            if ((isType(d, IsaSpec::InstructionType::TYPE_ALU) || isType(d, IsaSpec::InstructionType::TYPE_MOVE)) &&
+                d.tech->flags.TRY_WRITE && registerDeadAfter(i, d.dst) && flagsDeadAfter(i)) {
+                remove(i, stats.deadWrites);
+                changed = true;
+                continue;
+            }
+
+            // CMP whose flags no branch tests
+            if (isType(d, IsaSpec::InstructionType::TYPE_CMP) && !flagsTestedAfter(i, Semantics::FLAGS_ALL)) {
+                remove(i, stats.deadCompares);
+                changed = true;
+                continue;
+            }
+
+            // ALU op into Xn, then CMP Xn, 0 that only feeds N/Z tests: the two set N and Z alike, but CMP Xn, 0
+            // clears C and V where ADD or SUB may set them, and the signed comparisons test V
+            if (setsFlagsFromResult(d) && next < code.size()) {
+                Decoded& n = code[next];
+                if (!n.join && !n.pinned && is(n, "CMP", true) && n.imm == 0 && n.a == d.dst &&
+                    !flagsTestedAfter(next, Semantics::FLAG_C | Semantics::FLAG_V)) {
+                    remove(next, stats.compares);
+                    changed = true;
+                }
+            }
+
+            // Sequence with a cheaper equivalent in the rewrite database
+            if (rewrites && applyRewrite(i)) changed = true;
+        }
+        return changed;
+    }
+
+public:
+    explicit PeepholeOptimizer(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Rewrite database to apply as well, nullptr for none; must outlive optimize()
+    void setRewrites(const RewriteDatabase* database) { rewrites = database; }
+
+    // Optimize an assembled program in place, returns the number of instructions removed
+    size_t optimize(AssemblyResult& program) {
+        stats = Stats();
+        size_t oldSize = program.instructions.size();
+        code.assign(oldSize, Decoded());
+        for (size_t i = 0; i < oldSize; i++) {
+            code[i].raw = program.instructions[i];
+            decode(code[i]);
+        }
+
+        ProgramEditor editor(program, isaSpec);
+        for (size_t i = 0; i < oldSize; i++) {
+            code[i].pinned = editor.isPinned(i);
+            code[i].external = editor.isExternal(i);
+        }
+
+        // Every place control can arrive at other than by falling through
+        auto markJoin = [&](long address) {
+            if (address >= 0 && (size_t)address < oldSize) code[address].join = true;
+        };
+        for (const auto& symbol : program.symbols) markJoin(symbol.address);
+        for (const auto& address : editor.getCodeAddresses()) markJoin(address.target);
+
+        while (sweep()) {}
+
+        std::vector<char> removed(oldSize, 0);
+        for (size_t i = 0; i < oldSize; i++) {
+            program.instructions[i] = code[i].raw;
+            removed[i] = code[i].removed;
+        }
+        return editor.erase(removed);
+    }
+};
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "AsmExpression.hpp"
+#include "Assembler.hpp"
+#include "Semantics.hpp"
+
+// Code addresses held in an assembled program, and edits (branch retargeting,
+// deletion, insertion and reordering of instructions) that keep every one of
+// them pointing at the right code. Shared by the optimizer passes and register
+// allocation.
+//
+// A code address is a numeric BRANCH_I target, an address operand of the
+// form "label + constant" or ". + constant" (labels, '.', LR), or LR followed
+// by ADD/SUB Xn, Xn, constant, whose sum is the return address. Plain numbers
+// loaded into a register for "B Xn" are not known to be code addresses and
+// are not moved.
+//
+// The editor follows its own retargets, but otherwise describes the program
+// as it was when constructed: make a new one after each erase(), insert() or
+// reorder().
+class ProgramEditor {
+public:
+    struct CodeAddress {
+        size_t index;      // Instruction holding the address (the LR of an LR/ADD pair, addressing the sum)
+        long target;       // Instruction addressed, -1 for a label in another module
+        bool branch;       // BRANCH_I target, rather than a value loaded into a register
+    };
+
+private:
+    AssemblyResult& program;
+    const IsaSpec::ISA_SPEC& isaSpec;
+
+    std::vector<AsmExpressionValue> operandValues;  // Per address operand, as assembled
+    std::vector<long> partners;                      // Per address operand: ADD/SUB completing an LR, or -1
+    std::vector<long> operandOf;                     // Per instruction: its address operand, or -1
+    std::vector<char> hasOperand;
+    std::vector<char> pinned;
+    std::vector<char> external;
+    std::vector<CodeAddress> addresses;
+
+    bool isBranchImmediate(uint32_t raw) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, raw);
+        return tech && tech->type == IsaSpec::InstructionType::TYPE_BRANCH && tech->flags.IMMEDIATE;
+    }
+
+    // LR Xn (MOV Xn, .) or MOV Xn, label at index, then ADD/SUB Xn, Xn, k
+    bool isAdjustment(size_t index, size_t next) const {
+        if (next >= program.instructions.size()) return false;
+        const IsaSpec::InstructionTech* mov = Semantics::techOf(isaSpec, program.instructions[index]);
+        const IsaSpec::InstructionTech* alu = Semantics::techOf(isaSpec, program.instructions[next]);
+        if (!mov || !alu || mov->type != IsaSpec::InstructionType::TYPE_MOVE || !mov->flags.IMMEDIATE) return false;
+        if (alu->type != IsaSpec::InstructionType::TYPE_ALU || !alu->flags.IMMEDIATE) return false;
+        if (alu->mnemonic != "ADD" && alu->mnemonic != "SUB") return false;
+        uint32_t dst = (program.instructions[index] >> 8) & 0x7;
+        uint32_t raw = program.instructions[next];
+        return ((raw >> 8) & 0x7) == dst && ((raw >> 12) & 0x7) == dst;
+    }
+
+    long lookup(std::string_view name) const {
+        for (const auto& symbol : program.symbols) {
+            if (symbol.name == name) return symbol.address;
+        }
+        return -1;
+    }
+
+    AsmExpressionValue evaluate(const std::string& expression, int pc) const {
+        AsmExpressionValue value;
+        evaluateAsmExpression(expression, pc, [this](std::string_view name) { return (int)lookup(name); }, value);
+        return value;
+    }
+
+    static void setImmediate(uint32_t& raw, long value) { raw = (raw & 0xFFFF) | ((uint32_t)(value & 0xFFFF) << 16); }
+
+    static std::string relativeExpression(long offset) {
+        return offset == 0 ? "." : (offset > 0 ? ".+" : ".-") + std::to_string(offset > 0 ? offset : -offset);
+    }
+
+    // Move the program to a new layout: remap(old) is where code address old
+    // now is, newIndex[i] where instruction i went. The instructions themselves
+    // are not moved here.
+    template <typename Remap>
+    void relocate(Remap remap, const std::vector<uint16_t>& newIndex, const std::vector<char>& removed) {
+        std::vector<uint32_t>& code = program.instructions;
+        std::vector<AsmSymbol> oldSymbols = program.symbols;
+        for (auto& symbol : program.symbols) symbol.address = (uint16_t)remap(symbol.address);
+
+        // Numeric branch targets
+        for (size_t i = 0; i < code.size(); i++) {
+            if (!removed[i] && !hasOperand[i] && isBranchImmediate(code[i])) setImmediate(code[i], remap(code[i] >> 16));
+        }
+
+        // Address operands keep pointing at the same instruction; other label arithmetic is re-evaluated
+        std::vector<AsmAddressOperand> operands;
+        for (size_t k = 0; k < program.addressOperands.size(); k++) {
+            AsmAddressOperand& operand = program.addressOperands[k];
+            if (removed[operand.index]) continue;
+            const AsmExpressionValue& old = operandValues[k];
+            uint32_t& raw = code[operand.index];
+            long index = newIndex[operand.index];
+            long value;
+            std::string expression = operand.expression;
+            if (old.isAddress()) {
+                if (old.unresolved) value = raw >> 16;  // External label, left to the linker
+                else value = remap(old.value);
+                if (old.pcRelative) expression = relativeExpression(value - index);
+            } else {
+                value = evaluate(operand.expression, (int)index).value;
+            }
+            setImmediate(raw, value);
+
+            long next = partners[k];
+            if (next >= 0 && !removed[next]) {
+                bool add = Semantics::techOf(isaSpec, code[next])->mnemonic == "ADD";
+                long k2 = code[next] >> 16;
+                long target = remap((add ? old.value + k2 : old.value - k2) & 0xFFFF);  // 16-bit wraparound
+                setImmediate(code[next], add ? target - value : value - target);
+            }
+            operands.push_back({(size_t)index, expression});
+        }
+        program.addressOperands = std::move(operands);
+
+        // Object output: relocations move with their instruction and target
+        std::vector<ObjectModule::Relocation> relocations;
+        for (auto reloc : program.relocations) {
+            if (removed[reloc.index]) continue;
+            if (reloc.symbol.empty()) {
+                reloc.addend = (int32_t)remap(reloc.addend);
+            } else {
+                long offset = -1;
+                for (const auto& symbol : oldSymbols) {
+                    if (symbol.name == reloc.symbol) offset = symbol.address;
+                }
+                if (offset >= 0) reloc.addend = (int32_t)(remap(offset + reloc.addend) - remap(offset));
+            }
+            reloc.index = newIndex[reloc.index];
+            relocations.push_back(reloc);
+        }
+        program.relocations = std::move(relocations);
+    }
+
+    // Give the instruction at index a new address operand (or replace its old one)
+    void setOperand(size_t index, const std::string& expression) {
+        long k = operandOf[index];
+        if (k < 0) {
+            k = (long)program.addressOperands.size();
+            program.addressOperands.push_back({index, expression});
+            operandValues.push_back(AsmExpressionValue());
+            partners.push_back(-1);
+            operandOf[index] = k;
+        } else {
+            program.addressOperands[k].expression = expression;
+        }
+        operandValues[k] = evaluate(expression, (int)index);
+        hasOperand[index] = 1;
+        pinned[index] = 1;
+        external[index] = operandValues[k].unresolved;
+        setImmediate(program.instructions[index], operandValues[k].value);
+        for (auto& address : addresses) {
+            if (address.index == index && address.branch) address.target = external[index] ? -1 : operandValues[k].value;
+        }
+    }
+
+    ObjectModule::Relocation* relocationAt(size_t index) {
+        for (auto& reloc : program.relocations) {
+            if (reloc.index == index) return &reloc;
+        }
+        return nullptr;
+    }
+
+public:
+    ProgramEditor(AssemblyResult& assembled, const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec())
+        : program(assembled), isaSpec(spec) {
+        size_t size = program.instructions.size();
+        hasOperand.assign(size, 0);
+        pinned.assign(size, 0);
+        external.assign(size, 0);
+        operandOf.assign(size, -1);
+        for (size_t k = 0; k < program.addressOperands.size(); k++) {
+            hasOperand[program.addressOperands[k].index] = 1;
+            operandOf[program.addressOperands[k].index] = (long)k;
+        }
+
+        for (const auto& operand : program.addressOperands) {
+            operandValues.push_back(evaluate(operand.expression, (int)operand.index));
+            const AsmExpressionValue& value = operandValues.back();
+            pinned[operand.index] = 1;
+            external[operand.index] = value.unresolved;
+            partners.push_back(-1);
+
+            if (!value.isAddress()) continue;
+            bool branch = isBranchImmediate(program.instructions[operand.index]);
+            addresses.push_back({operand.index, value.unresolved ? -1 : value.value, branch});
+
+            // LR Xn / ADD Xn, Xn, k: the return address is the sum
+            size_t next = operand.index + 1;
+            if (!branch && !value.unresolved && next < size && !hasOperand[next] && isAdjustment(operand.index, next)) {
+                partners.back() = (long)next;
+                pinned[next] = 1;
+                uint32_t raw = program.instructions[next];
+                long k = raw >> 16;
+                bool add = Semantics::techOf(isaSpec, raw)->mnemonic == "ADD";
+                addresses.back().target = (add ? value.value + k : value.value - k) & 0xFFFF;
+            }
+        }
+
+        for (size_t i = 0; i < size; i++) {
+            if (!hasOperand[i] && isBranchImmediate(program.instructions[i])) {
+                addresses.push_back({i, (long)(program.instructions[i] >> 16), true});
+            }
+        }
+    }
+
+    const std::vector<CodeAddress>& getCodeAddresses() const { return addresses; }
+
+    // Holds or adjusts a code address, rewriting it would break the address
+    bool isPinned(size_t index) const { return pinned[index]; }
+    // Branch or address operand naming a label in another module (object output)
+    bool isExternal(size_t index) const { return external[index]; }
+
+    // Per instruction: the flags a branch may test before they are set again (Semantics::flagsLiveBefore).
+    // A register branch, a branch to another module or running past the end may lead to any test, EXIT to none.
+    std::vector<uint8_t> flagsLiveAfter() const {
+        const std::vector<uint32_t>& code = program.instructions;
+        size_t size = code.size();
+        std::vector<uint8_t> before(size, 0), after(size, 0);
+        auto liveAt = [&](size_t i) { return i < size ? before[i] : Semantics::FLAGS_ALL; };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = size; i-- > 0;) {
+                const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, code[i]);
+                uint8_t out = 0;
+                if (!tech) {
+                    out = Semantics::FLAGS_ALL;
+                } else if (tech->type == IsaSpec::InstructionType::TYPE_BRANCH) {
+                    out = tech->flags.IMMEDIATE && !external[i] ? liveAt(code[i] >> 16) : Semantics::FLAGS_ALL;
+                    if (Semantics::conditionOf(code[i]) != 0) out |= liveAt(i + 1);
+                } else if (tech->type != IsaSpec::InstructionType::TYPE_SERVICE) {
+                    out = liveAt(i + 1);
+                }
+                uint8_t in = Semantics::flagsLiveBefore(isaSpec, code[i], out);
+                if (in != before[i] || out != after[i]) {
+                    before[i] = in;
+                    after[i] = out;
+                    changed = true;
+                }
+            }
+        }
+        return after;
+    }
+
+    // Make the BRANCH_I at index go to target, an instruction of this program.
+    // A label operand becomes ". + offset" (and its relocation module-relative),
+    // a numeric target stays numeric.
+    void setBranchTarget(size_t index, long target) {
+        if (!hasOperand[index]) {
+            setImmediate(program.instructions[index], target);
+            for (auto& address : addresses) {
+                if (address.index == index && address.branch) address.target = target;
+            }
+            return;
+        }
+        setOperand(index, relativeExpression(target - (long)index));
+        if (ObjectModule::Relocation* reloc = relocationAt(index)) *reloc = {(uint16_t)index, ObjectModule::RELOC_BRANCH, "", (int32_t)target};
+    }
+
+    // Give the BRANCH_I or MOV_I at index the address operand ". + offset" to
+    // target, an instruction of this program (or its end). In object output
+    // it also gets the module-relative relocation that goes with it.
+    void setCodeAddress(size_t index, long target, bool objectOutput) {
+        setOperand(index, relativeExpression(target - (long)index));
+        if (!objectOutput) return;
+        bool branch = isBranchImmediate(program.instructions[index]);
+        ObjectModule::Relocation reloc = {(uint16_t)index, branch ? ObjectModule::RELOC_BRANCH : ObjectModule::RELOC_ADDRESS, "", (int32_t)target};
+        if (ObjectModule::Relocation* existing = relocationAt(index)) *existing = reloc;
+        else program.relocations.push_back(reloc);
+    }
+
+    // Make the BRANCH_I at index go wherever the BRANCH_I at source goes, label
+    // or external symbol included. False (and nothing changed) if source's
+    // target is computed by more than "label + constant" or ". + constant".
+    bool retarget(size_t index, size_t source) {
+        long k = operandOf[source];
+        if (k < 0) {
+            setBranchTarget(index, (long)(program.instructions[source] >> 16));
+            return true;
+        }
+        const AsmExpressionValue& value = operandValues[k];
+        if (!value.isAddress()) return false;
+        if (value.pcRelative) {
+            setBranchTarget(index, value.value);
+            return true;
+        }
+
+        std::string expression = program.addressOperands[k].expression;
+        ObjectModule::Relocation* from = relocationAt(source);
+        ObjectModule::Relocation copy = from ? *from : ObjectModule::Relocation();
+        setOperand(index, expression);
+        if (from) {
+            copy.index = (uint16_t)index;
+            if (ObjectModule::Relocation* reloc = relocationAt(index)) *reloc = copy;
+            else program.relocations.push_back(copy);
+        }
+        return true;
+    }
+
+    // Rearrange the instructions: order lists every old index once, in their
+    // new order. Labels, branch targets, code addresses and relocations follow
+    // the instruction they point at; the end of the program stays the end.
+    void reorder(const std::vector<size_t>& order) {
+        size_t size = program.instructions.size();
+        std::vector<uint32_t>& code = program.instructions;
+
+        std::vector<uint16_t> newIndex(size);
+        for (size_t k = 0; k < size; k++) newIndex[order[k]] = (uint16_t)k;
+        auto remap = [&](long old) { return (old >= 0 && (size_t)old < size) ? (long)newIndex[old] : old; };
+        relocate(remap, newIndex, std::vector<char>(size, 0));
+
+        std::vector<uint32_t> reordered(size);
+        for (size_t k = 0; k < size; k++) reordered[k] = code[order[k]];
+        code = std::move(reordered);
+    }
+
+    // Delete the marked instructions from program.instructions (which may have
+    // been rewritten since construction, but not resized). Branch targets,
+    // labels, address operands and relocations that pointed at a deleted
+    // instruction move to the next kept one; those held by a deleted
+    // instruction go with it. Returns the number of instructions deleted.
+    size_t erase(const std::vector<char>& removed) {
+        size_t oldSize = program.instructions.size();
+        std::vector<uint32_t>& code = program.instructions;
+
+        // Old address -> new address; a removed instruction maps to the next kept one
+        std::vector<uint16_t> newAddress(oldSize + 1);
+        uint16_t address = 0;
+        for (size_t i = 0; i < oldSize; i++) {
+            newAddress[i] = address;
+            if (!removed[i]) address++;
+        }
+        newAddress[oldSize] = address;
+        if (address == oldSize) return 0;
+        auto remap = [&](long old) { return (old >= 0 && (size_t)old <= oldSize) ? (long)newAddress[old] : old; };
+        relocate(remap, newAddress, removed);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < oldSize; i++) {
+            if (!removed[i]) code[kept++] = code[i];
+        }
+        code.resize(kept);
+        return oldSize - kept;
+    }
+
+    // Insert before[i] ahead of instruction i and after[i] behind it. Labels,
+    // branch targets and code addresses of instruction i move to the first
+    // instruction of before[i], so code jumping to i runs it too; address
+    // operands and relocations stay with their instruction. The caller keeps
+    // the program within 65535 instructions. Returns the number inserted.
+    size_t insert(const std::vector<std::vector<uint32_t>>& before, const std::vector<std::vector<uint32_t>>& after) {
+        size_t oldSize = program.instructions.size();
+        std::vector<uint32_t>& code = program.instructions;
+
+        std::vector<uint16_t> groupStart(oldSize + 1), newIndex(oldSize);
+        size_t address = 0;
+        for (size_t i = 0; i < oldSize; i++) {
+            groupStart[i] = (uint16_t)address;
+            address += before[i].size();
+            newIndex[i] = (uint16_t)address++;
+            address += after[i].size();
+        }
+        groupStart[oldSize] = (uint16_t)address;
+        if (address == oldSize) return 0;
+        auto remap = [&](long old) { return (old >= 0 && (size_t)old <= oldSize) ? (long)groupStart[old] : old; };
+        relocate(remap, newIndex, std::vector<char>(oldSize, 0));
+
+        std::vector<uint32_t> expanded;
+        expanded.reserve(address);
+        for (size_t i = 0; i < oldSize; i++) {
+            expanded.insert(expanded.end(), before[i].begin(), before[i].end());
+            expanded.push_back(code[i]);
+            expanded.insert(expanded.end(), after[i].begin(), after[i].end());
+        }
+        code = std::move(expanded);
+        return address - oldSize;
+    }
+};
@@ -0,0 +1,519 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ControlFlow.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Register allocation for virtual registers (%name operands).
+//
+// Liveness runs over the control-flow graph, and the interference graph is
+// colored with the 8 physical registers, Chaitin-Briggs style. Registers
+// named directly (X0-X7) are precolored: a virtual register never shares one
+// while it is live. Those the program writes are its results, live at EXIT,
+// at register branches and where control leaves the module; the others are
+// free for virtual registers, so their contents are not preserved.
+//
+// When more than 8 values are live at once, the virtual registers that are
+// cheapest to spill go to RAM words of the #SPILL area (default 240-255):
+// a READ_I into a short-lived temporary before each use and a WRITE_I after
+// each definition. Cost is the number of uses and definitions, each counted
+// 10x per loop it sits in, so values used inside loops stay in registers.
+// Spilled registers that are never live together share a word, and a reload
+// of a value still held in the same register since the last load or store
+// in the block is dropped.
+//
+// A virtual register is not kept across a branch to another module. Those
+// holding or adjusting a code address (LR Xn / ADD Xn, Xn, k) are never
+// spilled, as the pair must stay together.
+class RegisterAllocator {
+public:
+    struct Stats {
+        size_t virtuals = 0;   // Virtual registers allocated
+        size_t spilled = 0;    // Of which spilled to RAM
+        size_t slots = 0;      // RAM words used for spills
+        size_t loads = 0;      // READ_I inserted
+        size_t stores = 0;     // WRITE_I inserted
+    };
+
+private:
+    static constexpr int PHYSICAL = 8;
+    static constexpr int NO_NODE = -1;
+
+    const IsaSpec::ISA_SPEC& isaSpec;
+    Stats stats;
+
+    // One instruction: an original one, or a spill load/store around it
+    struct Op {
+        uint32_t raw;
+        int node[3] = {NO_NODE, NO_NODE, NO_NODE};  // Virtual register or temporary in DST, A, B; NO_NODE: as encoded
+        int spill = NO_NODE;                        // Spill load/store: the spilled virtual register
+        bool load = false;
+        bool dropped = false;                       // Redundant load, not emitted
+    };
+
+    // Original instruction i and the spill code around it
+    struct Group {
+        std::vector<Op> before;
+        Op op;
+        std::vector<Op> after;
+    };
+
+    // Small bit set over interference graph nodes
+    struct NodeSet {
+        std::vector<uint64_t> words;
+
+        explicit NodeSet(size_t size = 0) : words((size + 63) / 64, 0) {}
+        bool test(size_t n) const { return (words[n / 64] >> (n % 64)) & 1; }
+        void set(size_t n) { words[n / 64] |= (uint64_t)1 << (n % 64); }
+        void reset(size_t n) { words[n / 64] &= ~((uint64_t)1 << (n % 64)); }
+        bool merge(const NodeSet& other) {  // other may be smaller
+            bool changed = false;
+            for (size_t w = 0; w < other.words.size(); w++) {
+                uint64_t merged = words[w] | other.words[w];
+                changed |= merged != words[w];
+                words[w] = merged;
+            }
+            return changed;
+        }
+    };
+
+    std::vector<Group> groups;
+    std::vector<size_t> lineOf;          // Per node: a source line using it, 0 if none
+    std::vector<int> spillOf;            // Per node: the spilled virtual register a temporary stands for
+    std::vector<char> unspillable;       // Per node
+    size_t nodeCount = 0;
+    NodeSet results;                     // Physical registers the program writes
+
+    static int fieldIndex(uint8_t shift) { return shift == 8 ? 0 : (shift == 12 ? 1 : 2); }
+    static constexpr uint8_t fieldShift[3] = {8, 12, 16};
+
+    // Node in field f of op: its virtual register or temporary, else the physical register encoded
+    static int nodeIn(const Op& op, int f) {
+        if (op.node[f] != NO_NODE) return op.node[f];
+        return (op.raw >> fieldShift[f]) & 0x7;
+    }
+
+    // Registers read and written, from the TRY_READ_A/TRY_READ_B/TRY_WRITE flags. MOV
+    // reads only its source and MOV of an immediate nothing, whatever its flags say.
+    void operands(const Op& op, int uses[], int& useCount, int& def) const {
+        useCount = 0;
+        def = NO_NODE;
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, op.raw);
+        if (!tech) return;
+        bool move = tech->type == IsaSpec::InstructionType::TYPE_MOVE;
+        if (tech->flags.TRY_READ_A && !(move && tech->flags.IMMEDIATE)) uses[useCount++] = nodeIn(op, 1);
+        if (tech->flags.TRY_READ_B && !tech->flags.IMMEDIATE && !move) uses[useCount++] = nodeIn(op, 2);
+        if (tech->flags.TRY_WRITE) def = nodeIn(op, 0);
+    }
+
+    bool isRegisterMove(const Op& op) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, op.raw);
+        return tech && tech->type == IsaSpec::InstructionType::TYPE_MOVE && !tech->flags.IMMEDIATE;
+    }
+
+    // Control leaves for code that may read the results
+    bool leavesModule(const ControlFlowGraph::Block& block, const std::vector<uint32_t>& code) const {
+        const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, code[block.end - 1]);
+        bool registerBranch = tech && tech->type == IsaSpec::InstructionType::TYPE_BRANCH && !tech->flags.IMMEDIATE;
+        return block.exits || block.leaves || registerBranch;
+    }
+
+    template <typename Visitor>
+    void forEachOp(size_t start, size_t end, Visitor visit) {
+        for (size_t i = start; i < end; i++) {
+            for (Op& op : groups[i].before) visit(op);
+            visit(groups[i].op);
+            for (Op& op : groups[i].after) visit(op);
+        }
+    }
+
+    template <typename Visitor>
+    void forEachOpReverse(size_t start, size_t end, Visitor visit) {
+        for (size_t i = end; i-- > start;) {
+            for (size_t k = groups[i].after.size(); k-- > 0;) visit(groups[i].after[k]);
+            visit(groups[i].op);
+            for (size_t k = groups[i].before.size(); k-- > 0;) visit(groups[i].before[k]);
+        }
+    }
+
+    // Live-in set of every block
+    std::vector<NodeSet> liveness(const ControlFlowGraph& cfg, const std::vector<uint32_t>& code) {
+        const auto& blocks = cfg.getBlocks();
+        std::vector<NodeSet> liveIn(blocks.size(), NodeSet(nodeCount));
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t b = blocks.size(); b-- > 0;) {
+                NodeSet live = liveOut(cfg, code, liveIn, b);
+                forEachOpReverse(blocks[b].start, blocks[b].end, [&](const Op& op) { step(op, live); });
+                changed |= liveIn[b].merge(live);
+            }
+        }
+        return liveIn;
+    }
+
+    NodeSet liveOut(const ControlFlowGraph& cfg, const std::vector<uint32_t>& code, const std::vector<NodeSet>& liveIn, size_t b) const {
+        const ControlFlowGraph::Block& block = cfg.getBlocks()[b];
+        NodeSet live(nodeCount);
+        for (const auto& edge : block.successors) live.merge(liveIn[edge.block]);
+        if (leavesModule(block, code)) live.merge(results);
+        return live;
+    }
+
+    // Live before op, given live after it
+    void step(const Op& op, NodeSet& live) const {
+        int uses[2];
+        int useCount, def;
+        operands(op, uses, useCount, def);
+        if (def != NO_NODE) live.reset(def);
+        for (int u = 0; u < useCount; u++) live.set(uses[u]);
+    }
+
+    struct Graph {
+        std::vector<NodeSet> matrix;
+        std::vector<std::vector<int>> neighbors;
+        std::vector<std::vector<int>> preferred;  // Copy-related nodes, best given the same color
+
+        void addEdge(int a, int b) {
+            if (a == b || matrix[a].test(b)) return;
+            matrix[a].set(b);
+            matrix[b].set(a);
+            neighbors[a].push_back(b);
+            neighbors[b].push_back(a);
+        }
+    };
+
+    Graph interference(const ControlFlowGraph& cfg, const std::vector<uint32_t>& code) {
+        Graph graph;
+        graph.matrix.assign(nodeCount, NodeSet(nodeCount));
+        graph.neighbors.assign(nodeCount, {});
+        graph.preferred.assign(nodeCount, {});
+        std::vector<NodeSet> liveIn = liveness(cfg, code);
+        const auto& blocks = cfg.getBlocks();
+        for (size_t b = 0; b < blocks.size(); b++) {
+            NodeSet live = liveOut(cfg, code, liveIn, b);
+            forEachOpReverse(blocks[b].start, blocks[b].end, [&](const Op& op) {
+                int uses[2];
+                int useCount, def;
+                operands(op, uses, useCount, def);
+                if (def != NO_NODE) {
+                    // A copy's source may share the destination's register
+                    int source = isRegisterMove(op) ? uses[0] : NO_NODE;
+                    for (size_t n = 0; n < nodeCount; n++) {
+                        if (live.test(n) && (int)n != source) graph.addEdge(def, (int)n);
+                    }
+                    if (source != NO_NODE && source != def) {
+                        graph.preferred[def].push_back(source);
+                        graph.preferred[source].push_back(def);
+                    }
+                }
+                step(op, live);
+            });
+        }
+        // Temporaries of one spilled register share a color where they can, so reloads can be dropped
+        std::vector<int> firstTemp(nodeCount, NO_NODE);
+        for (size_t n = 0; n < nodeCount; n++) {
+            if (spillOf[n] == NO_NODE) continue;
+            int& first = firstTemp[spillOf[n]];
+            if (first == NO_NODE) {
+                first = (int)n;
+            } else {
+                graph.preferred[n].push_back(first);
+                graph.preferred[first].push_back((int)n);
+            }
+        }
+        return graph;
+    }
+
+    // Color virtual registers and temporaries; color[n] = -1 for those that must be spilled
+    std::vector<int> color(const Graph& graph, const std::vector<double>& cost) {
+        std::vector<int> colors(nodeCount, -1);
+        for (int r = 0; r < PHYSICAL; r++) colors[r] = r;
+
+        std::vector<size_t> degree(nodeCount);
+        std::vector<char> removed(nodeCount, 0);
+        for (size_t n = 0; n < nodeCount; n++) degree[n] = graph.neighbors[n].size();
+
+        // Simplify: remove nodes of degree < 8 first, else the one cheapest to spill per neighbor
+        std::vector<int> stack;
+        size_t remaining = nodeCount - PHYSICAL;
+        while (remaining > 0) {
+            int pick = NO_NODE;
+            double best = std::numeric_limits<double>::infinity();
+            for (size_t n = PHYSICAL; n < nodeCount; n++) {
+                if (removed[n]) continue;
+                if (degree[n] < (size_t)PHYSICAL) {
+                    pick = (int)n;
+                    break;
+                }
+                double ratio = cost[n] / (double)degree[n];
+                if (pick == NO_NODE || ratio < best) {
+                    pick = (int)n;
+                    best = ratio;
+                }
+            }
+            removed[pick] = 1;
+            remaining--;
+            stack.push_back(pick);
+            for (int m : graph.neighbors[pick]) degree[m]--;
+        }
+
+        // Select: optimistic, a node pushed as a spill candidate may still find a color
+        while (!stack.empty()) {
+            int n = stack.back();
+            stack.pop_back();
+            bool taken[PHYSICAL] = {};
+            for (int m : graph.neighbors[n]) {
+                if (colors[m] >= 0) taken[colors[m]] = true;
+            }
+            for (int m : graph.preferred[n]) {
+                if (colors[m] >= 0 && !taken[colors[m]]) {
+                    colors[n] = colors[m];
+                    break;
+                }
+            }
+            for (int c = 0; c < PHYSICAL && colors[n] < 0; c++) {
+                if (!taken[c]) colors[n] = c;
+            }
+        }
+        return colors;
+    }
+
+    void report(AssemblyResult& program, size_t line, std::string message) const {
+        if (line) message += " on line " + std::to_string(line);
+        program.diagnostics.push_back({AsmDiagnostic::SEVERITY_ERROR, line, std::move(message)});
+        program.errorCount++;
+    }
+
+    std::string nameOf(const AssemblyResult& program, int node) const {
+        int reg = spillOf[node] != NO_NODE ? spillOf[node] : node;
+        return "%" + program.virtualRegisters[reg - PHYSICAL];
+    }
+
+    // Replace every occurrence of virtual register v by a fresh temporary per instruction,
+    // loaded before a use and stored after a definition
+    void spill(int v) {
+        for (Group& group : groups) {
+            int temp = NO_NODE;
+            bool used = false, defined = false;
+            int uses[2];
+            int useCount, def;
+            operands(group.op, uses, useCount, def);
+            for (int f = 0; f < 3; f++) {
+                if (group.op.node[f] != v) continue;
+                if (temp == NO_NODE) {
+                    temp = (int)nodeCount++;
+                    lineOf.push_back(lineOf[v]);
+                    spillOf.push_back(v);
+                    unspillable.push_back(1);
+                }
+                group.op.node[f] = temp;
+            }
+            if (temp == NO_NODE) continue;
+            for (int u = 0; u < useCount; u++) used |= uses[u] == v;
+            defined = def == v;
+
+            if (used) {
+                Op load;
+                load.raw = IsaSpec::findOpcode(isaSpec, "READ", IsaSpec::InstructionType::TYPE_MEMORY, true);
+                load.node[0] = temp;
+                load.spill = v;
+                load.load = true;
+                group.before.push_back(load);
+            }
+            if (defined) {
+                Op store;
+                store.raw = IsaSpec::findOpcode(isaSpec, "WRITE", IsaSpec::InstructionType::TYPE_MEMORY, true);
+                store.node[1] = temp;
+                store.spill = v;
+                group.after.push_back(store);
+            }
+        }
+    }
+
+    // Give each spilled register a RAM word, sharing words between registers never live together
+    bool assignSlots(AssemblyResult& program, const Graph& original, const std::vector<int>& spilled, std::vector<int>& slotOf) {
+        slotOf.assign(nodeCount, -1);
+        for (int v : spilled) {
+            std::vector<char> taken(program.spillCount, 0);
+            for (int w : spilled) {
+                if (slotOf[w] >= 0 && (size_t)w < original.matrix.size() && original.matrix[v].test(w)) taken[slotOf[w]] = 1;
+            }
+            int slot = 0;
+            while (slot < (int)program.spillCount && taken[slot]) slot++;
+            if (slot == (int)program.spillCount) {
+                report(program, lineOf[v], "Out of spill space for " + nameOf(program, v) + ": #SPILL " +
+                       std::to_string(program.spillBase) + ", " + std::to_string(program.spillCount) + " is full");
+                return false;
+            }
+            slotOf[v] = slot;
+            stats.slots = std::max(stats.slots, (size_t)slot + 1);
+        }
+        return true;
+    }
+
+    // Drop reloads of a value still in its register since the last load or store of the same word in the block
+    void dropRedundantLoads(const ControlFlowGraph& cfg, const std::vector<int>& colors, const std::vector<int>& slotOf) {
+        for (const auto& block : cfg.getBlocks()) {
+            int holds[PHYSICAL];
+            for (int& slot : holds) slot = -1;
+            forEachOp(block.start, block.end, [&](Op& op) {
+                if (op.spill != NO_NODE) {
+                    int reg = colors[op.node[op.load ? 0 : 1]];
+                    int slot = slotOf[op.spill];
+                    if (op.load && holds[reg] == slot) {
+                        op.dropped = true;
+                        return;
+                    }
+                    if (!op.load) {
+                        for (int& held : holds) {
+                            if (held == slot) held = -1;
+                        }
+                    }
+                    holds[reg] = slot;
+                    return;
+                }
+                const IsaSpec::InstructionTech* tech = Semantics::techOf(isaSpec, op.raw);
+                if (tech && tech->type == IsaSpec::InstructionType::TYPE_MEMORY && !tech->flags.TRY_WRITE) {
+                    for (int& held : holds) held = -1;  // A program store may hit the spill area
+                    return;
+                }
+                int uses[2];
+                int useCount, def;
+                operands(op, uses, useCount, def);
+                if (def != NO_NODE) holds[colors[def]] = -1;
+            });
+        }
+    }
+
+    uint32_t encode(const Op& op, const std::vector<int>& colors, uint32_t spillAddress) const {
+        uint32_t raw = op.raw;
+        for (int f = 0; f < 3; f++) {
+            if (op.node[f] == NO_NODE) continue;
+            raw = (raw & ~(0x7u << fieldShift[f])) | ((uint32_t)colors[op.node[f]] << fieldShift[f]);
+        }
+        if (op.spill != NO_NODE) raw = (raw & 0xFFFF) | (spillAddress << 16);
+        return raw;
+    }
+
+public:
+    explicit RegisterAllocator(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Replace the virtual registers of an assembled program by physical ones, inserting
+    // spill code where needed. False (with errors added to program) if that cannot be done.
+    bool allocate(AssemblyResult& program, bool objectOutput) {
+        stats = Stats();
+        if (program.virtualRegisters.empty()) return true;
+        stats.virtuals = program.virtualRegisters.size();
+        const std::vector<uint32_t>& code = program.instructions;
+
+        nodeCount = PHYSICAL + program.virtualRegisters.size();
+        lineOf.assign(nodeCount, 0);
+        spillOf.assign(nodeCount, NO_NODE);
+        unspillable.assign(nodeCount, 0);
+        groups.assign(code.size(), Group());
+        for (size_t i = 0; i < code.size(); i++) groups[i].op.raw = code[i];
+
+        ProgramEditor editor(program, isaSpec);
+        for (const auto& operand : program.virtualOperands) {
+            int node = PHYSICAL + operand.reg;
+            groups[operand.index].op.node[fieldIndex(operand.shift)] = node;
+            if (!lineOf[node]) lineOf[node] = operand.line;
+            if (editor.isPinned(operand.index)) unspillable[node] = 1;
+        }
+
+        results = NodeSet(nodeCount);
+        for (const Group& group : groups) {
+            int uses[2];
+            int useCount, def;
+            operands(group.op, uses, useCount, def);
+            if (def != NO_NODE && def < PHYSICAL) results.set(def);
+        }
+
+        ControlFlowGraph cfg(isaSpec);
+        cfg.build(program, objectOutput);
+        std::vector<double> weight(code.size(), 1);
+        for (const auto& block : cfg.getBlocks()) {
+            double w = 1;
+            for (size_t d = 0; d < block.loopDepth && d < 6; d++) w *= 10;
+            for (size_t i = block.start; i < block.end; i++) weight[i] = w;
+        }
+
+        // Color, spilling what does not fit, until everything fits
+        Graph original;
+        std::vector<int> spilled;
+        std::vector<int> colors;
+        for (bool first = true; ; first = false) {
+            Graph graph = interference(cfg, code);
+            std::vector<double> cost(nodeCount, 0);
+            for (size_t i = 0; i < code.size(); i++) {
+                for (int f = 0; f < 3; f++) {
+                    if (groups[i].op.node[f] != NO_NODE) cost[groups[i].op.node[f]] += weight[i];
+                }
+            }
+            for (size_t n = 0; n < nodeCount; n++) {
+                if (unspillable[n]) cost[n] = std::numeric_limits<double>::infinity();
+            }
+
+            colors = color(graph, cost);
+            if (first) original = graph;
+
+            bool done = true;
+            for (size_t n = PHYSICAL; n < nodeCount && done; n++) {
+                if (colors[n] >= 0) continue;
+                done = false;
+                if (unspillable[n] || program.spillCount == 0) {
+                    report(program, lineOf[n], "More than 8 registers live at once and " + nameOf(program, (int)n) +
+                           (program.spillCount == 0 ? " cannot be spilled (#SPILL area is empty)" : " cannot be spilled"));
+                    return false;
+                }
+            }
+            if (done) break;
+            size_t count = nodeCount;
+            for (size_t n = PHYSICAL; n < count; n++) {
+                if (colors[n] >= 0) continue;
+                spill((int)n);
+                spilled.push_back((int)n);
+            }
+        }
+
+        std::vector<int> slotOf;
+        if (!assignSlots(program, original, spilled, slotOf)) return false;
+        dropRedundantLoads(cfg, colors, slotOf);
+
+        // Rewrite the program
+        std::vector<std::vector<uint32_t>> before(code.size()), after(code.size());
+        size_t total = 0;
+        for (size_t i = 0; i < groups.size(); i++) {
+            Group& group = groups[i];
+            program.instructions[i] = encode(group.op, colors, 0);
+            for (const Op& op : group.before) {
+                if (op.dropped) continue;
+                before[i].push_back(encode(op, colors, program.spillBase + slotOf[op.spill]));
+                stats.loads++;
+            }
+            for (const Op& op : group.after) {
+                after[i].push_back(encode(op, colors, program.spillBase + slotOf[op.spill]));
+                stats.stores++;
+            }
+            total += 1 + before[i].size() + after[i].size();
+        }
+        stats.spilled = spilled.size();
+        if (total > 0xFFFF) {
+            report(program, 0, "Spill code makes the program " + std::to_string(total) + " instructions, over the 65535 instruction limit");
+            return false;
+        }
+        editor.insert(before, after);
+        program.virtualOperands.clear();
+        return true;
+    }
+};
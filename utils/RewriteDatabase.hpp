@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "Semantics.hpp"
+
+// Rewrite database: straight-line sequences and the cheaper equivalents "gct
+// superopt" found for them, applied by the peephole optimizer ("gct asm -O1
+// --rewrites").
+//
+//   GCT-REWRITES 1
+//   <n> <pattern x n> <m> <replacement x m> <flags> <verified>   # assembly
+//
+// Instructions are hex encodings whose registers are variables: X0 is the
+// first register the pattern uses, X1 the next, and so on. A window of code
+// matches a pattern when every bit outside the register fields it uses is
+// equal and the variables bind to distinct registers. Variables only the
+// replacement uses are scratch registers: any register the window does not
+// use whose value is dead after it. flags is "nz" where N
+// and Z after the replacement are those after the pattern, "none" where the
+// flags may differ; verified is "exhaustive" (every value of the one input
+// register) or "random" (random and edge-case values). Text after '#' is
+// ignored.
+struct RewriteDatabase {
+    enum FlagsKept { FLAGS_NZ, FLAGS_NONE };
+
+    struct Rewrite {
+        std::vector<uint32_t> pattern;
+        std::vector<uint32_t> replacement;
+        FlagsKept flags = FLAGS_NONE;
+        bool exhaustive = false;
+    };
+    std::vector<Rewrite> rewrites;
+
+    static constexpr int FORMAT_VERSION = 1;
+
+    // Bits of the register fields an instruction uses
+    static uint32_t registerMask(const Semantics::Operation& operation) {
+        return (operation.writesDst() ? 0x7u << 8 : 0) | (operation.readsA() ? 0x7u << 12 : 0) |
+               (operation.readsB() ? 0x7u << 16 : 0);
+    }
+
+    // Replace the registers an instruction uses through map (old register -> new), -1 entries are assigned
+    // the next unused number in order of use; false if map has no room
+    static bool renameRegisters(const IsaSpec::ISA_SPEC& spec, uint32_t& raw, int map[8], int& next) {
+        Semantics::Operation operation = Semantics::decode(spec, raw);
+        auto rename = [&](bool used, int reg, int shift) {
+            if (!used) return true;
+            if (map[reg] < 0) {
+                if (next >= 8) return false;
+                map[reg] = next++;
+            }
+            raw = (raw & ~(0x7u << shift)) | ((uint32_t)map[reg] << shift);
+            return true;
+        };
+        // Sources before the destination: the order an instruction uses its registers in
+        return rename(operation.readsA(), operation.a, 12) && rename(operation.readsB(), operation.b, 16) &&
+               rename(operation.writesDst(), operation.dst, 8);
+    }
+
+    // Registers of sequence numbered in order of first use, map receives the original register of each variable
+    static std::vector<uint32_t> canonicalize(const IsaSpec::ISA_SPEC& spec, const std::vector<uint32_t>& sequence,
+                                              int variables[8], int& count) {
+        int map[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+        count = 0;
+        std::vector<uint32_t> result = sequence;
+        for (uint32_t& raw : result) renameRegisters(spec, raw, map, count);
+        for (int reg = 0; reg < 8; reg++) {
+            if (map[reg] >= 0) variables[map[reg]] = reg;
+        }
+        return result;
+    }
+
+    static unsigned cycles(const IsaSpec::ISA_SPEC& spec, const std::vector<uint32_t>& sequence) {
+        unsigned total = 0;
+        for (uint32_t raw : sequence) total += IsaSpec::instructionCycles(spec, raw);
+        return total;
+    }
+
+    // Assembly of a sequence, "; "-separated
+    static std::string assembly(const IsaSpec::ISA_SPEC& spec, const std::vector<uint32_t>& sequence) {
+        std::string text;
+        for (size_t i = 0; i < sequence.size(); i++) text += (i ? "; " : "") + disassemble(sequence[i], spec);
+        return text;
+    }
+
+    // window (pattern.size() instructions) matches rewrite, replacement receives its instructions for window's
+    // registers; scratch variables take the lowest registers the window does not use for which isFree(reg) holds
+    template <typename IsFree>
+    static bool match(const IsaSpec::ISA_SPEC& spec, const Rewrite& rewrite, const uint32_t* window,
+                      std::vector<uint32_t>& replacement, IsFree isFree) {
+        int bound[8] = {-1, -1, -1, -1, -1, -1, -1, -1};  // Variable -> register
+        int owner[8] = {-1, -1, -1, -1, -1, -1, -1, -1};  // Register -> variable
+        for (size_t i = 0; i < rewrite.pattern.size(); i++) {
+            uint32_t pattern = rewrite.pattern[i];
+            if ((pattern & 0xFF) != (window[i] & 0xFF)) return false;
+            uint32_t mask = registerMask(Semantics::decode(spec, pattern));
+            if ((pattern ^ window[i]) & ~mask) return false;
+            for (int shift : {8, 12, 16}) {
+                if (!(mask & (0x7u << shift))) continue;
+                int variable = (pattern >> shift) & 0x7, reg = (window[i] >> shift) & 0x7;
+                if (bound[variable] < 0 && owner[reg] < 0) {
+                    bound[variable] = reg;
+                    owner[reg] = variable;
+                } else if (bound[variable] != reg || owner[reg] != variable) {
+                    return false;
+                }
+            }
+        }
+
+        replacement = rewrite.replacement;
+        for (uint32_t& raw : replacement) {
+            uint32_t mask = registerMask(Semantics::decode(spec, raw));
+            for (int shift : {8, 12, 16}) {
+                if (!(mask & (0x7u << shift))) continue;
+                int variable = (raw >> shift) & 0x7;
+                for (int reg = 0; reg < 8 && bound[variable] < 0; reg++) {
+                    if (owner[reg] >= 0 || !isFree(reg)) continue;
+                    bound[variable] = reg;
+                    owner[reg] = variable;
+                }
+                if (bound[variable] < 0) return false;
+                raw = (raw & ~(0x7u << shift)) | ((uint32_t)bound[variable] << shift);
+            }
+        }
+        return true;
+    }
+
+    // Add rewrite, replacing one for the same pattern and flags unless that one is cheaper
+    void add(const IsaSpec::ISA_SPEC& spec, const Rewrite& rewrite) {
+        for (Rewrite& existing : rewrites) {
+            if (existing.pattern != rewrite.pattern || existing.flags != rewrite.flags) continue;
+            unsigned had = cycles(spec, existing.replacement), has = cycles(spec, rewrite.replacement);
+            if (has < had || (has == had && rewrite.replacement.size() < existing.replacement.size())) existing = rewrite;
+            return;
+        }
+        rewrites.push_back(rewrite);
+    }
+
+    bool writeToFile(const std::string& path, const IsaSpec::ISA_SPEC& spec, std::ostream& log = std::cerr) const {
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            log << "Error: Cannot write rewrite database '" << path << "'\n";
+            return false;
+        }
+        out << "GCT-REWRITES " << FORMAT_VERSION << "\n";
+        char hex[12];
+        for (const Rewrite& rewrite : rewrites) {
+            out << rewrite.pattern.size();
+            for (uint32_t raw : rewrite.pattern) {
+                std::snprintf(hex, sizeof(hex), " %08X", (unsigned)raw);
+                out << hex;
+            }
+            out << " " << rewrite.replacement.size();
+            for (uint32_t raw : rewrite.replacement) {
+                std::snprintf(hex, sizeof(hex), " %08X", (unsigned)raw);
+                out << hex;
+            }
+            out << (rewrite.flags == FLAGS_NZ ? " nz" : " none") << (rewrite.exhaustive ? " exhaustive" : " random")
+                << "   # " << assembly(spec, rewrite.pattern) << " => " << assembly(spec, rewrite.replacement) << "\n";
+        }
+        return (bool)out;
+    }
+
+    // Entries must be straight-line register code, strictly cheaper than their pattern (fewer cycles, or as
+    // many in fewer instructions), with the pattern's registers numbered in order of use
+    bool readFromFile(const std::string& path, const IsaSpec::ISA_SPEC& spec, std::ostream& log = std::cerr) {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            log << "Error: Cannot open rewrite database '" << path << "'\n";
+            return false;
+        }
+        rewrites.clear();
+
+        auto readSequence = [&](std::istringstream& fields, std::vector<uint32_t>& sequence) {
+            size_t count = 0;
+            if (!(fields >> count) || count == 0 || count > 16) return false;
+            std::string word;
+            for (size_t i = 0; i < count; i++) {
+                char* end = nullptr;
+                if (!(fields >> word)) return false;
+                unsigned long raw = std::strtoul(word.c_str(), &end, 16);
+                if (word[0] == '-' || end != word.c_str() + word.size() || raw > 0xFFFFFFFFul) return false;
+                if (Semantics::decode(spec, (uint32_t)raw).op == Semantics::Op::OTHER) return false;
+                sequence.push_back((uint32_t)raw);
+            }
+            return true;
+        };
+
+        std::string line;
+        bool ok = std::getline(in, line) && line.rfind("GCT-REWRITES " + std::to_string(FORMAT_VERSION), 0) == 0;
+        while (ok && std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string flags, verified, extra;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+            Rewrite rewrite;
+            ok = readSequence(fields, rewrite.pattern) && readSequence(fields, rewrite.replacement) &&
+                 (fields >> flags >> verified) && !(fields >> extra) &&
+                 (flags == "nz" || flags == "none") && (verified == "exhaustive" || verified == "random");
+            if (!ok) break;
+            rewrite.flags = flags == "nz" ? FLAGS_NZ : FLAGS_NONE;
+            rewrite.exhaustive = verified == "exhaustive";
+
+            int variables[8], count = 0;
+            ok = canonicalize(spec, rewrite.pattern, variables, count) == rewrite.pattern;
+            unsigned before = cycles(spec, rewrite.pattern), after = cycles(spec, rewrite.replacement);
+            ok = ok && (after < before || (after == before && rewrite.replacement.size() < rewrite.pattern.size()));
+            if (ok) rewrites.push_back(rewrite);
+        }
+
+        if (!ok) log << "Error: Malformed rewrite database '" << path << "'\n";
+        return ok;
+    }
+};
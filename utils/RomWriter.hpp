@@ -7,6 +7,7 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdint>
+#include <cstdlib>
 
 #ifdef _WIN32
 #include <direct.h>
@@ -74,11 +75,11 @@ public:
     void set(uint8_t address, uint16_t value) { data[address] = value; }
     uint16_t get(uint8_t address) const { return data[address]; }
 
-    bool writeToFile() {
+    bool writeToFile(std::ostream& log = std::cout) {
         createDirectories(filename);
         std::ofstream out(filename);
         if (!out.is_open()) {
-            std::cerr << "Error: Cannot write to '" << filename << "'\n";
+            log << "Error: Cannot write to '" << filename << "'\n";
             return false;
         }
         for (int i = 0; i < ROM_SIZE; ++i) {
@@ -100,7 +101,7 @@ public:
             }
         }
         out.close();
-        std::cout << "Wrote ROM: " << filename << " (" << ROM_SIZE << " entries, " << formatToString(format) << " format)\n";
+        log << "Wrote ROM: " << filename << " (" << ROM_SIZE << " entries, " << formatToString(format) << " format)\n";
         return true;
     }
 
@@ -109,4 +110,47 @@ public:
     RomFormat getFormat() const { return format; }
 };
 
+// Reads ROM files back in any of the formats RomWriter writes
+class RomReader {
+public:
+    // Up to 256 entries, one per line; false if the file cannot be read or a line is not a value in format
+    static bool readFromFile(const std::string& filename, RomFormat format, std::vector<uint16_t>& data,
+                             std::ostream& log = std::cerr) {
+        std::ifstream in(filename);
+        if (!in.is_open()) {
+            log << "Error: Cannot open ROM '" << filename << "'\n";
+            return false;
+        }
+        data.clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t start = line.find_first_not_of(" \t\r"), end = line.find_last_not_of(" \t\r");
+            if (start == std::string::npos) continue;
+            std::string word = line.substr(start, end - start + 1);
+            char* stop = nullptr;
+            long value = -1;
+            switch (format) {
+                case ROM_HEX: value = word[0] == '-' ? -1 : std::strtol(word.c_str(), &stop, 16); break;
+                case ROM_UINT: value = word[0] == '-' ? -1 : std::strtol(word.c_str(), &stop, 10); break;
+                case ROM_INT:
+                    value = std::strtol(word.c_str(), &stop, 10);
+                    if (value >= -32768 && value < 0) value += 65536;
+                    else if (value > 32767) value = -1;
+                    break;
+                case ROM_BINARY:
+                    value = word.size() == 16 ? std::strtol(word.c_str(), &stop, 2) : -1;
+                    break;
+            }
+            if (value < 0 || value > 0xFFFF || (stop && *stop != '\0') || data.size() == ROM_SIZE) {
+                log << "Error: Malformed ROM '" << filename << "' at entry " << data.size() << "\n";
+                return false;
+            }
+            data.push_back((uint16_t)value);
+        }
+        return true;
+    }
+
+    static const size_t ROM_SIZE = 256;
+};
+
 #endif
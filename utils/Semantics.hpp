@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include "IsaSpec.hpp"
+
+// What the register-to-register instructions compute (ALU ops, MOV, CMP), for
+// tools that evaluate code rather than just move it around. Instructions are
+// decoded once through the ISA spec into an Operation, which executes on a
+// State without any further lookups.
+//
+// ALU ops set N and Z from their result. ADD sets C on carry out and SUB and
+// CMP on no borrow (x >= y), both set V on signed overflow; the other ALU ops
+// clear C and V. Shifts by 16 or more give 0. MOV leaves the flags alone here,
+// although the optimizers assume it may set them. Branch conditions are
+// evaluated by mnemonic, so their codes come from the spec; the signed ones
+// follow the branch condition ROM (BLT is N != V, BLE adds Z), not N alone.
+namespace Semantics {
+
+enum class Op : uint8_t {
+    AND, OR, XOR, NOT, ADD, SUB, LSL, LSR, BCDL, BCDH, UMUL_L, UMUL_H, MUL_L, MUL_H,
+    MOV, CMP,
+    OTHER  // Branches, memory, print, EXIT, FPU, reserved and unknown opcodes
+};
+
+enum Flag : uint8_t { FLAG_N = 1, FLAG_Z = 2, FLAG_C = 4, FLAG_V = 8 };
+constexpr uint8_t FLAGS_ALL = FLAG_N | FLAG_Z | FLAG_C | FLAG_V;
+
+struct State {
+    uint16_t regs[8] = {};
+    bool n = false, z = false, c = false, v = false;
+};
+
+struct Operation {
+    Op op = Op::OTHER;
+    bool immediate = false;
+    uint8_t dst = 0, a = 0, b = 0;
+    uint16_t imm = 0;
+
+    // Register fields the operation actually uses
+    bool writesDst() const { return op != Op::CMP && op != Op::OTHER; }
+    bool readsA() const { return op != Op::OTHER && !(op == Op::MOV && immediate); }
+    bool readsB() const {
+        return !immediate && op != Op::NOT && op != Op::BCDL && op != Op::BCDH && op != Op::MOV && op != Op::OTHER;
+    }
+    bool setsFlags() const { return op != Op::MOV && op != Op::OTHER; }
+};
+
+inline Op operationOf(const IsaSpec::InstructionTech& tech) {
+    static constexpr std::string_view aluNames[] = {"AND", "OR", "XOR", "NOT", "ADD", "SUB", "LSL", "LSR",
+                                                    "BCDL", "BCDH", "UMUL_L", "UMUL_H", "MUL_L", "MUL_H"};
+    if (tech.type == IsaSpec::InstructionType::TYPE_MOVE) return Op::MOV;
+    if (tech.type == IsaSpec::InstructionType::TYPE_CMP) return Op::CMP;
+    if (tech.type != IsaSpec::InstructionType::TYPE_ALU) return Op::OTHER;
+    for (size_t i = 0; i < sizeof(aluNames) / sizeof(aluNames[0]); i++) {
+        if (tech.mnemonic == aluNames[i]) return (Op)i;
+    }
+    return Op::OTHER;
+}
+
+// Spec entry of an encoded instruction, nullptr for an unknown opcode
+inline const IsaSpec::InstructionTech* techOf(const IsaSpec::ISA_SPEC& spec, uint32_t raw) {
+    auto it = spec.opcode_map.find(raw & 0xFF);
+    return it == spec.opcode_map.end() ? nullptr : it->second;
+}
+
+// Condition code of an encoded branch
+inline int conditionOf(uint32_t raw) { return (raw >> 8) & 0xF; }
+
+inline Operation decode(const IsaSpec::ISA_SPEC& spec, uint32_t raw) {
+    Operation operation;
+    const IsaSpec::InstructionTech* tech = techOf(spec, raw);
+    if (!tech) return operation;
+    operation.op = operationOf(*tech);
+    operation.immediate = tech->flags.IMMEDIATE;
+    operation.dst = (raw >> 8) & 0x7;
+    operation.a = (raw >> 12) & 0x7;
+    operation.b = (raw >> 16) & 0x7;
+    operation.imm = (uint16_t)(raw >> 16);
+    return operation;
+}
+
+// Binary-coded decimal of value, one digit per nibble: the lower 4 of its 5 digits (high = false) or the
+// upper 4 (so 46368 gives 6368 and 4636)
+inline uint16_t bcd(uint16_t value, bool high) {
+    uint32_t digits = 0;
+    for (int shift = 0; value > 0; shift += 4, value /= 10) digits |= (uint32_t)(value % 10) << shift;
+    return (uint16_t)(high ? digits >> 4 : digits);
+}
+
+// Execute operation on state; OTHER does nothing
+inline void execute(const Operation& operation, State& state) {
+    uint16_t x = state.regs[operation.a];
+    uint16_t y = operation.immediate ? operation.imm : state.regs[operation.b];
+    uint32_t result = 0;
+    bool carry = false, overflow = false;
+    switch (operation.op) {
+        case Op::AND: result = x & y; break;
+        case Op::OR: result = x | y; break;
+        case Op::XOR: result = x ^ y; break;
+        case Op::NOT: result = (uint16_t)~x; break;
+        case Op::ADD:
+            result = (uint32_t)x + y;
+            carry = result > 0xFFFF;
+            overflow = (~(x ^ y) & (x ^ result) & 0x8000) != 0;
+            break;
+        case Op::SUB:
+        case Op::CMP:
+            result = (uint16_t)(x - y);
+            carry = x >= y;
+            overflow = ((x ^ y) & (x ^ result) & 0x8000) != 0;
+            break;
+        case Op::LSL: result = y > 15 ? 0 : (uint16_t)(x << y); break;
+        case Op::LSR: result = y > 15 ? 0 : x >> y; break;
+        case Op::BCDL: result = bcd(x, false); break;
+        case Op::BCDH: result = bcd(x, true); break;
+        case Op::UMUL_L: result = (uint16_t)((uint32_t)x * y); break;
+        case Op::UMUL_H: result = ((uint32_t)x * y) >> 16; break;
+        case Op::MUL_L: result = (uint16_t)((int32_t)(int16_t)x * (int16_t)y); break;
+        case Op::MUL_H: result = (uint16_t)(((int32_t)(int16_t)x * (int16_t)y) >> 16); break;
+        case Op::MOV:
+            state.regs[operation.dst] = operation.immediate ? operation.imm : x;
+            return;
+        case Op::OTHER:
+            return;
+    }
+    if (operation.op != Op::CMP) state.regs[operation.dst] = (uint16_t)result;
+    state.n = (result & 0x8000) != 0;
+    state.z = (uint16_t)result == 0;
+    state.c = carry;
+    state.v = overflow;
+}
+
+// Whether branch condition code holds with state's flags, needs receives the flags it tests; false if the
+// spec has no such condition
+inline bool testCondition(const IsaSpec::ISA_SPEC& spec, int condition, const State& state, bool& holds, uint8_t& needs) {
+    struct Test {
+        std::string_view mnemonic;
+        uint8_t needs;
+    };
+    static const Test tests[] = {{"B", 0}, {"BEQ", FLAG_Z}, {"BNE", FLAG_Z}, {"BLT", FLAG_N | FLAG_V},
+                                 {"BLE", FLAG_N | FLAG_Z | FLAG_V}, {"BGT", FLAG_N | FLAG_Z | FLAG_V},
+                                 {"BGE", FLAG_N | FLAG_V}, {"BCS", FLAG_C}, {"BCC", FLAG_C},
+                                 {"BMI", FLAG_N}, {"BPL", FLAG_N}, {"BVS", FLAG_V}, {"BVC", FLAG_V},
+                                 {"BHI", FLAG_C | FLAG_Z}, {"BLS", FLAG_C | FLAG_Z}};
+    for (const auto& bc : spec.branch_conditions) {
+        if (bc.code != condition) continue;
+        for (const Test& test : tests) {
+            if (bc.mnemonic != test.mnemonic) continue;
+            std::string_view m = test.mnemonic;
+            bool n = state.n, z = state.z, c = state.c, v = state.v;
+            needs = test.needs;
+            if (m == "B") holds = true;
+            else if (m == "BEQ") holds = z;
+            else if (m == "BNE") holds = !z;
+            else if (m == "BLT") holds = n != v;
+            else if (m == "BGE") holds = n == v;
+            else if (m == "BLE") holds = z || n != v;
+            else if (m == "BGT") holds = !z && n == v;
+            else if (m == "BMI") holds = n;
+            else if (m == "BPL") holds = !n;
+            else if (m == "BCS") holds = c;
+            else if (m == "BCC") holds = !c;
+            else if (m == "BVS") holds = v;
+            else if (m == "BVC") holds = !v;
+            else if (m == "BHI") holds = c && !z;
+            else holds = !c || z;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Flags branch condition code tests; all of them if the spec has no such condition
+inline uint8_t conditionNeeds(const IsaSpec::ISA_SPEC& spec, int condition) {
+    State state;
+    bool holds = false;
+    uint8_t needs = 0;
+    return testCondition(spec, condition, state, holds, needs) ? needs : FLAGS_ALL;
+}
+
+// Flags live before an encoded instruction, given those live after it: ALU ops and CMP set all four, a
+// branch tests those of its condition and an unknown opcode may test any. MOV counts as leaving them
+// alone, the cautious reading for liveness.
+inline uint8_t flagsLiveBefore(const IsaSpec::ISA_SPEC& spec, uint32_t raw, uint8_t after) {
+    const IsaSpec::InstructionTech* tech = techOf(spec, raw);
+    if (!tech) return FLAGS_ALL;
+    if (tech->type == IsaSpec::InstructionType::TYPE_ALU || tech->type == IsaSpec::InstructionType::TYPE_CMP) return 0;
+    if (tech->type == IsaSpec::InstructionType::TYPE_BRANCH) return after | conditionNeeds(spec, conditionOf(raw));
+    return after;
+}
+
+} // namespace Semantics
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Assembler.hpp"
+#include "ProgramEditor.hpp"
+#include "Semantics.hpp"
+
+// Strength reduction (-O1): multiplies by a constant become shifts, adds and
+// masks where the cycle-cost table (InstructionTech::cycles) makes the
+// replacement cheaper.
+//
+//   UMUL_L/MUL_L Xd, Xa, 2^k            LSL Xd, Xa, k
+//   UMUL_L/MUL_L Xd, Xa, 0 (1)          AND Xd, Xa, 0 (OR Xd, Xa, 0)
+//   UMUL_L/MUL_L Xd, Xa, (2^s +- 1)*2^j LSL Xd, Xa, s / ADD|SUB Xd, Xd, Xa [/ LSL Xd, Xd, j]
+//   UMUL_L/MUL_L Xd, Xa, -(2^s - 1)     LSL Xd, Xa, s / SUB Xd, Xa, Xd
+//   UMUL_H Xd, Xa, 2^k                  LSR Xd, Xa, 16-k (unsigned divide by 2^(16-k))
+//   LSR Xd, Xa, k / LSL Xd, Xd, k       AND Xd, Xa, ~(2^k-1) (round down to a multiple of 2^k)
+//   AND Xd, Xa, m / SUB Xd, Xa, Xd      AND Xd, Xa, ~m (x - x / 2^k * 2^k: x modulo 2^k)
+//
+// Multi-instruction sequences need Xd != Xa. The result, and with it N and
+// Z, is unchanged, but C and V may not be: an instruction is rewritten only
+// where no branch can test C or V before an ALU op or CMP sets them again.
+class StrengthReducer {
+public:
+    struct Stats {
+        size_t multiplies = 0;   // Constant multiplies replaced
+        size_t divides = 0;      // UMUL_H by a power of two replaced
+        size_t masks = 0;        // Shift pairs and modulo sequences folded into AND
+        size_t added = 0;        // Instructions inserted by multi-instruction sequences
+        size_t removed = 0;      // Instructions deleted by folding
+        long cycles = 0;         // Estimated cycles saved per execution of every rewritten instruction
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    Stats stats;
+
+    struct Decoded {
+        const IsaSpec::InstructionTech* tech;
+        uint8_t dst, a, b;
+        uint16_t imm;
+    };
+
+    Decoded decode(uint32_t raw) const {
+        return {Semantics::techOf(isaSpec, raw),
+                (uint8_t)((raw >> 8) & 0x7), (uint8_t)((raw >> 12) & 0x7), (uint8_t)((raw >> 16) & 0x7), (uint16_t)(raw >> 16)};
+    }
+
+    static bool is(const Decoded& d, std::string_view mnemonic, bool immediate) {
+        return d.tech && d.tech->type == IsaSpec::InstructionType::TYPE_ALU && d.tech->mnemonic == mnemonic &&
+               d.tech->flags.IMMEDIATE == immediate;
+    }
+
+    uint32_t aluImmediate(std::string_view mnemonic, uint8_t dst, uint8_t a, uint16_t imm) const {
+        return IsaSpec::findOpcode(isaSpec, mnemonic, IsaSpec::InstructionType::TYPE_ALU, true) |
+               ((uint32_t)dst << 8) | ((uint32_t)a << 12) | ((uint32_t)imm << 16);
+    }
+
+    uint32_t aluRegister(std::string_view mnemonic, uint8_t dst, uint8_t a, uint8_t b) const {
+        return IsaSpec::findOpcode(isaSpec, mnemonic, IsaSpec::InstructionType::TYPE_ALU, false) |
+               ((uint32_t)dst << 8) | ((uint32_t)a << 12) | ((uint32_t)b << 16);
+    }
+
+    long cost(const std::vector<uint32_t>& sequence) const {
+        long total = 0;
+        for (uint32_t raw : sequence) total += IsaSpec::instructionCycles(isaSpec, raw);
+        return total;
+    }
+
+    static int log2Exact(uint32_t value) {
+        if (value == 0 || (value & (value - 1))) return -1;
+        int k = 0;
+        while (value >>= 1) k++;
+        return k;
+    }
+
+    // Cheapest sequence computing the low 16 bits of Xa * c into Xd, empty if none is known
+    std::vector<uint32_t> multiplySequence(uint8_t dst, uint8_t a, uint16_t c) const {
+        std::vector<std::vector<uint32_t>> candidates;
+        if (c == 0) candidates.push_back({aluImmediate("AND", dst, a, 0)});
+        if (c == 1) candidates.push_back({aluImmediate("OR", dst, a, 0)});
+        int k = log2Exact(c);
+        if (k > 0) candidates.push_back({aluImmediate("LSL", dst, a, (uint16_t)k)});
+
+        if (dst != a && c > 1) {
+            int j = 0;
+            uint32_t m = c;
+            while (!(m & 1)) {
+                m >>= 1;
+                j++;
+            }
+            for (int s = 1; s < 16; s++) {
+                std::vector<uint32_t> sequence;
+                if (m == (1u << s) + 1) sequence = {aluImmediate("LSL", dst, a, (uint16_t)s), aluRegister("ADD", dst, dst, a)};
+                else if (m == (1u << s) - 1) sequence = {aluImmediate("LSL", dst, a, (uint16_t)s), aluRegister("SUB", dst, dst, a)};
+                else continue;
+                if (j > 0) sequence.push_back(aluImmediate("LSL", dst, dst, (uint16_t)j));
+                candidates.push_back(sequence);
+            }
+            // Negative constants: Xa - Xa * 2^s
+            uint32_t negated = (uint32_t)(-(int32_t)c) & 0xFFFF;
+            int s = log2Exact(negated + 1);
+            if (s > 0 && s < 16) candidates.push_back({aluImmediate("LSL", dst, a, (uint16_t)s), aluRegister("SUB", dst, a, dst)});
+        }
+
+        std::vector<uint32_t> best;
+        for (const auto& candidate : candidates) {
+            if (best.empty() || cost(candidate) < cost(best) || (cost(candidate) == cost(best) && candidate.size() < best.size())) {
+                best = candidate;
+            }
+        }
+        return best;
+    }
+
+    // One round over the program, true if anything changed
+    bool round(AssemblyResult& program) {
+        std::vector<uint32_t>& code = program.instructions;
+        size_t size = code.size();
+        ProgramEditor editor(program, isaSpec);
+        std::vector<uint8_t> carryLive = editor.flagsLiveAfter();
+        for (uint8_t& flags : carryLive) flags &= Semantics::FLAG_C | Semantics::FLAG_V;
+
+        std::vector<char> join(size + 1, 0);
+        for (const auto& symbol : program.symbols) {
+            if (symbol.address <= size) join[symbol.address] = 1;
+        }
+        for (const auto& address : editor.getCodeAddresses()) {
+            if (address.target >= 0 && (size_t)address.target <= size) join[address.target] = 1;
+        }
+
+        // Pairs folded into one AND, deleting the first
+        std::vector<char> removed(size, 0);
+        for (size_t i = 0; i + 1 < size; i++) {
+            size_t next = i + 1;
+            if (removed[i] || join[next] || carryLive[next] || editor.isPinned(i) || editor.isPinned(next)) continue;
+            Decoded first = decode(code[i]);
+            Decoded second = decode(code[next]);
+            uint32_t replacement;
+            if (is(first, "LSR", true) && is(second, "LSL", true) && first.imm == second.imm && first.imm > 0 && first.imm < 16 &&
+                second.dst == first.dst && second.a == first.dst) {
+                replacement = aluImmediate("AND", first.dst, first.a, (uint16_t)(0xFFFFu << first.imm));
+            } else if (is(first, "AND", true) && is(second, "SUB", false) && first.dst != first.a &&
+                       second.dst == first.dst && second.a == first.a && second.b == first.dst) {
+                replacement = aluImmediate("AND", first.dst, first.a, (uint16_t)~first.imm);
+            } else {
+                continue;
+            }
+            stats.cycles += cost({code[i], code[next]}) - cost({replacement});
+            code[next] = replacement;
+            removed[i] = 1;
+            stats.masks++;
+        }
+        if (size_t count = editor.erase(removed)) {
+            stats.removed += count;
+            return true;
+        }
+
+        // Multiplies, in place or expanded into the instructions before them
+        std::vector<std::vector<uint32_t>> before(size), after(size);
+        size_t total = size;
+        bool changed = false;
+        for (size_t i = 0; i < size; i++) {
+            if (carryLive[i] || editor.isPinned(i)) continue;
+            Decoded d = decode(code[i]);
+            std::vector<uint32_t> sequence;
+            bool divide = false;
+            if (is(d, "UMUL_L", true) || is(d, "MUL_L", true)) {
+                sequence = multiplySequence(d.dst, d.a, d.imm);
+            } else if (is(d, "UMUL_H", true)) {
+                int k = log2Exact(d.imm);
+                if (k == 0 || d.imm == 0) sequence = {aluImmediate("AND", d.dst, d.a, 0)};
+                else if (k > 0) sequence = {aluImmediate("LSR", d.dst, d.a, (uint16_t)(16 - k))};
+                divide = true;
+            }
+            if (sequence.empty() || cost(sequence) >= cost({code[i]})) continue;
+            if (total + sequence.size() - 1 > 256) continue;
+            total += sequence.size() - 1;
+
+            stats.cycles += cost({code[i]}) - cost(sequence);
+            code[i] = sequence.back();
+            before[i].assign(sequence.begin(), sequence.end() - 1);
+            if (divide) stats.divides++;
+            else stats.multiplies++;
+            changed = true;
+        }
+        stats.added += editor.insert(before, after);
+        return changed;
+    }
+
+public:
+    explicit StrengthReducer(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    const Stats& getStats() const { return stats; }
+
+    // Reduce the constant multiplies of an assembled program in place, returns the number of instructions rewritten
+    size_t optimize(AssemblyResult& program) {
+        stats = Stats();
+        while (round(program)) {}
+        return stats.multiplies + stats.divides + stats.masks;
+    }
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <vector>
+#include "IsaSpec.hpp"
+#include "Semantics.hpp"
+#include "RewriteDatabase.hpp"
+#include "ThreadPool.hpp"
+
+// Superoptimizer ("gct superopt"): exhaustive search for the cheapest
+// sequence of up to maxLength instructions that computes the same registers
+// as a short straight-line target sequence.
+//
+// The target's registers are renumbered X0, X1, ... in order of use (the
+// rewrite database form); candidates may use those and scratchRegisters more,
+// whose values afterwards do not matter. Each position of a candidate is one
+// of the ALU ops, MOV or CMP of the ISA spec over those registers, with
+// immediates taken from the target and their neighbours (c +- 1, -c, ~c) plus
+// common masks; shifts by an immediate use 1..15, shifts by a register are
+// left out. Candidates are tried shortest first, depth-first within a
+// length, pruned by cycle cost (InstructionTech::cycles) against the best
+// found so far, and run on a few test states as they grow; a prefix is
+// dropped once more target registers are wrong than instructions remain to
+// write them. One that matches is run on all test states
+// (random and edge-case register values), then on every value of the input
+// register if there is at most one, or on 65536 more random states if not.
+//
+// A candidate keeps N and Z if its last flag-setting instruction comes after
+// any MOV (which may set them too) and gives the target's N and Z on every
+// state; C and V are never compared. The best candidate that keeps N and Z
+// is reported, and the best overall if that one is cheaper still. The search
+// is split by first instruction over a thread pool.
+class Superoptimizer {
+public:
+    struct Stats {
+        size_t candidates = 0;    // Instructions each position is chosen from
+        uint64_t sequences = 0;   // Candidate sequences run
+        uint64_t verified = 0;    // Sequences that passed the first test states and were verified
+    };
+
+private:
+    const IsaSpec::ISA_SPEC& isaSpec;
+    size_t maxLength = 4;
+    int scratchRegisters = 1;
+    size_t threads = 0;
+    Stats stats;
+
+    static constexpr size_t QUICK_STATES = 4;  // States partial sequences run on as they grow
+    static constexpr size_t TEST_STATES = 256;
+    static constexpr unsigned NO_KEY = ~0u;
+
+    struct Candidate {
+        uint32_t raw;
+        Semantics::Operation operation;
+        unsigned cycles;
+    };
+
+    // Best sequence of one kind, ordered by key (cycles, then length) and then encoding
+    struct Best {
+        unsigned key = NO_KEY;
+        std::vector<uint32_t> sequence;
+        bool exhaustive = false;
+
+        void offer(unsigned newKey, const std::vector<uint32_t>& newSequence, bool newExhaustive) {
+            if (newKey > key || (newKey == key && newSequence >= sequence)) return;
+            key = newKey;
+            sequence = newSequence;
+            exhaustive = newExhaustive;
+        }
+    };
+
+    struct Search {
+        std::vector<Semantics::Operation> target;
+        int registers = 0;          // Target registers, compared after the run
+        int inputMask = 0;          // Target registers read before written
+        bool targetSetsNZ = false;
+        std::vector<Candidate> candidates;
+        std::vector<Semantics::State> states, expected;
+        std::atomic<unsigned> limit{0};  // Largest key still worth trying
+        std::atomic<uint64_t> sequences{0}, verified{0};
+        std::mutex mutex;
+        Best any, keepsNZ;
+    };
+
+    static unsigned keyOf(unsigned cycles, size_t length) { return cycles * 64 + (unsigned)length; }
+
+    static void run(const std::vector<Semantics::Operation>& sequence, Semantics::State& state) {
+        for (const Semantics::Operation& operation : sequence) Semantics::execute(operation, state);
+    }
+
+    // Last instruction that may set the flags sets them from its result (no MOV after it)
+    static bool setsNZ(const std::vector<Semantics::Operation>& sequence) {
+        for (size_t i = sequence.size(); i-- > 0;) {
+            if (sequence[i].op == Semantics::Op::MOV) return false;
+            if (sequence[i].setsFlags()) return true;
+        }
+        return false;
+    }
+
+    static bool sameRegisters(const Semantics::State& a, const Semantics::State& b, int registers) {
+        for (int reg = 0; reg < registers; reg++) {
+            if (a.regs[reg] != b.regs[reg]) return false;
+        }
+        return true;
+    }
+
+    static bool sameNZ(const Semantics::State& a, const Semantics::State& b) { return a.n == b.n && a.z == b.z; }
+
+    // Instructions a position can hold, over variables registers
+    std::vector<Candidate> enumerateCandidates(const std::vector<Semantics::Operation>& target, int variables) const {
+        std::vector<uint16_t> constants = {1, 2, 0x00FF, 0xFF00, 0x7FFF, 0x8000, 0xFFFF};
+        for (const Semantics::Operation& operation : target) {
+            if (!operation.immediate || operation.op == Semantics::Op::NOT || operation.op == Semantics::Op::BCDL ||
+                operation.op == Semantics::Op::BCDH) continue;
+            uint16_t c = operation.imm;
+            for (uint16_t value : {c, (uint16_t)(c + 1), (uint16_t)(c - 1), (uint16_t)-c, (uint16_t)~c}) {
+                constants.push_back(value);
+            }
+        }
+        std::sort(constants.begin(), constants.end());
+        constants.erase(std::unique(constants.begin(), constants.end()), constants.end());
+
+        std::vector<Candidate> candidates;
+        auto add = [&](const IsaSpec::InstructionTech& tech, int dst, int a, int b, uint16_t imm) {
+            uint32_t raw = tech.opcode | ((uint32_t)dst << 8) | ((uint32_t)a << 12) |
+                           (tech.flags.IMMEDIATE ? (uint32_t)imm << 16 : (uint32_t)b << 16);
+            candidates.push_back({raw, Semantics::decode(isaSpec, raw), tech.cycles});
+        };
+        for (const auto& tech : isaSpec.instructions_tech) {
+            Semantics::Op op = Semantics::operationOf(tech);
+            bool immediate = tech.flags.IMMEDIATE;
+            bool shift = op == Semantics::Op::LSL || op == Semantics::Op::LSR;
+            bool commutative = op == Semantics::Op::AND || op == Semantics::Op::OR || op == Semantics::Op::XOR ||
+                               op == Semantics::Op::ADD || op == Semantics::Op::UMUL_L || op == Semantics::Op::UMUL_H ||
+                               op == Semantics::Op::MUL_L || op == Semantics::Op::MUL_H;
+            if (op == Semantics::Op::OTHER || op == Semantics::Op::BCDL || op == Semantics::Op::BCDH) continue;
+            if ((shift && !immediate) || (op == Semantics::Op::NOT && immediate)) continue;
+
+            Semantics::Operation form;
+            form.op = op;
+            form.immediate = immediate;
+            int dsts = form.writesDst() ? variables : 1;
+            int as = form.readsA() ? variables : 1;
+            int bs = form.readsB() ? variables : 1;
+            for (int dst = 0; dst < dsts; dst++) {
+                for (int a = 0; a < as; a++) {
+                    if (op == Semantics::Op::MOV && !immediate && a == dst) continue;
+                    if (!immediate) {
+                        for (int b = commutative ? a : 0; b < bs; b++) add(tech, dst, a, b, 0);
+                    } else if (shift) {
+                        for (uint16_t k = 1; k < 16; k++) add(tech, dst, a, 0, k);
+                    } else {
+                        for (uint16_t c : constants) add(tech, dst, a, 0, c);
+                        if (op == Semantics::Op::AND || op == Semantics::Op::MOV || op == Semantics::Op::CMP) add(tech, dst, a, 0, 0);
+                    }
+                }
+            }
+        }
+        return candidates;
+    }
+
+    // Candidate sequence computes the target's registers (and N and Z if keepsNZ) on every state checked
+    bool verify(Search& search, const std::vector<Semantics::Operation>& sequence, bool& keepsNZ, bool& exhaustive) const {
+        for (size_t s = 0; s < search.states.size(); s++) {
+            Semantics::State state = search.states[s];
+            run(sequence, state);
+            if (!sameRegisters(state, search.expected[s], search.registers)) return false;
+            keepsNZ = keepsNZ && sameNZ(state, search.expected[s]);
+        }
+
+        // Every value of the single input register, or more random states
+        int inputs = 0, input = 0;
+        for (int reg = 0; reg < 8; reg++) {
+            if (search.inputMask & (1 << reg)) {
+                inputs++;
+                input = reg;
+            }
+        }
+        exhaustive = inputs <= 1;
+        std::mt19937 random(12345);
+        for (uint32_t value = 0; value < 0x10000; value++) {
+            Semantics::State before;
+            for (uint16_t& reg : before.regs) reg = (uint16_t)random();
+            if (exhaustive) before.regs[input] = (uint16_t)value;
+            Semantics::State want = before, got = before;
+            run(search.target, want);
+            run(sequence, got);
+            if (!sameRegisters(want, got, search.registers)) return false;
+            keepsNZ = keepsNZ && sameNZ(want, got);
+        }
+        return true;
+    }
+
+    // Run chosen (ending in a new instruction) on the quick states, check it once it is length instructions
+    // long, grow it otherwise
+    void extend(Search& search, std::vector<size_t>& chosen, std::vector<Semantics::Operation>& sequence, size_t length,
+                unsigned cycles, const Semantics::State* parent, uint64_t& sequences, uint64_t& verified) const {
+        const Candidate& last = search.candidates[chosen.back()];
+        Semantics::State states[QUICK_STATES];
+        int wrong = 0;  // Target registers that do not hold their result yet
+        for (size_t s = 0; s < QUICK_STATES; s++) {
+            states[s] = parent[s];
+            Semantics::execute(last.operation, states[s]);
+            for (int reg = 0; reg < search.registers; reg++) {
+                if (states[s].regs[reg] != search.expected[s].regs[reg]) wrong |= 1 << reg;
+            }
+        }
+        sequences++;
+
+        unsigned key = keyOf(cycles, chosen.size());
+        if (chosen.size() == length) {
+            if (wrong || key > search.limit.load(std::memory_order_relaxed)) return;
+            verified++;
+            bool keepsNZ = search.targetSetsNZ && setsNZ(sequence), exhaustive = false;
+            if (!verify(search, sequence, keepsNZ, exhaustive)) return;
+            std::vector<uint32_t> raws;
+            for (size_t c : chosen) raws.push_back(search.candidates[c].raw);
+            std::lock_guard<std::mutex> lock(search.mutex);
+            search.any.offer(key, raws, exhaustive);
+            if (keepsNZ) search.keepsNZ.offer(key, raws, exhaustive);
+            if (keepsNZ || !search.targetSetsNZ) {
+                unsigned limit = search.limit.load();
+                while (key < limit && !search.limit.compare_exchange_weak(limit, key)) {}
+            }
+            return;
+        }
+
+        // Each remaining instruction writes one register, so at most that many may still be wrong
+        size_t remaining = length - chosen.size();
+        int wrongCount = 0;
+        for (int reg = 0; reg < search.registers; reg++) wrongCount += (wrong >> reg) & 1;
+        if ((size_t)wrongCount > remaining) return;
+
+        for (size_t c = 0; c < search.candidates.size(); c++) {
+            const Candidate& next = search.candidates[c];
+            const Semantics::Operation& operation = next.operation;
+            if (keyOf(cycles + next.cycles, chosen.size() + 1) > search.limit.load(std::memory_order_relaxed)) continue;
+            // The last instruction has to write the one wrong register, or only set flags if none is wrong
+            if (remaining == 1 && (wrongCount == 1 ? !operation.writesDst() || !(wrong & (1 << operation.dst))
+                                                   : operation.writesDst() && operation.dst < search.registers)) continue;
+            // Skip writes the next instruction overwrites unread, and compares whose flags it replaces
+            if (last.operation.writesDst() && operation.writesDst() && operation.dst == last.operation.dst &&
+                !(operation.readsA() && operation.a == last.operation.dst) &&
+                !(operation.readsB() && operation.b == last.operation.dst)) continue;
+            if (last.operation.op == Semantics::Op::CMP && operation.setsFlags()) continue;
+
+            chosen.push_back(c);
+            sequence.push_back(operation);
+            extend(search, chosen, sequence, length, cycles + next.cycles, states, sequences, verified);
+            chosen.pop_back();
+            sequence.pop_back();
+        }
+    }
+
+public:
+    explicit Superoptimizer(const IsaSpec::ISA_SPEC& spec = IsaSpec::sharedISASpec()) : isaSpec(spec) {}
+
+    void setMaxLength(size_t length) { maxLength = length; }
+    void setScratchRegisters(int count) { scratchRegisters = count; }
+    void setThreads(size_t count) { threads = count; }
+    const Stats& getStats() const { return stats; }
+
+    // Search cheaper equivalents of target, found receives the rewrites (pattern = target with registers
+    // renumbered); false with a message on log if target is not straight-line register code
+    bool search(const std::vector<uint32_t>& target, std::vector<RewriteDatabase::Rewrite>& found, std::ostream& log) {
+        stats = Stats();
+        found.clear();
+        if (target.empty()) {
+            log << "Error: Empty sequence\n";
+            return false;
+        }
+        for (uint32_t raw : target) {
+            if (Semantics::decode(isaSpec, raw).op == Semantics::Op::OTHER) {
+                log << "Error: '" << disassemble(raw, isaSpec) << "' is not an ALU op, MOV or CMP\n";
+                return false;
+            }
+        }
+
+        Search search;
+        int variables[8];
+        std::vector<uint32_t> pattern = RewriteDatabase::canonicalize(isaSpec, target, variables, search.registers);
+        int written = 0;
+        for (uint32_t raw : pattern) {
+            Semantics::Operation operation = Semantics::decode(isaSpec, raw);
+            if (operation.readsA() && !(written & (1 << operation.a))) search.inputMask |= 1 << operation.a;
+            if (operation.readsB() && !(written & (1 << operation.b))) search.inputMask |= 1 << operation.b;
+            if (operation.writesDst()) written |= 1 << operation.dst;
+            search.target.push_back(operation);
+        }
+        search.targetSetsNZ = setsNZ(search.target);
+        search.candidates = enumerateCandidates(search.target, std::min(8, search.registers + scratchRegisters));
+        stats.candidates = search.candidates.size();
+        search.limit = keyOf(RewriteDatabase::cycles(isaSpec, pattern), pattern.size()) - 1;
+
+        // Test states: edge values in each input register, then random ones; all registers random otherwise
+        static const uint16_t edges[] = {0, 1, 2, 3, 0x7FFF, 0x8000, 0x8001, 0xFFFE, 0xFFFF, 0x00FF, 0xFF00, 0x5555, 0xAAAA};
+        std::mt19937 random(1);
+        for (size_t s = 0; s < TEST_STATES; s++) {
+            Semantics::State state;
+            for (uint16_t& reg : state.regs) reg = (uint16_t)random();
+            for (int reg = 0; reg < 8; reg++) {
+                if ((search.inputMask & (1 << reg)) && random() % 2) state.regs[reg] = edges[random() % (sizeof(edges) / sizeof(edges[0]))];
+            }
+            search.states.push_back(state);
+            run(search.target, state);
+            search.expected.push_back(state);
+        }
+
+        // Shortest first, so the cheapest short replacement bounds the longer searches
+        for (size_t length = 1; length <= maxLength && keyOf((unsigned)length, length) <= search.limit; length++) {
+            ThreadPool pool(threads);
+            for (size_t first = 0; first < search.candidates.size(); first++) {
+                if (keyOf(search.candidates[first].cycles, 1) > search.limit) continue;
+                pool.submit([this, &search, first, length] {
+                    std::vector<size_t> chosen = {first};
+                    std::vector<Semantics::Operation> sequence = {search.candidates[first].operation};
+                    uint64_t sequences = 0, verified = 0;
+                    extend(search, chosen, sequence, length, search.candidates[first].cycles, search.states.data(),
+                           sequences, verified);
+                    search.sequences += sequences;
+                    search.verified += verified;
+                });
+            }
+            pool.wait();
+        }
+        stats.sequences = search.sequences;
+        stats.verified = search.verified;
+
+        auto report = [&](const Best& best, RewriteDatabase::FlagsKept flags) {
+            RewriteDatabase::Rewrite rewrite;
+            rewrite.pattern = pattern;
+            rewrite.replacement = best.sequence;
+            rewrite.flags = flags;
+            rewrite.exhaustive = best.exhaustive;
+            found.push_back(rewrite);
+        };
+        if (search.keepsNZ.key != NO_KEY) report(search.keepsNZ, RewriteDatabase::FLAGS_NZ);
+        if (search.any.key < search.keepsNZ.key) report(search.any, RewriteDatabase::FLAGS_NONE);
+        return true;
+    }
+};
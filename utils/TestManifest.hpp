@@ -0,0 +1,215 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Emulator.hpp"
+
+// Regression tests for emulated programs ("gct test"): which program to run
+// from which state, and what it must leave behind.
+//
+//   GCT-TESTS 1
+//   test <name> <program>     a source or ROM base, relative to the manifest
+//     steps <N>               step limit (default: gct test --steps)
+//     reg Xn=V                initial register
+//     mem A=V                 initial RAM word
+//     expect <status>         how the run ends: exited (the default), limit, off-rom, invalid
+//     expect Xn=V             register afterwards
+//     expect mem A=V          RAM word afterwards
+//     expect screen "<text>"  screen afterwards, as gct run prints it
+//     expect steps <N>        instructions executed, EXIT included
+//
+// Lines after a test line belong to it; indentation is optional. Numbers
+// are decimal or 0x hex, values may be negative (16-bit two's complement).
+// Text after '#' is ignored, except inside the quotes of a screen.
+struct TestManifest {
+    struct Test {
+        std::string name;
+        std::string program;
+        size_t line = 0;
+        uint64_t maxSteps = 0;  // 0: the runner's default
+        std::vector<std::pair<int, uint16_t>> registers;
+        std::vector<std::pair<int, uint16_t>> memory;
+        Emulator::Status status = Emulator::STATUS_EXITED;
+        std::vector<std::pair<int, uint16_t>> expectRegisters;
+        std::vector<std::pair<int, uint16_t>> expectMemory;
+        bool checkScreen = false;
+        std::string screen;
+        bool checkSteps = false;
+        uint64_t steps = 0;
+    };
+    std::vector<Test> tests;
+
+    static constexpr int FORMAT_VERSION = 1;
+
+    static const char* statusName(Emulator::Status status) {
+        switch (status) {
+            case Emulator::STATUS_EXITED: return "exited";
+            case Emulator::STATUS_STEP_LIMIT: return "limit";
+            case Emulator::STATUS_OFF_ROM: return "off-rom";
+            case Emulator::STATUS_INVALID: return "invalid";
+            default: return "running";
+        }
+    }
+
+    static bool parseNumber(const std::string& word, long low, long high, long& value) {
+        char* end = nullptr;
+        bool negative = !word.empty() && word[0] == '-';
+        std::string digits = negative ? word.substr(1) : word;
+        bool hex = digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X');
+        value = (long)std::strtoul(digits.c_str(), &end, hex ? 16 : 10);
+        if (negative) value = -value;
+        return !digits.empty() && digits[0] != '-' && *end == '\0' && value >= low && value <= high;
+    }
+
+    // "Xn=V" or "A=V"
+    static bool parseAssignment(const std::string& text, bool isRegister, int& target, uint16_t& value) {
+        size_t equals = text.find('=');
+        if (equals == std::string::npos) return false;
+        std::string left = text.substr(0, equals);
+        long number = 0, result = 0;
+        if (isRegister) {
+            if (left.size() != 2 || (left[0] != 'X' && left[0] != 'x') || !parseNumber(left.substr(1), 0, 7, number)) return false;
+        } else if (!parseNumber(left, 0, 255, number)) {
+            return false;
+        }
+        if (!parseNumber(text.substr(equals + 1), -32768, 0xFFFF, result)) return false;
+        target = (int)number;
+        value = (uint16_t)result;
+        return true;
+    }
+
+    bool readFromFile(const std::string& path, std::ostream& log = std::cerr) {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            log << "Error: Cannot open test manifest '" << path << "'\n";
+            return false;
+        }
+        std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+        std::string line;
+        size_t lineNumber = 1;
+        bool ok = std::getline(in, line) && line.rfind("GCT-TESTS " + std::to_string(FORMAT_VERSION), 0) == 0;
+        size_t firstTest = tests.size();
+        while (ok && std::getline(in, line)) {
+            lineNumber++;
+            // A screen keeps its quoted text, '#' included
+            std::string quoted;
+            size_t open = line.find('"'), close = line.rfind('"');
+            if (open != std::string::npos && close > open && line.find('#') > open) {
+                quoted = line.substr(open + 1, close - open - 1);
+                line = line.substr(0, open) + "\"\"" + line.substr(close + 1);
+            }
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string keyword, first, second, extra;
+            if (!(fields >> keyword)) continue;
+            fields >> first >> second;
+            if (fields >> extra) {
+                ok = false;
+                break;
+            }
+
+            if (keyword == "test") {
+                ok = !first.empty() && !second.empty();
+                if (!ok) break;
+                Test test;
+                test.name = first;
+                test.program = (directory / second).lexically_normal().string();
+                test.line = lineNumber;
+                tests.push_back(test);
+                continue;
+            }
+            ok = tests.size() > firstTest;
+            if (!ok) break;
+            Test& test = tests.back();
+            int target = 0;
+            uint16_t value = 0;
+            long number = 0;
+            if (keyword == "steps") {
+                ok = second.empty() && parseNumber(first, 1, LONG_MAX, number);
+                test.maxSteps = (uint64_t)number;
+            } else if (keyword == "reg") {
+                ok = second.empty() && parseAssignment(first, true, target, value);
+                test.registers.push_back({target, value});
+            } else if (keyword == "mem") {
+                ok = second.empty() && parseAssignment(first, false, target, value);
+                test.memory.push_back({target, value});
+            } else if (keyword != "expect") {
+                ok = false;
+            } else if (first == "mem") {
+                ok = parseAssignment(second, false, target, value);
+                test.expectMemory.push_back({target, value});
+            } else if (first == "screen") {
+                ok = second == "\"\"";
+                test.checkScreen = true;
+                test.screen = quoted;
+            } else if (first == "steps") {
+                ok = parseNumber(second, 0, LONG_MAX, number);
+                test.checkSteps = true;
+                test.steps = (uint64_t)number;
+            } else if (!second.empty()) {
+                ok = false;
+            } else if (parseAssignment(first, true, target, value)) {
+                test.expectRegisters.push_back({target, value});
+            } else {
+                ok = false;
+                for (Emulator::Status status : {Emulator::STATUS_EXITED, Emulator::STATUS_STEP_LIMIT, Emulator::STATUS_OFF_ROM,
+                                                 Emulator::STATUS_INVALID}) {
+                    if (first == statusName(status)) {
+                        test.status = status;
+                        ok = true;
+                    }
+                }
+            }
+        }
+
+        if (!ok) log << "Error: Malformed test manifest '" << path << "' at line " << lineNumber << "\n";
+        return ok;
+    }
+
+    // The machine a test starts from
+    static void prepare(const Test& test, Emulator::Machine& machine) {
+        machine = Emulator::Machine();
+        for (const auto& [reg, value] : test.registers) machine.cpu.regs[reg] = value;
+        for (const auto& [address, value] : test.memory) machine.memory[address] = value;
+    }
+
+    // What a finished run got wrong, one line per expectation; empty if it passed
+    static std::string check(const Test& test, Emulator::Status status, const Emulator::Machine& machine,
+                             const Emulator::Stats& stats) {
+        std::ostringstream failures;
+        auto hex = [](uint16_t value) {
+            char text[8];
+            std::snprintf(text, sizeof(text), "%04X", (unsigned)value);
+            return std::string(text);
+        };
+        if (status != test.status) {
+            failures << "expected " << statusName(test.status) << ", got " << statusName(status) << " at " << machine.pc << "\n";
+        }
+        for (const auto& [reg, value] : test.expectRegisters) {
+            if (machine.cpu.regs[reg] != value) {
+                failures << "expected X" << reg << "=" << hex(value) << ", got " << hex(machine.cpu.regs[reg]) << "\n";
+            }
+        }
+        for (const auto& [address, value] : test.expectMemory) {
+            if (machine.memory[address] != value) {
+                failures << "expected mem " << address << "=" << hex(value) << ", got " << hex(machine.memory[address]) << "\n";
+            }
+        }
+        std::string screen = test.checkScreen ? Emulator::screenText(machine) : "";
+        if (screen != test.screen) failures << "expected screen \"" << test.screen << "\", got \"" << screen << "\"\n";
+        if (test.checkSteps && stats.steps != test.steps) {
+            failures << "expected " << test.steps << " steps, got " << stats.steps << "\n";
+        }
+        return failures.str();
+    }
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Work-stealing loop over independent items ("gct test"): run(count, body)
+// calls body(index, worker) once for every index below count, on a fixed
+// number of workers (the calling thread is worker 0).
+//
+// Every worker starts with an equal contiguous share of the indices and
+// takes them from the front, so neighbouring items (tests of the same
+// program) stay on one core. A worker whose share runs out steals the back
+// half of another worker's share, starting its search at a random victim.
+// A share is a [begin, end) pair packed into one atomic word, so taking and
+// stealing are a compare-and-swap each, with no lock; shares sit on cache
+// lines of their own. Indices are 32-bit.
+class WorkStealing {
+private:
+    struct alignas(64) Share {
+        std::atomic<uint64_t> range{0};  // begin << 32 | end
+    };
+
+    static uint64_t pack(uint32_t begin, uint32_t end) { return (uint64_t)begin << 32 | end; }
+    static uint32_t beginOf(uint64_t range) { return (uint32_t)(range >> 32); }
+    static uint32_t endOf(uint64_t range) { return (uint32_t)range; }
+
+    std::unique_ptr<Share[]> shares;
+    size_t workers;
+    std::atomic<uint64_t> steals{0};
+
+    // Take the front index of a share, false if it is empty
+    static bool takeFront(Share& share, uint32_t& index) {
+        uint64_t range = share.range.load(std::memory_order_acquire);
+        while (beginOf(range) < endOf(range)) {
+            if (share.range.compare_exchange_weak(range, pack(beginOf(range) + 1, endOf(range)), std::memory_order_acq_rel)) {
+                index = beginOf(range);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Move the back half of another worker's share (at least one index) into thief's empty share
+    bool steal(size_t thief, uint64_t& seed) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        size_t first = (size_t)(seed >> 33) % workers;
+        for (size_t offset = 0; offset < workers; offset++) {
+            size_t victim = (first + offset) % workers;
+            if (victim == thief) continue;
+            uint64_t range = shares[victim].range.load(std::memory_order_acquire);
+            while (beginOf(range) < endOf(range)) {
+                uint32_t middle = beginOf(range) + (endOf(range) - beginOf(range)) / 2;
+                if (shares[victim].range.compare_exchange_weak(range, pack(beginOf(range), middle), std::memory_order_acq_rel)) {
+                    shares[thief].range.store(pack(middle, endOf(range)), std::memory_order_release);
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    template <typename Body>
+    void work(size_t worker, Body& body) {
+        uint64_t seed = worker + 1;
+        uint32_t index = 0;
+        for (;;) {
+            while (takeFront(shares[worker], index)) body((size_t)index, worker);
+            // Nothing left to steal: the rest is being run (or about to be, by a thief) elsewhere
+            if (!steal(worker, seed)) return;
+        }
+    }
+
+public:
+    // threadCount 0 = one worker per hardware thread
+    explicit WorkStealing(size_t threadCount = 0) : workers(threadCount) {
+        if (workers == 0) workers = std::thread::hardware_concurrency();
+        if (workers == 0) workers = 1;
+        shares.reset(new Share[workers]);
+    }
+
+    size_t size() const { return workers; }
+    uint64_t getSteals() const { return steals.load(); }
+
+    template <typename Body>
+    void run(size_t count, Body body) {
+        count = std::min<size_t>(count, UINT32_MAX);
+        for (size_t worker = 0; worker < workers; worker++) {
+            shares[worker].range.store(pack((uint32_t)(count * worker / workers), (uint32_t)(count * (worker + 1) / workers)));
+        }
+        std::vector<std::thread> threads;
+        for (size_t worker = 1; worker < workers; worker++) {
+            threads.emplace_back([this, worker, &body] { work(worker, body); });
+        }
+        work(0, body);
+        for (auto& thread : threads) thread.join();
+    }
+};
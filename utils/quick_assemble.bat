@@ -22,11 +22,5 @@ if %ERRORLEVEL% NEQ 0 (
 echo Compilation successful!
 echo.
 
-REM Run with automated input
-(
-echo 1
-echo script.s
-echo.
-echo.
-echo 0
-) | gct.exe
+REM Assemble script.s headlessly and update the Digital Logic Sim project
+gct.exe asm --sim -o "" script.s